@@ -5,6 +5,7 @@
 
 
 #include "ngx_http_vhost_traffic_status_module.h"
+#include "ngx_http_vhost_traffic_status_shm.h"
 #include "ngx_http_vhost_traffic_status_control.h"
 #include "ngx_http_vhost_traffic_status_display_json.h"
 #include "ngx_http_vhost_traffic_status_display.h"
@@ -441,13 +442,14 @@ ngx_http_vhost_traffic_status_node_delete_all(
 
     while (node != sentinel) {
 
-        ngx_rbtree_delete(ctx->rbtree, node);
-        ngx_slab_free_locked(shpool, node);
+        ngx_http_vhost_traffic_status_shm_free_node(ctx, shpool, node);
 
         control->count++;
 
         node = ctx->rbtree->root;
     }
+
+    ngx_http_vhost_traffic_status_shm_reclaim(ctx, shpool);
 }
 
 
@@ -492,11 +494,12 @@ ngx_http_vhost_traffic_status_node_delete_group(
     for (i = 0; i < n; i++) {
         node = deletes[i].node;
 
-        ngx_rbtree_delete(ctx->rbtree, node);
-        ngx_slab_free_locked(shpool, node);
+        ngx_http_vhost_traffic_status_shm_free_node(ctx, shpool, node);
 
         control->count++;
     }
+
+    ngx_http_vhost_traffic_status_shm_reclaim(ctx, shpool);
 }
 
 
@@ -528,8 +531,8 @@ ngx_http_vhost_traffic_status_node_delete_zone(
     node = ngx_http_vhost_traffic_status_node_lookup(ctx->rbtree, &key, hash);
 
     if (node != NULL) {
-        ngx_rbtree_delete(ctx->rbtree, node);
-        ngx_slab_free_locked(shpool, node);
+        ngx_http_vhost_traffic_status_shm_free_node(ctx, shpool, node);
+        ngx_http_vhost_traffic_status_shm_reclaim(ctx, shpool);
 
         control->count++;
     }
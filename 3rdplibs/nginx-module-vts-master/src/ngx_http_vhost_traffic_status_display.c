@@ -71,9 +71,12 @@ ngx_http_vhost_traffic_status_display_handler_control(ngx_http_request_t *r)
     ngx_buf_t                                 *b;
     ngx_chain_t                                out;
     ngx_slab_pool_t                           *shpool;
+    ngx_http_vhost_traffic_status_ctx_t       *ctx;
     ngx_http_vhost_traffic_status_control_t   *control;
     ngx_http_vhost_traffic_status_loc_conf_t  *vtscf;
 
+    ctx = ngx_http_get_module_main_conf(r, ngx_http_vhost_traffic_status_module);
+
     vtscf = ngx_http_get_module_loc_conf(r, ngx_http_vhost_traffic_status_module);
 
     /* init control */
@@ -226,6 +229,8 @@ ngx_http_vhost_traffic_status_display_handler_control(ngx_http_request_t *r)
 
     ngx_shmtx_lock(&shpool->mutex);
 
+    ngx_http_vhost_traffic_status_shm_fold(ctx);
+
     switch (control->command) {
 
     case NGX_HTTP_VHOST_TRAFFIC_STATUS_CONTROL_CMD_STATUS:
@@ -402,6 +407,7 @@ ngx_http_vhost_traffic_status_display_handler_default(ngx_http_request_t *r)
     if (format == NGX_HTTP_VHOST_TRAFFIC_STATUS_FORMAT_JSON) {
         shpool = (ngx_slab_pool_t *) vtscf->shm_zone->shm.addr;
         ngx_shmtx_lock(&shpool->mutex);
+        ngx_http_vhost_traffic_status_shm_fold(ctx);
         b->last = ngx_http_vhost_traffic_status_display_set(r, b->last);
         ngx_shmtx_unlock(&shpool->mutex);
 
@@ -412,6 +418,7 @@ ngx_http_vhost_traffic_status_display_handler_default(ngx_http_request_t *r)
     } else if (format == NGX_HTTP_VHOST_TRAFFIC_STATUS_FORMAT_JSONP) {
         shpool = (ngx_slab_pool_t *) vtscf->shm_zone->shm.addr;
         ngx_shmtx_lock(&shpool->mutex);
+        ngx_http_vhost_traffic_status_shm_fold(ctx);
         b->last = ngx_sprintf(b->last, "%V", &vtscf->jsonp);
         b->last = ngx_sprintf(b->last, "(");
         b->last = ngx_http_vhost_traffic_status_display_set(r, b->last);
@@ -421,6 +428,7 @@ ngx_http_vhost_traffic_status_display_handler_default(ngx_http_request_t *r)
     } else if (format == NGX_HTTP_VHOST_TRAFFIC_STATUS_FORMAT_PROMETHEUS) {
         shpool = (ngx_slab_pool_t *) vtscf->shm_zone->shm.addr;
         ngx_shmtx_lock(&shpool->mutex);
+        ngx_http_vhost_traffic_status_shm_fold(ctx);
         b->last = ngx_http_vhost_traffic_status_display_prometheus_set(r, b->last);
         ngx_shmtx_unlock(&shpool->mutex);
 
@@ -523,7 +531,9 @@ ngx_int_t
 ngx_http_vhost_traffic_status_display_get_size(ngx_http_request_t *r,
     ngx_int_t format)
 {
-    ngx_uint_t                                 size, un;
+    ngx_uint_t                                 i, size, un, zs;
+    ngx_shm_zone_t                            *shm_zone;
+    ngx_list_part_t                           *part;
     ngx_http_vhost_traffic_status_shm_info_t  *shm_info;
 
     shm_info = ngx_pcalloc(r->pool, sizeof(ngx_http_vhost_traffic_status_shm_info_t));
@@ -537,17 +547,40 @@ ngx_http_vhost_traffic_status_display_get_size(ngx_http_request_t *r,
     un = shm_info->used_node
          + (ngx_uint_t) ngx_http_vhost_traffic_status_display_get_upstream_nelts(r);
 
+    /* shared zones slab reports */
+    zs = 0;
+    part = (ngx_list_part_t *) &ngx_cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        zs += NGX_HTTP_VHOST_TRAFFIC_STATUS_SLAB_SIZE + shm_zone[i].shm.name.len;
+    }
+
     size = 0;
 
     switch (format) {
 
     case NGX_HTTP_VHOST_TRAFFIC_STATUS_FORMAT_JSON:
     case NGX_HTTP_VHOST_TRAFFIC_STATUS_FORMAT_JSONP:
+        size = zs;
+        /* fall through */
+
     case NGX_HTTP_VHOST_TRAFFIC_STATUS_FORMAT_PROMETHEUS:
-        size = sizeof(ngx_http_vhost_traffic_status_node_t) / NGX_PTR_SIZE
-               * NGX_ATOMIC_T_LEN * un  /* values size */
-               + (un * 1024)            /* names  size */
-               + 4096;                  /* main   size */
+        size += sizeof(ngx_http_vhost_traffic_status_node_t) / NGX_PTR_SIZE
+                * NGX_ATOMIC_T_LEN * un  /* values size */
+                + (un * 1024)            /* names  size */
+                + 4096;                  /* main   size */
         break;
 
     case NGX_HTTP_VHOST_TRAFFIC_STATUS_FORMAT_HTML:
@@ -155,6 +155,86 @@ ngx_http_vhost_traffic_status_display_set_main(ngx_http_request_t *r,
     return buf;
 }
 
+/*
+ * Slab allocator report of every shared memory zone (limit_req, VTS, cache
+ * keys...): pages left and per size class (slot) usage and allocation
+ * failures, for sizing the zones against the number of keys they hold.
+ * The caller holds the lock of the VTS zone.
+ */
+u_char *
+ngx_http_vhost_traffic_status_display_set_slab(ngx_http_request_t *r,
+    u_char *buf)
+{
+    ngx_uint_t        i, j, n, pages, pfree;
+    ngx_slab_stat_t   stats[NGX_HTTP_VHOST_TRAFFIC_STATUS_SLAB_SLOTS_MAX];
+    ngx_shm_zone_t   *shm_zone;
+    ngx_slab_pool_t  *shpool, *vts_shpool;
+    ngx_list_part_t  *part;
+
+    ngx_http_vhost_traffic_status_loc_conf_t  *vtscf;
+
+    vtscf = ngx_http_get_module_loc_conf(r, ngx_http_vhost_traffic_status_module);
+    vts_shpool = (ngx_slab_pool_t *) vtscf->shm_zone->shm.addr;
+
+    part = (ngx_list_part_t *) &ngx_cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        if (shm_zone[i].shm.addr == NULL) {
+            continue;
+        }
+
+        shpool = (ngx_slab_pool_t *) shm_zone[i].shm.addr;
+
+        n = ngx_min(ngx_pagesize_shift - shpool->min_shift,
+                    NGX_HTTP_VHOST_TRAFFIC_STATUS_SLAB_SLOTS_MAX);
+
+        /* take a snapshot, do not format under the lock */
+        if (shpool != vts_shpool) {
+            ngx_shmtx_lock(&shpool->mutex);
+        }
+
+        pages = shpool->last - shpool->pages;
+        pfree = shpool->pfree;
+        ngx_memcpy(stats, shpool->stats, n * sizeof(ngx_slab_stat_t));
+
+        if (shpool != vts_shpool) {
+            ngx_shmtx_unlock(&shpool->mutex);
+        }
+
+        buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_SLAB,
+                          &shm_zone[i].shm.name, shm_zone[i].shm.size,
+                          ngx_pagesize, pages, pfree);
+
+        for (j = 0; j < n; j++) {
+            buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_SLAB_SLOT,
+                              (ngx_uint_t) 1 << (j + shpool->min_shift),
+                              stats[j].total, stats[j].used,
+                              stats[j].reqs, stats[j].fails);
+        }
+
+        if (n) {
+            buf--;
+        }
+
+        buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_SLAB_E);
+    }
+
+    return buf;
+}
+
+
 u_char *
 ngx_http_vhost_traffic_status_display_set_server_node(
     ngx_http_request_t *r,
@@ -177,6 +257,8 @@ ngx_http_vhost_traffic_status_display_set_server_node(
                       "display_set_server_node::escape_json_pool() failed");
     }
 
+    ngx_http_vhost_traffic_status_node_lock(vtsn);
+
 #if (NGX_HTTP_CACHE)
     buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_SERVER,
                       &dst, vtsn->stat_request_counter,
@@ -259,6 +341,8 @@ ngx_http_vhost_traffic_status_display_set_server_node(
                       vtsn->stat_request_time_counter_oc);
 #endif
 
+    ngx_http_vhost_traffic_status_node_unlock(vtsn);
+
     return buf;
 }
 
@@ -297,9 +381,11 @@ ngx_http_vhost_traffic_status_display_set_server(ngx_http_request_t *r,
             vtscf->stats.stat_4xx_counter += vtsn->stat_4xx_counter;
             vtscf->stats.stat_5xx_counter += vtsn->stat_5xx_counter;
             vtscf->stats.stat_request_time_counter += vtsn->stat_request_time_counter;
+            ngx_http_vhost_traffic_status_node_lock(vtsn);
             ngx_http_vhost_traffic_status_node_time_queue_merge(
                 &vtscf->stats.stat_request_times,
                 &vtsn->stat_request_times, vtscf->average_period);
+            ngx_http_vhost_traffic_status_node_unlock(vtsn);
 
             vtscf->stats.stat_request_counter_oc += vtsn->stat_request_counter_oc;
             vtscf->stats.stat_in_bytes_oc += vtsn->stat_in_bytes_oc;
@@ -478,6 +564,8 @@ ngx_http_vhost_traffic_status_display_set_upstream_node(ngx_http_request_t *r,
     }
 
     if (vtsn != NULL) {
+        ngx_http_vhost_traffic_status_node_lock(vtsn);
+
         buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_UPSTREAM,
                 &key, vtsn->stat_request_counter,
                 vtsn->stat_in_bytes, vtsn->stat_out_bytes,
@@ -519,6 +607,8 @@ ngx_http_vhost_traffic_status_display_set_upstream_node(ngx_http_request_t *r,
                 vtsn->stat_4xx_counter_oc, vtsn->stat_5xx_counter_oc,
                 vtsn->stat_request_time_counter_oc, vtsn->stat_response_time_counter_oc);
 
+        ngx_http_vhost_traffic_status_node_unlock(vtsn);
+
     } else {
         buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_UPSTREAM,
                 &key, (ngx_atomic_uint_t) 0,
@@ -913,6 +1003,24 @@ ngx_http_vhost_traffic_status_display_set(ngx_http_request_t *r,
 
     buf = ngx_http_vhost_traffic_status_display_set_main(r, buf);
 
+    /* slabZones */
+    o = buf;
+
+    buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_SLAB_S);
+
+    s = buf;
+
+    buf = ngx_http_vhost_traffic_status_display_set_slab(r, buf);
+
+    if (s == buf) {
+        buf = o;
+
+    } else {
+        buf--;
+        buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_E);
+        buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_NEXT);
+    }
+
     /* serverZones */
     buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_SERVER_S);
 
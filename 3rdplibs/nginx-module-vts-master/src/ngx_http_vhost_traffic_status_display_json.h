@@ -38,6 +38,33 @@
     "\"usedNode\":%ui"                                                         \
     "},"
 
+/* slab size classes reported per zone (ngx_pagesize_shift - min_shift) */
+#define NGX_HTTP_VHOST_TRAFFIC_STATUS_SLAB_SLOTS_MAX       32
+
+/* output size of a zone slab report, name excluded */
+#define NGX_HTTP_VHOST_TRAFFIC_STATUS_SLAB_SIZE                                \
+    (256 + NGX_HTTP_VHOST_TRAFFIC_STATUS_SLAB_SLOTS_MAX                        \
+           * (64 + 4 * NGX_ATOMIC_T_LEN))
+
+#define NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_SLAB_S "\"slabZones\":{"
+
+#define NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_SLAB "\"%V\":{"                 \
+    "\"size\":%uz,"                                                            \
+    "\"pageSize\":%ui,"                                                        \
+    "\"pages\":%ui,"                                                           \
+    "\"freePages\":%ui,"                                                       \
+    "\"slots\":["
+
+#define NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_SLAB_SLOT "{"                   \
+    "\"size\":%ui,"                                                            \
+    "\"total\":%ui,"                                                           \
+    "\"used\":%ui,"                                                            \
+    "\"reqs\":%ui,"                                                            \
+    "\"fails\":%ui"                                                            \
+    "},"
+
+#define NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_SLAB_E "]},"
+
 #define NGX_HTTP_VHOST_TRAFFIC_STATUS_JSON_FMT_SERVER_S "\"serverZones\":{"
 
 #if (NGX_HTTP_CACHE)
@@ -218,6 +245,8 @@
 
 u_char *ngx_http_vhost_traffic_status_display_set_main(
     ngx_http_request_t *r, u_char *buf);
+u_char *ngx_http_vhost_traffic_status_display_set_slab(
+    ngx_http_request_t *r, u_char *buf);
 u_char *ngx_http_vhost_traffic_status_display_set_server_node(
     ngx_http_request_t *r,
     u_char *buf, ngx_str_t *key,
@@ -62,6 +62,8 @@ ngx_http_vhost_traffic_status_display_prometheus_set_server_node(
 
     (void) ngx_http_vhost_traffic_status_node_position_key(&server, 1);
 
+    ngx_http_vhost_traffic_status_node_lock(vtsn);
+
     buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_PROMETHEUS_FMT_SERVER,
                       &server, vtsn->stat_in_bytes,
                       &server, vtsn->stat_out_bytes,
@@ -75,6 +77,8 @@ ngx_http_vhost_traffic_status_display_prometheus_set_server_node(
                                    &vtsn->stat_request_times, vtscf->average_method,
                                    vtscf->average_period) / 1000);
 
+    ngx_http_vhost_traffic_status_node_unlock(vtsn);
+
     /* histogram */
     b = &vtsn->stat_request_buckets;
 
@@ -153,9 +157,11 @@ ngx_http_vhost_traffic_status_display_prometheus_set_server(ngx_http_request_t *
             vtscf->stats.stat_4xx_counter += vtsn->stat_4xx_counter;
             vtscf->stats.stat_5xx_counter += vtsn->stat_5xx_counter;
             vtscf->stats.stat_request_time_counter += vtsn->stat_request_time_counter;
+            ngx_http_vhost_traffic_status_node_lock(vtsn);
             ngx_http_vhost_traffic_status_node_time_queue_merge(
                 &vtscf->stats.stat_request_times,
                 &vtsn->stat_request_times, vtscf->average_period);
+            ngx_http_vhost_traffic_status_node_unlock(vtsn);
 
 #if (NGX_HTTP_CACHE)
             vtscf->stats.stat_cache_miss_counter +=
@@ -203,6 +209,8 @@ ngx_http_vhost_traffic_status_display_prometheus_set_filter_node(
     (void) ngx_http_vhost_traffic_status_node_position_key(&filter, 1);
     (void) ngx_http_vhost_traffic_status_node_position_key(&filter_name, 2);
 
+    ngx_http_vhost_traffic_status_node_lock(vtsn);
+
     buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_PROMETHEUS_FMT_FILTER,
                       &filter, &filter_name, vtsn->stat_in_bytes,
                       &filter, &filter_name, vtsn->stat_out_bytes,
@@ -217,6 +225,8 @@ ngx_http_vhost_traffic_status_display_prometheus_set_filter_node(
                           &vtsn->stat_request_times, vtscf->average_method,
                           vtscf->average_period) / 1000);
 
+    ngx_http_vhost_traffic_status_node_unlock(vtsn);
+
     /* histogram */
     b = &vtsn->stat_request_buckets;
 
@@ -317,6 +327,8 @@ ngx_http_vhost_traffic_status_display_prometheus_set_upstream_node(
         (void) ngx_http_vhost_traffic_status_node_position_key(&upstream_server, 1);
     }
 
+    ngx_http_vhost_traffic_status_node_lock(vtsn);
+
     buf = ngx_sprintf(buf, NGX_HTTP_VHOST_TRAFFIC_STATUS_PROMETHEUS_FMT_UPSTREAM,
                       &upstream, &upstream_server, vtsn->stat_in_bytes,
                       &upstream, &upstream_server, vtsn->stat_out_bytes,
@@ -336,6 +348,8 @@ ngx_http_vhost_traffic_status_display_prometheus_set_upstream_node(
                           &vtsn->stat_upstream.response_times, vtscf->average_method,
                           vtscf->average_period) / 1000);
 
+    ngx_http_vhost_traffic_status_node_unlock(vtsn);
+
     /* histogram */
     len = 2;
 
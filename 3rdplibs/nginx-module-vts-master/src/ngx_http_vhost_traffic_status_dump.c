@@ -5,6 +5,7 @@
 
 
 #include "ngx_http_vhost_traffic_status_module.h"
+#include "ngx_http_vhost_traffic_status_shm.h"
 #include "ngx_http_vhost_traffic_status_dump.h"
 
 
@@ -108,14 +109,19 @@ ngx_http_vhost_traffic_status_dump_node_write(ngx_event_t *ev, ngx_file_t *file,
     ngx_rbtree_node_t *node)
 {
     ngx_http_vhost_traffic_status_ctx_t   *ctx;
-    ngx_http_vhost_traffic_status_node_t  *vtsn;
+    ngx_http_vhost_traffic_status_node_t  *vtsn, ovtsn;
 
     ctx = ev->data;
 
     if (node != ctx->rbtree->sentinel) {
         vtsn = (ngx_http_vhost_traffic_status_node_t *) &node->color;
 
-        (void) ngx_write_fd(file->fd, vtsn, sizeof(ngx_http_vhost_traffic_status_node_t));
+        /* the time queues of the slots nodes are copied under the node lock */
+        ngx_http_vhost_traffic_status_node_lock(vtsn);
+        ovtsn = *vtsn;
+        ngx_http_vhost_traffic_status_node_unlock(vtsn);
+
+        (void) ngx_write_fd(file->fd, &ovtsn, sizeof(ngx_http_vhost_traffic_status_node_t));
         (void) ngx_write_fd(file->fd, vtsn->data, vtsn->len);
         (void) ngx_write_fd(file->fd, NGX_HTTP_VHOST_TRAFFIC_STATUS_DUMP_DATA_PAD,
                             sizeof(NGX_HTTP_VHOST_TRAFFIC_STATUS_DUMP_DATA_PAD));
@@ -187,12 +193,19 @@ ngx_http_vhost_traffic_status_dump_execute(ngx_event_t *ev)
     ssize_t                               n;
     ngx_fd_t                              fd;
     ngx_file_t                            file;
+    ngx_slab_pool_t                      *shpool;
     ngx_http_vhost_traffic_status_ctx_t  *ctx;
 
     ctx = ev->data;
 
     name = ctx->dump_file.data;
 
+    shpool = (ngx_slab_pool_t *) ctx->shm_zone->shm.addr;
+
+    ngx_shmtx_lock(&shpool->mutex);
+    ngx_http_vhost_traffic_status_shm_fold(ctx);
+    ngx_shmtx_unlock(&shpool->mutex);
+
     fd = ngx_open_file(name, NGX_FILE_RDWR, NGX_FILE_TRUNCATE, NGX_FILE_DEFAULT_ACCESS);
 
     if (fd == NGX_INVALID_FILE) {
@@ -285,6 +298,16 @@ ngx_http_vhost_traffic_status_dump_restore_add_node(ngx_event_t *ev,
                + offsetof(ngx_http_vhost_traffic_status_node_t, data)
                + key->len;
 
+        if (ovtsn->stat_upstream.type == NGX_HTTP_VHOST_TRAFFIC_STATUS_UPSTREAM_FG) {
+            size += ngx_http_vhost_traffic_status_node_lru_size();
+        }
+
+        if (ctx->worker_slots) {
+            size += ngx_http_vhost_traffic_status_node_slots_size(ctx->worker_slots_n,
+                        ovtsn->stat_request_buckets.len
+                        + ovtsn->stat_upstream.response_buckets.len);
+        }
+
         node = ngx_slab_alloc_locked(shpool, size);
         if (node == NULL) {
             ngx_log_error(NGX_LOG_ALERT, ev->log, 0,
@@ -300,9 +323,18 @@ ngx_http_vhost_traffic_status_dump_restore_add_node(ngx_event_t *ev,
 
         *vtsn = *ovtsn;
 
+        vtsn->slots = 0;
+        vtsn->lru = 0;
         ngx_memcpy(vtsn->data, key->data, key->len);
 
+        if (ctx->worker_slots) {
+            ngx_http_vhost_traffic_status_node_slots_init(vtsn, ctx->worker_slots_n);
+        }
+
+        ngx_memory_barrier();
         ngx_rbtree_insert(ctx->rbtree, node);
+
+        ngx_http_vhost_traffic_status_shm_lru_insert(ctx, node);
     }
 
     ngx_shmtx_unlock(&shpool->mutex);
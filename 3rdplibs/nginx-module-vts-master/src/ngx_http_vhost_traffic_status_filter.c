@@ -267,15 +267,12 @@ next:
 
 
 ngx_int_t
-ngx_http_vhost_traffic_status_filter_max_node_match(ngx_http_request_t *r,
-    ngx_str_t *filter)
+ngx_http_vhost_traffic_status_filter_max_node_match(
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_str_t *filter)
 {
     ngx_uint_t                                     i, n;
-    ngx_http_vhost_traffic_status_ctx_t           *ctx;
     ngx_http_vhost_traffic_status_filter_match_t  *matches;
 
-    ctx = ngx_http_get_module_main_conf(r, ngx_http_vhost_traffic_status_module);
-
     if (ctx->filter_max_node_matches == NULL) {
         return NGX_OK;
     }
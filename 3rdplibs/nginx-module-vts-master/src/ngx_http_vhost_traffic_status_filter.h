@@ -48,7 +48,7 @@ ngx_int_t ngx_http_vhost_traffic_status_filter_get_nodes(
     ngx_http_request_t *r, ngx_array_t **filter_nodes,
     ngx_str_t *name, ngx_rbtree_node_t *node);
 ngx_int_t ngx_http_vhost_traffic_status_filter_max_node_match(
-    ngx_http_request_t *r, ngx_str_t *filter);
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_str_t *filter);
 
 char *ngx_http_vhost_traffic_status_filter_by_set_key(ngx_conf_t *cf,
     ngx_command_t *cmd, void *conf);
@@ -123,6 +123,8 @@ ngx_http_vhost_traffic_status_limit_handler_traffic(ngx_http_request_t *r,
 
             vtsn = (ngx_http_vhost_traffic_status_node_t *) &node->color;
 
+            ngx_http_vhost_traffic_status_node_fold(vtsn);
+
             traffic_used = (ngx_atomic_t) ngx_http_vhost_traffic_status_node_member(vtsn, &variable);
 
         /* traffic of server */
@@ -145,6 +147,8 @@ ngx_http_vhost_traffic_status_limit_handler_traffic(ngx_http_request_t *r,
 
             vtsn = (ngx_http_vhost_traffic_status_node_t *) &node->color;
 
+            ngx_http_vhost_traffic_status_node_fold(vtsn);
+
             traffic_used = (ngx_atomic_t) ngx_http_vhost_traffic_status_node_member(vtsn, &variable);
         }
 
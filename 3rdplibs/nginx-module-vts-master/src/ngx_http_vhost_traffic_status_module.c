@@ -146,6 +146,13 @@ static ngx_command_t ngx_http_vhost_traffic_status_commands[] = {
       0,
       NULL },
 
+    { ngx_string("vhost_traffic_status_worker_slots"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_vhost_traffic_status_ctx_t, worker_slots),
+      NULL },
+
     { ngx_string("vhost_traffic_status_display"),
       NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_NOARGS|NGX_CONF_TAKE1,
       ngx_http_vhost_traffic_status_display,
@@ -248,6 +255,7 @@ static ngx_int_t
 ngx_http_vhost_traffic_status_handler(ngx_http_request_t *r)
 {
     ngx_int_t                                  rc;
+    ngx_atomic_uint_t                          epoch;
     ngx_http_vhost_traffic_status_ctx_t       *ctx;
     ngx_http_vhost_traffic_status_loc_conf_t  *vtscf;
 
@@ -264,6 +272,8 @@ ngx_http_vhost_traffic_status_handler(ngx_http_request_t *r)
         return NGX_DECLINED;
     }
 
+    epoch = ngx_http_vhost_traffic_status_shm_enter(r);
+
     rc = ngx_http_vhost_traffic_status_shm_add_server(r);
     if (rc != NGX_OK) {
         ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
@@ -290,6 +300,8 @@ ngx_http_vhost_traffic_status_handler(ngx_http_request_t *r)
     }
 #endif
 
+    ngx_http_vhost_traffic_status_shm_leave(r, epoch);
+
     return NGX_DECLINED;
 }
 
@@ -401,40 +413,42 @@ ngx_http_vhost_traffic_status_init_zone(ngx_shm_zone_t *shm_zone, void *data)
 {
     ngx_http_vhost_traffic_status_ctx_t  *octx = data;
 
-    size_t                                len;
-    ngx_slab_pool_t                      *shpool;
-    ngx_rbtree_node_t                    *sentinel;
-    ngx_http_vhost_traffic_status_ctx_t  *ctx;
+    size_t                                  len;
+    ngx_slab_pool_t                        *shpool;
+    ngx_http_vhost_traffic_status_ctx_t    *ctx;
+    ngx_http_vhost_traffic_status_shctx_t  *sh;
 
     ctx = shm_zone->data;
 
+    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
     if (octx) {
+        ctx->sh = octx->sh;
         ctx->rbtree = octx->rbtree;
-        return NGX_OK;
+        goto workers;
     }
 
-    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
-
     if (shm_zone->shm.exists) {
-        ctx->rbtree = shpool->data;
-        return NGX_OK;
+        ctx->sh = shpool->data;
+        ctx->rbtree = &ctx->sh->rbtree;
+        goto workers;
     }
 
-    ctx->rbtree = ngx_slab_alloc(shpool, sizeof(ngx_rbtree_t));
-    if (ctx->rbtree == NULL) {
+    sh = ngx_slab_calloc(shpool, sizeof(ngx_http_vhost_traffic_status_shctx_t));
+    if (sh == NULL) {
         return NGX_ERROR;
     }
 
-    shpool->data = ctx->rbtree;
+    ctx->sh = sh;
+    ctx->rbtree = &sh->rbtree;
 
-    sentinel = ngx_slab_alloc(shpool, sizeof(ngx_rbtree_node_t));
-    if (sentinel == NULL) {
-        return NGX_ERROR;
-    }
+    shpool->data = sh;
 
-    ngx_rbtree_init(ctx->rbtree, sentinel,
+    ngx_rbtree_init(&sh->rbtree, &sh->sentinel,
                     ngx_http_vhost_traffic_status_rbtree_insert_value);
 
+    sh->epoch = 1;
+
     len = sizeof(" in vhost_traffic_status_zone \"\"") + shm_zone->shm.name.len;
 
     shpool->log_ctx = ngx_slab_alloc(shpool, len);
@@ -445,6 +459,22 @@ ngx_http_vhost_traffic_status_init_zone(ngx_shm_zone_t *shm_zone, void *data)
     ngx_sprintf(shpool->log_ctx, " in vhost_traffic_status_zone \"%V\"%Z",
                 &shm_zone->shm.name);
 
+workers:
+
+    /* workers of this and of the previous cycle, while it shuts down */
+    if (ctx->worker_slots && ctx->sh->workers == NULL) {
+        sh = ctx->sh;
+
+        sh->nworkers = 2 * ctx->worker_slots_n;
+        sh->workers = ngx_slab_calloc(shpool,
+                                      sh->nworkers * sizeof(ngx_http_vhost_traffic_status_worker_t));
+        if (sh->workers == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    ngx_http_vhost_traffic_status_shm_lru_init(ctx, shpool);
+
     return NGX_OK;
 }
 
@@ -791,6 +821,8 @@ ngx_http_vhost_traffic_status_create_main_conf(ngx_conf_t *cf)
      *     ctx->dump_file = { 0, NULL };
      *     ctx->dump_period = 0;
      *     ctx->dump_event = { NULL, ... };
+     *
+     *     ctx->worker_slots_n = 0;
      */
 
     ctx->filter_max_node = NGX_CONF_UNSET_UINT;
@@ -799,6 +831,7 @@ ngx_http_vhost_traffic_status_create_main_conf(ngx_conf_t *cf)
     ctx->limit_check_duplicate = NGX_CONF_UNSET;
     ctx->dump = NGX_CONF_UNSET;
     ctx->dump_period = NGX_CONF_UNSET_MSEC;
+    ctx->worker_slots = NGX_CONF_UNSET;
 
     return ctx;
 }
@@ -810,6 +843,7 @@ ngx_http_vhost_traffic_status_init_main_conf(ngx_conf_t *cf, void *conf)
     ngx_http_vhost_traffic_status_ctx_t  *ctx = conf;
 
     ngx_int_t                                  rc;
+    ngx_core_conf_t                           *ccf;
     ngx_http_vhost_traffic_status_loc_conf_t  *vtscf;
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, cf->log, 0,
@@ -850,6 +884,12 @@ ngx_http_vhost_traffic_status_init_main_conf(ngx_conf_t *cf, void *conf)
     ngx_conf_init_value(ctx->dump, 0);
     ngx_conf_merge_msec_value(ctx->dump_period, ctx->dump_period,
                               NGX_HTTP_VHOST_TRAFFIC_STATUS_DEFAULT_DUMP_PERIOD * 1000);
+    ngx_conf_init_value(ctx->worker_slots, 0);
+
+    /* one slot per worker process, "worker_processes" is set before "http" */
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cf->cycle->conf_ctx, ngx_core_module);
+
+    ctx->worker_slots_n = (ccf->worker_processes > 0) ? (ngx_uint_t) ccf->worker_processes : 1;
 
     return NGX_CONF_OK;
 }
@@ -1058,6 +1098,14 @@ ngx_http_vhost_traffic_status_init_worker(ngx_cycle_t *cycle)
         return NGX_OK;
     }
 
+    if (ctx->enable && ctx->sh != NULL
+        && (ngx_process == NGX_PROCESS_WORKER || ngx_process == NGX_PROCESS_SINGLE))
+    {
+        if (ngx_http_vhost_traffic_status_shm_init_worker(ctx, cycle->log) != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
     if (!(ctx->enable & ctx->dump) || ctx->rbtree == NULL) {
         ngx_log_debug0(NGX_LOG_DEBUG_HTTP, cycle->log, 0,
                        "vts::init_worker(): is bypassed");
@@ -1095,6 +1143,10 @@ ngx_http_vhost_traffic_status_exit_worker(ngx_cycle_t *cycle)
         return;
     }
 
+    if (ctx->sh != NULL) {
+        ngx_http_vhost_traffic_status_shm_exit_worker(ctx);
+    }
+
     if (!(ctx->enable & ctx->dump) || ctx->rbtree == NULL) {
         ngx_log_debug0(NGX_LOG_DEBUG_HTTP, cycle->log, 0,
                        "vts::exit_worker(): is bypassed");
@@ -220,7 +220,37 @@
 )
 
 
+/*
+ * A process updating the nodes without the zone lock
+ * (vhost_traffic_status_worker_slots): it publishes the epoch it entered in,
+ * so that deleted nodes are not freed under its feet.
+ */
+typedef struct {
+    ngx_atomic_t                            pid;
+    ngx_atomic_t                            epoch;
+    u_char                                  pad[NGX_CPU_CACHE_LINE - 2 * sizeof(ngx_atomic_t)];
+} ngx_http_vhost_traffic_status_worker_t;
+
+
+typedef struct {
+    ngx_rbtree_t                            rbtree;
+    ngx_rbtree_node_t                       sentinel;
+
+    /* deleted nodes waiting for the lock-free readers to leave their epoch */
+    ngx_atomic_t                            epoch;
+    ngx_rbtree_node_t                      *retired;
+
+    ngx_uint_t                              nworkers;
+    ngx_http_vhost_traffic_status_worker_t *workers;
+
+    /* filter nodes limited by vhost_traffic_status_filter_max_node */
+    ngx_queue_t                             lru;
+    ngx_uint_t                              lru_nodes;
+} ngx_http_vhost_traffic_status_shctx_t;
+
+
 typedef struct {
+    ngx_http_vhost_traffic_status_shctx_t  *sh;
     ngx_rbtree_t                           *rbtree;
 
     /* array of ngx_http_vhost_traffic_status_filter_t */
@@ -248,6 +278,9 @@ typedef struct {
     ngx_str_t                               dump_file;
     ngx_msec_t                              dump_period;
     ngx_event_t                             dump_event;
+
+    ngx_flag_t                              worker_slots;
+    ngx_uint_t                              worker_slots_n;
 } ngx_http_vhost_traffic_status_ctx_t;
 
 
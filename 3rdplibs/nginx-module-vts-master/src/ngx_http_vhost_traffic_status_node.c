@@ -129,114 +129,66 @@ found:
 
 
 ngx_rbtree_node_t *
-ngx_http_vhost_traffic_status_find_lru(ngx_http_request_t *r)
-{
-    ngx_rbtree_node_t                         *node;
-    ngx_http_vhost_traffic_status_ctx_t       *ctx;
-    ngx_http_vhost_traffic_status_shm_info_t  *shm_info;
-
-    ctx = ngx_http_get_module_main_conf(r, ngx_http_vhost_traffic_status_module);
-    node = NULL;
-
-    /* disabled */
-    if (ctx->filter_max_node == 0) {
-        return NULL;
-    }
-
-    shm_info = ngx_pcalloc(r->pool, sizeof(ngx_http_vhost_traffic_status_shm_info_t));
-
-    if (shm_info == NULL) { 
-        return NULL;
-    }
-
-    ngx_http_vhost_traffic_status_shm_info(r, shm_info);
-
-    /* find */
-    if (shm_info->filter_used_node >= ctx->filter_max_node) {
-        node = ngx_http_vhost_traffic_status_find_lru_node(r, NULL, ctx->rbtree->root);
-    }
-
-    return node;
-}
-
-
-ngx_rbtree_node_t *
-ngx_http_vhost_traffic_status_find_lru_node(ngx_http_request_t *r,
-    ngx_rbtree_node_t *a, ngx_rbtree_node_t *b)
+ngx_http_vhost_traffic_status_node_lookup(ngx_rbtree_t *rbtree, ngx_str_t *key,
+    uint32_t hash)
 {
-    ngx_str_t                              filter;
-    ngx_http_vhost_traffic_status_ctx_t   *ctx;
+    ngx_int_t                              rc;
+    ngx_rbtree_node_t                     *node, *sentinel;
     ngx_http_vhost_traffic_status_node_t  *vtsn;
 
-    ctx = ngx_http_get_module_main_conf(r, ngx_http_vhost_traffic_status_module);
-
-    if (b != ctx->rbtree->sentinel) {
-        vtsn = (ngx_http_vhost_traffic_status_node_t *) &b->color;
-
-        if (vtsn->stat_upstream.type == NGX_HTTP_VHOST_TRAFFIC_STATUS_UPSTREAM_FG) {
-            filter.data = vtsn->data;
-            filter.len = vtsn->len;
+    node = rbtree->root;
+    sentinel = rbtree->sentinel;
 
-            (void) ngx_http_vhost_traffic_status_node_position_key(&filter, 1);
+    while (node != sentinel) {
 
-            if (ngx_http_vhost_traffic_status_filter_max_node_match(r, &filter) == NGX_OK) {
-                a = ngx_http_vhost_traffic_status_find_lru_node_cmp(r, a, b);
-            }
+        if (hash < node->key) {
+            node = node->left;
+            continue;
         }
 
-        a = ngx_http_vhost_traffic_status_find_lru_node(r, a, b->left);
-        a = ngx_http_vhost_traffic_status_find_lru_node(r, a, b->right);
-    }
-
-    return a;
-}
-
-
-ngx_rbtree_node_t *
-ngx_http_vhost_traffic_status_find_lru_node_cmp(ngx_http_request_t *r,
-    ngx_rbtree_node_t *a, ngx_rbtree_node_t *b)
-{
-    ngx_int_t                                         ai, bi;
-    ngx_http_vhost_traffic_status_node_t             *avtsn, *bvtsn;
-    ngx_http_vhost_traffic_status_node_time_queue_t  *aq, *bq;
-
-    if (a == NULL) {
-        return b;
-    }
+        if (hash > node->key) {
+            node = node->right;
+            continue;
+        }
 
-    avtsn = (ngx_http_vhost_traffic_status_node_t *) &a->color;
-    bvtsn = (ngx_http_vhost_traffic_status_node_t *) &b->color;
+        /* hash == node->key */
 
-    aq = &avtsn->stat_request_times;
-    bq = &bvtsn->stat_request_times;
+        vtsn = (ngx_http_vhost_traffic_status_node_t *) &node->color;
 
-    if (aq->front == aq->rear) {
-        return a;
-    }
+        rc = ngx_memn2cmp(key->data, vtsn->data, key->len, (size_t) vtsn->len);
+        if (rc == 0) {
+            return node;
+        }
 
-    if (bq->front == bq->rear) {
-        return b;
+        node = (rc < 0) ? node->left : node->right;
     }
 
-    ai = ngx_http_vhost_traffic_status_node_time_queue_rear(aq);
-    bi = ngx_http_vhost_traffic_status_node_time_queue_rear(bq);
-
-    return (aq->times[ai].time < bq->times[bi].time) ? a : b;
+    return NULL;
 }
 
 
+/*
+   Lookup without the zone lock: the tree may be rebalanced meanwhile, so a miss
+   is not final (the caller looks up again under the lock). Deleted nodes are
+   not freed while the caller is in its epoch, see shm_enter().
+*/
 ngx_rbtree_node_t *
-ngx_http_vhost_traffic_status_node_lookup(ngx_rbtree_t *rbtree, ngx_str_t *key,
-    uint32_t hash)
+ngx_http_vhost_traffic_status_node_lookup_lockfree(ngx_rbtree_t *rbtree,
+    ngx_str_t *key, uint32_t hash)
 {
     ngx_int_t                              rc;
+    ngx_uint_t                             depth;
     ngx_rbtree_node_t                     *node, *sentinel;
     ngx_http_vhost_traffic_status_node_t  *vtsn;
 
     node = rbtree->root;
     sentinel = rbtree->sentinel;
 
-    while (node != sentinel) {
+    for (depth = 0; node != sentinel && node != NULL; depth++) {
+
+        if (depth == NGX_HTTP_VHOST_TRAFFIC_STATUS_LOOKUP_DEPTH_MAX) {
+            return NULL;
+        }
 
         if (hash < node->key) {
             node = node->left;
@@ -267,6 +219,11 @@ ngx_http_vhost_traffic_status_node_lookup(ngx_rbtree_t *rbtree, ngx_str_t *key,
 void
 ngx_http_vhost_traffic_status_node_zero(ngx_http_vhost_traffic_status_node_t *vtsn)
 {
+    ngx_uint_t                                   i;
+    ngx_http_vhost_traffic_status_node_slots_t  *slots;
+
+    ngx_http_vhost_traffic_status_node_lock(vtsn);
+
     vtsn->stat_request_counter = 0;
     vtsn->stat_in_bytes = 0;
     vtsn->stat_out_bytes = 0;
@@ -310,6 +267,15 @@ ngx_http_vhost_traffic_status_node_zero(ngx_http_vhost_traffic_status_node_t *vt
     vtsn->stat_cache_scarce_counter_oc = 0;
 #endif
 
+    if (vtsn->slots) {
+        slots = ngx_http_vhost_traffic_status_node_slots(vtsn);
+
+        for (i = 0; i < slots->n; i++) {
+            ngx_memzero(ngx_http_vhost_traffic_status_node_slot(vtsn, i), slots->size);
+        }
+    }
+
+    ngx_http_vhost_traffic_status_node_unlock(vtsn);
 }
 
 
@@ -619,6 +585,318 @@ ngx_http_vhost_traffic_status_node_histogram_observe(
 }
 
 
+size_t
+ngx_http_vhost_traffic_status_node_slots_size(ngx_uint_t n, ngx_uint_t buckets)
+{
+    size_t  size;
+
+    size = ngx_align(offsetof(ngx_http_vhost_traffic_status_node_slot_t, buckets)
+                     + buckets * sizeof(ngx_atomic_t), NGX_CPU_CACHE_LINE);
+
+    /* alignment after the key, slots header, slots */
+    return NGX_CPU_CACHE_LINE - 1
+           + ngx_align(sizeof(ngx_http_vhost_traffic_status_node_slots_t), NGX_CPU_CACHE_LINE)
+           + n * size;
+}
+
+
+/*
+   The node key and histogram buckets are set, and the node was allocated with
+   ngx_http_vhost_traffic_status_node_slots_size() more bytes.
+*/
+void
+ngx_http_vhost_traffic_status_node_slots_init(
+    ngx_http_vhost_traffic_status_node_t *vtsn, ngx_uint_t n)
+{
+    ngx_uint_t                                   buckets;
+    ngx_http_vhost_traffic_status_node_slots_t  *slots;
+
+    buckets = vtsn->stat_request_buckets.len + vtsn->stat_upstream.response_buckets.len;
+
+    slots = ngx_http_vhost_traffic_status_node_slots(vtsn);
+
+    slots->lock = 0;
+    slots->n = n;
+    slots->size = ngx_align(offsetof(ngx_http_vhost_traffic_status_node_slot_t, buckets)
+                            + buckets * sizeof(ngx_atomic_t), NGX_CPU_CACHE_LINE);
+
+    ngx_memzero(ngx_http_vhost_traffic_status_node_slot(vtsn, 0), n * slots->size);
+
+    vtsn->slots = 1;
+}
+
+
+/*
+   The time queues and averages of a node of per worker slots are updated
+   under the node lock without the zone lock: they are read or zeroed under
+   both. The workers only try the node lock, so it is held briefly.
+*/
+void
+ngx_http_vhost_traffic_status_node_lock(ngx_http_vhost_traffic_status_node_t *vtsn)
+{
+    ngx_http_vhost_traffic_status_node_slots_t  *slots;
+
+    if (!vtsn->slots) {
+        return;
+    }
+
+    slots = ngx_http_vhost_traffic_status_node_slots(vtsn);
+
+    ngx_spinlock(&slots->lock, 1, 2048);
+}
+
+
+void
+ngx_http_vhost_traffic_status_node_unlock(ngx_http_vhost_traffic_status_node_t *vtsn)
+{
+    ngx_http_vhost_traffic_status_node_slots_t  *slots;
+
+    if (!vtsn->slots) {
+        return;
+    }
+
+    slots = ngx_http_vhost_traffic_status_node_slots(vtsn);
+
+    ngx_memory_barrier();
+    ngx_unlock(&slots->lock);
+}
+
+
+ngx_http_vhost_traffic_status_node_slot_t *
+ngx_http_vhost_traffic_status_node_slot(ngx_http_vhost_traffic_status_node_t *vtsn,
+    ngx_uint_t worker)
+{
+    u_char                                      *p;
+    ngx_http_vhost_traffic_status_node_slots_t  *slots;
+
+    slots = ngx_http_vhost_traffic_status_node_slots(vtsn);
+
+    p = (u_char *) slots
+        + ngx_align(sizeof(ngx_http_vhost_traffic_status_node_slots_t), NGX_CPU_CACHE_LINE)
+        + (worker % slots->n) * slots->size;
+
+    return (ngx_http_vhost_traffic_status_node_slot_t *) p;
+}
+
+
+void
+ngx_http_vhost_traffic_status_node_slot_update(ngx_http_request_t *r,
+    ngx_http_vhost_traffic_status_node_t *vtsn,
+    ngx_http_vhost_traffic_status_node_slot_t *slot, ngx_msec_int_t ms)
+{
+    ngx_int_t      i, n;
+    ngx_uint_t     status;
+    ngx_atomic_t  *counter;
+
+    status = r->headers_out.status;
+
+    (void) ngx_atomic_fetch_add(&slot->stat_request_counter, 1);
+    (void) ngx_atomic_fetch_add(&slot->stat_in_bytes, (ngx_atomic_int_t) r->request_length);
+    (void) ngx_atomic_fetch_add(&slot->stat_out_bytes, (ngx_atomic_int_t) r->connection->sent);
+
+    if (status < 200) {
+        counter = &slot->stat_1xx_counter;
+
+    } else if (status < 300) {
+        counter = &slot->stat_2xx_counter;
+
+    } else if (status < 400) {
+        counter = &slot->stat_3xx_counter;
+
+    } else if (status < 500) {
+        counter = &slot->stat_4xx_counter;
+
+    } else {
+        counter = &slot->stat_5xx_counter;
+    }
+
+    (void) ngx_atomic_fetch_add(counter, 1);
+    (void) ngx_atomic_fetch_add(&slot->stat_request_time_counter, (ngx_atomic_int_t) ms);
+
+    n = vtsn->stat_request_buckets.len;
+
+    for (i = 0; i < n; i++) {
+        if (ms <= vtsn->stat_request_buckets.buckets[i].msec) {
+            (void) ngx_atomic_fetch_add(&slot->buckets[i], 1);
+        }
+    }
+
+#if (NGX_HTTP_CACHE)
+    if (r->upstream == NULL || r->upstream->cache_status == 0) {
+        return;
+    }
+
+    switch (r->upstream->cache_status) {
+
+    case NGX_HTTP_CACHE_MISS:
+        counter = &slot->stat_cache_miss_counter;
+        break;
+
+    case NGX_HTTP_CACHE_BYPASS:
+        counter = &slot->stat_cache_bypass_counter;
+        break;
+
+    case NGX_HTTP_CACHE_EXPIRED:
+        counter = &slot->stat_cache_expired_counter;
+        break;
+
+    case NGX_HTTP_CACHE_STALE:
+        counter = &slot->stat_cache_stale_counter;
+        break;
+
+    case NGX_HTTP_CACHE_UPDATING:
+        counter = &slot->stat_cache_updating_counter;
+        break;
+
+#if defined(nginx_version) && nginx_version >= 1005007
+    case NGX_HTTP_CACHE_REVALIDATED:
+        counter = &slot->stat_cache_revalidated_counter;
+        break;
+#endif
+
+    case NGX_HTTP_CACHE_HIT:
+        counter = &slot->stat_cache_hit_counter;
+        break;
+
+    case NGX_HTTP_CACHE_SCARCE:
+        counter = &slot->stat_cache_scarce_counter;
+        break;
+
+    default:
+        return;
+    }
+
+    (void) ngx_atomic_fetch_add(counter, 1);
+#endif
+}
+
+
+void
+ngx_http_vhost_traffic_status_node_slot_upstream(
+    ngx_http_vhost_traffic_status_node_t *vtsn,
+    ngx_http_vhost_traffic_status_node_slot_t *slot, ngx_msec_int_t ms)
+{
+    ngx_int_t      i, n;
+    ngx_atomic_t  *buckets;
+
+    (void) ngx_atomic_fetch_add(&slot->stat_response_time_counter, (ngx_atomic_int_t) ms);
+
+    buckets = &slot->buckets[vtsn->stat_request_buckets.len];
+    n = vtsn->stat_upstream.response_buckets.len;
+
+    for (i = 0; i < n; i++) {
+        if (ms <= vtsn->stat_upstream.response_buckets.buckets[i].msec) {
+            (void) ngx_atomic_fetch_add(&buckets[i], 1);
+        }
+    }
+}
+
+
+static ngx_inline ngx_atomic_uint_t
+ngx_http_vhost_traffic_status_node_slot_take(ngx_atomic_t *counter)
+{
+    ngx_atomic_uint_t  v;
+
+    v = *counter;
+
+    if (v) {
+        (void) ngx_atomic_fetch_add(counter, -(ngx_atomic_int_t) v);
+    }
+
+    return v;
+}
+
+
+/*
+   Move the per worker counters into the node. The zone lock is held: the node
+   members are written under it only, the slots are drained with atomic
+   operations as the workers keep adding to them.
+*/
+void
+ngx_http_vhost_traffic_status_node_fold(ngx_http_vhost_traffic_status_node_t *vtsn)
+{
+    ngx_int_t                                    j, rn, un;
+    ngx_uint_t                                   i;
+    ngx_atomic_uint_t                            response_time_counter;
+    ngx_http_vhost_traffic_status_node_t         ovtsn;
+    ngx_http_vhost_traffic_status_node_slot_t   *slot;
+    ngx_http_vhost_traffic_status_node_slots_t  *slots;
+
+    if (!vtsn->slots) {
+        return;
+    }
+
+    ovtsn = *vtsn;
+
+    slots = ngx_http_vhost_traffic_status_node_slots(vtsn);
+
+    rn = vtsn->stat_request_buckets.len;
+    un = vtsn->stat_upstream.response_buckets.len;
+
+    for (i = 0; i < slots->n; i++) {
+        slot = ngx_http_vhost_traffic_status_node_slot(vtsn, i);
+
+        vtsn->stat_request_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_request_counter);
+        vtsn->stat_in_bytes +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_in_bytes);
+        vtsn->stat_out_bytes +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_out_bytes);
+        vtsn->stat_1xx_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_1xx_counter);
+        vtsn->stat_2xx_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_2xx_counter);
+        vtsn->stat_3xx_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_3xx_counter);
+        vtsn->stat_4xx_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_4xx_counter);
+        vtsn->stat_5xx_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_5xx_counter);
+        vtsn->stat_request_time_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_request_time_counter);
+        vtsn->stat_upstream.response_time_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_response_time_counter);
+
+#if (NGX_HTTP_CACHE)
+        vtsn->stat_cache_miss_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_cache_miss_counter);
+        vtsn->stat_cache_bypass_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_cache_bypass_counter);
+        vtsn->stat_cache_expired_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_cache_expired_counter);
+        vtsn->stat_cache_stale_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_cache_stale_counter);
+        vtsn->stat_cache_updating_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_cache_updating_counter);
+        vtsn->stat_cache_revalidated_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_cache_revalidated_counter);
+        vtsn->stat_cache_hit_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_cache_hit_counter);
+        vtsn->stat_cache_scarce_counter +=
+            ngx_http_vhost_traffic_status_node_slot_take(&slot->stat_cache_scarce_counter);
+#endif
+
+        for (j = 0; j < rn; j++) {
+            vtsn->stat_request_buckets.buckets[j].counter +=
+                ngx_http_vhost_traffic_status_node_slot_take(&slot->buckets[j]);
+        }
+
+        for (j = 0; j < un; j++) {
+            vtsn->stat_upstream.response_buckets.buckets[j].counter +=
+                ngx_http_vhost_traffic_status_node_slot_take(&slot->buckets[rn + j]);
+        }
+    }
+
+    ngx_http_vhost_traffic_status_add_oc((&ovtsn), vtsn);
+
+    response_time_counter = ovtsn.stat_upstream.response_time_counter;
+
+    if (response_time_counter > vtsn->stat_upstream.response_time_counter) {
+        vtsn->stat_response_time_counter_oc++;
+    }
+}
+
+
 ngx_int_t
 ngx_http_vhost_traffic_status_node_member_cmp(ngx_str_t *member, const char *name)
 {
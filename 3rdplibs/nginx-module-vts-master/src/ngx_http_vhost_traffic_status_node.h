@@ -10,6 +10,24 @@
 
 #define NGX_HTTP_VHOST_TRAFFIC_STATUS_DEFAULT_QUEUE_LEN    64
 #define NGX_HTTP_VHOST_TRAFFIC_STATUS_DEFAULT_BUCKET_LEN   32
+#define NGX_HTTP_VHOST_TRAFFIC_STATUS_LOOKUP_DEPTH_MAX     128
+
+#define ngx_http_vhost_traffic_status_node_lru_size()                          \
+    (NGX_ALIGNMENT - 1 + sizeof(ngx_http_vhost_traffic_status_node_lru_t))
+
+/* filter nodes have an lru link after the key */
+#define ngx_http_vhost_traffic_status_node_lru(vtsn)                           \
+    ((ngx_http_vhost_traffic_status_node_lru_t *)                              \
+     ngx_align_ptr((vtsn)->data + (vtsn)->len, NGX_ALIGNMENT))
+
+#define ngx_http_vhost_traffic_status_node_end(vtsn)                           \
+    (((vtsn)->stat_upstream.type == NGX_HTTP_VHOST_TRAFFIC_STATUS_UPSTREAM_FG) \
+     ? (u_char *) (ngx_http_vhost_traffic_status_node_lru(vtsn) + 1)           \
+     : (vtsn)->data + (vtsn)->len)
+
+#define ngx_http_vhost_traffic_status_node_slots(vtsn)                         \
+    ((ngx_http_vhost_traffic_status_node_slots_t *)                            \
+     ngx_align_ptr(ngx_http_vhost_traffic_status_node_end(vtsn), NGX_CPU_CACHE_LINE))
 
 
 typedef struct {
@@ -50,6 +68,8 @@ typedef struct {
 
 typedef struct {
     u_char                                                 color;
+    u_char                                                 slots;
+    u_char                                                 lru;
     ngx_atomic_t                                           stat_request_counter;
     ngx_atomic_t                                           stat_in_bytes;
     ngx_atomic_t                                           stat_out_bytes;
@@ -105,6 +125,60 @@ typedef struct {
 } ngx_http_vhost_traffic_status_node_t;
 
 
+/*
+ * Per worker counters of a node (vhost_traffic_status_worker_slots), each on
+ * its own cache lines and updated with atomic operations without the zone
+ * lock. They are folded into the node under the lock before it is read.
+ */
+typedef struct {
+    ngx_atomic_t                                           stat_request_counter;
+    ngx_atomic_t                                           stat_in_bytes;
+    ngx_atomic_t                                           stat_out_bytes;
+    ngx_atomic_t                                           stat_1xx_counter;
+    ngx_atomic_t                                           stat_2xx_counter;
+    ngx_atomic_t                                           stat_3xx_counter;
+    ngx_atomic_t                                           stat_4xx_counter;
+    ngx_atomic_t                                           stat_5xx_counter;
+    ngx_atomic_t                                           stat_request_time_counter;
+    ngx_atomic_t                                           stat_response_time_counter;
+
+#if (NGX_HTTP_CACHE)
+    ngx_atomic_t                                           stat_cache_miss_counter;
+    ngx_atomic_t                                           stat_cache_bypass_counter;
+    ngx_atomic_t                                           stat_cache_expired_counter;
+    ngx_atomic_t                                           stat_cache_stale_counter;
+    ngx_atomic_t                                           stat_cache_updating_counter;
+    ngx_atomic_t                                           stat_cache_revalidated_counter;
+    ngx_atomic_t                                           stat_cache_hit_counter;
+    ngx_atomic_t                                           stat_cache_scarce_counter;
+#endif
+
+    /* request time buckets, then upstream response time buckets */
+    ngx_atomic_t                                           buckets[1];
+} ngx_http_vhost_traffic_status_node_slot_t;
+
+
+/*
+ * Link of a filter node in the lru queue of the zone. Nodes of per worker
+ * slots are not moved without the lock, they are marked as used instead and
+ * moved when they reach the head of the queue.
+ */
+typedef struct {
+    ngx_queue_t                                            queue;
+    ngx_rbtree_node_t                                     *node;
+    ngx_atomic_t                                           used;
+} ngx_http_vhost_traffic_status_node_lru_t;
+
+
+/* follows the node key, the slots follow on the next cache lines */
+typedef struct {
+    /* time queues and averages */
+    ngx_atomic_t                                           lock;
+    ngx_uint_t                                             n;
+    size_t                                                 size;
+} ngx_http_vhost_traffic_status_node_slots_t;
+
+
 ngx_int_t ngx_http_vhost_traffic_status_node_generate_key(ngx_pool_t *pool,
     ngx_str_t *buf, ngx_str_t *dst, unsigned type);
 ngx_int_t ngx_http_vhost_traffic_status_node_position_key(ngx_str_t *buf,
@@ -112,6 +186,8 @@ ngx_int_t ngx_http_vhost_traffic_status_node_position_key(ngx_str_t *buf,
 
 ngx_rbtree_node_t *ngx_http_vhost_traffic_status_node_lookup(
     ngx_rbtree_t *rbtree, ngx_str_t *key, uint32_t hash);
+ngx_rbtree_node_t *ngx_http_vhost_traffic_status_node_lookup_lockfree(
+    ngx_rbtree_t *rbtree, ngx_str_t *key, uint32_t hash);
 void ngx_http_vhost_traffic_status_node_zero(
     ngx_http_vhost_traffic_status_node_t *vtsn);
 void ngx_http_vhost_traffic_status_node_init(ngx_http_request_t *r,
@@ -121,6 +197,25 @@ void ngx_http_vhost_traffic_status_node_set(ngx_http_request_t *r,
 void ngx_http_vhost_traffic_status_node_update(ngx_http_request_t *r,
     ngx_http_vhost_traffic_status_node_t *vtsn, ngx_msec_int_t ms);
 
+size_t ngx_http_vhost_traffic_status_node_slots_size(ngx_uint_t n,
+    ngx_uint_t buckets);
+void ngx_http_vhost_traffic_status_node_slots_init(
+    ngx_http_vhost_traffic_status_node_t *vtsn, ngx_uint_t n);
+void ngx_http_vhost_traffic_status_node_lock(
+    ngx_http_vhost_traffic_status_node_t *vtsn);
+void ngx_http_vhost_traffic_status_node_unlock(
+    ngx_http_vhost_traffic_status_node_t *vtsn);
+ngx_http_vhost_traffic_status_node_slot_t *ngx_http_vhost_traffic_status_node_slot(
+    ngx_http_vhost_traffic_status_node_t *vtsn, ngx_uint_t worker);
+void ngx_http_vhost_traffic_status_node_slot_update(ngx_http_request_t *r,
+    ngx_http_vhost_traffic_status_node_t *vtsn,
+    ngx_http_vhost_traffic_status_node_slot_t *slot, ngx_msec_int_t ms);
+void ngx_http_vhost_traffic_status_node_slot_upstream(
+    ngx_http_vhost_traffic_status_node_t *vtsn,
+    ngx_http_vhost_traffic_status_node_slot_t *slot, ngx_msec_int_t ms);
+void ngx_http_vhost_traffic_status_node_fold(
+    ngx_http_vhost_traffic_status_node_t *vtsn);
+
 void ngx_http_vhost_traffic_status_node_time_queue_zero(
     ngx_http_vhost_traffic_status_node_time_queue_t *q);
 void ngx_http_vhost_traffic_status_node_time_queue_init(
@@ -163,12 +258,6 @@ void ngx_http_vhost_traffic_status_find_name(ngx_http_request_t *r,
 ngx_rbtree_node_t *ngx_http_vhost_traffic_status_find_node(ngx_http_request_t *r,
     ngx_str_t *key, unsigned type, uint32_t key_hash);
 
-ngx_rbtree_node_t *ngx_http_vhost_traffic_status_find_lru(ngx_http_request_t *r);
-ngx_rbtree_node_t *ngx_http_vhost_traffic_status_find_lru_node(ngx_http_request_t *r,
-    ngx_rbtree_node_t *a, ngx_rbtree_node_t *b);
-ngx_rbtree_node_t *ngx_http_vhost_traffic_status_find_lru_node_cmp(ngx_http_request_t *r,
-    ngx_rbtree_node_t *a, ngx_rbtree_node_t *b);
-
 ngx_int_t ngx_http_vhost_traffic_status_node_member_cmp(ngx_str_t *member, const char *name);
 ngx_atomic_uint_t ngx_http_vhost_traffic_status_node_member(
     ngx_http_vhost_traffic_status_node_t *vtsn,
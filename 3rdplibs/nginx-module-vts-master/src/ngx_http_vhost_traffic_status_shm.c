@@ -21,6 +21,408 @@ static ngx_int_t ngx_http_vhost_traffic_status_shm_add_node_cache(ngx_http_reque
 
 static ngx_int_t ngx_http_vhost_traffic_status_shm_add_filter_node(ngx_http_request_t *r,
     ngx_array_t *filter_keys);
+static void ngx_http_vhost_traffic_status_shm_add_node_slots(ngx_http_request_t *r,
+    ngx_http_vhost_traffic_status_node_t *vtsn, unsigned type);
+static void ngx_http_vhost_traffic_status_shm_fold_node(
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_rbtree_node_t *node);
+
+static ngx_int_t ngx_http_vhost_traffic_status_shm_lru_match(
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_str_t *key, unsigned type);
+static void ngx_http_vhost_traffic_status_shm_lru_link(
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_rbtree_node_t *node);
+static void ngx_http_vhost_traffic_status_shm_lru_touch(
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_http_vhost_traffic_status_node_t *vtsn);
+static void ngx_http_vhost_traffic_status_shm_lru_expire(
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_slab_pool_t *shpool);
+static void ngx_http_vhost_traffic_status_shm_lru_init_node(
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_rbtree_node_t *node);
+
+
+/* the entry of this process in the zone, if it updates without the lock */
+static ngx_http_vhost_traffic_status_worker_t  *ngx_http_vhost_traffic_status_worker;
+static ngx_uint_t                               ngx_http_vhost_traffic_status_worker_slot;
+
+
+ngx_int_t
+ngx_http_vhost_traffic_status_shm_init_worker(ngx_http_vhost_traffic_status_ctx_t *ctx,
+    ngx_log_t *log)
+{
+    ngx_uint_t                               i;
+    ngx_slab_pool_t                         *shpool;
+    ngx_http_vhost_traffic_status_shctx_t   *sh;
+    ngx_http_vhost_traffic_status_worker_t  *w;
+
+    sh = ctx->sh;
+
+    if (!ctx->worker_slots || sh->workers == NULL) {
+        return NGX_OK;
+    }
+
+    shpool = (ngx_slab_pool_t *) ctx->shm_zone->shm.addr;
+
+    ngx_shmtx_lock(&shpool->mutex);
+
+    for (i = 0; i < sh->nworkers; i++) {
+        w = &sh->workers[i];
+
+        /* left by a worker that exited abnormally */
+        if (w->pid == (ngx_atomic_uint_t) ngx_pid
+            || (w->pid != 0
+                && kill((ngx_pid_t) w->pid, 0) == -1 && ngx_errno == NGX_ESRCH))
+        {
+            w->epoch = 0;
+            w->pid = 0;
+        }
+
+        if (w->pid == 0 && ngx_http_vhost_traffic_status_worker == NULL) {
+            w->epoch = 0;
+            w->pid = ngx_pid;
+
+            ngx_http_vhost_traffic_status_worker = w;
+            ngx_http_vhost_traffic_status_worker_slot = i;
+        }
+    }
+
+    ngx_http_vhost_traffic_status_shm_reclaim(ctx, shpool);
+
+    ngx_shmtx_unlock(&shpool->mutex);
+
+    if (ngx_http_vhost_traffic_status_worker == NULL) {
+        ngx_log_error(NGX_LOG_WARN, log, 0,
+                      "vhost_traffic_status_worker_slots: all %ui worker entries are in use, "
+                      "the worker updates under the zone lock", sh->nworkers);
+    }
+
+    return NGX_OK;
+}
+
+
+void
+ngx_http_vhost_traffic_status_shm_exit_worker(ngx_http_vhost_traffic_status_ctx_t *ctx)
+{
+    ngx_slab_pool_t                         *shpool;
+    ngx_http_vhost_traffic_status_worker_t  *w;
+
+    w = ngx_http_vhost_traffic_status_worker;
+
+    if (w == NULL) {
+        return;
+    }
+
+    shpool = (ngx_slab_pool_t *) ctx->shm_zone->shm.addr;
+
+    ngx_shmtx_lock(&shpool->mutex);
+
+    w->epoch = 0;
+    w->pid = 0;
+
+    ngx_shmtx_unlock(&shpool->mutex);
+
+    ngx_http_vhost_traffic_status_worker = NULL;
+}
+
+
+/*
+ * Entered before the lock-free updates of a request: nodes deleted from now
+ * on are not freed until shm_leave().
+ */
+ngx_atomic_uint_t
+ngx_http_vhost_traffic_status_shm_enter(ngx_http_request_t *r)
+{
+    ngx_atomic_uint_t                     epoch;
+    ngx_http_vhost_traffic_status_ctx_t  *ctx;
+
+    if (ngx_http_vhost_traffic_status_worker == NULL) {
+        return 0;
+    }
+
+    ctx = ngx_http_get_module_main_conf(r, ngx_http_vhost_traffic_status_module);
+
+    epoch = ctx->sh->epoch;
+
+    /* a full barrier: the epoch is published before the tree is read */
+    (void) ngx_atomic_cmp_set(&ngx_http_vhost_traffic_status_worker->epoch, 0, epoch);
+
+    return epoch;
+}
+
+
+void
+ngx_http_vhost_traffic_status_shm_leave(ngx_http_request_t *r, ngx_atomic_uint_t epoch)
+{
+    if (ngx_http_vhost_traffic_status_worker == NULL || epoch == 0) {
+        return;
+    }
+
+    (void) ngx_atomic_cmp_set(&ngx_http_vhost_traffic_status_worker->epoch, epoch, 0);
+}
+
+
+/*
+ * Delete a node, the zone lock is held. While workers update the nodes without
+ * the lock, the node is retired in the current epoch instead of being freed
+ * (see shm_reclaim()): ngx_rbtree_delete() has cleared its links, its key and
+ * parent members link it in the retired list.
+ */
+void
+ngx_http_vhost_traffic_status_shm_free_node(ngx_http_vhost_traffic_status_ctx_t *ctx,
+    ngx_slab_pool_t *shpool, ngx_rbtree_node_t *node)
+{
+    ngx_http_vhost_traffic_status_node_t      *vtsn;
+    ngx_http_vhost_traffic_status_shctx_t     *sh;
+    ngx_http_vhost_traffic_status_node_lru_t  *lru;
+
+    sh = ctx->sh;
+
+    vtsn = (ngx_http_vhost_traffic_status_node_t *) &node->color;
+
+    if (vtsn->lru) {
+        lru = ngx_http_vhost_traffic_status_node_lru(vtsn);
+
+        ngx_queue_remove(&lru->queue);
+        sh->lru_nodes--;
+        vtsn->lru = 0;
+    }
+
+    ngx_rbtree_delete(ctx->rbtree, node);
+
+    if (sh->workers == NULL) {
+        ngx_slab_free_locked(shpool, node);
+        return;
+    }
+
+    node->key = sh->epoch;
+    node->parent = sh->retired;
+    sh->retired = node;
+}
+
+
+/*
+ * Free the retired nodes no worker can still reach, the zone lock is held.
+ * A worker that has not published its epoch yet enters the new one and walks
+ * the tree without the retired nodes.
+ */
+void
+ngx_http_vhost_traffic_status_shm_reclaim(ngx_http_vhost_traffic_status_ctx_t *ctx,
+    ngx_slab_pool_t *shpool)
+{
+    ngx_uint_t                              i;
+    ngx_atomic_uint_t                       epoch, oldest;
+    ngx_rbtree_node_t                      *node, **p;
+    ngx_http_vhost_traffic_status_shctx_t  *sh;
+
+    sh = ctx->sh;
+
+    if (sh->retired == NULL) {
+        return;
+    }
+
+    /* a full barrier: the nodes are unlinked before the new epoch is seen */
+    oldest = ngx_atomic_fetch_add(&sh->epoch, 1) + 1;
+
+    /* the oldest epoch a worker is still in */
+
+    for (i = 0; i < sh->nworkers; i++) {
+        epoch = sh->workers[i].epoch;
+
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+
+    p = &sh->retired;
+
+    while (*p != NULL) {
+        node = *p;
+
+        if (node->key < oldest) {
+            *p = node->parent;
+            ngx_slab_free_locked(shpool, node);
+            continue;
+        }
+
+        p = &node->parent;
+    }
+}
+
+
+/*
+ * The filter nodes of the groups limited by vhost_traffic_status_filter_max_node
+ * are linked in the lru queue of the zone, the least recently used first, so
+ * that a node is evicted without walking the tree.
+ */
+static ngx_int_t
+ngx_http_vhost_traffic_status_shm_lru_match(ngx_http_vhost_traffic_status_ctx_t *ctx,
+    ngx_str_t *key, unsigned type)
+{
+    ngx_str_t  filter;
+
+    if (ctx->filter_max_node == 0
+        || type != NGX_HTTP_VHOST_TRAFFIC_STATUS_UPSTREAM_FG)
+    {
+        return NGX_DECLINED;
+    }
+
+    filter = *key;
+
+    (void) ngx_http_vhost_traffic_status_node_position_key(&filter, 1);
+
+    return ngx_http_vhost_traffic_status_filter_max_node_match(ctx, &filter);
+}
+
+
+static void
+ngx_http_vhost_traffic_status_shm_lru_link(ngx_http_vhost_traffic_status_ctx_t *ctx,
+    ngx_rbtree_node_t *node)
+{
+    ngx_http_vhost_traffic_status_node_t      *vtsn;
+    ngx_http_vhost_traffic_status_node_lru_t  *lru;
+
+    vtsn = (ngx_http_vhost_traffic_status_node_t *) &node->color;
+    lru = ngx_http_vhost_traffic_status_node_lru(vtsn);
+
+    lru->node = node;
+    lru->used = 0;
+
+    ngx_queue_insert_tail(&ctx->sh->lru, &lru->queue);
+    ctx->sh->lru_nodes++;
+
+    vtsn->lru = 1;
+}
+
+
+static void
+ngx_http_vhost_traffic_status_shm_lru_touch(ngx_http_vhost_traffic_status_ctx_t *ctx,
+    ngx_http_vhost_traffic_status_node_t *vtsn)
+{
+    ngx_http_vhost_traffic_status_node_lru_t  *lru;
+
+    if (!vtsn->lru) {
+        return;
+    }
+
+    lru = ngx_http_vhost_traffic_status_node_lru(vtsn);
+
+    lru->used = 0;
+
+    ngx_queue_remove(&lru->queue);
+    ngx_queue_insert_tail(&ctx->sh->lru, &lru->queue);
+}
+
+
+/*
+ * Make room for a new node of a limited filter group, the zone lock is held.
+ * A node used without the lock since it was queued gets a second chance.
+ */
+static void
+ngx_http_vhost_traffic_status_shm_lru_expire(ngx_http_vhost_traffic_status_ctx_t *ctx,
+    ngx_slab_pool_t *shpool)
+{
+    ngx_queue_t                               *q;
+    ngx_http_vhost_traffic_status_shctx_t     *sh;
+    ngx_http_vhost_traffic_status_node_lru_t  *lru;
+
+    sh = ctx->sh;
+
+    while (sh->lru_nodes >= ctx->filter_max_node && !ngx_queue_empty(&sh->lru)) {
+        q = ngx_queue_head(&sh->lru);
+        lru = ngx_queue_data(q, ngx_http_vhost_traffic_status_node_lru_t, queue);
+
+        if (lru->used) {
+            lru->used = 0;
+
+            ngx_queue_remove(q);
+            ngx_queue_insert_tail(&sh->lru, q);
+            continue;
+        }
+
+        ngx_http_vhost_traffic_status_shm_free_node(ctx, shpool, lru->node);
+    }
+}
+
+
+/* links a node restored or kept from the previous cycle, the lock is held */
+void
+ngx_http_vhost_traffic_status_shm_lru_insert(ngx_http_vhost_traffic_status_ctx_t *ctx,
+    ngx_rbtree_node_t *node)
+{
+    ngx_str_t                              key;
+    ngx_http_vhost_traffic_status_node_t  *vtsn;
+
+    vtsn = (ngx_http_vhost_traffic_status_node_t *) &node->color;
+
+    vtsn->lru = 0;
+
+    key.data = vtsn->data;
+    key.len = vtsn->len;
+
+    if (ngx_http_vhost_traffic_status_shm_lru_match(ctx, &key,
+            vtsn->stat_upstream.type) == NGX_OK)
+    {
+        ngx_http_vhost_traffic_status_shm_lru_link(ctx, node);
+    }
+}
+
+
+static void
+ngx_http_vhost_traffic_status_shm_lru_init_node(ngx_http_vhost_traffic_status_ctx_t *ctx,
+    ngx_rbtree_node_t *node)
+{
+    if (node != ctx->rbtree->sentinel) {
+        ngx_http_vhost_traffic_status_shm_lru_insert(ctx, node);
+
+        ngx_http_vhost_traffic_status_shm_lru_init_node(ctx, node->left);
+        ngx_http_vhost_traffic_status_shm_lru_init_node(ctx, node->right);
+    }
+}
+
+
+/*
+ * (Re)build the lru queue for the vhost_traffic_status_filter_max_node of
+ * this cycle, which may limit other groups than the previous one did.
+ */
+void
+ngx_http_vhost_traffic_status_shm_lru_init(ngx_http_vhost_traffic_status_ctx_t *ctx,
+    ngx_slab_pool_t *shpool)
+{
+    ngx_shmtx_lock(&shpool->mutex);
+
+    ngx_queue_init(&ctx->sh->lru);
+    ctx->sh->lru_nodes = 0;
+
+    ngx_http_vhost_traffic_status_shm_lru_init_node(ctx, ctx->rbtree->root);
+
+    ngx_shmtx_unlock(&shpool->mutex);
+}
+
+
+static void
+ngx_http_vhost_traffic_status_shm_fold_node(ngx_http_vhost_traffic_status_ctx_t *ctx,
+    ngx_rbtree_node_t *node)
+{
+    ngx_http_vhost_traffic_status_node_t  *vtsn;
+
+    if (node != ctx->rbtree->sentinel) {
+        vtsn = (ngx_http_vhost_traffic_status_node_t *) &node->color;
+
+        ngx_http_vhost_traffic_status_node_fold(vtsn);
+
+        ngx_http_vhost_traffic_status_shm_fold_node(ctx, node->left);
+        ngx_http_vhost_traffic_status_shm_fold_node(ctx, node->right);
+    }
+}
+
+
+/* the zone lock is held */
+void
+ngx_http_vhost_traffic_status_shm_fold(ngx_http_vhost_traffic_status_ctx_t *ctx)
+{
+    if (ctx->sh->workers == NULL) {
+        return;
+    }
+
+    ngx_http_vhost_traffic_status_shm_fold_node(ctx, ctx->rbtree->root);
+}
 
 
 void
@@ -42,6 +444,17 @@ ngx_http_vhost_traffic_status_shm_info_node(ngx_http_request_t *r,
                + offsetof(ngx_http_vhost_traffic_status_node_t, data)
                + vtsn->len;
 
+        if (vtsn->stat_upstream.type == NGX_HTTP_VHOST_TRAFFIC_STATUS_UPSTREAM_FG) {
+            size += ngx_http_vhost_traffic_status_node_lru_size();
+        }
+
+        if (vtsn->slots) {
+            size += ngx_http_vhost_traffic_status_node_slots_size(
+                        ngx_http_vhost_traffic_status_node_slots(vtsn)->n,
+                        vtsn->stat_request_buckets.len
+                        + vtsn->stat_upstream.response_buckets.len);
+        }
+
         shm_info->used_size += size;
         shm_info->used_node++;
 
@@ -51,7 +464,7 @@ ngx_http_vhost_traffic_status_shm_info_node(ngx_http_request_t *r,
 
             (void) ngx_http_vhost_traffic_status_node_position_key(&filter, 1);
 
-            if (ngx_http_vhost_traffic_status_filter_max_node_match(r, &filter) == NGX_OK) {
+            if (ngx_http_vhost_traffic_status_filter_max_node_match(ctx, &filter) == NGX_OK) {
                 shm_info->filter_used_size += size;
                 shm_info->filter_used_node++;
             }
@@ -87,10 +500,12 @@ ngx_http_vhost_traffic_status_shm_add_node(ngx_http_request_t *r,
     size_t                                     size;
     unsigned                                   init;
     uint32_t                                   hash;
+    ngx_int_t                                  limited;
     ngx_slab_pool_t                           *shpool;
-    ngx_rbtree_node_t                         *node, *lrun;
+    ngx_rbtree_node_t                         *node;
     ngx_http_vhost_traffic_status_ctx_t       *ctx;
     ngx_http_vhost_traffic_status_node_t      *vtsn;
+    ngx_http_vhost_traffic_status_node_lru_t  *lru;
     ngx_http_vhost_traffic_status_loc_conf_t  *vtscf;
     ngx_http_vhost_traffic_status_shm_info_t  *shm_info;
 
@@ -104,32 +519,72 @@ ngx_http_vhost_traffic_status_shm_add_node(ngx_http_request_t *r,
 
     shpool = (ngx_slab_pool_t *) vtscf->shm_zone->shm.addr;
 
+    hash = ngx_crc32_short(key->data, key->len);
+
+    /*
+     * update the per worker slots of an existing node without the lock; the
+     * cache sizes of the cache nodes are set under it
+     */
+    if (ngx_http_vhost_traffic_status_worker != NULL
+        && ngx_http_vhost_traffic_status_worker->epoch != 0
+        && type != NGX_HTTP_VHOST_TRAFFIC_STATUS_UPSTREAM_CC)
+    {
+        node = ngx_http_vhost_traffic_status_node_lookup_lockfree(ctx->rbtree, key, hash);
+
+        if (node != NULL) {
+            vtsn = (ngx_http_vhost_traffic_status_node_t *) &node->color;
+
+            if (vtsn->slots) {
+                if (vtsn->lru) {
+                    lru = ngx_http_vhost_traffic_status_node_lru(vtsn);
+
+                    if (!lru->used) {
+                        lru->used = 1;
+                    }
+                }
+
+                ngx_http_vhost_traffic_status_shm_add_node_slots(r, vtsn, type);
+                return NGX_OK;
+            }
+        }
+    }
+
     ngx_shmtx_lock(&shpool->mutex);
 
     /* find node */
-    hash = ngx_crc32_short(key->data, key->len);
-
     node = ngx_http_vhost_traffic_status_find_node(r, key, type, hash);
 
     /* set common */
     if (node == NULL) {
         init = NGX_HTTP_VHOST_TRAFFIC_STATUS_NODE_NONE;
 
-        /* delete lru node */
-        lrun = ngx_http_vhost_traffic_status_find_lru(r);
-        if (lrun != NULL) {
-            ngx_rbtree_delete(ctx->rbtree, lrun);
-            ngx_slab_free_locked(shpool, lrun);
+        /* delete lru nodes */
+        limited = ngx_http_vhost_traffic_status_shm_lru_match(ctx, key, type);
+        if (limited == NGX_OK) {
+            ngx_http_vhost_traffic_status_shm_lru_expire(ctx, shpool);
         }
 
+        ngx_http_vhost_traffic_status_shm_reclaim(ctx, shpool);
+
         size = offsetof(ngx_rbtree_node_t, color)
                + offsetof(ngx_http_vhost_traffic_status_node_t, data)
                + key->len;
 
+        if (type == NGX_HTTP_VHOST_TRAFFIC_STATUS_UPSTREAM_FG) {
+            size += ngx_http_vhost_traffic_status_node_lru_size();
+        }
+
+        if (ctx->worker_slots) {
+            size += ngx_http_vhost_traffic_status_node_slots_size(ctx->worker_slots_n,
+                        (vtscf->histogram_buckets == NULL)
+                        ? 0 : 2 * vtscf->histogram_buckets->nelts);
+        }
+
         node = ngx_slab_alloc_locked(shpool, size);
         if (node == NULL) {
             shm_info = ngx_pcalloc(r->pool, sizeof(ngx_http_vhost_traffic_status_shm_info_t));
             if (shm_info == NULL) {
+                ngx_shmtx_unlock(&shpool->mutex);
                 return NGX_ERROR;
             }
 
@@ -147,16 +602,36 @@ ngx_http_vhost_traffic_status_shm_add_node(ngx_http_request_t *r,
         vtsn = (ngx_http_vhost_traffic_status_node_t *) &node->color;
 
         node->key = hash;
+        vtsn->slots = 0;
+        vtsn->lru = 0;
         vtsn->len = (u_short) key->len;
         ngx_http_vhost_traffic_status_node_init(r, vtsn);
         vtsn->stat_upstream.type = type;
         ngx_memcpy(vtsn->data, key->data, key->len);
 
-        ngx_rbtree_insert(ctx->rbtree, node);
+        if (ctx->worker_slots) {
+            ngx_http_vhost_traffic_status_node_slots_init(vtsn, ctx->worker_slots_n);
+        }
 
     } else {
+        limited = NGX_DECLINED;
         init = NGX_HTTP_VHOST_TRAFFIC_STATUS_NODE_FIND;
         vtsn = (ngx_http_vhost_traffic_status_node_t *) &node->color;
+
+        ngx_http_vhost_traffic_status_shm_lru_touch(ctx, vtsn);
+
+        if (vtsn->slots) {
+            ngx_http_vhost_traffic_status_shm_add_node_slots(r, vtsn, type);
+
+#if (NGX_HTTP_CACHE)
+            if (type == NGX_HTTP_VHOST_TRAFFIC_STATUS_UPSTREAM_CC) {
+                (void) ngx_http_vhost_traffic_status_shm_add_node_cache(r, vtsn, init);
+            }
+#endif
+
+            goto done;
+        }
+
         ngx_http_vhost_traffic_status_node_set(r, vtsn);
     }
 
@@ -180,6 +655,18 @@ ngx_http_vhost_traffic_status_shm_add_node(ngx_http_request_t *r,
         break;
     }
 
+    /* the node is complete when lock-free readers find it */
+    if (init == NGX_HTTP_VHOST_TRAFFIC_STATUS_NODE_NONE) {
+        ngx_memory_barrier();
+        ngx_rbtree_insert(ctx->rbtree, node);
+
+        if (limited == NGX_OK) {
+            ngx_http_vhost_traffic_status_shm_lru_link(ctx, node);
+        }
+    }
+
+done:
+
     vtscf->node_caches[type] = node;
 
     ngx_shmtx_unlock(&shpool->mutex);
@@ -188,6 +675,68 @@ ngx_http_vhost_traffic_status_shm_add_node(ngx_http_request_t *r,
 }
 
 
+/*
+ * Update a node of per worker slots: the counters with atomic operations and
+ * the time queues under the node lock. A time sample is dropped when another
+ * worker holds the node lock, the counters and histograms are exact.
+ */
+static void
+ngx_http_vhost_traffic_status_shm_add_node_slots(ngx_http_request_t *r,
+    ngx_http_vhost_traffic_status_node_t *vtsn, unsigned type)
+{
+    ngx_uint_t                                   worker;
+    ngx_msec_int_t                               ms, ums;
+    ngx_http_vhost_traffic_status_loc_conf_t    *vtscf;
+    ngx_http_vhost_traffic_status_node_slot_t   *slot;
+    ngx_http_vhost_traffic_status_node_slots_t  *slots;
+
+    vtscf = ngx_http_get_module_loc_conf(r, ngx_http_vhost_traffic_status_module);
+
+    worker = (ngx_http_vhost_traffic_status_worker != NULL)
+             ? ngx_http_vhost_traffic_status_worker_slot
+             : (ngx_uint_t) ngx_worker;
+
+    slot = ngx_http_vhost_traffic_status_node_slot(vtsn, worker);
+
+    ms = ngx_http_vhost_traffic_status_request_time(r);
+    ngx_http_vhost_traffic_status_node_slot_update(r, vtsn, slot, ms);
+
+    ums = 0;
+
+    if (type == NGX_HTTP_VHOST_TRAFFIC_STATUS_UPSTREAM_UA
+        || type == NGX_HTTP_VHOST_TRAFFIC_STATUS_UPSTREAM_UG)
+    {
+        ums = ngx_http_vhost_traffic_status_upstream_response_time(r);
+        ngx_http_vhost_traffic_status_node_slot_upstream(vtsn, slot, ums);
+    }
+
+    slots = ngx_http_vhost_traffic_status_node_slots(vtsn);
+
+    if (ngx_trylock(&slots->lock)) {
+        ngx_http_vhost_traffic_status_node_time_queue_insert(&vtsn->stat_request_times, ms);
+
+        vtsn->stat_request_time = ngx_http_vhost_traffic_status_node_time_queue_average(
+                                      &vtsn->stat_request_times, vtscf->average_method,
+                                      vtscf->average_period);
+
+        if (type == NGX_HTTP_VHOST_TRAFFIC_STATUS_UPSTREAM_UA
+            || type == NGX_HTTP_VHOST_TRAFFIC_STATUS_UPSTREAM_UG)
+        {
+            ngx_http_vhost_traffic_status_node_time_queue_insert(
+                &vtsn->stat_upstream.response_times, ums);
+
+            vtsn->stat_upstream.response_time =
+                ngx_http_vhost_traffic_status_node_time_queue_average(
+                    &vtsn->stat_upstream.response_times, vtscf->average_method,
+                    vtscf->average_period);
+        }
+
+        ngx_memory_barrier();
+        ngx_unlock(&slots->lock);
+    }
+}
+
+
 static ngx_int_t
 ngx_http_vhost_traffic_status_shm_add_node_upstream(ngx_http_request_t *r,
     ngx_http_vhost_traffic_status_node_t *vtsn, unsigned init)
@@ -32,6 +32,24 @@ void ngx_http_vhost_traffic_status_shm_info_node(ngx_http_request_t *r,
 void ngx_http_vhost_traffic_status_shm_info(ngx_http_request_t *r,
     ngx_http_vhost_traffic_status_shm_info_t *shm_info);
 
+ngx_int_t ngx_http_vhost_traffic_status_shm_init_worker(
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_log_t *log);
+void ngx_http_vhost_traffic_status_shm_exit_worker(
+    ngx_http_vhost_traffic_status_ctx_t *ctx);
+ngx_atomic_uint_t ngx_http_vhost_traffic_status_shm_enter(ngx_http_request_t *r);
+void ngx_http_vhost_traffic_status_shm_leave(ngx_http_request_t *r,
+    ngx_atomic_uint_t epoch);
+void ngx_http_vhost_traffic_status_shm_free_node(
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_slab_pool_t *shpool,
+    ngx_rbtree_node_t *node);
+void ngx_http_vhost_traffic_status_shm_reclaim(
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_slab_pool_t *shpool);
+void ngx_http_vhost_traffic_status_shm_fold(ngx_http_vhost_traffic_status_ctx_t *ctx);
+void ngx_http_vhost_traffic_status_shm_lru_insert(
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_rbtree_node_t *node);
+void ngx_http_vhost_traffic_status_shm_lru_init(
+    ngx_http_vhost_traffic_status_ctx_t *ctx, ngx_slab_pool_t *shpool);
+
 
 #endif /* _NGX_HTTP_VTS_SHM_H_INCLUDED_ */
 
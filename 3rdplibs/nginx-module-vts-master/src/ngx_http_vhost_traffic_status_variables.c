@@ -151,6 +151,8 @@ ngx_http_vhost_traffic_status_node_variable(ngx_http_request_t *r,
 
     vtsn = (ngx_http_vhost_traffic_status_node_t *) &node->color;
 
+    ngx_http_vhost_traffic_status_node_fold(vtsn);
+
     v->len = ngx_sprintf(p, "%uA", *((ngx_atomic_t *) ((char *) vtsn + data))) - p;
     v->valid = 1;
     v->no_cacheable = 0;
@@ -0,0 +1,288 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "generator_monitor.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include <utils/utils_logs.h>
+#include <utils/utils_time.h>
+
+// **** Definitions ****
+
+/// Maximum generator CPU utilisation for a run to be valid
+#define GENERATOR_CPU_UTILISATION_MAX 0.9
+
+/// Monitor context structure
+typedef struct generator_monitor_ctx_s {
+    utils_logs_ctx_t *utils_logs_ctx;
+    uint64_t lag_max_usecs;
+    /// Run start (monotonic and process CPU time)
+    uint64_t t0_usecs;
+    uint64_t cpu0_usecs;
+    /// Scheduler state
+    uint64_t sched_usecs;
+    uint64_t sched_slept_usecs;
+    uint64_t sched_end_usecs;
+    uint64_t sched_cpu0_usecs;
+    uint64_t sched_cpu_usecs;
+    uint64_t deadlines_missed;
+    /// Per-request samples
+    std::mutex samples_mutex;
+    std::vector<uint64_t> lags;
+    std::vector<uint64_t> resps;
+    std::vector<uint64_t> thread_cpus;
+    uint64_t responses_2xx;
+    uint64_t responses_other;
+    uint64_t failed;
+    uint64_t last_response_usecs;
+} generator_monitor_ctx_t;
+
+// **** Prototypes ****
+
+static uint64_t percentile(std::vector<uint64_t> &values, double p);
+
+// **** Implementations ****
+
+generator_monitor_ctx_t* generator_monitor_open(uint64_t lag_max_usecs,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    generator_monitor_ctx_t *ctx = new generator_monitor_ctx_t();
+    ctx->utils_logs_ctx = LOG_CTX_GET();
+    ctx->lag_max_usecs = lag_max_usecs;
+    generator_monitor_start(ctx);
+    return ctx;
+}
+
+void generator_monitor_close(generator_monitor_ctx_t **ref_generator_monitor_ctx)
+{
+    if (ref_generator_monitor_ctx == nullptr ||
+            *ref_generator_monitor_ctx == nullptr)
+        return;
+
+    delete *ref_generator_monitor_ctx;
+    *ref_generator_monitor_ctx = nullptr;
+}
+
+void generator_monitor_start(generator_monitor_ctx_t *ctx)
+{
+    LOG_CTX_INIT(nullptr);
+
+    CHECK_DO(ctx != nullptr, return);
+    LOG_CTX_SET(ctx->utils_logs_ctx);
+
+    std::lock_guard<std::mutex> lck(ctx->samples_mutex);
+    ctx->lags.clear();
+    ctx->resps.clear();
+    ctx->thread_cpus.clear();
+    ctx->responses_2xx = ctx->responses_other = ctx->failed = 0;
+    ctx->last_response_usecs = 0;
+    ctx->deadlines_missed = 0;
+    ctx->sched_slept_usecs = 0;
+    ctx->sched_end_usecs = 0;
+    ctx->sched_cpu_usecs = 0;
+    ctx->t0_usecs = utils_gettime_monot_usecs(LOG_CTX_GET());
+    ctx->cpu0_usecs = utils_gettime_process_cputime_usecs(LOG_CTX_GET());
+    ctx->sched_cpu0_usecs = utils_gettime_thread_cputime_usecs(LOG_CTX_GET());
+    ctx->sched_usecs = ctx->t0_usecs;
+}
+
+uint64_t generator_monitor_intended_usecs(generator_monitor_ctx_t *ctx)
+{
+    return ctx != nullptr ? ctx->sched_usecs : 0;
+}
+
+void generator_monitor_wait(generator_monitor_ctx_t *ctx, uint64_t usecs)
+{
+    struct timespec deadline;
+    LOG_CTX_INIT(nullptr);
+
+    CHECK_DO(ctx != nullptr, return);
+    LOG_CTX_SET(ctx->utils_logs_ctx);
+
+    ctx->sched_usecs += usecs;
+    uint64_t now_usecs = utils_gettime_monot_usecs(LOG_CTX_GET());
+    if (now_usecs >= ctx->sched_usecs) {
+        // Already late: the scheduler itself could not keep up
+        if (now_usecs - ctx->sched_usecs > ctx->lag_max_usecs)
+            ctx->deadlines_missed++;
+        return;
+    }
+
+    deadline.tv_sec = ctx->sched_usecs / 1000000;
+    deadline.tv_nsec = (ctx->sched_usecs % 1000000) * 1000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+            nullptr) == EINTR)
+        ;
+    ctx->sched_slept_usecs += utils_gettime_monot_usecs(LOG_CTX_GET()) -
+            now_usecs;
+}
+
+void generator_monitor_sched_end(generator_monitor_ctx_t *ctx)
+{
+    LOG_CTX_INIT(nullptr);
+
+    CHECK_DO(ctx != nullptr, return);
+    LOG_CTX_SET(ctx->utils_logs_ctx);
+
+    ctx->sched_end_usecs = utils_gettime_monot_usecs(LOG_CTX_GET());
+    ctx->sched_cpu_usecs = utils_gettime_thread_cputime_usecs(LOG_CTX_GET()) -
+            ctx->sched_cpu0_usecs;
+}
+
+void generator_monitor_request(generator_monitor_ctx_t *ctx,
+        uint64_t intended_usecs, uint64_t sent_usecs, uint64_t resp_usecs,
+        long http_code, uint64_t thread_cpu_usecs)
+{
+    if (ctx == nullptr)
+        return;
+
+    uint64_t lag_usecs = sent_usecs > intended_usecs ?
+            sent_usecs - intended_usecs : 0;
+
+    std::lock_guard<std::mutex> lck(ctx->samples_mutex);
+    ctx->lags.push_back(lag_usecs);
+    ctx->thread_cpus.push_back(thread_cpu_usecs);
+    if (http_code == 0) {
+        ctx->failed++;
+        return;
+    }
+    if (http_code >= 200 && http_code < 300)
+        ctx->responses_2xx++;
+    else
+        ctx->responses_other++;
+    ctx->resps.push_back(resp_usecs);
+    ctx->last_response_usecs = std::max(ctx->last_response_usecs,
+            sent_usecs + resp_usecs);
+}
+
+int generator_monitor_stop(generator_monitor_ctx_t *ctx,
+        generator_report_t *report)
+{
+    LOG_CTX_INIT(nullptr);
+
+    CHECK_DO(ctx != nullptr && report != nullptr, return -1);
+    LOG_CTX_SET(ctx->utils_logs_ctx);
+
+    uint64_t t1_usecs = utils_gettime_monot_usecs(LOG_CTX_GET());
+    uint64_t cpu1_usecs = utils_gettime_process_cputime_usecs(LOG_CTX_GET());
+    long cpus_num = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus_num < 1)
+        cpus_num = 1;
+    if (ctx->sched_end_usecs == 0)
+        generator_monitor_sched_end(ctx);
+
+    std::lock_guard<std::mutex> lck(ctx->samples_mutex);
+
+    report->requests_num = ctx->lags.size();
+    report->lag_p50_usecs = percentile(ctx->lags, 0.50);
+    report->lag_p99_usecs = percentile(ctx->lags, 0.99);
+    report->lag_max_usecs = percentile(ctx->lags, 1.0);
+    report->resp_p50_usecs = percentile(ctx->resps, 0.50);
+    report->resp_p90_usecs = percentile(ctx->resps, 0.90);
+    report->resp_p99_usecs = percentile(ctx->resps, 0.99);
+    report->resp_max_usecs = percentile(ctx->resps, 1.0);
+    report->responses_2xx = ctx->responses_2xx;
+    report->responses_other = ctx->responses_other;
+    report->failed = ctx->failed;
+    report->throughput_rps = ctx->last_response_usecs > ctx->t0_usecs ?
+            ctx->responses_2xx * 1e6 / (ctx->last_response_usecs -
+            ctx->t0_usecs) : 0;
+    report->deadlines_missed = ctx->deadlines_missed;
+
+    uint64_t sched_span_usecs = ctx->sched_end_usecs - ctx->t0_usecs;
+    report->loop_utilisation = sched_span_usecs > 0 ?
+            (double)(sched_span_usecs - std::min(sched_span_usecs,
+            ctx->sched_slept_usecs)) / sched_span_usecs : 0;
+    report->cpu_utilisation = t1_usecs > ctx->t0_usecs ?
+            (double)(cpu1_usecs - ctx->cpu0_usecs) /
+            ((t1_usecs - ctx->t0_usecs) * cpus_num) : 0;
+    report->sched_cpu_usecs = ctx->sched_cpu_usecs;
+
+    uint64_t thread_cpu_tot_usecs = 0;
+    for (unsigned int i = 0; i < ctx->thread_cpus.size(); i++)
+        thread_cpu_tot_usecs += ctx->thread_cpus[i];
+    report->thread_cpu_avg_usecs = ctx->thread_cpus.empty() ? 0 :
+            thread_cpu_tot_usecs / ctx->thread_cpus.size();
+    report->thread_cpu_max_usecs = percentile(ctx->thread_cpus, 1.0);
+
+    // Verdict: was the client the bottleneck?
+    report->flag_valid = true;
+    report->invalid_reason.clear();
+    if (report->lag_p99_usecs > ctx->lag_max_usecs) {
+        report->flag_valid = false;
+        report->invalid_reason += "send lag p99 " +
+                std::to_string(report->lag_p99_usecs / 1000) + " ms > " +
+                std::to_string(ctx->lag_max_usecs / 1000) + " ms; ";
+    }
+    if (report->deadlines_missed > 0) {
+        report->flag_valid = false;
+        report->invalid_reason += std::to_string(report->deadlines_missed) +
+                " schedule deadlines missed; ";
+    }
+    if (report->cpu_utilisation > GENERATOR_CPU_UTILISATION_MAX) {
+        report->flag_valid = false;
+        report->invalid_reason += "generator CPU utilisation " +
+                std::to_string((int)(report->cpu_utilisation * 100)) + "%; ";
+    }
+    if (!report->invalid_reason.empty())
+        report->invalid_reason.resize(report->invalid_reason.size() - 2);
+    return 0;
+}
+
+void generator_report_print(const generator_report_t &r,
+        const std::string &tag)
+{
+    printf("\nGenerator (%s): %" PRIu64 " requests\n"
+            "  send lag p50/p99/max: %.3f/%.3f/%.3f ms\n"
+            "  response time p50/p99: %.3f/%.3f ms\n"
+            "  scheduler utilisation: %.1f%% (CPU %.3f ms), "
+            "deadlines missed: %" PRIu64 "\n"
+            "  process CPU utilisation: %.1f%%; client thread CPU avg/max: "
+            "%.3f/%.3f ms\n",
+            tag.c_str(), r.requests_num,
+            r.lag_p50_usecs / 1000.0, r.lag_p99_usecs / 1000.0,
+            r.lag_max_usecs / 1000.0,
+            r.resp_p50_usecs / 1000.0, r.resp_p99_usecs / 1000.0,
+            r.loop_utilisation * 100, r.sched_cpu_usecs / 1000.0,
+            r.deadlines_missed, r.cpu_utilisation * 100,
+            r.thread_cpu_avg_usecs / 1000.0, r.thread_cpu_max_usecs / 1000.0);
+    if (!r.flag_valid)
+        printf("  INVALID RUN (client was the bottleneck): %s\n",
+                r.invalid_reason.c_str());
+}
+
+static uint64_t percentile(std::vector<uint64_t> &values, double p)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    size_t i = (size_t)(p * (values.size() - 1) + 0.5);
+    return values[std::min(i, values.size() - 1)];
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file generator_monitor.h
+/// @brief Load generator self-instrumentation.
+///
+/// Tells apart latency caused by nginx from latency caused by the harness
+/// itself. The setting scheduler (the thread running the setting function)
+/// follows an absolute schedule of intended send times; for each request the
+/// monitor tracks:
+/// - the send lag (actual minus intended send time; e.g. thread creation or
+/// a CPU-starved generator),
+/// - the response time and the CPU time of the client thread.
+/// It also tracks the scheduler utilisation (busy fraction between the start
+/// of the setting and the last scheduled burst) and the CPU utilisation of
+/// the whole generator process. A run is flagged as invalid when the client
+/// was the bottleneck.
+
+#ifndef GENERATOR_MONITOR_H_
+#define GENERATOR_MONITOR_H_
+
+#include <inttypes.h>
+#include <string>
+
+// **** Definitions ****
+
+// Forward declarations
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+typedef struct generator_monitor_ctx_s generator_monitor_ctx_t;
+
+/// Generator report of a run
+typedef struct generator_report_s {
+    uint64_t requests_num;
+    /// Requests answered with a 2xx status, with another status or failed
+    uint64_t responses_2xx;
+    uint64_t responses_other;
+    uint64_t failed;
+    /// 2xx responses per second (from the start of the run to the last
+    /// response)
+    double throughput_rps;
+    uint64_t lag_p50_usecs;
+    uint64_t lag_p99_usecs;
+    uint64_t lag_max_usecs;
+    uint64_t resp_p50_usecs;
+    uint64_t resp_p90_usecs;
+    uint64_t resp_p99_usecs;
+    uint64_t resp_max_usecs;
+    /// Number of schedule deadlines the scheduler was late for by more than
+    /// the maximum lag
+    uint64_t deadlines_missed;
+    /// Scheduler busy fraction [0..1]
+    double loop_utilisation;
+    /// Generator process CPU utilisation, relative to all online CPUs [0..1]
+    double cpu_utilisation;
+    uint64_t sched_cpu_usecs;
+    uint64_t thread_cpu_avg_usecs;
+    uint64_t thread_cpu_max_usecs;
+    /// Set to false if the client was the bottleneck
+    bool flag_valid;
+    std::string invalid_reason;
+} generator_report_t;
+
+// **** Prototypes ****
+
+/// Open the generator monitor.
+/// @param lag_max_usecs Maximum send lag (99th percentile) tolerated for a
+/// run to be valid.
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return Pointer to the monitor context structure, NULL if fails.
+generator_monitor_ctx_t* generator_monitor_open(uint64_t lag_max_usecs,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/// Release the generator monitor.
+/// @param ref_generator_monitor_ctx Reference to the pointer to the monitor
+/// context structure. Pointer is set to NULL on return.
+void generator_monitor_close(generator_monitor_ctx_t **ref_generator_monitor_ctx);
+
+/// Reset the monitor and start a new run; the schedule origin is set to now.
+/// Must be called from the scheduler thread.
+void generator_monitor_start(generator_monitor_ctx_t *generator_monitor_ctx);
+
+/// Get the intended send time of the current schedule point.
+/// @return Monotonic time in microseconds.
+uint64_t generator_monitor_intended_usecs(
+        generator_monitor_ctx_t *generator_monitor_ctx);
+
+/// Advance the schedule and sleep until the new deadline (absolute, so that
+/// scheduler delays do not accumulate). Must be called from the scheduler
+/// thread.
+/// @param usecs Schedule advance in microseconds.
+void generator_monitor_wait(generator_monitor_ctx_t *generator_monitor_ctx,
+        uint64_t usecs);
+
+/// Mark the end of the schedule. Must be called from the scheduler thread.
+void generator_monitor_sched_end(
+        generator_monitor_ctx_t *generator_monitor_ctx);
+
+/// Account a finished request (thread-safe). Response times are only
+/// accounted for requests that got a response.
+/// @param intended_usecs Intended send time (see
+/// 'generator_monitor_intended_usecs()').
+/// @param sent_usecs Actual send time (monotonic time in microseconds).
+/// @param resp_usecs Response time in microseconds.
+/// @param http_code Response status code (0 if the request failed).
+/// @param thread_cpu_usecs CPU time consumed by the client thread.
+void generator_monitor_request(generator_monitor_ctx_t *generator_monitor_ctx,
+        uint64_t intended_usecs, uint64_t sent_usecs, uint64_t resp_usecs,
+        long http_code, uint64_t thread_cpu_usecs);
+
+/// Stop the run (call once all the client threads are joined) and compute
+/// its report.
+/// @param generator_report Returned report.
+/// @return 0 if succeed, -1 otherwise.
+int generator_monitor_stop(generator_monitor_ctx_t *generator_monitor_ctx,
+        generator_report_t *generator_report);
+
+/// Print a report to the console.
+/// @param generator_report Report to print.
+/// @param tag Report tag (e.g. the setting title).
+void generator_report_print(const generator_report_t &generator_report,
+        const std::string &tag);
+
+#endif /* GENERATOR_MONITOR_H_ */
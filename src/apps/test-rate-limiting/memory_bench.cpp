@@ -0,0 +1,596 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "memory_bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <utils/utils_logs.h>
+#include <utils/utils_time.h>
+#include <utils/libcurl_wrap.h>
+
+// **** Definitions ****
+
+/// Maximum number of connections being established at a time
+#define MEMBENCH_INFLIGHT_MAX 512
+
+/// Connections per source address (kept below the ephemeral port range
+/// size); source addresses are taken from 127.0.0.1 on
+#define MEMBENCH_CONNS_PER_SRCADDR 20000
+
+/// Time-out to establish each population step
+#define MEMBENCH_OPEN_TOUT_MSECS (60 * 1000)
+
+///@{
+/// Slow readers: tiny receive buffer and paced reads (10 KiB/s)
+#define MEMBENCH_SLOW_RCVBUF 4096
+#define MEMBENCH_SLOW_READ_BYTES 1024
+#define MEMBENCH_SLOW_READ_PERIOD_MSECS 100
+///@}
+
+/// Time let to the workers to settle after each population step
+#define MEMBENCH_SETTLE_MSECS 2000
+
+/// Number of (sequential) normal client requests at each step
+#define MEMBENCH_NORMAL_REQUESTS 20
+
+/// Benchmark connection
+typedef struct bench_conn_s {
+    int fd;
+    enum {CONN_CONNECTING, CONN_WAITING_RESPONSE, CONN_ESTABLISHED} state;
+    bool flag_slow;
+    size_t rcvd; // Response bytes received while waiting the response
+} bench_conn_t;
+
+/// Sample of a population step
+typedef struct bench_sample_s {
+    uint32_t idle_num;
+    uint32_t slow_num;
+    uint64_t rss_kb;
+    uint64_t anon_kb;
+    uint64_t shmem_kb;
+    uint64_t fds_num;
+    double serve_p50_msecs;
+    double serve_p99_msecs;
+    uint32_t serve_failed;
+} bench_sample_t;
+
+/// Benchmark context structure
+typedef struct memory_bench_ctx_s {
+    const memory_bench_params_t *params;
+    volatile int *flag_exit;
+    utils_logs_ctx_t *utils_logs_ctx;
+    int epoll_fd;
+    struct sockaddr_in dst_addr;
+    uint64_t conns_seq; // Used to pick the source address
+    std::vector<int> idle_fds;
+    /// Slow readers, shared with the pacing thread
+    std::vector<int> slow_fds;
+    std::mutex slow_fds_mutex;
+    volatile int flag_exit_reader_thr;
+} memory_bench_ctx_t;
+
+// **** Prototypes ****
+
+static int raise_nofile_limit(uint64_t fds_needed, utils_logs_ctx_t
+        *const utils_logs_ctx);
+static uint32_t conns_open(memory_bench_ctx_t *ctx, uint32_t conns_num,
+        bool flag_slow);
+static int conn_start(memory_bench_ctx_t *ctx, bench_conn_t *conn);
+static void conns_close(std::vector<int> &fds);
+static void slow_readers_thr(memory_bench_ctx_t *ctx);
+static void sample_step(memory_bench_ctx_t *ctx, bench_sample_t *sample);
+static int results_write(const memory_bench_params_t &params,
+        const std::vector<bench_sample_t> &idle_samples,
+        const std::vector<bench_sample_t> &slow_samples);
+static std::vector<uint32_t> steps_get(uint32_t max);
+
+// **** Implementations ****
+
+int memory_bench_create_body(const char *path, size_t size)
+{
+    char block[4096];
+
+    memset(block, 'x', sizeof(block));
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr)
+        return -1;
+    for (size_t written = 0; written < size; written += sizeof(block)) {
+        if (fwrite(block, std::min(sizeof(block), size - written), 1,
+                file) != 1) {
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+int memory_bench_run(const memory_bench_params_t &params,
+        volatile int *flag_exit, utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    memory_bench_ctx_t ctx;
+    std::vector<bench_sample_t> idle_samples, slow_samples;
+    std::thread readerThread;
+    int end_code = -1;
+
+    CHECK_DO(!params.nginx_workers.empty() && flag_exit != nullptr,
+            return -1);
+
+    ctx.params = &params;
+    ctx.flag_exit = flag_exit;
+    ctx.utils_logs_ctx = LOG_CTX_GET();
+    ctx.conns_seq = 0;
+    ctx.flag_exit_reader_thr = 0;
+    memset(&ctx.dst_addr, 0, sizeof(ctx.dst_addr));
+    ctx.dst_addr.sin_family = AF_INET;
+    ctx.dst_addr.sin_port = htons((uint16_t)atoi(params.port));
+    CHECK_DO(inet_pton(AF_INET, params.host, &ctx.dst_addr.sin_addr) == 1,
+            return -1);
+    ctx.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    CHECK_DO(ctx.epoll_fd >= 0, return -1);
+
+    // Both sweeps are run one after the other
+    uint32_t idle_max = params.idle_max, slow_max = params.slow_max;
+    if (raise_nofile_limit(std::max(idle_max, slow_max), LOG_CTX_GET())
+            != 0) {
+        struct rlimit rl;
+        getrlimit(RLIMIT_NOFILE, &rl);
+        uint64_t avail = rl.rlim_cur > 1024 ? rl.rlim_cur - 1024 : 0;
+        idle_max = (uint32_t)std::min<uint64_t>(idle_max, avail);
+        slow_max = (uint32_t)std::min<uint64_t>(slow_max, avail);
+        LOGW("Not enough file descriptors; limiting to %u idle connections "
+                "and %u slow readers\n", idle_max, slow_max);
+    }
+
+    printf("\nMemory benchmark: up to %u idle keep-alive connections and %u "
+            "slow readers\n", idle_max, slow_max);
+    printf("%10s %10s %12s %12s %12s %8s %12s %12s\n", "idle", "slow",
+            "RSS(KiB)", "anon(KiB)", "shmem(KiB)", "fds", "serve-p50(ms)",
+            "serve-p99(ms)");
+
+    // Idle keep-alive connections sweep
+    std::vector<uint32_t> steps = steps_get(idle_max);
+    for (unsigned int i = 0; i < steps.size() && !*flag_exit; i++) {
+        bench_sample_t sample;
+        uint32_t wanted = steps[i] - ctx.idle_fds.size();
+        if (conns_open(&ctx, wanted, false) < wanted)
+            LOGW("Could only establish %zu idle connections\n",
+                    ctx.idle_fds.size());
+        sample_step(&ctx, &sample);
+        idle_samples.push_back(sample);
+    }
+    conns_close(ctx.idle_fds);
+
+    // Slow readers sweep
+    readerThread = std::thread(slow_readers_thr, &ctx);
+    steps = steps_get(slow_max);
+    for (unsigned int i = 0; i < steps.size() && !*flag_exit; i++) {
+        bench_sample_t sample;
+        uint32_t wanted = steps[i] - ctx.slow_fds.size();
+        if (conns_open(&ctx, wanted, true) < wanted)
+            LOGW("Could only establish %zu slow readers\n",
+                    ctx.slow_fds.size());
+        sample_step(&ctx, &sample);
+        slow_samples.push_back(sample);
+    }
+    ctx.flag_exit_reader_thr = 1;
+    readerThread.join();
+    conns_close(ctx.slow_fds);
+
+    if (!*flag_exit)
+        CHECK_DO(results_write(params, idle_samples, slow_samples) == 0,
+                goto end);
+
+    end_code = 0;
+end:
+    close(ctx.epoll_fd);
+    return end_code;
+}
+
+static int raise_nofile_limit(uint64_t fds_needed,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    struct rlimit rl;
+
+    fds_needed += 1024; // Margin for the rest of the application
+    CHECK_DO(getrlimit(RLIMIT_NOFILE, &rl) == 0, return -1);
+    if (rl.rlim_cur >= fds_needed)
+        return 0;
+    rl.rlim_cur = fds_needed;
+    if (rl.rlim_max < fds_needed)
+        rl.rlim_max = fds_needed; // Only succeeds if privileged
+    if (setrlimit(RLIMIT_NOFILE, &rl) == 0)
+        return 0;
+
+    // Fallback: soft limit up to the hard one
+    CHECK_DO(getrlimit(RLIMIT_NOFILE, &rl) == 0, return -1);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    return -1;
+}
+
+/// Establish the given number of connections (non-blocking, at most
+/// MEMBENCH_INFLIGHT_MAX handshakes at a time). Idle connections complete
+/// one request before being considered established; slow readers are
+/// established as soon as their request is sent.
+/// @return Number of connections established.
+static uint32_t conns_open(memory_bench_ctx_t *ctx, uint32_t conns_num,
+        bool flag_slow)
+{
+    std::vector<bench_conn_t> conns(conns_num);
+    struct epoll_event events[64];
+    uint32_t started = 0, inflight = 0, established = 0;
+    LOG_CTX_INIT(ctx->utils_logs_ctx);
+
+    uint64_t tout_msecs = utils_gettime_monot_msecs(LOG_CTX_GET()) +
+            MEMBENCH_OPEN_TOUT_MSECS;
+    while ((started < conns_num || inflight > 0) && !*ctx->flag_exit &&
+            utils_gettime_monot_msecs(LOG_CTX_GET()) < tout_msecs) {
+
+        // Start new handshakes
+        while (started < conns_num && inflight < MEMBENCH_INFLIGHT_MAX) {
+            bench_conn_t *conn = &conns[started++];
+            conn->flag_slow = flag_slow;
+            if (conn_start(ctx, conn) != 0)
+                continue;
+            struct epoll_event ev = {};
+            ev.events = EPOLLOUT;
+            ev.data.ptr = conn;
+            if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) != 0) {
+                close(conn->fd);
+                conn->fd = -1;
+                continue;
+            }
+            inflight++;
+        }
+
+        int events_num = epoll_wait(ctx->epoll_fd, events, 64, 100);
+        for (int e = 0; e < events_num; e++) {
+            bench_conn_t *conn = (bench_conn_t*)events[e].data.ptr;
+            bool flag_done = false, flag_failed = false;
+
+            if (events[e].events & (EPOLLERR | EPOLLHUP)) {
+                flag_failed = true;
+            } else if (conn->state == bench_conn_t::CONN_CONNECTING) {
+                // Connected: send the request (fits in the socket buffer)
+                char req[256];
+                int len = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\n"
+                        "Host: %s\r\n\r\n", flag_slow ?
+                        ctx->params->slow_location :
+                        ctx->params->idle_location, ctx->params->host);
+                if (send(conn->fd, req, len, MSG_NOSIGNAL) != len) {
+                    flag_failed = true;
+                } else if (flag_slow) {
+                    flag_done = true;
+                } else {
+                    struct epoll_event ev = {};
+                    ev.events = EPOLLIN;
+                    ev.data.ptr = conn;
+                    conn->state = bench_conn_t::CONN_WAITING_RESPONSE;
+                    epoll_ctl(ctx->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+                }
+            } else {
+                // Response to the idle-location request (headers only)
+                char buf[1024];
+                ssize_t ret = recv(conn->fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (ret > 0) {
+                    conn->rcvd += ret;
+                    flag_done = memmem(buf, ret, "\r\n\r\n", 4) != nullptr;
+                } else if (ret == 0 || errno != EAGAIN) {
+                    flag_failed = true;
+                }
+            }
+
+            if (flag_done || flag_failed) {
+                epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+                inflight--;
+            }
+            if (flag_failed) {
+                close(conn->fd);
+                conn->fd = -1;
+            } else if (flag_done) {
+                conn->state = bench_conn_t::CONN_ESTABLISHED;
+                established++;
+                if (flag_slow) {
+                    std::lock_guard<std::mutex> lck(ctx->slow_fds_mutex);
+                    ctx->slow_fds.push_back(conn->fd);
+                } else {
+                    ctx->idle_fds.push_back(conn->fd);
+                }
+            }
+        }
+    }
+
+    // Drop the handshakes that did not complete in time
+    for (unsigned int i = 0; i < started; i++) {
+        if (conns[i].fd >= 0 &&
+                conns[i].state != bench_conn_t::CONN_ESTABLISHED) {
+            epoll_ctl(ctx->epoll_fd, EPOLL_CTL_DEL, conns[i].fd, nullptr);
+            close(conns[i].fd);
+        }
+    }
+    return established;
+}
+
+static int conn_start(memory_bench_ctx_t *ctx, bench_conn_t *conn)
+{
+    struct sockaddr_in src_addr;
+    int one = 1;
+
+    conn->state = bench_conn_t::CONN_CONNECTING;
+    conn->rcvd = 0;
+    conn->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (conn->fd < 0)
+        return -1;
+
+    // Spread the connections over several loop-back source addresses to
+    // overcome the ephemeral port range limit (the port is chosen at
+    // 'connect()' time)
+    memset(&src_addr, 0, sizeof(src_addr));
+    src_addr.sin_family = AF_INET;
+    src_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK +
+            (uint32_t)(ctx->conns_seq++ / MEMBENCH_CONNS_PER_SRCADDR));
+    setsockopt(conn->fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one,
+            sizeof(one));
+    if (bind(conn->fd, (struct sockaddr*)&src_addr, sizeof(src_addr)) != 0)
+        goto failed;
+
+    if (conn->flag_slow) {
+        // Throttle the receive window (must be set before connecting)
+        int rcvbuf = MEMBENCH_SLOW_RCVBUF;
+        setsockopt(conn->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+
+    if (connect(conn->fd, (struct sockaddr*)&ctx->dst_addr,
+            sizeof(ctx->dst_addr)) != 0 && errno != EINPROGRESS)
+        goto failed;
+    return 0;
+
+failed:
+    close(conn->fd);
+    conn->fd = -1;
+    return -1;
+}
+
+static void conns_close(std::vector<int> &fds)
+{
+    for (unsigned int i = 0; i < fds.size(); i++)
+        close(fds[i]);
+    fds.clear();
+}
+
+static void slow_readers_thr(memory_bench_ctx_t *ctx)
+{
+    char buf[MEMBENCH_SLOW_READ_BYTES];
+
+    while (!ctx->flag_exit_reader_thr && !*ctx->flag_exit) {
+        {
+            std::lock_guard<std::mutex> lck(ctx->slow_fds_mutex);
+            for (unsigned int i = 0; i < ctx->slow_fds.size(); i++)
+                recv(ctx->slow_fds[i], buf, sizeof(buf), MSG_DONTWAIT);
+        }
+        usleep(MEMBENCH_SLOW_READ_PERIOD_MSECS * 1000);
+    }
+}
+
+static void sample_step(memory_bench_ctx_t *ctx, bench_sample_t *sample)
+{
+    std::vector<uint64_t> serve_usecs;
+    libcurl_wrap_sink_t sink = {};
+    sink.type = LIBCURL_WRAP_SINK_DISCARD;
+    const libcurl_wrap_req_ctx_t libcurl_wrap_req_ctx = {
+            .method = LIBCURL_WRAP_METHOD_GET, .headers = nullptr,
+            .host = ctx->params->host, .port = ctx->params->port,
+            .location = ctx->params->normal_location, .qstring = nullptr,
+            .body = nullptr, .tout = 5, .flag_libcurl_verbose = 0,
+            .sink = &sink, .source = nullptr
+    };
+
+    memset(sample, 0, sizeof(bench_sample_t));
+    sample->idle_num = ctx->idle_fds.size();
+    {
+        std::lock_guard<std::mutex> lck(ctx->slow_fds_mutex);
+        sample->slow_num = ctx->slow_fds.size();
+    }
+
+    usleep(MEMBENCH_SETTLE_MSECS * 1000);
+
+    // Workers memory and file descriptors
+    for (unsigned int w = 0; w < ctx->params->nginx_workers.size(); w++) {
+        char path[64], line[256];
+        pid_t pid = ctx->params->nginx_workers[w];
+
+        snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+        FILE *status = fopen(path, "r");
+        if (status == nullptr)
+            continue;
+        while (fgets(line, sizeof(line), status) != nullptr) {
+            unsigned long kb;
+            if (sscanf(line, "VmRSS: %lu", &kb) == 1)
+                sample->rss_kb += kb;
+            else if (sscanf(line, "RssAnon: %lu", &kb) == 1)
+                sample->anon_kb += kb;
+            else if (sscanf(line, "RssShmem: %lu", &kb) == 1)
+                sample->shmem_kb += kb;
+        }
+        fclose(status);
+
+        snprintf(path, sizeof(path), "/proc/%d/fd", (int)pid);
+        DIR *dir = opendir(path);
+        if (dir == nullptr)
+            continue;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (entry->d_name[0] != '.')
+                sample->fds_num++;
+        }
+        closedir(dir);
+    }
+
+    // Normal clients time-to-serve
+    for (int i = 0; i < MEMBENCH_NORMAL_REQUESTS && !*ctx->flag_exit; i++) {
+        long http_ret_code;
+        char *response_str = nullptr;
+        libcurl_wrap_stats_ctx_t stats_ctx = {};
+
+        if (libcurl_wrap_cli_request(&libcurl_wrap_req_ctx, nullptr,
+                &response_str, &http_ret_code, nullptr, &stats_ctx) != 0 ||
+                http_ret_code != 200)
+            sample->serve_failed++;
+        else
+            serve_usecs.push_back(stats_ctx.time_total_usecs);
+        if (response_str != nullptr)
+            free(response_str);
+    }
+    if (!serve_usecs.empty()) {
+        std::sort(serve_usecs.begin(), serve_usecs.end());
+        sample->serve_p50_msecs = serve_usecs[(serve_usecs.size() - 1) / 2] /
+                1000.0;
+        sample->serve_p99_msecs = serve_usecs[(size_t)(0.99 *
+                (serve_usecs.size() - 1) + 0.5)] / 1000.0;
+    }
+
+    printf("%10u %10u %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %8" PRIu64
+            " %12.3f %12.3f", sample->idle_num, sample->slow_num,
+            sample->rss_kb, sample->anon_kb, sample->shmem_kb,
+            sample->fds_num, sample->serve_p50_msecs,
+            sample->serve_p99_msecs);
+    if (sample->serve_failed > 0)
+        printf(" (%u failed)", sample->serve_failed);
+    printf("\n");
+    fflush(stdout);
+}
+
+static int results_write(const memory_bench_params_t &params,
+        const std::vector<bench_sample_t> &idle_samples,
+        const std::vector<bench_sample_t> &slow_samples)
+{
+    const std::vector<bench_sample_t> *sweeps[2] = {&idle_samples,
+            &slow_samples};
+    const char *sweep_names[2] = {"idle", "slow"};
+    LOG_CTX_INIT(nullptr);
+
+    // Results table (with the per-connection memory cost relative to the
+    // first step of each sweep) and plot data
+    std::string results_path = params.output_prefix + ".txt";
+    FILE *resultsfile = fopen(results_path.c_str(), "wb");
+    CHECK_DO(resultsfile != nullptr, return -1);
+    for (int s = 0; s < 2; s++) {
+        std::string data_path = params.data_prefix + "-" + sweep_names[s] +
+                ".dat";
+        FILE *datafile = fopen(data_path.c_str(), "wb");
+        CHECK_DO(datafile != nullptr, fclose(resultsfile); return -1);
+
+        fprintf(resultsfile, "# %s sweep\n# conns rss_kb anon_kb shmem_kb "
+                "fds bytes_per_conn serve_p50_ms serve_p99_ms failed\n",
+                sweep_names[s]);
+        const std::vector<bench_sample_t> &samples = *sweeps[s];
+        for (unsigned int i = 0; i < samples.size(); i++) {
+            const bench_sample_t &smp = samples[i];
+            uint32_t conns = s == 0 ? smp.idle_num : smp.slow_num;
+            uint32_t conns0 = s == 0 ? samples[0].idle_num :
+                    samples[0].slow_num;
+            double bytes_per_conn = conns > conns0 ?
+                    ((double)smp.rss_kb - samples[0].rss_kb) * 1024 /
+                    (conns - conns0) : 0;
+            const char *fmt = "%u %" PRIu64 " %" PRIu64 " %" PRIu64 " %"
+                    PRIu64 " %.0f %.3f %.3f %u\n";
+            fprintf(resultsfile, fmt, conns, smp.rss_kb, smp.anon_kb,
+                    smp.shmem_kb, smp.fds_num, bytes_per_conn,
+                    smp.serve_p50_msecs, smp.serve_p99_msecs,
+                    smp.serve_failed);
+            // Logarithmic x-axis: the zero-connections step is skipped
+            if (conns > 0)
+                fprintf(datafile, fmt, conns, smp.rss_kb, smp.anon_kb,
+                        smp.shmem_kb, smp.fds_num, bytes_per_conn,
+                        smp.serve_p50_msecs, smp.serve_p99_msecs,
+                        smp.serve_failed);
+        }
+        fprintf(resultsfile, "\n");
+        fclose(datafile);
+    }
+    fclose(resultsfile);
+
+    // Plot
+    FILE *gnuplot = popen("gnuplot", "w");
+    CHECK_DO(gnuplot != nullptr, return -1);
+    fprintf(gnuplot, "set term svg enhanced background rgb 'white' "
+            "size 1720,1440\n");
+    fprintf(gnuplot, "set output '%s_plot.svg'\n",
+            params.output_prefix.c_str());
+    fprintf(gnuplot, "set multiplot layout 2,1 title \"Nginx workers memory "
+            "vs. idle connections and slow readers\" enhanced "
+            "font 'Arial,18'\n");
+    fprintf(gnuplot, "set logscale x\n");
+    fprintf(gnuplot, "set grid\n");
+    fprintf(gnuplot, "set ylabel 'KiB'\n");
+    fprintf(gnuplot, "set y2label 'normal client time-to-serve (ms)'\n");
+    fprintf(gnuplot, "set y2tics\n");
+    fprintf(gnuplot, "set style data linespoints\n");
+    for (int s = 0; s < 2; s++) {
+        std::string data_path = params.data_prefix + "-" + sweep_names[s] +
+                ".dat";
+        fprintf(gnuplot, "set xlabel '%s connections'\n", sweep_names[s]);
+        fprintf(gnuplot, "plot "
+                "'%s' using 1:2 title 'RSS', "
+                "'%s' using 1:3 title 'anonymous', "
+                "'%s' using 1:4 title 'shared memory', "
+                "'%s' using 1:7 axes x1y2 title 'time-to-serve p50', "
+                "'%s' using 1:8 axes x1y2 title 'time-to-serve p99'\n",
+                data_path.c_str(), data_path.c_str(), data_path.c_str(),
+                data_path.c_str(), data_path.c_str());
+    }
+    fprintf(gnuplot, "unset multiplot\n");
+    fflush(gnuplot);
+    pclose(gnuplot);
+
+    printf("\nMemory benchmark results written to '%s'\n",
+            results_path.c_str());
+    return 0;
+}
+
+/// Population steps: 0 and powers of ten up to (and including) the maximum.
+static std::vector<uint32_t> steps_get(uint32_t max)
+{
+    std::vector<uint32_t> steps(1, 0);
+    for (uint64_t step = 10; step < max; step *= 10)
+        steps.push_back((uint32_t)step);
+    if (max > 0)
+        steps.push_back(max);
+    return steps;
+}
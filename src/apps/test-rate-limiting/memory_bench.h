@@ -0,0 +1,92 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file memory_bench.h
+/// @brief Idle-connection and slow-reader memory benchmark.
+///
+/// Measures the per-connection memory cost of the nginx workers and how
+/// their buffers behave under slow readers. Two populations are grown in
+/// geometric steps:
+/// - idle keep-alive connections: each one performs a single request on
+/// the "idle" location and then stays open doing nothing;
+/// - slow readers: connections with a tiny receive buffer (throttled
+/// receive window) requesting a large proxied body and reading it at a
+/// fixed slow pace.
+/// At each step the workers RSS (total, anonymous and shared memory) and
+/// open file descriptors are sampled, and the time-to-serve of a few
+/// normal clients is measured.
+
+#ifndef MEMORY_BENCH_H_
+#define MEMORY_BENCH_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+
+// **** Definitions ****
+
+// Forward declarations
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+
+/// Benchmark parameters
+typedef struct memory_bench_params_s {
+    /// Nginx proxy address
+    const char *host;
+    const char *port;
+    /// Location answering immediately (used by the idle connections)
+    const char *idle_location;
+    /// Location serving a large proxied body (used by the slow readers)
+    const char *slow_location;
+    /// Location used by the normal clients
+    const char *normal_location;
+    /// Nginx worker processes to sample
+    std::vector<pid_t> nginx_workers;
+    /// Maximum number of idle connections and of slow readers
+    uint32_t idle_max;
+    uint32_t slow_max;
+    /// Path prefix of the temporary plot data files
+    std::string data_prefix;
+    /// Path prefix of the results table and plot
+    std::string output_prefix;
+} memory_bench_params_t;
+
+// **** Prototypes ****
+
+/// Create the large body served to the slow readers.
+/// @param path Body file path.
+/// @param size Body size in bytes.
+/// @return 0 if succeed, -1 otherwise.
+int memory_bench_create_body(const char *path, size_t size);
+
+/// Run the benchmark (blocking).
+/// @param params Benchmark parameters.
+/// @param flag_exit Pointer to the application exit flag; the benchmark
+/// returns as soon as it is set.
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return 0 if succeed, -1 otherwise.
+int memory_bench_run(const memory_bench_params_t &params,
+        volatile int *flag_exit, utils_logs_ctx_t *const utils_logs_ctx);
+
+#endif /* MEMORY_BENCH_H_ */
@@ -0,0 +1,381 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "metrics_endpoint.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utils/utils_logs.h>
+
+// **** Definitions ****
+
+/// Exposition text re-rendering period
+#define RENDER_PERIOD_MSECS 250
+
+/// Maximum time a scraper is given to send its request
+#define SCRAPE_RECV_TOUT_MSECS 1000
+
+/// Metric names prefix
+#define METRIC_PREFIX "trl_client_"
+
+/// Histogram buckets upper bounds, in microseconds ("+Inf" bucket implicit)
+static const uint64_t resp_buckets_usecs[] = {1000, 2500, 5000, 10000, 25000,
+        50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000};
+static const uint64_t lag_buckets_usecs[] = {100, 250, 500, 1000, 2500, 5000,
+        10000, 25000, 50000, 100000};
+#define RESP_BUCKETS_NUM (sizeof(resp_buckets_usecs) / sizeof(uint64_t))
+#define LAG_BUCKETS_NUM (sizeof(lag_buckets_usecs) / sizeof(uint64_t))
+
+/// Response status classes
+static const char *status_class_lut[] = {"failed", "1xx", "2xx", "3xx",
+        "4xx", "5xx"};
+#define STATUS_CLASSES_NUM (sizeof(status_class_lut) / sizeof(char*))
+
+/// Endpoint context structure
+typedef struct metrics_endpoint_ctx_s {
+    utils_logs_ctx_t *utils_logs_ctx;
+    int listen_fd;
+    volatile int flag_exit;
+    std::thread server_thread;
+    /// Recorded metrics (non-cumulative histogram buckets)
+    std::atomic<uint64_t> resp_buckets[RESP_BUCKETS_NUM + 1];
+    std::atomic<uint64_t> resp_sum_usecs;
+    std::atomic<uint64_t> lag_buckets[LAG_BUCKETS_NUM + 1];
+    std::atomic<uint64_t> lag_sum_usecs;
+    std::atomic<uint64_t> lag_max_usecs;
+    std::atomic<int64_t> in_flight;
+    std::atomic<uint64_t> responses[STATUS_CLASSES_NUM];
+    /// Scenario marker (rarely written)
+    std::mutex scenario_mutex;
+    std::string scenario;
+    uint32_t trial;
+    double scenario_start_secs;
+    uint64_t scenarios_started;
+    /// Pre-rendered exposition (server thread only)
+    std::string exposition;
+} metrics_endpoint_ctx_t;
+
+// **** Prototypes ****
+
+static void server_thr(metrics_endpoint_ctx_t *ctx);
+static void render(metrics_endpoint_ctx_t *ctx);
+static void render_histogram(std::string &out, const char *name,
+        const char *help, const uint64_t *bounds_usecs, size_t bounds_num,
+        const std::atomic<uint64_t> *buckets, uint64_t sum_usecs);
+static void serve_scrape(metrics_endpoint_ctx_t *ctx, int fd);
+static size_t bucket_index(const uint64_t *bounds_usecs, size_t bounds_num,
+        uint64_t usecs);
+
+// **** Implementations ****
+
+metrics_endpoint_ctx_t* metrics_endpoint_open(const char *port,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    struct sockaddr_in addr = {};
+    int on = 1;
+
+    CHECK_DO(port != nullptr, return nullptr);
+
+    metrics_endpoint_ctx_t *ctx = new metrics_endpoint_ctx_t();
+    ctx->utils_logs_ctx = LOG_CTX_GET();
+    ctx->flag_exit = 0;
+    for (size_t i = 0; i <= RESP_BUCKETS_NUM; i++)
+        ctx->resp_buckets[i] = 0;
+    for (size_t i = 0; i <= LAG_BUCKETS_NUM; i++)
+        ctx->lag_buckets[i] = 0;
+    for (size_t i = 0; i < STATUS_CLASSES_NUM; i++)
+        ctx->responses[i] = 0;
+    ctx->resp_sum_usecs = 0;
+    ctx->lag_sum_usecs = 0;
+    ctx->lag_max_usecs = 0;
+    ctx->in_flight = 0;
+    ctx->trial = 0;
+    ctx->scenario_start_secs = 0;
+    ctx->scenarios_started = 0;
+
+    ctx->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    CHECK_DO(ctx->listen_fd >= 0, goto error);
+    setsockopt(ctx->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)strtoul(port, nullptr, 10));
+    if (bind(ctx->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+            listen(ctx->listen_fd, 16) != 0) {
+        LOGE("Could not listen on metrics port %s: %s\n", port,
+                strerror(errno));
+        goto error;
+    }
+
+    render(ctx);
+    ctx->server_thread = std::thread(server_thr, ctx);
+    return ctx;
+
+error:
+    if (ctx->listen_fd >= 0)
+        close(ctx->listen_fd);
+    delete ctx;
+    return nullptr;
+}
+
+void metrics_endpoint_close(metrics_endpoint_ctx_t **ref_metrics_endpoint_ctx)
+{
+    metrics_endpoint_ctx_t *ctx;
+
+    if (ref_metrics_endpoint_ctx == nullptr ||
+            (ctx = *ref_metrics_endpoint_ctx) == nullptr)
+        return;
+
+    ctx->flag_exit = 1;
+    if (ctx->server_thread.joinable())
+        ctx->server_thread.join();
+    close(ctx->listen_fd);
+    delete ctx;
+    *ref_metrics_endpoint_ctx = nullptr;
+}
+
+void metrics_endpoint_begin(metrics_endpoint_ctx_t *metrics_endpoint_ctx)
+{
+    if (metrics_endpoint_ctx == nullptr)
+        return;
+
+    metrics_endpoint_ctx->in_flight.fetch_add(1, std::memory_order_relaxed);
+}
+
+void metrics_endpoint_end(metrics_endpoint_ctx_t *metrics_endpoint_ctx,
+        uint64_t send_lag_usecs, uint64_t resp_usecs, long http_code)
+{
+    metrics_endpoint_ctx_t *ctx = metrics_endpoint_ctx;
+
+    if (ctx == nullptr)
+        return;
+
+    ctx->in_flight.fetch_sub(1, std::memory_order_relaxed);
+
+    size_t status_class = (http_code >= 100 && http_code < 600) ?
+            (size_t)(http_code / 100) : 0;
+    ctx->responses[status_class].fetch_add(1, std::memory_order_relaxed);
+    if (status_class != 0) {
+        ctx->resp_buckets[bucket_index(resp_buckets_usecs, RESP_BUCKETS_NUM,
+                resp_usecs)].fetch_add(1, std::memory_order_relaxed);
+        ctx->resp_sum_usecs.fetch_add(resp_usecs, std::memory_order_relaxed);
+    }
+
+    ctx->lag_buckets[bucket_index(lag_buckets_usecs, LAG_BUCKETS_NUM,
+            send_lag_usecs)].fetch_add(1, std::memory_order_relaxed);
+    ctx->lag_sum_usecs.fetch_add(send_lag_usecs, std::memory_order_relaxed);
+    uint64_t lag_max = ctx->lag_max_usecs.load(std::memory_order_relaxed);
+    while (send_lag_usecs > lag_max && !ctx->lag_max_usecs.
+            compare_exchange_weak(lag_max, send_lag_usecs,
+            std::memory_order_relaxed));
+}
+
+void metrics_endpoint_scenario(metrics_endpoint_ctx_t *metrics_endpoint_ctx,
+        const std::string &scenario, uint32_t trial)
+{
+    struct timespec ts;
+
+    if (metrics_endpoint_ctx == nullptr)
+        return;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    std::lock_guard<std::mutex> lck(metrics_endpoint_ctx->scenario_mutex);
+    metrics_endpoint_ctx->scenario = scenario;
+    metrics_endpoint_ctx->trial = trial;
+    metrics_endpoint_ctx->scenario_start_secs = (double)ts.tv_sec +
+            (double)ts.tv_nsec / 1000000000;
+    if (!scenario.empty())
+        metrics_endpoint_ctx->scenarios_started++;
+}
+
+static void server_thr(metrics_endpoint_ctx_t *ctx)
+{
+    struct timespec ts;
+    uint64_t next_render_msecs = 0;
+
+    while (!ctx->flag_exit) {
+        struct pollfd pfd = {.fd = ctx->listen_fd, .events = POLLIN,
+                .revents = 0};
+
+        // Re-render periodically, independently of the scrapes
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t now_msecs = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+        if (now_msecs >= next_render_msecs) {
+            render(ctx);
+            next_render_msecs = now_msecs + RENDER_PERIOD_MSECS;
+        }
+
+        if (poll(&pfd, 1, RENDER_PERIOD_MSECS) <= 0)
+            continue;
+        int fd = accept4(ctx->listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        serve_scrape(ctx, fd);
+        close(fd);
+    }
+}
+
+static void render(metrics_endpoint_ctx_t *ctx)
+{
+    char line[512];
+    std::string out;
+
+    out.reserve(ctx->exposition.capacity());
+
+    render_histogram(out, METRIC_PREFIX "request_duration_seconds",
+            "Client-observed response time of the requests answered.",
+            resp_buckets_usecs, RESP_BUCKETS_NUM, ctx->resp_buckets,
+            ctx->resp_sum_usecs);
+    render_histogram(out, METRIC_PREFIX "send_lag_seconds",
+            "Actual minus intended request send time (generator lag).",
+            lag_buckets_usecs, LAG_BUCKETS_NUM, ctx->lag_buckets,
+            ctx->lag_sum_usecs);
+    snprintf(line, sizeof(line), "# HELP " METRIC_PREFIX "send_lag_max_seconds"
+            " Maximum send lag since start.\n"
+            "# TYPE " METRIC_PREFIX "send_lag_max_seconds gauge\n"
+            METRIC_PREFIX "send_lag_max_seconds %.6f\n",
+            (double)ctx->lag_max_usecs / 1000000);
+    out += line;
+
+    snprintf(line, sizeof(line), "# HELP " METRIC_PREFIX "requests_in_flight"
+            " Requests sent and not finished yet.\n"
+            "# TYPE " METRIC_PREFIX "requests_in_flight gauge\n"
+            METRIC_PREFIX "requests_in_flight %" PRId64 "\n",
+            (int64_t)ctx->in_flight);
+    out += line;
+
+    out += "# HELP " METRIC_PREFIX "responses_total Finished requests by "
+            "response status class.\n"
+            "# TYPE " METRIC_PREFIX "responses_total counter\n";
+    for (size_t i = 0; i < STATUS_CLASSES_NUM; i++) {
+        snprintf(line, sizeof(line), METRIC_PREFIX "responses_total"
+                "{class=\"%s\"} %" PRIu64 "\n", status_class_lut[i],
+                (uint64_t)ctx->responses[i]);
+        out += line;
+    }
+
+    {
+        std::lock_guard<std::mutex> lck(ctx->scenario_mutex);
+        out += "# HELP " METRIC_PREFIX "scenario_info Scenario being played "
+                "(empty when idle).\n"
+                "# TYPE " METRIC_PREFIX "scenario_info gauge\n"
+                METRIC_PREFIX "scenario_info{scenario=\"" + ctx->scenario +
+                "\",trial=\"" + std::to_string(ctx->trial) + "\"} 1\n";
+        snprintf(line, sizeof(line), "# HELP " METRIC_PREFIX
+                "scenario_start_time_seconds Unix time the current scenario "
+                "(or idle period) started.\n"
+                "# TYPE " METRIC_PREFIX "scenario_start_time_seconds gauge\n"
+                METRIC_PREFIX "scenario_start_time_seconds %.3f\n"
+                "# HELP " METRIC_PREFIX "scenarios_started_total Scenario "
+                "trials started.\n"
+                "# TYPE " METRIC_PREFIX "scenarios_started_total counter\n"
+                METRIC_PREFIX "scenarios_started_total %" PRIu64 "\n",
+                ctx->scenario_start_secs, ctx->scenarios_started);
+        out += line;
+    }
+
+    ctx->exposition.swap(out);
+}
+
+static void render_histogram(std::string &out, const char *name,
+        const char *help, const uint64_t *bounds_usecs, size_t bounds_num,
+        const std::atomic<uint64_t> *buckets, uint64_t sum_usecs)
+{
+    char line[256];
+    uint64_t cumulative = 0;
+
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n", name,
+            help, name);
+    out += line;
+    for (size_t i = 0; i <= bounds_num; i++) {
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+        if (i < bounds_num)
+            snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %" PRIu64 "\n",
+                    name, (double)bounds_usecs[i] / 1000000, cumulative);
+        else
+            snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %" PRIu64
+                    "\n", name, cumulative);
+        out += line;
+    }
+    snprintf(line, sizeof(line), "%s_sum %.6f\n%s_count %" PRIu64 "\n", name,
+            (double)sum_usecs / 1000000, name, cumulative);
+    out += line;
+}
+
+static void serve_scrape(metrics_endpoint_ctx_t *ctx, int fd)
+{
+    char request[1024] = {0};
+    size_t len = 0;
+    std::string response;
+    struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+
+    // Read the request head (the body, if any, is ignored)
+    while (len < sizeof(request) - 1 && strstr(request, "\r\n\r\n") ==
+            nullptr) {
+        if (poll(&pfd, 1, SCRAPE_RECV_TOUT_MSECS) <= 0)
+            return;
+        ssize_t ret = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+        if (ret <= 0)
+            return;
+        len += ret;
+        request[len] = '\0';
+    }
+
+    if (strncmp(request, "GET /metrics ", 13) == 0 ||
+            strncmp(request, "GET /metrics?", 13) == 0) {
+        response = "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/plain; version=0.0.4\r\n"
+                "Content-Length: " + std::to_string(ctx->exposition.size()) +
+                "\r\nConnection: close\r\n\r\n" + ctx->exposition;
+    } else {
+        response = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n"
+                "Connection: close\r\n\r\n";
+    }
+
+    for (size_t sent = 0; sent < response.size();) {
+        ssize_t ret = send(fd, response.data() + sent, response.size() - sent,
+                MSG_NOSIGNAL);
+        if (ret <= 0)
+            return;
+        sent += ret;
+    }
+}
+
+static size_t bucket_index(const uint64_t *bounds_usecs, size_t bounds_num,
+        uint64_t usecs)
+{
+    size_t i = 0;
+    while (i < bounds_num && usecs > bounds_usecs[i])
+        i++;
+    return i;
+}
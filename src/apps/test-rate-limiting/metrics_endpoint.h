@@ -0,0 +1,81 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file metrics_endpoint.h
+/// @brief Embedded Prometheus metrics endpoint of the load generator.
+///
+/// Exposes the client-observed view of the test (response time and send lag
+/// histograms, requests in flight, responses by status class and scenario
+/// markers) in the Prometheus text exposition format, so that it can be
+/// scraped and shown next to the nginx-side metrics (VTS and exporters).
+///
+/// Recording only touches atomic counters (no locks, no allocations). The
+/// exposition text is rendered periodically by a dedicated server thread;
+/// a scrape just sends the last rendered buffer, so scraping does not
+/// perturb the generator.
+/// All the recording functions are no-ops on a null instance.
+
+#ifndef METRICS_ENDPOINT_H_
+#define METRICS_ENDPOINT_H_
+
+#include <inttypes.h>
+#include <string>
+
+// **** Definitions ****
+
+// Forward declarations
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+typedef struct metrics_endpoint_ctx_s metrics_endpoint_ctx_t;
+
+// **** Prototypes ****
+
+/// Start serving the metrics at 'http://<any address>:<port>/metrics'.
+/// @param port Listening TCP port.
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return Pointer to the endpoint context structure, NULL if fails.
+metrics_endpoint_ctx_t* metrics_endpoint_open(const char *port,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/// Stop serving and release the endpoint.
+/// @param ref_metrics_endpoint_ctx Reference to the pointer to the endpoint
+/// context structure. Pointer is set to NULL on return.
+void metrics_endpoint_close(metrics_endpoint_ctx_t **ref_metrics_endpoint_ctx);
+
+/// Account a request being sent (in-flight until 'metrics_endpoint_end()').
+void metrics_endpoint_begin(metrics_endpoint_ctx_t *metrics_endpoint_ctx);
+
+/// Account a finished request.
+/// @param send_lag_usecs Actual minus intended send time.
+/// @param resp_usecs Response time.
+/// @param http_code HTTP status, zero if the request failed.
+void metrics_endpoint_end(metrics_endpoint_ctx_t *metrics_endpoint_ctx,
+        uint64_t send_lag_usecs, uint64_t resp_usecs, long http_code);
+
+/// Set the scenario marker.
+/// @param scenario Scenario (setting) being played; empty when idle.
+/// @param trial Trial number of the scenario.
+void metrics_endpoint_scenario(metrics_endpoint_ctx_t *metrics_endpoint_ctx,
+        const std::string &scenario, uint32_t trial);
+
+#endif /* METRICS_ENDPOINT_H_ */
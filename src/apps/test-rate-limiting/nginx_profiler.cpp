@@ -0,0 +1,580 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "nginx_profiler.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <elf.h>
+#include <cxxabi.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <utils/utils_logs.h>
+#include <utils/utils_perf.h>
+
+// **** Definitions ****
+
+/// Flame-graph geometry
+#define FLAMEGRAPH_WIDTH 1200
+#define FLAMEGRAPH_FRAME_HEIGHT 16
+#define FLAMEGRAPH_FONT_SIZE 12
+#define FLAMEGRAPH_FONT_WIDTH 0.59
+#define FLAMEGRAPH_PAD_TOP 50
+#define FLAMEGRAPH_PAD_BOTTOM 20
+#define FLAMEGRAPH_MIN_WIDTH_PX 0.1
+
+/// Lowest kernel-space address on x86-64
+#define KERNEL_ADDR_MIN 0xffff800000000000ULL
+
+/// Function symbol of an ELF image
+typedef struct elf_symbol_s {
+    uint64_t addr;
+    uint64_t size;
+    std::string name;
+} elf_symbol_t;
+
+/// Loadable segment of an ELF image (used to translate file offsets into
+/// symbol virtual addresses)
+typedef struct elf_segment_s {
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t filesz;
+} elf_segment_t;
+
+/// Symbol table of an ELF image (sorted by address)
+typedef struct elf_image_s {
+    std::vector<elf_symbol_t> symbols;
+    std::vector<elf_segment_t> segments;
+} elf_image_t;
+
+/// Executable memory mapping of a profiled process
+typedef struct proc_mapping_s {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    std::string path;
+} proc_mapping_t;
+
+/// Profiler context structure
+typedef struct nginx_profiler_ctx_s {
+    utils_logs_ctx_t *utils_logs_ctx;
+    utils_perf_sampler_ctx_t *utils_perf_sampler_ctx;
+    std::thread pollingThread;
+    volatile int flag_exit;
+    uint64_t samples_cnt;
+    uint64_t lost_cnt;
+    /// Raw call-chains (leaf first, first element is the PID) and counts
+    std::map<std::vector<uint64_t>, uint64_t> stacks;
+    /// Executable mappings of each profiled process, captured at start
+    std::map<pid_t, std::vector<proc_mapping_t> > mappings;
+    /// ELF images symbol tables, indexed by path
+    std::map<std::string, elf_image_t> images;
+    /// Kernel symbols (if readable)
+    std::vector<elf_symbol_t> kallsyms;
+} nginx_profiler_ctx_t;
+
+/// Flame-graph tree node
+typedef struct flame_node_s {
+    std::string name;
+    uint64_t value;
+    std::map<std::string, size_t> children; // Name to node index
+} flame_node_t;
+
+// **** Prototypes ****
+
+static void polling_thr(nginx_profiler_ctx_t *ctx);
+static void sample_cb(void *opaque, pid_t pid, pid_t tid, const uint64_t *ips,
+        uint32_t ips_num);
+static void nginx_profiler_stop(nginx_profiler_ctx_t *ctx);
+static std::vector<proc_mapping_t> proc_mappings_load(pid_t pid);
+static void elf_image_load(const std::string &path, elf_image_t &image);
+static void kallsyms_load(std::vector<elf_symbol_t> &kallsyms);
+static std::string symbolize(nginx_profiler_ctx_t *ctx, pid_t pid,
+        uint64_t ip, bool is_return_addr);
+static int flamegraph_write(const std::map<std::string, uint64_t> &folded,
+        const std::string &svg_path, const std::string &title);
+
+// **** Implementations ****
+
+nginx_profiler_ctx_t* nginx_profiler_open(const std::vector<pid_t> &pids,
+        uint32_t freq_hz, utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    CHECK_DO(!pids.empty() && freq_hz > 0, return nullptr);
+
+    nginx_profiler_ctx_t *ctx = new nginx_profiler_ctx_t();
+    ctx->utils_logs_ctx = LOG_CTX_GET();
+    ctx->flag_exit = 0;
+    ctx->samples_cnt = 0;
+    ctx->lost_cnt = 0;
+
+    // Capture the address-space layout now: workers may exit before we
+    // symbolize (nginx is stopped right after each scenario)
+    for (unsigned int i = 0; i < pids.size(); i++)
+        ctx->mappings[pids[i]] = proc_mappings_load(pids[i]);
+
+    ctx->utils_perf_sampler_ctx = utils_perf_sampler_open(pids.data(),
+            pids.size(), freq_hz, LOG_CTX_GET());
+    if (ctx->utils_perf_sampler_ctx == nullptr) {
+        LOGE("Could not start profiling nginx workers\n");
+        delete ctx;
+        return nullptr;
+    }
+
+    ctx->pollingThread = std::thread(polling_thr, ctx);
+    return ctx;
+}
+
+void nginx_profiler_close(nginx_profiler_ctx_t **ref_nginx_profiler_ctx)
+{
+    nginx_profiler_ctx_t *ctx;
+
+    if (ref_nginx_profiler_ctx == nullptr ||
+            (ctx = *ref_nginx_profiler_ctx) == nullptr)
+        return;
+
+    nginx_profiler_stop(ctx);
+    delete ctx;
+    *ref_nginx_profiler_ctx = nullptr;
+}
+
+int nginx_profiler_dump(nginx_profiler_ctx_t *ctx,
+        const std::string &folded_path, const std::string &svg_path,
+        const std::string &title)
+{
+    std::map<std::string, uint64_t> folded;
+    LOG_CTX_INIT(nullptr);
+
+    CHECK_DO(ctx != nullptr, return -1);
+    LOG_CTX_SET(ctx->utils_logs_ctx);
+
+    nginx_profiler_stop(ctx);
+
+    if (ctx->kallsyms.empty())
+        kallsyms_load(ctx->kallsyms);
+
+    // Symbolize and fold stacks (root frame first)
+    for (std::map<std::vector<uint64_t>, uint64_t>::const_iterator it =
+            ctx->stacks.begin(); it != ctx->stacks.end(); ++it) {
+        const std::vector<uint64_t> &chain = it->first;
+        pid_t pid = (pid_t)chain[0];
+        std::string line = "nginx";
+
+        for (size_t i = chain.size() - 1; i >= 1; i--) {
+            line += ';';
+            line += symbolize(ctx, pid, chain[i], i > 1);
+        }
+        folded[line] += it->second;
+    }
+
+    FILE *foldedfile = fopen(folded_path.c_str(), "wb");
+    CHECK_DO(foldedfile != nullptr, return -1);
+    for (std::map<std::string, uint64_t>::const_iterator it = folded.begin();
+            it != folded.end(); ++it)
+        fprintf(foldedfile, "%s %" PRIu64 "\n", it->first.c_str(), it->second);
+    fclose(foldedfile);
+
+    printf("\nProfile: %" PRIu64 " samples (%" PRIu64 " lost) written to "
+            "'%s'\n", ctx->samples_cnt, ctx->lost_cnt, svg_path.c_str());
+
+    CHECK_DO(flamegraph_write(folded, svg_path, title) == 0, return -1);
+    return 0;
+}
+
+static void polling_thr(nginx_profiler_ctx_t *ctx)
+{
+    while (!ctx->flag_exit) {
+        if (utils_perf_sampler_poll(ctx->utils_perf_sampler_ctx, 100,
+                sample_cb, ctx) < 0)
+            break;
+    }
+    // Drain what is left
+    utils_perf_sampler_poll(ctx->utils_perf_sampler_ctx, 0, sample_cb, ctx);
+}
+
+static void sample_cb(void *opaque, pid_t pid, pid_t tid, const uint64_t *ips,
+        uint32_t ips_num)
+{
+    nginx_profiler_ctx_t *ctx = (nginx_profiler_ctx_t*)opaque;
+    std::vector<uint64_t> chain(ips_num + 1);
+
+    chain[0] = (uint64_t)pid;
+    std::copy(ips, ips + ips_num, chain.begin() + 1);
+    ctx->stacks[chain]++;
+    ctx->samples_cnt++;
+}
+
+static void nginx_profiler_stop(nginx_profiler_ctx_t *ctx)
+{
+    ctx->flag_exit = 1;
+    if (ctx->pollingThread.joinable())
+        ctx->pollingThread.join();
+    if (ctx->utils_perf_sampler_ctx != nullptr)
+        ctx->lost_cnt = utils_perf_sampler_lost(ctx->utils_perf_sampler_ctx);
+    utils_perf_sampler_close(&ctx->utils_perf_sampler_ctx);
+}
+
+static std::vector<proc_mapping_t> proc_mappings_load(pid_t pid)
+{
+    std::vector<proc_mapping_t> mappings;
+    char path[64], line[1024];
+
+    snprintf(path, sizeof(path), "/proc/%d/maps", (int)pid);
+    FILE *mapsfile = fopen(path, "r");
+    if (mapsfile == nullptr)
+        return mappings;
+
+    while (fgets(line, sizeof(line), mapsfile) != nullptr) {
+        unsigned long long start, end, offset;
+        char perms[8], file[PATH_MAX + 1] = {0};
+
+        if (sscanf(line, "%llx-%llx %7s %llx %*s %*s %4096s", &start, &end,
+                perms, &offset, file) < 4)
+            continue;
+        if (perms[2] != 'x' || file[0] != '/')
+            continue;
+        proc_mapping_t mapping = {start, end, offset, file};
+        mappings.push_back(mapping);
+    }
+    fclose(mapsfile);
+
+    std::sort(mappings.begin(), mappings.end(),
+            [](const proc_mapping_t &a, const proc_mapping_t &b) {
+                return a.start < b.start; });
+    return mappings;
+}
+
+static void elf_image_load(const std::string &path, elf_image_t &image)
+{
+    struct stat st;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Elf64_Ehdr)) {
+        close(fd);
+        return;
+    }
+    const uint8_t *base = (const uint8_t*)mmap(nullptr, st.st_size, PROT_READ,
+            MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return;
+
+    const size_t size = st.st_size;
+    const Elf64_Ehdr *ehdr = (const Elf64_Ehdr*)base;
+    if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+            ehdr->e_ident[EI_CLASS] != ELFCLASS64 ||
+            ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf64_Phdr) > size ||
+            ehdr->e_shoff + ehdr->e_shnum * sizeof(Elf64_Shdr) > size) {
+        munmap((void*)base, size);
+        return;
+    }
+
+    // Loadable segments
+    const Elf64_Phdr *phdrs = (const Elf64_Phdr*)(base + ehdr->e_phoff);
+    for (int i = 0; i < ehdr->e_phnum; i++) {
+        if (phdrs[i].p_type != PT_LOAD)
+            continue;
+        elf_segment_t segment = {phdrs[i].p_offset, phdrs[i].p_vaddr,
+                phdrs[i].p_filesz};
+        image.segments.push_back(segment);
+    }
+
+    // Function symbols; prefer the complete table ('.symtab') over the
+    // dynamic one, which only has exported symbols
+    const Elf64_Shdr *shdrs = (const Elf64_Shdr*)(base + ehdr->e_shoff);
+    for (Elf64_Word type : {SHT_SYMTAB, SHT_DYNSYM}) {
+        for (int i = 0; i < ehdr->e_shnum && image.symbols.empty(); i++) {
+            const Elf64_Shdr &shdr = shdrs[i];
+            if (shdr.sh_type != type || shdr.sh_link >= ehdr->e_shnum ||
+                    shdr.sh_offset + shdr.sh_size > size)
+                continue;
+            const Elf64_Shdr &strtab = shdrs[shdr.sh_link];
+            if (strtab.sh_offset + strtab.sh_size > size)
+                continue;
+            const Elf64_Sym *syms = (const Elf64_Sym*)(base + shdr.sh_offset);
+            const char *strs = (const char*)(base + strtab.sh_offset);
+            for (size_t s = 0; s < shdr.sh_size / sizeof(Elf64_Sym); s++) {
+                if (ELF64_ST_TYPE(syms[s].st_info) != STT_FUNC ||
+                        syms[s].st_value == 0 ||
+                        syms[s].st_name >= strtab.sh_size)
+                    continue;
+                elf_symbol_t symbol = {syms[s].st_value, syms[s].st_size,
+                        strs + syms[s].st_name};
+                image.symbols.push_back(symbol);
+            }
+        }
+    }
+    munmap((void*)base, size);
+
+    std::sort(image.symbols.begin(), image.symbols.end(),
+            [](const elf_symbol_t &a, const elf_symbol_t &b) {
+                return a.addr < b.addr; });
+}
+
+static void kallsyms_load(std::vector<elf_symbol_t> &kallsyms)
+{
+    char line[512];
+    bool all_zero = true;
+
+    FILE *kallsymsfile = fopen("/proc/kallsyms", "r");
+    if (kallsymsfile == nullptr)
+        return;
+    while (fgets(line, sizeof(line), kallsymsfile) != nullptr) {
+        unsigned long long addr;
+        char type, name[256];
+        if (sscanf(line, "%llx %c %255s", &addr, &type, name) != 3)
+            continue;
+        if (type != 't' && type != 'T')
+            continue;
+        elf_symbol_t symbol = {addr, 0, name};
+        kallsyms.push_back(symbol);
+        all_zero &= (addr == 0);
+    }
+    fclose(kallsymsfile);
+
+    // Addresses are hidden to unprivileged readers ('kptr_restrict')
+    if (all_zero)
+        kallsyms.clear();
+    std::sort(kallsyms.begin(), kallsyms.end(),
+            [](const elf_symbol_t &a, const elf_symbol_t &b) {
+                return a.addr < b.addr; });
+}
+
+/// Find the symbol containing the given address (symbols sorted by address).
+/// Symbols of unknown size are assumed to span up to the next symbol.
+static const elf_symbol_t* symbol_find(const std::vector<elf_symbol_t> &syms,
+        uint64_t addr)
+{
+    std::vector<elf_symbol_t>::const_iterator it = std::upper_bound(
+            syms.begin(), syms.end(), addr,
+            [](uint64_t a, const elf_symbol_t &s) { return a < s.addr; });
+    if (it == syms.begin())
+        return nullptr;
+    --it;
+    if (it->size != 0 && addr >= it->addr + it->size)
+        return nullptr;
+    return &(*it);
+}
+
+static std::string symbol_name(const std::string &name)
+{
+    int status = -1;
+    char *demangled = abi::__cxa_demangle(name.c_str(), nullptr, nullptr,
+            &status);
+    if (status != 0 || demangled == nullptr)
+        return name;
+    std::string ret = demangled;
+    free(demangled);
+    return ret;
+}
+
+static std::string symbolize(nginx_profiler_ctx_t *ctx, pid_t pid,
+        uint64_t ip, bool is_return_addr)
+{
+    // Return addresses point to the instruction following the call; step
+    // back into the call instruction so we do not resolve into the next
+    // function
+    uint64_t addr = is_return_addr ? ip - 1 : ip;
+
+    if (addr >= KERNEL_ADDR_MIN) {
+        const elf_symbol_t *sym = symbol_find(ctx->kallsyms, addr);
+        return (sym != nullptr ? sym->name : std::string("[kernel]")) + "_[k]";
+    }
+
+    const std::vector<proc_mapping_t> &mappings = ctx->mappings[pid];
+    std::vector<proc_mapping_t>::const_iterator map = std::upper_bound(
+            mappings.begin(), mappings.end(), addr,
+            [](uint64_t a, const proc_mapping_t &m) { return a < m.start; });
+    if (map == mappings.begin() || addr >= (--map)->end)
+        return "[unknown]";
+
+    std::map<std::string, elf_image_t>::iterator image =
+            ctx->images.find(map->path);
+    if (image == ctx->images.end()) {
+        image = ctx->images.insert(std::make_pair(map->path,
+                elf_image_t())).first;
+        elf_image_load(map->path, image->second);
+    }
+
+    // Mapped address -> file offset -> symbol virtual address
+    uint64_t file_offset = addr - map->start + map->offset;
+    const std::vector<elf_segment_t> &segments = image->second.segments;
+    for (unsigned int i = 0; i < segments.size(); i++) {
+        if (file_offset < segments[i].offset ||
+                file_offset >= segments[i].offset + segments[i].filesz)
+            continue;
+        uint64_t vaddr = file_offset - segments[i].offset + segments[i].vaddr;
+        const elf_symbol_t *sym = symbol_find(image->second.symbols, vaddr);
+        if (sym != nullptr)
+            return symbol_name(sym->name);
+        break;
+    }
+
+    const char *basename = strrchr(map->path.c_str(), '/');
+    std::string name("[");
+    name += basename != nullptr ? basename + 1 : map->path.c_str();
+    return name + "]";
+}
+
+static std::string svg_escape(const std::string &str)
+{
+    std::string ret;
+    for (unsigned int i = 0; i < str.size(); i++) {
+        switch (str[i]) {
+        case '<': ret += "&lt;"; break;
+        case '>': ret += "&gt;"; break;
+        case '&': ret += "&amp;"; break;
+        case '"': ret += "&quot;"; break;
+        default: ret += str[i]; break;
+        }
+    }
+    return ret;
+}
+
+/// Classic flame-graph "hot" palette; colour is a function of the frame name
+/// so that the same function keeps its colour across scenarios
+static void flamegraph_color(const std::string &name, int *r, int *g, int *b)
+{
+    uint32_t hash = 2166136261u; // FNV-1a
+    for (unsigned int i = 0; i < name.size(); i++)
+        hash = (hash ^ (uint8_t)name[i]) * 16777619u;
+    double v1 = (hash & 0xff) / 255.0, v2 = ((hash >> 8) & 0xff) / 255.0;
+    *r = 205 + (int)(50 * v2);
+    *g = (int)(230 * v1);
+    *b = (int)(55 * v2);
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, "_[k]") == 0) {
+        *g = 140 + (int)(60 * v1); // Kernel frames in orange
+        *b = 0;
+    }
+}
+
+static int flamegraph_write(const std::map<std::string, uint64_t> &folded,
+        const std::string &svg_path, const std::string &title)
+{
+    std::vector<flame_node_t> nodes(1);
+    int depth_max = 0;
+
+    // Build the frames tree (node 0 is the root: "all")
+    nodes[0].name = "all";
+    nodes[0].value = 0;
+    for (std::map<std::string, uint64_t>::const_iterator it = folded.begin();
+            it != folded.end(); ++it) {
+        size_t node = 0, pos = 0;
+        int depth = 0;
+        nodes[0].value += it->second;
+        while (pos != std::string::npos) {
+            size_t next = it->first.find(';', pos);
+            std::string frame = it->first.substr(pos, next == std::string::npos
+                    ? std::string::npos : next - pos);
+            pos = next == std::string::npos ? next : next + 1;
+
+            std::map<std::string, size_t>::iterator child =
+                    nodes[node].children.find(frame);
+            if (child == nodes[node].children.end()) {
+                flame_node_t new_node;
+                new_node.name = frame;
+                new_node.value = 0;
+                nodes.push_back(new_node);
+                child = nodes[node].children.insert(std::make_pair(frame,
+                        nodes.size() - 1)).first;
+            }
+            node = child->second;
+            nodes[node].value += it->second;
+            depth++;
+        }
+        depth_max = std::max(depth_max, depth);
+    }
+
+    FILE *svg = fopen(svg_path.c_str(), "wb");
+    if (svg == nullptr)
+        return -1;
+
+    const int height = FLAMEGRAPH_PAD_TOP + FLAMEGRAPH_PAD_BOTTOM +
+            (depth_max + 1) * FLAMEGRAPH_FRAME_HEIGHT;
+    const double total = nodes[0].value > 0 ? nodes[0].value : 1;
+    fprintf(svg, "<?xml version=\"1.0\" standalone=\"no\"?>\n"
+            "<svg version=\"1.1\" width=\"%d\" height=\"%d\" "
+            "xmlns=\"http://www.w3.org/2000/svg\">\n"
+            "<rect x=\"0\" y=\"0\" width=\"100%%\" height=\"100%%\" "
+            "fill=\"#f8f8f8\"/>\n"
+            "<text x=\"%d\" y=\"24\" text-anchor=\"middle\" "
+            "font-family=\"Verdana\" font-size=\"17\">%s</text>\n"
+            "<text x=\"10\" y=\"%d\" font-family=\"Verdana\" "
+            "font-size=\"%d\">%" PRIu64 " samples</text>\n",
+            FLAMEGRAPH_WIDTH + 20, height, FLAMEGRAPH_WIDTH / 2 + 10,
+            svg_escape(title).c_str(), height - 5, FLAMEGRAPH_FONT_SIZE,
+            nodes[0].value);
+
+    // Depth-first walk; children laid out left to right in name order
+    struct frame_pos { size_t node; double x; int depth; };
+    std::vector<frame_pos> stack(1, frame_pos{0, 10.0, 0});
+    while (!stack.empty()) {
+        frame_pos fp = stack.back();
+        stack.pop_back();
+        const flame_node_t &node = nodes[fp.node];
+        double width = node.value / total * FLAMEGRAPH_WIDTH;
+        if (width < FLAMEGRAPH_MIN_WIDTH_PX)
+            continue;
+
+        int r, g, b;
+        double y = height - FLAMEGRAPH_PAD_BOTTOM -
+                (fp.depth + 1) * FLAMEGRAPH_FRAME_HEIGHT;
+        std::string name = svg_escape(node.name);
+        flamegraph_color(node.name, &r, &g, &b);
+        fprintf(svg, "<g><title>%s (%" PRIu64 " samples, %.2f%%)</title>"
+                "<rect x=\"%.1f\" y=\"%.1f\" width=\"%.1f\" height=\"%d\" "
+                "fill=\"rgb(%d,%d,%d)\" rx=\"2\" ry=\"2\"/>", name.c_str(),
+                node.value, 100.0 * node.value / total, fp.x, y, width,
+                FLAMEGRAPH_FRAME_HEIGHT - 1, r, g, b);
+        size_t chars = (size_t)(width / (FLAMEGRAPH_FONT_SIZE *
+                FLAMEGRAPH_FONT_WIDTH));
+        if (chars >= 3) {
+            std::string label = node.name.size() <= chars ? node.name :
+                    node.name.substr(0, chars - 2) + "..";
+            fprintf(svg, "<text x=\"%.1f\" y=\"%.1f\" font-family=\"Verdana\" "
+                    "font-size=\"%d\">%s</text>", fp.x + 3,
+                    y + FLAMEGRAPH_FRAME_HEIGHT - 4, FLAMEGRAPH_FONT_SIZE,
+                    svg_escape(label).c_str());
+        }
+        fprintf(svg, "</g>\n");
+
+        double x = fp.x;
+        for (std::map<std::string, size_t>::const_iterator it =
+                node.children.begin(); it != node.children.end(); ++it) {
+            stack.push_back(frame_pos{it->second, x, fp.depth + 1});
+            x += nodes[it->second].value / total * FLAMEGRAPH_WIDTH;
+        }
+    }
+
+    fprintf(svg, "</svg>\n");
+    fclose(svg);
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file nginx_profiler.h
+/// @brief Per-scenario sampling profiler of the nginx worker processes.
+///
+/// Samples the CPU-clock of every thread of the given worker processes (see
+/// 'utils/utils_perf.h'), symbolizes the collected call-chains using the ELF
+/// symbol tables of the mapped binaries and outputs them as "folded stacks"
+/// (one 'frame1;frame2;...;leaf count' line per distinct stack) and as a
+/// flame-graph SVG.
+
+#ifndef NGINX_PROFILER_H_
+#define NGINX_PROFILER_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+
+// **** Definitions ****
+
+// Forward declarations
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+typedef struct nginx_profiler_ctx_s nginx_profiler_ctx_t;
+
+// **** Prototypes ****
+
+/// Attach the profiler to the given processes and start sampling (a
+/// dedicated thread drains the sampling buffers until the profiler is
+/// stopped).
+/// @param pids Processes to profile (typically the nginx workers).
+/// @param freq_hz Sampling frequency in Hertz.
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return Pointer to the profiler context structure, NULL if fails.
+nginx_profiler_ctx_t* nginx_profiler_open(const std::vector<pid_t> &pids,
+        uint32_t freq_hz, utils_logs_ctx_t *const utils_logs_ctx);
+
+/// Stop sampling (if not already stopped) and release the profiler.
+/// @param ref_nginx_profiler_ctx Reference to the pointer to the profiler
+/// context structure. Pointer is set to NULL on return.
+void nginx_profiler_close(nginx_profiler_ctx_t **ref_nginx_profiler_ctx);
+
+/// Stop sampling and write the collected profile.
+/// @param nginx_profiler_ctx Pointer to the profiler context structure.
+/// @param folded_path Output path of the folded stacks file.
+/// @param svg_path Output path of the flame-graph SVG file.
+/// @param title Title to be rendered in the flame-graph.
+/// @return 0 if succeed, -1 otherwise.
+int nginx_profiler_dump(nginx_profiler_ctx_t *nginx_profiler_ctx,
+        const std::string &folded_path, const std::string &svg_path,
+        const std::string &title);
+
+#endif /* NGINX_PROFILER_H_ */
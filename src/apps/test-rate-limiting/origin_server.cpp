@@ -0,0 +1,719 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "origin_server.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <utils/utils_logs.h>
+#include <utils/utils_timer.h>
+
+// **** Definitions ****
+
+/// Body filling pattern (the first line is what the nginx origin replies)
+#define BODY_PATTERN "Server 'Origin-1' received HTTP request\n"
+
+/// Maximum request head size (the connection is closed beyond)
+#define REQUEST_HEAD_MAX 16384
+
+/// Response latency resolution
+#define TIMER_TICK_USECS 100
+
+#define EVENTS_MAX 256
+
+/// Route table; shared by the connections serving a response from it, so
+/// that it (and its body file) outlive a concurrent reconfiguration
+typedef struct route_table_s {
+    std::vector<origin_route_t> routes;
+    /// In-memory body file, as large as the largest route body (-1 if none)
+    int body_fd;
+    ~route_table_s() {
+        if (body_fd >= 0)
+            close(body_fd);
+    }
+} route_table_t;
+
+typedef enum conn_state_enum {
+    CONN_READING = 0,
+    CONN_WAITING,
+    CONN_WRITING
+} conn_state_t;
+
+/// Connection
+typedef struct conn_s {
+    int fd;
+    conn_state_t state;
+    /// Received data not yet parsed (pipelined requests)
+    std::string in;
+    /// Response being served
+    std::string head;
+    size_t head_sent;
+    off_t body_off;
+    off_t body_end;
+    std::shared_ptr<route_table_t> table;
+    bool flag_close;
+    bool flag_out;
+    /// Response latency timer (pending in state CONN_WAITING)
+    utils_timer_t timer;
+    struct origin_server_ctx_s *ctx;
+} conn_t;
+
+/// Server context structure
+typedef struct origin_server_ctx_s {
+    utils_logs_ctx_t *utils_logs_ctx;
+    int listen_fd;
+    int epoll_fd;
+    volatile int flag_exit;
+    std::thread server_thread;
+    /// Current route table (swapped by 'origin_server_configure()')
+    std::mutex table_mutex;
+    std::shared_ptr<route_table_t> table;
+    /// Event loop state (server thread only)
+    std::map<int, conn_t*> conns;
+    utils_timer_wheel_t *timer_wheel;
+    std::mt19937_64 rng;
+} origin_server_ctx_t;
+
+// **** Prototypes ****
+
+static std::shared_ptr<route_table_t> route_table_create(
+        const std::vector<origin_route_t> &routes,
+        utils_logs_ctx_t *const utils_logs_ctx);
+static void server_thr(origin_server_ctx_t *ctx);
+static void conn_accept(origin_server_ctx_t *ctx);
+static void conn_read(origin_server_ctx_t *ctx, conn_t *conn);
+static int conn_process(origin_server_ctx_t *ctx, conn_t *conn);
+static int conn_write(origin_server_ctx_t *ctx, conn_t *conn);
+static void conn_close(origin_server_ctx_t *ctx, conn_t *conn);
+static void conn_timer_cb(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer, void *userdata);
+static void request_handle(origin_server_ctx_t *ctx, conn_t *conn,
+        const std::string &req, uint64_t *ref_delay_usecs);
+static const origin_route_t* route_match(const route_table_t *table,
+        const std::string &path);
+static uint64_t latency_sample(origin_server_ctx_t *ctx,
+        const origin_latency_t &latency);
+static int status_sample(origin_server_ctx_t *ctx,
+        const std::vector<std::pair<int, double> > &statuses);
+static const char* status_reason(int status);
+
+// **** Implementations ****
+
+origin_server_ctx_t* origin_server_open(const char *host, const char *port,
+        const std::vector<origin_route_t> &routes,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    struct sockaddr_in addr = {};
+    struct epoll_event ev = {};
+    int on = 1;
+
+    CHECK_DO(host != nullptr && port != nullptr, return nullptr);
+
+    origin_server_ctx_t *ctx = new origin_server_ctx_t();
+    ctx->utils_logs_ctx = LOG_CTX_GET();
+    ctx->flag_exit = 0;
+    ctx->listen_fd = -1;
+    ctx->epoll_fd = -1;
+    ctx->timer_wheel = nullptr;
+    ctx->rng.seed(std::random_device()());
+
+    ctx->table = route_table_create(routes, LOG_CTX_GET());
+    CHECK_DO(ctx->table != nullptr, goto error);
+
+    ctx->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK |
+            SOCK_CLOEXEC, 0);
+    CHECK_DO(ctx->listen_fd >= 0, goto error);
+    setsockopt(ctx->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)strtoul(port, nullptr, 10));
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1) {
+        LOGE("Invalid origin address '%s'\n", host);
+        goto error;
+    }
+    if (bind(ctx->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+            listen(ctx->listen_fd, SOMAXCONN) != 0) {
+        LOGE("Could not listen on origin %s:%s: %s\n", host, port,
+                strerror(errno));
+        goto error;
+    }
+
+    ctx->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    CHECK_DO(ctx->epoll_fd >= 0, goto error);
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr; // the listening socket
+    CHECK_DO(epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, ctx->listen_fd, &ev)
+            == 0, goto error);
+
+    // Response latencies; also wakes the loop up on closing
+    ctx->timer_wheel = utils_timer_wheel_open(TIMER_TICK_USECS, LOG_CTX_GET());
+    CHECK_DO(ctx->timer_wheel != nullptr, goto error);
+    ev.data.ptr = ctx; // the timer wheel
+    CHECK_DO(epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, utils_timer_wheel_get_fd(
+            ctx->timer_wheel), &ev) == 0, goto error);
+
+    ctx->server_thread = std::thread(server_thr, ctx);
+    return ctx;
+error:
+    origin_server_close(&ctx);
+    return nullptr;
+}
+
+void origin_server_close(origin_server_ctx_t **ref_origin_server_ctx)
+{
+    origin_server_ctx_t *ctx;
+
+    if (ref_origin_server_ctx == nullptr ||
+            (ctx = *ref_origin_server_ctx) == nullptr)
+        return;
+
+    ctx->flag_exit = 1;
+    utils_timer_wheel_wakeup(ctx->timer_wheel);
+    if (ctx->server_thread.joinable())
+        ctx->server_thread.join();
+    while (!ctx->conns.empty())
+        conn_close(ctx, ctx->conns.begin()->second);
+    utils_timer_wheel_close(&ctx->timer_wheel);
+    if (ctx->epoll_fd >= 0)
+        close(ctx->epoll_fd);
+    if (ctx->listen_fd >= 0)
+        close(ctx->listen_fd);
+    delete ctx;
+    *ref_origin_server_ctx = nullptr;
+}
+
+int origin_server_configure(origin_server_ctx_t *origin_server_ctx,
+        const std::vector<origin_route_t> &routes)
+{
+    if (origin_server_ctx == nullptr)
+        return 0;
+
+    std::shared_ptr<route_table_t> table = route_table_create(routes,
+            origin_server_ctx->utils_logs_ctx);
+    if (table == nullptr)
+        return -1;
+    std::lock_guard<std::mutex> lock(origin_server_ctx->table_mutex);
+    origin_server_ctx->table.swap(table);
+    return 0;
+}
+
+int origin_server_parse_routes(const std::string &path,
+        std::vector<origin_route_t> &routes,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    std::ifstream file(path);
+    std::string line;
+    int line_num = 0;
+
+    if (!file.is_open()) {
+        LOGE("Could not open origin routes file '%s'\n", path.c_str());
+        return -1;
+    }
+
+    while (std::getline(file, line)) {
+        std::string token;
+        origin_route_t route = {};
+        line_num++;
+
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+        std::istringstream iss(line);
+        if (!(iss >> route.uri))
+            continue; // empty line
+        route.latency.type = ORIGIN_LATENCY_CONSTANT;
+
+        while (iss >> token) {
+            size_t eq = token.find('=');
+            std::string key = token.substr(0, eq);
+            std::string val = eq == std::string::npos ? "" :
+                    token.substr(eq + 1);
+            std::vector<std::string> f;
+            std::istringstream vss(val);
+            std::string s;
+            char *endptr = nullptr;
+            bool ok = !val.empty();
+
+            if (key == "latency") {
+                while (std::getline(vss, s, ':'))
+                    f.push_back(s);
+                origin_latency_t &l = route.latency;
+                if (f.size() == 2 && f[0] == "const") {
+                    l.type = ORIGIN_LATENCY_CONSTANT;
+                    l.usecs = strtoull(f[1].c_str(), &endptr, 10);
+                    ok = *endptr == '\0';
+                } else if (f.size() == 3 && f[0] == "lognormal") {
+                    l.type = ORIGIN_LATENCY_LOGNORMAL;
+                    l.usecs = strtoull(f[1].c_str(), nullptr, 10);
+                    l.sigma = strtod(f[2].c_str(), nullptr);
+                    ok = l.usecs > 0 && l.sigma > 0;
+                } else if (f.size() == 4 && f[0] == "bimodal") {
+                    l.type = ORIGIN_LATENCY_BIMODAL;
+                    l.usecs = strtoull(f[1].c_str(), nullptr, 10);
+                    l.slow_usecs = strtoull(f[2].c_str(), nullptr, 10);
+                    l.slow_fraction = strtod(f[3].c_str(), nullptr);
+                    ok = l.slow_fraction >= 0 && l.slow_fraction <= 1;
+                } else if (f.size() == 2 && f[0] == "trace") {
+                    std::ifstream trace(f[1]);
+                    uint64_t usecs;
+                    l.type = ORIGIN_LATENCY_TRACE;
+                    while (trace >> usecs)
+                        l.trace_usecs.push_back(usecs);
+                    ok = !l.trace_usecs.empty();
+                } else {
+                    ok = false;
+                }
+            } else if (key == "status") {
+                while (ok && std::getline(vss, s, ',')) {
+                    size_t colon = s.find(':');
+                    int status = atoi(s.substr(0, colon).c_str());
+                    double weight = colon == std::string::npos ? 1.0 :
+                            strtod(s.c_str() + colon + 1, nullptr);
+                    ok = status >= 100 && status <= 599 && weight > 0;
+                    route.statuses.push_back(std::make_pair(status, weight));
+                }
+            } else if (key == "body") {
+                unsigned long long size = strtoull(val.c_str(), &endptr, 10);
+                switch (*endptr) {
+                case 'K': size <<= 10; endptr++; break;
+                case 'M': size <<= 20; endptr++; break;
+                case 'G': size <<= 30; endptr++; break;
+                default: break;
+                }
+                route.body_size = (size_t)size;
+                ok = ok && *endptr == '\0';
+            } else if (key == "cache-control") {
+                route.cache_control = val;
+            } else {
+                ok = false;
+            }
+
+            if (!ok) {
+                LOGE("Origin routes file '%s', line %d: invalid '%s'\n",
+                        path.c_str(), line_num, token.c_str());
+                return -1;
+            }
+        }
+        routes.push_back(route);
+    }
+    return 0;
+}
+
+static std::shared_ptr<route_table_t> route_table_create(
+        const std::vector<origin_route_t> &routes,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    std::shared_ptr<route_table_t> table(new route_table_t());
+    size_t body_size = 0;
+
+    table->routes = routes;
+    table->body_fd = -1;
+    for (size_t i = 0; i < routes.size(); i++)
+        body_size = std::max(body_size, routes[i].body_size);
+    if (body_size == 0)
+        return table;
+
+    // Fill the body file once; responses are 'sendfile()'d from it
+    table->body_fd = memfd_create("origin-body", MFD_CLOEXEC);
+    if (table->body_fd < 0) {
+        LOGE("Could not create the origin body file: %s\n", strerror(errno));
+        return nullptr;
+    }
+    std::string chunk;
+    while (chunk.size() < 65536)
+        chunk += BODY_PATTERN;
+    for (size_t off = 0; off < body_size; ) {
+        size_t len = std::min(chunk.size(), body_size - off);
+        ssize_t ret = write(table->body_fd, chunk.data(), len);
+        if (ret <= 0) {
+            LOGE("Could not fill the origin body file: %s\n",
+                    strerror(errno));
+            return nullptr;
+        }
+        off += (size_t)ret;
+    }
+    return table;
+}
+
+static void server_thr(origin_server_ctx_t *ctx)
+{
+    struct epoll_event events[EVENTS_MAX];
+
+    while (ctx->flag_exit == 0) {
+        bool flag_timers = false;
+
+        // The timer wheel wakes the loop up (due timers or closing)
+        int n = epoll_wait(ctx->epoll_fd, events, EVENTS_MAX, -1);
+        for (int i = 0; i < n; i++) {
+            conn_t *conn = (conn_t*)events[i].data.ptr;
+            if (conn == nullptr) {
+                conn_accept(ctx);
+                continue;
+            }
+            if (events[i].data.ptr == ctx) {
+                flag_timers = true;
+                continue;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                conn_close(ctx, conn);
+                continue;
+            }
+            if (events[i].events & EPOLLOUT) {
+                int ret = conn_write(ctx, conn);
+                if (ret < 0 || (ret == 0 && conn_process(ctx, conn) < 0))
+                    continue; // closed
+            }
+            if (events[i].events & EPOLLIN)
+                conn_read(ctx, conn);
+        }
+
+        // Fire the due response timers (after the events: they may close
+        // connections)
+        if (flag_timers)
+            utils_timer_wheel_expire(ctx->timer_wheel);
+    }
+}
+
+static void conn_accept(origin_server_ctx_t *ctx)
+{
+    int fd, on = 1;
+
+    while ((fd = accept4(ctx->listen_fd, nullptr, nullptr, SOCK_NONBLOCK |
+            SOCK_CLOEXEC)) >= 0) {
+        struct epoll_event ev = {};
+        conn_t *conn = new conn_t();
+        conn->fd = fd;
+        conn->state = CONN_READING;
+        conn->head_sent = 0;
+        conn->body_off = conn->body_end = 0;
+        conn->flag_close = false;
+        conn->flag_out = false;
+        conn->ctx = ctx;
+        utils_timer_init(&conn->timer, conn_timer_cb, conn);
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            delete conn;
+            continue;
+        }
+        ctx->conns[fd] = conn;
+    }
+}
+
+static void conn_read(origin_server_ctx_t *ctx, conn_t *conn)
+{
+    char buf[16384];
+    ssize_t ret;
+
+    while ((ret = recv(conn->fd, buf, sizeof(buf), 0)) > 0)
+        conn->in.append(buf, (size_t)ret);
+    if (ret == 0 || (errno != EAGAIN && errno != EWOULDBLOCK) ||
+            conn->in.size() > REQUEST_HEAD_MAX * 4) {
+        // Peer gone (a client does not half-close while waiting for a
+        // response) or flooding us
+        conn_close(ctx, conn);
+        return;
+    }
+    conn_process(ctx, conn);
+}
+
+/// Serve the pipelined requests received so far, until one must wait (for
+/// its latency to elapse or for socket buffer space).
+/// @return 0 on success, -1 if the connection was closed.
+static int conn_process(origin_server_ctx_t *ctx, conn_t *conn)
+{
+    while (conn->state == CONN_READING) {
+        uint64_t delay_usecs = 0;
+        size_t end = conn->in.find("\r\n\r\n");
+
+        if (end == std::string::npos) {
+            if (conn->in.size() > REQUEST_HEAD_MAX) {
+                conn_close(ctx, conn);
+                return -1;
+            }
+            return 0;
+        }
+        request_handle(ctx, conn, conn->in.substr(0, end + 2), &delay_usecs);
+        conn->in.erase(0, end + 4);
+
+        if (delay_usecs > 0) {
+            conn->state = CONN_WAITING;
+            if (utils_timer_wheel_add_rel(ctx->timer_wheel, &conn->timer,
+                    delay_usecs) != 0) {
+                conn_close(ctx, conn);
+                return -1;
+            }
+            return 0;
+        }
+        conn->state = CONN_WRITING;
+        int ret = conn_write(ctx, conn);
+        if (ret != 0)
+            return ret < 0 ? -1 : 0;
+    }
+    return 0;
+}
+
+/// Send the pending response.
+/// @return 0 if completely sent, 1 if blocked, -1 if the connection was
+/// closed.
+static int conn_write(origin_server_ctx_t *ctx, conn_t *conn)
+{
+    struct epoll_event ev = {};
+    bool has_body = conn->body_off < conn->body_end;
+
+    while (conn->head_sent < conn->head.size()) {
+        ssize_t ret = send(conn->fd, conn->head.data() + conn->head_sent,
+                conn->head.size() - conn->head_sent, MSG_NOSIGNAL |
+                (has_body ? MSG_MORE : 0));
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                goto blocked;
+            conn_close(ctx, conn);
+            return -1;
+        }
+        conn->head_sent += (size_t)ret;
+    }
+    while (conn->body_off < conn->body_end) {
+        ssize_t ret = sendfile(conn->fd, conn->table->body_fd,
+                &conn->body_off, (size_t)(conn->body_end - conn->body_off));
+        if (ret < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                goto blocked;
+            conn_close(ctx, conn);
+            return -1;
+        }
+        if (ret == 0) {
+            conn_close(ctx, conn);
+            return -1;
+        }
+    }
+
+    // Done
+    conn->table.reset();
+    if (conn->flag_close) {
+        conn_close(ctx, conn);
+        return -1;
+    }
+    conn->state = CONN_READING;
+    if (conn->flag_out) {
+        conn->flag_out = false;
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        epoll_ctl(ctx->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+    }
+    return 0;
+
+blocked:
+    if (!conn->flag_out) {
+        conn->flag_out = true;
+        ev.events = EPOLLIN | EPOLLOUT;
+        ev.data.ptr = conn;
+        epoll_ctl(ctx->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+    }
+    return 1;
+}
+
+static void conn_close(origin_server_ctx_t *ctx, conn_t *conn)
+{
+    utils_timer_wheel_cancel(ctx->timer_wheel, &conn->timer);
+    ctx->conns.erase(conn->fd);
+    close(conn->fd); // also removes it from the epoll set
+    delete conn;
+}
+
+/// Response latency elapsed: send the response.
+static void conn_timer_cb(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer, void *userdata)
+{
+    conn_t *conn = (conn_t*)userdata;
+
+    conn->state = CONN_WRITING;
+    if (conn_write(conn->ctx, conn) == 0)
+        conn_process(conn->ctx, conn);
+}
+
+/// Prepare the response to a request.
+/// @param req Request head, without the terminating empty line.
+/// @param ref_delay_usecs Where to return the response latency.
+static void request_handle(origin_server_ctx_t *ctx, conn_t *conn,
+        const std::string &req, uint64_t *ref_delay_usecs)
+{
+    std::shared_ptr<route_table_t> table;
+    const origin_route_t *route;
+    int status = 404;
+    size_t body_size = 0;
+    char line[256];
+
+    // Request line: "METHOD PATH[?QUERY] VERSION"
+    size_t sp1 = req.find(' ');
+    size_t sp2 = sp1 == std::string::npos ? sp1 : req.find(' ', sp1 + 1);
+    size_t eol = req.find("\r\n");
+    std::string path = sp2 == std::string::npos ? "" :
+            req.substr(sp1 + 1, sp2 - sp1 - 1);
+    path = path.substr(0, path.find('?'));
+    std::string version = sp2 == std::string::npos ? "" :
+            req.substr(sp2 + 1, eol - sp2 - 1);
+    conn->flag_close = version != "HTTP/1.1";
+    for (size_t pos = eol; pos != std::string::npos && pos < req.size();
+            pos = req.find("\r\n", pos + 2)) {
+        const char *hdr = req.c_str() + pos + 2;
+        if (strncasecmp(hdr, "Connection:", 11) == 0) {
+            hdr += 11 + strspn(hdr + 11, " \t");
+            conn->flag_close = strncasecmp(hdr, "close", 5) == 0;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(ctx->table_mutex);
+        table = ctx->table;
+    }
+    route = route_match(table.get(), path);
+    if (route != nullptr) {
+        status = status_sample(ctx, route->statuses);
+        if (status >= 200 && status != 204 && status != 304)
+            body_size = route->body_size;
+        *ref_delay_usecs = latency_sample(ctx, route->latency);
+    }
+
+    snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n"
+            "Server: origin-1\r\n", status, status_reason(status));
+    conn->head = line;
+    if (status >= 200 && status != 204 && status != 304) {
+        snprintf(line, sizeof(line), "Content-Length: %zu\r\n", body_size);
+        conn->head += line;
+    }
+    if (route != nullptr && !route->cache_control.empty())
+        conn->head += "Cache-Control: " + route->cache_control + "\r\n";
+    if (conn->flag_close)
+        conn->head += "Connection: close\r\n";
+    conn->head += "\r\n";
+    conn->head_sent = 0;
+    conn->body_off = 0;
+    conn->body_end = (off_t)body_size;
+    conn->table = table;
+}
+
+static const origin_route_t* route_match(const route_table_t *table,
+        const std::string &path)
+{
+    for (size_t i = 0; i < table->routes.size(); i++) {
+        const std::string &uri = table->routes[i].uri;
+        if (!uri.empty() && uri.back() == '*') {
+            if (path.compare(0, uri.size() - 1, uri, 0, uri.size() - 1) == 0)
+                return &table->routes[i];
+        } else if (path == uri) {
+            return &table->routes[i];
+        }
+    }
+    return nullptr;
+}
+
+static uint64_t latency_sample(origin_server_ctx_t *ctx,
+        const origin_latency_t &latency)
+{
+    switch (latency.type) {
+    case ORIGIN_LATENCY_LOGNORMAL: {
+        std::lognormal_distribution<double> dist(log((double)latency.usecs),
+                latency.sigma);
+        return (uint64_t)dist(ctx->rng);
+    }
+    case ORIGIN_LATENCY_BIMODAL: {
+        std::bernoulli_distribution dist(latency.slow_fraction);
+        return dist(ctx->rng) ? latency.slow_usecs : latency.usecs;
+    }
+    case ORIGIN_LATENCY_TRACE: {
+        if (latency.trace_usecs.empty())
+            return 0;
+        std::uniform_int_distribution<size_t> dist(0,
+                latency.trace_usecs.size() - 1);
+        return latency.trace_usecs[dist(ctx->rng)];
+    }
+    case ORIGIN_LATENCY_CONSTANT:
+    default:
+        return latency.usecs;
+    }
+}
+
+static int status_sample(origin_server_ctx_t *ctx,
+        const std::vector<std::pair<int, double> > &statuses)
+{
+    double total = 0;
+
+    if (statuses.empty())
+        return 200;
+    if (statuses.size() == 1)
+        return statuses[0].first;
+    for (size_t i = 0; i < statuses.size(); i++)
+        total += statuses[i].second;
+    double r = std::uniform_real_distribution<double>(0, total)(ctx->rng);
+    for (size_t i = 0; i < statuses.size(); i++) {
+        if ((r -= statuses[i].second) < 0)
+            return statuses[i].first;
+    }
+    return statuses.back().first;
+}
+
+static const char* status_reason(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    default: return "Unknown";
+    }
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file origin_server.h
+/// @brief Built-in programmable origin server.
+///
+/// Single-threaded epoll HTTP/1.1 server (keep-alive and pipelining
+/// supported, GET semantics only) replacing the nginx origin. Each request
+/// is matched against a route table; the route gives the response latency
+/// distribution, status code mix, body size and 'Cache-Control' header.
+/// Bodies are sent with 'sendfile()' from one shared in-memory file, so no
+/// per-request copy is ever made. Delayed responses do not block the loop
+/// (timers), thus thousands of concurrent slow replies cost no threads.
+/// The route table can be replaced at run time (e.g. between the phases of
+/// a setting); requests already being served keep their former route.
+
+#ifndef ORIGIN_SERVER_H_
+#define ORIGIN_SERVER_H_
+
+#include <inttypes.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+// **** Definitions ****
+
+// Forward declarations
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+typedef struct origin_server_ctx_s origin_server_ctx_t;
+
+/// Response latency distribution types
+typedef enum origin_latency_type_enum {
+    ORIGIN_LATENCY_CONSTANT = 0,
+    /// Log-normal of given median and shape (sigma)
+    ORIGIN_LATENCY_LOGNORMAL,
+    /// Fast or slow constant latency, the latter with the given probability
+    ORIGIN_LATENCY_BIMODAL,
+    /// Uniformly sampled from a recorded trace
+    ORIGIN_LATENCY_TRACE
+} origin_latency_type_t;
+
+/// Response latency distribution
+typedef struct origin_latency_s {
+    origin_latency_type_t type;
+    /// Constant, median (log-normal) or fast mode (bimodal) latency
+    uint64_t usecs;
+    /// Bimodal slow mode latency
+    uint64_t slow_usecs;
+    /// Bimodal slow mode probability [0..1]
+    double slow_fraction;
+    /// Log-normal shape
+    double sigma;
+    /// Trace samples
+    std::vector<uint64_t> trace_usecs;
+} origin_latency_t;
+
+/// Route
+typedef struct origin_route_s {
+    /// Request path (query string excluded); exact match, or prefix match
+    /// if it ends with '*' (so "*" alone matches any path)
+    std::string uri;
+    origin_latency_t latency;
+    /// Status codes and their weights (a single 200 if empty)
+    std::vector<std::pair<int, double> > statuses;
+    /// Body size in bytes (not sent with 1xx, 204 and 304 statuses)
+    size_t body_size;
+    /// 'Cache-Control' header value (no header if empty)
+    std::string cache_control;
+} origin_route_t;
+
+// **** Prototypes ****
+
+/// Start serving.
+/// @param host Listening IPv4 address.
+/// @param port Listening TCP port.
+/// @param routes Initial route table (first matching route wins; requests
+/// matching no route are answered with 404).
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return Pointer to the server context structure, NULL if fails.
+origin_server_ctx_t* origin_server_open(const char *host, const char *port,
+        const std::vector<origin_route_t> &routes,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/// Stop serving (open connections are closed) and release the server.
+/// @param ref_origin_server_ctx Reference to the pointer to the server
+/// context structure. Pointer is set to NULL on return.
+void origin_server_close(origin_server_ctx_t **ref_origin_server_ctx);
+
+/// Replace the route table. This is a no-op on a null instance (i.e. when
+/// the nginx origin is used instead).
+/// @return 0 if succeed, -1 otherwise.
+int origin_server_configure(origin_server_ctx_t *origin_server_ctx,
+        const std::vector<origin_route_t> &routes);
+
+/// Parse a route table file. One route per line ('#' starts a comment):
+///   URI [latency=SPEC] [status=CODE[:WEIGHT][,CODE[:WEIGHT]...]]
+///       [body=BYTES] [cache-control=VALUE]
+/// where SPEC is one of 'const:USECS', 'lognormal:MEDIAN_USECS:SIGMA',
+/// 'bimodal:FAST_USECS:SLOW_USECS:SLOW_FRACTION' or 'trace:FILE' (one
+/// latency in microseconds per line). VALUE can not contain spaces.
+/// @param path Route table file path.
+/// @param routes Parsed routes (appended).
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return 0 if succeed, -1 on syntax error.
+int origin_server_parse_routes(const std::string &path,
+        std::vector<origin_route_t> &routes,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+#endif /* ORIGIN_SERVER_H_ */
@@ -0,0 +1,407 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "results_summary.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <dirent.h>
+#include <algorithm>
+#include <vector>
+#include <json-c/json.h>
+#include <utils/utils_logs.h>
+
+// **** Definitions ****
+
+/// Summary files suffix
+#define SUMMARY_SUFFIX "_summary.json"
+
+/// Significance level of the comparison
+#define COMPARE_ALPHA 0.05
+
+/// Minimum relative change considered a regression (even if significant)
+#define COMPARE_CHANGE_MIN 0.01
+
+/// Metrics checked for the confidence interval convergence
+static const char *converge_metrics[] = {"throughput_rps", "latency_p50_ms",
+        nullptr};
+
+/// Summary context structure
+typedef struct results_summary_ctx_s {
+    utils_logs_ctx_t *utils_logs_ctx;
+    std::string setting;
+    std::string description;
+    std::map<std::string, std::string> parameters;
+    unsigned int trials;
+    bool flag_converged;
+    /// Metric name to per-trial samples
+    std::map<std::string, std::vector<double> > metrics;
+} results_summary_ctx_t;
+
+/// Metric statistics
+typedef struct metric_stats_s {
+    double mean;
+    double stddev;
+    double ci95; // Confidence interval half-width
+} metric_stats_t;
+
+// **** Prototypes ****
+
+static const char* metric_better(const std::string &name);
+static metric_stats_t metric_stats(const std::vector<double> &samples);
+static double student_t975(unsigned int df);
+static double welch_pvalue(const std::vector<double> &a,
+        const std::vector<double> &b);
+static double betai(double a, double b, double x);
+static int summary_load(const std::string &path,
+        std::map<std::string, std::vector<double> > &metrics,
+        std::map<std::string, std::string> &betters);
+
+// **** Implementations ****
+
+results_summary_ctx_t* results_summary_open(const std::string &setting,
+        const std::string &description,
+        const std::map<std::string, std::string> &parameters,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    results_summary_ctx_t *ctx = new results_summary_ctx_t();
+    ctx->utils_logs_ctx = LOG_CTX_GET();
+    ctx->setting = setting;
+    ctx->description = description;
+    ctx->parameters = parameters;
+    ctx->trials = 0;
+    ctx->flag_converged = false;
+    return ctx;
+}
+
+void results_summary_close(results_summary_ctx_t **ref_results_summary_ctx)
+{
+    if (ref_results_summary_ctx == nullptr ||
+            *ref_results_summary_ctx == nullptr)
+        return;
+
+    delete *ref_results_summary_ctx;
+    *ref_results_summary_ctx = nullptr;
+}
+
+void results_summary_add_trial(results_summary_ctx_t *ctx,
+        const std::map<std::string, double> &metrics)
+{
+    if (ctx == nullptr)
+        return;
+
+    for (std::map<std::string, double>::const_iterator it = metrics.begin();
+            it != metrics.end(); ++it)
+        ctx->metrics[it->first].push_back(it->second);
+    ctx->trials++;
+}
+
+bool results_summary_converged(results_summary_ctx_t *ctx,
+        unsigned int trials_min, double ci_rel)
+{
+    if (ctx == nullptr || ctx->trials < std::max(trials_min, 2u))
+        return false;
+
+    for (int i = 0; converge_metrics[i] != nullptr; i++) {
+        std::map<std::string, std::vector<double> >::const_iterator it =
+                ctx->metrics.find(converge_metrics[i]);
+        if (it == ctx->metrics.end())
+            continue;
+        metric_stats_t stats = metric_stats(it->second);
+        if (stats.ci95 > ci_rel * fabs(stats.mean))
+            return false;
+    }
+    ctx->flag_converged = true;
+    return true;
+}
+
+int results_summary_write(results_summary_ctx_t *ctx, const std::string &path)
+{
+    LOG_CTX_INIT(nullptr);
+
+    CHECK_DO(ctx != nullptr, return -1);
+    LOG_CTX_SET(ctx->utils_logs_ctx);
+
+    json_object *jobj = json_object_new_object();
+    json_object_object_add(jobj, "setting",
+            json_object_new_string(ctx->setting.c_str()));
+    json_object_object_add(jobj, "description",
+            json_object_new_string(ctx->description.c_str()));
+
+    json_object *jparams = json_object_new_object();
+    for (std::map<std::string, std::string>::const_iterator it =
+            ctx->parameters.begin(); it != ctx->parameters.end(); ++it)
+        json_object_object_add(jparams, it->first.c_str(),
+                json_object_new_string(it->second.c_str()));
+    json_object_object_add(jobj, "parameters", jparams);
+
+    json_object_object_add(jobj, "trials", json_object_new_int(ctx->trials));
+    json_object_object_add(jobj, "converged",
+            json_object_new_boolean(ctx->flag_converged));
+
+    json_object *jmetrics = json_object_new_object();
+    for (std::map<std::string, std::vector<double> >::const_iterator it =
+            ctx->metrics.begin(); it != ctx->metrics.end(); ++it) {
+        metric_stats_t stats = metric_stats(it->second);
+        json_object *jmetric = json_object_new_object();
+        json_object_object_add(jmetric, "better",
+                json_object_new_string(metric_better(it->first)));
+        json_object_object_add(jmetric, "mean",
+                json_object_new_double(stats.mean));
+        json_object_object_add(jmetric, "stddev",
+                json_object_new_double(stats.stddev));
+        json_object_object_add(jmetric, "ci95",
+                json_object_new_double(stats.ci95));
+        json_object *jsamples = json_object_new_array();
+        for (unsigned int s = 0; s < it->second.size(); s++)
+            json_object_array_add(jsamples,
+                    json_object_new_double(it->second[s]));
+        json_object_object_add(jmetric, "samples", jsamples);
+        json_object_object_add(jmetrics, it->first.c_str(), jmetric);
+    }
+    json_object_object_add(jobj, "metrics", jmetrics);
+
+    int ret_code = json_object_to_file_ext(path.c_str(), jobj,
+            JSON_C_TO_STRING_PRETTY);
+    json_object_put(jobj);
+    CHECK_DO(ret_code == 0, return -1);
+
+    printf("\nSummary of '%s' (%u trial%s%s) written to '%s'\n",
+            ctx->setting.c_str(), ctx->trials, ctx->trials > 1 ? "s" : "",
+            ctx->flag_converged ? ", converged" : "", path.c_str());
+    return 0;
+}
+
+int results_summary_compare(const std::string &dir_base,
+        const std::string &dir_new, utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    DIR *dir;
+    struct dirent *entry;
+    std::vector<std::string> names;
+    int regressions = 0;
+
+    dir = opendir(dir_base.c_str());
+    if (dir == nullptr) {
+        LOGE("Could not open results directory '%s'\n", dir_base.c_str());
+        return -1;
+    }
+    while ((entry = readdir(dir)) != nullptr) {
+        std::string name = entry->d_name;
+        if (name.size() > strlen(SUMMARY_SUFFIX) && name.compare(name.size() -
+                strlen(SUMMARY_SUFFIX), std::string::npos,
+                SUMMARY_SUFFIX) == 0)
+            names.push_back(name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    if (names.empty()) {
+        LOGE("No summaries found in '%s'\n", dir_base.c_str());
+        return -1;
+    }
+
+    printf("\nComparing '%s' (base) against '%s' (new); alpha= %.2f\n",
+            dir_base.c_str(), dir_new.c_str(), COMPARE_ALPHA);
+    for (unsigned int n = 0; n < names.size(); n++) {
+        std::map<std::string, std::vector<double> > base, cur;
+        std::map<std::string, std::string> betters, betters_new;
+
+        if (summary_load(dir_base + "/" + names[n], base, betters) != 0)
+            return -1;
+        if (summary_load(dir_new + "/" + names[n], cur, betters_new) != 0) {
+            printf("\n%s: missing in new results\n", names[n].c_str());
+            continue;
+        }
+
+        printf("\n%s\n", names[n].substr(0, names[n].size() -
+                strlen(SUMMARY_SUFFIX)).c_str());
+        for (std::map<std::string, std::vector<double> >::const_iterator it =
+                base.begin(); it != base.end(); ++it) {
+            std::map<std::string, std::vector<double> >::const_iterator
+                    it_new = cur.find(it->first);
+            if (it_new == cur.end() || it->second.empty() ||
+                    it_new->second.empty())
+                continue;
+
+            metric_stats_t s_base = metric_stats(it->second);
+            metric_stats_t s_new = metric_stats(it_new->second);
+            double change = s_base.mean != 0 ?
+                    (s_new.mean - s_base.mean) / fabs(s_base.mean) : 0;
+            printf("  %-36s %12.3f -> %12.3f (%+7.1f%%)", it->first.c_str(),
+                    s_base.mean, s_new.mean, change * 100);
+
+            if (it->second.size() < 2 || it_new->second.size() < 2) {
+                printf("  p= n/a (needs >= 2 trials)\n");
+                continue;
+            }
+            double p = welch_pvalue(it->second, it_new->second);
+            printf("  p= %.4f", p);
+
+            const std::string &better = betters[it->first];
+            bool flag_worse = (better == "higher" && change < 0) ||
+                    (better == "lower" && change > 0);
+            if (p < COMPARE_ALPHA && fabs(change) >= COMPARE_CHANGE_MIN) {
+                if (flag_worse) {
+                    printf("  REGRESSION");
+                    regressions++;
+                } else {
+                    printf("  %s", better == "none" ? "changed" : "improved");
+                }
+            }
+            printf("\n");
+        }
+    }
+    printf("\n%d regression%s found\n", regressions,
+            regressions == 1 ? "" : "s");
+    return regressions;
+}
+
+/// Direction in which a metric is considered to improve.
+static const char* metric_better(const std::string &name)
+{
+    if (name.compare(0, 10, "throughput") == 0)
+        return "higher";
+    if (name.compare(0, 8, "latency_") == 0 ||
+            name.compare(0, 8, "send_lag") == 0 ||
+            name.find("cpu") != std::string::npos ||
+            name.find("_per_req") != std::string::npos)
+        return "lower";
+    return "none"; // e.g. limit_req behaviour counts
+}
+
+static metric_stats_t metric_stats(const std::vector<double> &samples)
+{
+    metric_stats_t stats = {0, 0, 0};
+    size_t n = samples.size();
+
+    if (n == 0)
+        return stats;
+    for (size_t i = 0; i < n; i++)
+        stats.mean += samples[i];
+    stats.mean /= n;
+    if (n < 2)
+        return stats;
+    for (size_t i = 0; i < n; i++)
+        stats.stddev += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+    stats.stddev = sqrt(stats.stddev / (n - 1));
+    stats.ci95 = student_t975(n - 1) * stats.stddev / sqrt((double)n);
+    return stats;
+}
+
+/// Two-sided 95% critical value of the Student's t distribution.
+static double student_t975(unsigned int df)
+{
+    static const double t975[30] = {
+            12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262,
+            2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101,
+            2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052,
+            2.048, 2.045, 2.042
+    };
+    if (df == 0)
+        return INFINITY;
+    return df <= 30 ? t975[df - 1] : 1.96;
+}
+
+/// Two-sided p-value of the Welch's unequal variances t-test.
+static double welch_pvalue(const std::vector<double> &a,
+        const std::vector<double> &b)
+{
+    metric_stats_t sa = metric_stats(a), sb = metric_stats(b);
+    double va = sa.stddev * sa.stddev / a.size();
+    double vb = sb.stddev * sb.stddev / b.size();
+
+    if (va + vb == 0)
+        return sa.mean == sb.mean ? 1 : 0;
+
+    double t = (sb.mean - sa.mean) / sqrt(va + vb);
+    double df = (va + vb) * (va + vb) / (va * va / (a.size() - 1) +
+            vb * vb / (b.size() - 1));
+    return betai(df / 2, 0.5, df / (df + t * t));
+}
+
+/// Regularized incomplete beta function I_x(a, b) (continued fraction
+/// evaluation by the modified Lentz's method).
+static double betai(double a, double b, double x)
+{
+    if (x <= 0)
+        return 0;
+    if (x >= 1)
+        return 1;
+    if (x > (a + 1) / (a + b + 2))
+        return 1 - betai(b, a, 1 - x);
+
+    double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) +
+            b * log(1 - x)) / a;
+    double f = 1, c = 1, d = 0;
+    for (int i = 0; i <= 200; i++) {
+        int m = i / 2;
+        double numerator;
+        if (i == 0)
+            numerator = 1;
+        else if (i % 2 == 0)
+            numerator = (m * (b - m) * x) / ((a + 2 * m - 1) * (a + 2 * m));
+        else
+            numerator = -((a + m) * (a + b + m) * x) /
+                    ((a + 2 * m) * (a + 2 * m + 1));
+        d = 1 + numerator * d;
+        if (fabs(d) < 1e-30)
+            d = 1e-30;
+        d = 1 / d;
+        c = 1 + numerator / c;
+        if (fabs(c) < 1e-30)
+            c = 1e-30;
+        double cd = c * d;
+        f *= cd;
+        if (fabs(1 - cd) < 1e-10)
+            break;
+    }
+    return front * (f - 1);
+}
+
+static int summary_load(const std::string &path,
+        std::map<std::string, std::vector<double> > &metrics,
+        std::map<std::string, std::string> &betters)
+{
+    json_object *jobj, *jmetrics;
+
+    if ((jobj = json_object_from_file(path.c_str())) == nullptr)
+        return -1;
+    if (json_object_object_get_ex(jobj, "metrics", &jmetrics) == 0) {
+        json_object_put(jobj);
+        return -1;
+    }
+    json_object_object_foreach(jmetrics, name, jmetric) {
+        json_object *jsamples, *jbetter;
+        if (json_object_object_get_ex(jmetric, "samples", &jsamples) == 0)
+            continue;
+        std::vector<double> &samples = metrics[name];
+        for (size_t i = 0; i < json_object_array_length(jsamples); i++)
+            samples.push_back(json_object_get_double(
+                    json_object_array_get_idx(jsamples, i)));
+        betters[name] = json_object_object_get_ex(jmetric, "better",
+                &jbetter) != 0 ? json_object_get_string(jbetter) : "none";
+    }
+    json_object_put(jobj);
+    return 0;
+}
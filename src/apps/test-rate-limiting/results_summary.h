@@ -0,0 +1,108 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file results_summary.h
+/// @brief Machine-readable per-setting summaries and run-to-run comparison.
+///
+/// Each setting may be played several times (trials). Each trial yields a
+/// set of named metrics (throughput, latency percentiles, reject/delay
+/// counts, CPU, counters...). The summary keeps all the samples of each
+/// metric and is written as JSON ('<setting>_summary.json'):
+///
+///     {
+///       "setting": "setting-1", "description": "...",
+///       "parameters": {"rps_limit": "10", ...},
+///       "trials": 3, "converged": true,
+///       "metrics": {
+///         "throughput_rps": {"better": "higher", "mean": 9.8,
+///                 "stddev": 0.1, "ci95": 0.2, "samples": [9.7, 9.8, 9.9]},
+///         ...
+///       }
+///     }
+///
+/// Two result sets (directories of summaries) can be compared: each metric
+/// is checked with a Welch's t-test and a statistically significant change
+/// in the "worse" direction is reported as a regression.
+
+#ifndef RESULTS_SUMMARY_H_
+#define RESULTS_SUMMARY_H_
+
+#include <string>
+#include <map>
+
+// **** Definitions ****
+
+// Forward declarations
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+typedef struct results_summary_ctx_s results_summary_ctx_t;
+
+// **** Prototypes ****
+
+/// Open a new (empty) setting summary.
+/// @param setting Setting title.
+/// @param description Setting description.
+/// @param parameters Setting parameters (name to value).
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return Pointer to the summary context structure, NULL if fails.
+results_summary_ctx_t* results_summary_open(const std::string &setting,
+        const std::string &description,
+        const std::map<std::string, std::string> &parameters,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/// Release the summary.
+/// @param ref_results_summary_ctx Reference to the pointer to the summary
+/// context structure. Pointer is set to NULL on return.
+void results_summary_close(results_summary_ctx_t **ref_results_summary_ctx);
+
+/// Add the metrics of a trial.
+/// @param metrics Metric name to value.
+void results_summary_add_trial(results_summary_ctx_t *results_summary_ctx,
+        const std::map<std::string, double> &metrics);
+
+/// Check whether enough trials were played: at least 'trials_min' and the
+/// 95% confidence interval half-width of the throughput and of the median
+/// latency are within 'ci_rel' times their mean.
+/// @param trials_min Minimum number of trials.
+/// @param ci_rel Relative confidence interval half-width target (e.g. 0.05).
+/// @return true if converged.
+bool results_summary_converged(results_summary_ctx_t *results_summary_ctx,
+        unsigned int trials_min, double ci_rel);
+
+/// Write the summary as JSON.
+/// @param path Output file path.
+/// @return 0 if succeed, -1 otherwise.
+int results_summary_write(results_summary_ctx_t *results_summary_ctx,
+        const std::string &path);
+
+/// Compare two result sets (the summaries found in each directory), print
+/// the differences and report the statistically significant regressions of
+/// 'dir_new' with respect to 'dir_base'.
+/// @param dir_base Baseline results directory.
+/// @param dir_new New results directory.
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return Number of regressions found, -1 on error.
+int results_summary_compare(const std::string &dir_base,
+        const std::string &dir_new, utils_logs_ctx_t *const utils_logs_ctx);
+
+#endif /* RESULTS_SUMMARY_H_ */
@@ -0,0 +1,512 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "scenario.h"
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <curl/curl.h>
+#include <utils/utils_logs.h>
+#include <utils/utils_time.h>
+#include <utils/utils_timer.h>
+#include <utils/utils_pool.h>
+#include <utils/utils_arena.h>
+
+// **** Definitions ****
+
+/// Maximum event loop sleep, bounds the reaction time to aborting
+#define LOOP_TOUT_MAX_MSECS 100
+
+#define EVENTS_MAX 256
+
+/// Sleep resolution
+#define TIMER_TICK_USECS 100
+
+/// Request in flight
+typedef struct transfer_s {
+    CURL *easy;
+    /// Awaiter of the request (or of its burst) and response index
+    scenario_burst_awaiter_t *waiter;
+    size_t index;
+    /// Transfers in flight list
+    struct transfer_s *prev, *next;
+} transfer_t;
+
+/// Header of the coroutine frames, telling where they were allocated
+typedef struct frame_hdr_s {
+    alignas(std::max_align_t) bool flag_arena;
+} frame_hdr_t;
+
+/// Event loop context structure
+typedef struct scenario_loop_s {
+    utils_logs_ctx_t *utils_logs_ctx;
+    const scenario_params_t *params;
+    int epoll_fd;
+    CURLM *multi;
+    struct curl_slist *headers;
+    /// libcurl timer (zero if not armed)
+    uint64_t curl_due_usecs;
+    /// Sleeping coroutines
+    utils_timer_wheel_t *timer_wheel;
+    /// Coroutines to resume, with the time they were due
+    std::deque<std::pair<std::coroutine_handle<>, uint64_t> > ready;
+    /// Independent coroutines alive, and those just finished
+    std::set<void*> tasks;
+    std::vector<void*> finished;
+    /// Transfers in flight (pooled, the loop is single-threaded)
+    transfer_t *transfers;
+    utils_pool<transfer_t> transfer_pool;
+    /// Concurrency slots in use
+    std::vector<bool> slots;
+    /// Time the coroutine being resumed was due
+    uint64_t sched_usecs;
+} scenario_loop_t;
+
+/// Loop running on this thread
+static thread_local scenario_loop_t *loop_current = nullptr;
+
+/// Coroutine frames of the loops running on this thread (reset per scenario;
+/// the chunks are kept, so the next scenario does not allocate)
+static thread_local utils_arena frame_arena;
+
+// **** Prototypes ****
+
+static int socket_cb(CURL *easy, curl_socket_t s, int what, void *userp,
+        void *socketp);
+static int timer_cb(CURLM *multi, long timeout_ms, void *userp);
+static size_t write_cb(char *ptr, size_t size, size_t nmemb, void *userdata);
+static void loop_resume_ready(scenario_loop_t *loop);
+static void loop_transfers_done(scenario_loop_t *loop);
+static void transfer_close(scenario_loop_t *loop, transfer_t *transfer);
+static void sleep_timer_cb(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer, void *userdata);
+
+// **** Implementations ****
+
+int scenario_run(const scenario_params_t &params, scenario_task_t task,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    scenario_loop_t loop;
+    scenario_loop_t *loop_prev = loop_current;
+    struct epoll_event ev = {};
+    struct epoll_event events[EVENTS_MAX];
+    int ret = -1;
+
+    loop.utils_logs_ctx = LOG_CTX_GET();
+    loop.params = &params;
+    loop.headers = nullptr;
+    loop.curl_due_usecs = 0;
+    loop.sched_usecs = scenario_now_usecs();
+    loop.multi = nullptr;
+    loop.timer_wheel = nullptr;
+    loop.transfers = nullptr;
+    loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    CHECK_DO(loop.epoll_fd >= 0, goto end);
+    loop.timer_wheel = utils_timer_wheel_open(TIMER_TICK_USECS, LOG_CTX_GET());
+    CHECK_DO(loop.timer_wheel != nullptr, goto end);
+    ev.events = EPOLLIN;
+    ev.data.fd = utils_timer_wheel_get_fd(loop.timer_wheel);
+    CHECK_DO(epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) == 0,
+            goto end);
+    CHECK_DO((loop.multi = curl_multi_init()) != nullptr, goto end);
+    curl_multi_setopt(loop.multi, CURLMOPT_SOCKETFUNCTION, socket_cb);
+    curl_multi_setopt(loop.multi, CURLMOPT_SOCKETDATA, &loop);
+    curl_multi_setopt(loop.multi, CURLMOPT_TIMERFUNCTION, timer_cb);
+    curl_multi_setopt(loop.multi, CURLMOPT_TIMERDATA, &loop);
+    for (size_t i = 0; i < params.headers.size(); i++)
+        loop.headers = curl_slist_append(loop.headers,
+                params.headers[i].c_str());
+
+    loop_current = &loop;
+    scenario_spawn(std::move(task));
+
+    while (!loop.tasks.empty()) {
+        if (params.flag_exit != nullptr && *params.flag_exit != 0)
+            goto end;
+
+        loop_resume_ready(&loop);
+        if (loop.tasks.empty())
+            break;
+        if (utils_timer_wheel_pending(loop.timer_wheel) == 0 &&
+                loop.transfers == nullptr) {
+            LOGE("Scenario coroutines waiting for nothing\n");
+            goto end;
+        }
+
+        // The sleepers wake the loop up through the timer wheel descriptor
+        uint64_t now = scenario_now_usecs();
+        uint64_t due = now + LOOP_TOUT_MAX_MSECS * 1000;
+        bool flag_timers = false;
+        if (loop.curl_due_usecs != 0)
+            due = std::min(due, loop.curl_due_usecs);
+        int tout_msecs = due <= now ? 0 : (int)((due - now + 999) / 1000);
+
+        int n = epoll_wait(loop.epoll_fd, events, EVENTS_MAX, tout_msecs);
+        for (int i = 0; i < n; i++) {
+            int running, flags = 0;
+            if (events[i].data.fd == utils_timer_wheel_get_fd(
+                    loop.timer_wheel)) {
+                flag_timers = true;
+                continue;
+            }
+            if (events[i].events & EPOLLIN)
+                flags |= CURL_CSELECT_IN;
+            if (events[i].events & EPOLLOUT)
+                flags |= CURL_CSELECT_OUT;
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+                flags |= CURL_CSELECT_ERR;
+            curl_multi_socket_action(loop.multi, events[i].data.fd, flags,
+                    &running);
+        }
+        now = scenario_now_usecs();
+        if (loop.curl_due_usecs != 0 && loop.curl_due_usecs <= now) {
+            int running;
+            loop.curl_due_usecs = 0;
+            curl_multi_socket_action(loop.multi, CURL_SOCKET_TIMEOUT, 0,
+                    &running);
+        }
+        loop_transfers_done(&loop);
+
+        // Wake up the sleepers
+        if (flag_timers)
+            utils_timer_wheel_expire(loop.timer_wheel);
+    }
+    ret = 0;
+end:
+    // Abort what is left: transfers first (their awaiters live in the
+    // coroutine frames), then the coroutines (with their sub-routines)
+    while (loop.transfers != nullptr)
+        transfer_close(&loop, loop.transfers);
+    utils_timer_wheel_close(&loop.timer_wheel); // sleepers too
+    for (auto it = loop.tasks.begin(); it != loop.tasks.end(); ++it)
+        std::coroutine_handle<>::from_address(*it).destroy();
+    loop.tasks.clear();
+    loop_current = loop_prev;
+    if (loop.headers != nullptr)
+        curl_slist_free_all(loop.headers);
+    if (loop.multi != nullptr)
+        curl_multi_cleanup(loop.multi);
+    if (loop.epoll_fd >= 0)
+        close(loop.epoll_fd);
+    // All the frames of the scenario are gone by now
+    if (loop_prev == nullptr)
+        frame_arena.reset();
+    return ret;
+}
+
+void scenario_spawn(scenario_task_t task)
+{
+    scenario_loop_t *loop = loop_current;
+    std::coroutine_handle<> handle = task.release();
+
+    if (loop == nullptr || !handle)
+        return;
+    loop->tasks.insert(handle.address());
+    loop->ready.push_back(std::make_pair(handle, loop->sched_usecs));
+}
+
+uint64_t scenario_now_usecs()
+{
+    return utils_gettime_monot_usecs(nullptr);
+}
+
+scenario_sleep_awaiter_t scenario_sleep_until(uint64_t monot_usecs)
+{
+    return scenario_sleep_awaiter_t{monot_usecs, nullptr, {}};
+}
+
+scenario_sleep_awaiter_t scenario_sleep_for(uint64_t usecs)
+{
+    uint64_t from = loop_current != nullptr ? loop_current->sched_usecs :
+            scenario_now_usecs();
+    return scenario_sleep_awaiter_t{from + usecs, nullptr, {}};
+}
+
+scenario_request_awaiter_t scenario_request(const std::string &uri)
+{
+    scenario_request_awaiter_t awaiter;
+    awaiter.uri = uri;
+    awaiter.count = 1;
+    awaiter.pending = 0;
+    return awaiter;
+}
+
+scenario_request_awaiter_t scenario_request_from(const std::string &uri,
+        const std::string &source)
+{
+    scenario_request_awaiter_t awaiter = scenario_request(uri);
+    awaiter.source = source;
+    return awaiter;
+}
+
+scenario_burst_awaiter_t scenario_burst(const std::string &uri,
+        unsigned int count)
+{
+    scenario_burst_awaiter_t awaiter;
+    awaiter.uri = uri;
+    awaiter.count = count;
+    awaiter.pending = 0;
+    return awaiter;
+}
+
+bool scenario_sleep_awaiter_s::await_ready() const noexcept
+{
+    return due_usecs <= scenario_now_usecs();
+}
+
+void scenario_sleep_awaiter_s::await_suspend(std::coroutine_handle<> handle)
+{
+    LOG_CTX_INIT(loop_current->utils_logs_ctx);
+
+    this->handle = handle;
+    utils_timer_init(&timer, sleep_timer_cb, this);
+    CHECK_DO(utils_timer_wheel_add(loop_current->timer_wheel, &timer,
+            due_usecs) == 0, loop_current->ready.push_back(std::make_pair(
+            handle, due_usecs)));
+}
+
+void scenario_burst_awaiter_s::await_suspend(std::coroutine_handle<> handle)
+{
+    scenario_loop_t *loop = loop_current;
+    const scenario_params_t *params = loop->params;
+    LOG_CTX_INIT(loop->utils_logs_ctx);
+
+    // libcurl copies the strings it is set: built once for the whole burst
+    const std::string url = "http://" + params->host + ":" + params->port +
+            uri;
+    const std::string interface = source.empty() ? "" : "host!" + source;
+
+    this->handle = handle;
+    responses.assign(count, scenario_response_t());
+    for (unsigned int i = 0; i < count; i++) {
+        transfer_t *transfer = loop->transfer_pool.get();
+        scenario_response_t &response = responses[i];
+
+        transfer->waiter = this;
+        transfer->index = i;
+        response.intended_usecs = loop->sched_usecs;
+        response.slot = (int)(std::find(loop->slots.begin(),
+                loop->slots.end(), false) - loop->slots.begin());
+        if (response.slot == (int)loop->slots.size())
+            loop->slots.push_back(true);
+        else
+            loop->slots[response.slot] = true;
+
+        transfer->easy = curl_easy_init();
+        CHECK_DO(transfer->easy != nullptr, goto error);
+        curl_easy_setopt(transfer->easy, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(transfer->easy, CURLOPT_HTTPHEADER, loop->headers);
+        curl_easy_setopt(transfer->easy, CURLOPT_TIMEOUT, params->tout_secs);
+        curl_easy_setopt(transfer->easy, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(transfer->easy, CURLOPT_WRITEFUNCTION, write_cb);
+        if (!interface.empty())
+            curl_easy_setopt(transfer->easy, CURLOPT_INTERFACE,
+                    interface.c_str());
+        curl_easy_setopt(transfer->easy, CURLOPT_PRIVATE, transfer);
+        CHECK_DO(curl_multi_add_handle(loop->multi, transfer->easy) ==
+                CURLM_OK, goto error);
+
+        transfer->prev = nullptr;
+        transfer->next = loop->transfers;
+        if (loop->transfers != nullptr)
+            loop->transfers->prev = transfer;
+        loop->transfers = transfer;
+        pending++;
+        if (params->on_request)
+            params->on_request(uri);
+        response.sent_usecs = scenario_now_usecs();
+        continue;
+error:
+        // Account it as failed straight away
+        loop->slots[response.slot] = false;
+        if (transfer->easy != nullptr)
+            curl_easy_cleanup(transfer->easy);
+        loop->transfer_pool.put(transfer);
+        response.sent_usecs = scenario_now_usecs();
+        if (params->on_response)
+            params->on_response(uri, response);
+    }
+    if (pending == 0)
+        loop->ready.push_back(std::make_pair(handle, scenario_now_usecs()));
+}
+
+void* scenario_task_t::promise_type::operator new(size_t size)
+{
+    bool flag_arena = loop_current != nullptr;
+    frame_hdr_t *hdr = (frame_hdr_t*)(flag_arena ?
+            frame_arena.alloc(sizeof(frame_hdr_t) + size) :
+            ::operator new(sizeof(frame_hdr_t) + size));
+
+    hdr->flag_arena = flag_arena;
+    return hdr + 1;
+}
+
+void scenario_task_t::promise_type::operator delete(void *ptr,
+        size_t size) noexcept
+{
+    frame_hdr_t *hdr = (frame_hdr_t*)ptr - 1;
+
+    // Arena frames are released with the whole arena
+    if (!hdr->flag_arena)
+        ::operator delete(hdr);
+}
+
+std::coroutine_handle<>
+scenario_task_t::promise_type::final_awaiter_t::await_suspend(
+        std::coroutine_handle<promise_type> handle) noexcept
+{
+    if (handle.promise().continuation)
+        return handle.promise().continuation;
+    // Independent coroutine: the loop destroys it once back in control
+    loop_current->finished.push_back(handle.address());
+    return std::noop_coroutine();
+}
+
+static int socket_cb(CURL *easy, curl_socket_t s, int what, void *userp,
+        void *socketp)
+{
+    scenario_loop_t *loop = (scenario_loop_t*)userp;
+    struct epoll_event ev = {};
+
+    ev.data.fd = s;
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, s, &ev);
+        return 0;
+    }
+    if (what & CURL_POLL_IN)
+        ev.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT)
+        ev.events |= EPOLLOUT;
+    if (socketp == nullptr) {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, s, &ev);
+        curl_multi_assign(loop->multi, s, loop);
+    } else {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, s, &ev);
+    }
+    return 0;
+}
+
+static int timer_cb(CURLM *multi, long timeout_ms, void *userp)
+{
+    scenario_loop_t *loop = (scenario_loop_t*)userp;
+
+    // Zero means 'not armed': a due time of (at least) one is fine
+    loop->curl_due_usecs = timeout_ms < 0 ? 0 :
+            std::max<uint64_t>(1, scenario_now_usecs() + timeout_ms * 1000);
+    return 0;
+}
+
+static size_t write_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    return size * nmemb; // Bodies are discarded
+}
+
+static void loop_resume_ready(scenario_loop_t *loop)
+{
+    while (!loop->ready.empty()) {
+        std::coroutine_handle<> handle = loop->ready.front().first;
+        loop->sched_usecs = loop->ready.front().second;
+        loop->ready.pop_front();
+        handle.resume();
+
+        for (size_t i = 0; i < loop->finished.size(); i++) {
+            loop->tasks.erase(loop->finished[i]);
+            std::coroutine_handle<>::from_address(loop->finished[i]).destroy();
+        }
+        loop->finished.clear();
+    }
+}
+
+static void loop_transfers_done(scenario_loop_t *loop)
+{
+    CURLMsg *msg;
+    int msgs_left;
+
+    while ((msg = curl_multi_info_read(loop->multi, &msgs_left)) != nullptr) {
+        transfer_t *transfer = nullptr;
+        curl_off_t value = 0;
+
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &transfer);
+        scenario_burst_awaiter_t *waiter = transfer->waiter;
+        scenario_response_t &response = waiter->responses[transfer->index];
+
+        if (msg->data.result == CURLE_OK) {
+            curl_easy_getinfo(transfer->easy, CURLINFO_RESPONSE_CODE,
+                    &response.http_code);
+            curl_easy_getinfo(transfer->easy, CURLINFO_CONNECT_TIME_T,
+                    &value);
+            response.stats.time_connect_usecs = (uint64_t)value;
+            curl_easy_getinfo(transfer->easy, CURLINFO_STARTTRANSFER_TIME_T,
+                    &value);
+            response.stats.time_first_byte_usecs = (uint64_t)value;
+            curl_easy_getinfo(transfer->easy, CURLINFO_TOTAL_TIME_T, &value);
+            response.stats.time_total_usecs = (uint64_t)value;
+            curl_easy_getinfo(transfer->easy,
+                    CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &value);
+            response.stats.download_size_bytes = (int64_t)value;
+        } else {
+            response.http_code = 0;
+        }
+
+        // The awaiter outlives its transfers
+        const std::string &uri = waiter->uri;
+        transfer_close(loop, transfer);
+        if (loop->params->on_response)
+            loop->params->on_response(uri, response);
+        if (--waiter->pending == 0)
+            loop->ready.push_back(std::make_pair(waiter->handle,
+                    scenario_now_usecs()));
+    }
+}
+
+static void transfer_close(scenario_loop_t *loop, transfer_t *transfer)
+{
+    loop->slots[transfer->waiter->responses[transfer->index].slot] = false;
+    curl_multi_remove_handle(loop->multi, transfer->easy);
+    curl_easy_cleanup(transfer->easy);
+    if (transfer->prev != nullptr)
+        transfer->prev->next = transfer->next;
+    else
+        loop->transfers = transfer->next;
+    if (transfer->next != nullptr)
+        transfer->next->prev = transfer->prev;
+    loop->transfer_pool.put(transfer);
+}
+
+static void sleep_timer_cb(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer, void *userdata)
+{
+    scenario_sleep_awaiter_t *awaiter = (scenario_sleep_awaiter_t*)userdata;
+
+    loop_current->ready.push_back(std::make_pair(awaiter->handle,
+            awaiter->due_usecs));
+}
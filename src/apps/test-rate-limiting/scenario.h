@@ -0,0 +1,224 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file scenario.h
+/// @brief Coroutine-based traffic scenarios.
+///
+/// A scenario is a C++20 coroutine ('scenario_task_t') describing what
+/// simulated clients do: send a request or a burst of concurrent requests,
+/// react to each response (e.g. retry after a 503 with backoff), sleep until
+/// an absolute time, and start other independent clients ('scenario_spawn()')
+/// so that phases may overlap.
+///
+/// All the scenario coroutines of a run are multiplexed on the calling
+/// thread by a single epoll event loop driving a libcurl multi handle, so
+/// thousands of concurrent clients cost no threads.
+/// The awaitables below may only be used from coroutines run by
+/// 'scenario_run()'.
+
+#ifndef SCENARIO_H_
+#define SCENARIO_H_
+
+#include <inttypes.h>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+#include <utils/libcurl_wrap.h>
+#include <utils/utils_timer.h>
+
+// **** Definitions ****
+
+// Forward declarations
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+
+/// Scenario coroutine. Start it either by passing it to 'scenario_run()' or
+/// 'scenario_spawn()' (independent client), or by awaiting it from another
+/// scenario coroutine (sub-routine, e.g. a request with a retry policy).
+class scenario_task_t {
+public:
+    struct promise_type {
+        /// Coroutine awaiting this one (none if independent)
+        std::coroutine_handle<> continuation;
+
+        scenario_task_t get_return_object() {
+            return scenario_task_t(
+                    std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        struct final_awaiter_t {
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(
+                    std::coroutine_handle<promise_type> handle) noexcept;
+            void await_resume() const noexcept {}
+        };
+        final_awaiter_t final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+
+        /// Frames created while 'scenario_run()' runs come from a per-thread
+        /// arena, released at once when the (outermost) run ends: they are
+        /// not reused along a run. Other frames come from the heap.
+        static void* operator new(size_t size);
+        static void operator delete(void *ptr, size_t size) noexcept;
+    };
+
+    explicit scenario_task_t(std::coroutine_handle<promise_type> handle):
+        handle(handle) {}
+    scenario_task_t(scenario_task_t &&other) noexcept: handle(other.handle) {
+        other.handle = nullptr;
+    }
+    scenario_task_t(const scenario_task_t&) = delete;
+    scenario_task_t& operator=(const scenario_task_t&) = delete;
+    ~scenario_task_t() {
+        if (handle)
+            handle.destroy();
+    }
+
+    /// Give up the coroutine ownership (to the event loop)
+    std::coroutine_handle<promise_type> release() {
+        std::coroutine_handle<promise_type> ret = handle;
+        handle = nullptr;
+        return ret;
+    }
+
+    /// Awaiting a task runs it to completion
+    bool await_ready() const noexcept { return !handle || handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+        handle.promise().continuation = caller;
+        return handle;
+    }
+    void await_resume() const noexcept {}
+
+private:
+    std::coroutine_handle<promise_type> handle;
+};
+
+/// Outcome of a request
+typedef struct scenario_response_s {
+    /// HTTP status, zero if the request failed
+    long http_code;
+    /// Scheduled send time (monotonic clock): the time the awaiting
+    /// coroutine was due to resume when it issued the request
+    uint64_t intended_usecs;
+    /// Actual send time (monotonic clock)
+    uint64_t sent_usecs;
+    /// Transfer timings and size
+    libcurl_wrap_stats_ctx_t stats;
+    /// Concurrency slot: lowest number not used by any other request in
+    /// flight (e.g. to lay requests out on timeline tracks)
+    int slot;
+} scenario_response_t;
+
+/// Run parameters
+typedef struct scenario_params_s {
+    /// Target server
+    std::string host;
+    std::string port;
+    /// Additional request headers
+    std::vector<std::string> headers;
+    /// Request timeout
+    long tout_secs;
+    /// If set (asynchronously), the run is aborted
+    volatile int *flag_exit;
+    /// Called on each request being sent (optional)
+    std::function<void(const std::string &uri)> on_request;
+    /// Called on each finished request (optional)
+    std::function<void(const std::string &uri,
+            const scenario_response_t &response)> on_response;
+} scenario_params_t;
+
+/// Awaitable of 'scenario_sleep_until()' and 'scenario_sleep_for()'
+typedef struct scenario_sleep_awaiter_s {
+    uint64_t due_usecs;
+    /// Sleeper, scheduled in the loop timer wheel
+    std::coroutine_handle<> handle;
+    utils_timer_t timer;
+    bool await_ready() const noexcept;
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() const noexcept {}
+} scenario_sleep_awaiter_t;
+
+/// Awaitable of 'scenario_burst()'
+typedef struct scenario_burst_awaiter_s {
+    std::string uri;
+    /// Local address to send from (any if empty)
+    std::string source;
+    unsigned int count;
+    std::vector<scenario_response_t> responses;
+    /// Requests still in flight
+    unsigned int pending;
+    std::coroutine_handle<> handle;
+    bool await_ready() const noexcept { return count == 0; }
+    void await_suspend(std::coroutine_handle<> handle);
+    std::vector<scenario_response_t> await_resume() {
+        return std::move(responses);
+    }
+} scenario_burst_awaiter_t;
+
+/// Awaitable of 'scenario_request()'
+typedef struct scenario_request_awaiter_s: scenario_burst_awaiter_t {
+    scenario_response_t await_resume() { return responses[0]; }
+} scenario_request_awaiter_t;
+
+// **** Prototypes ****
+
+/// Run a scenario until it and all the clients it spawned are done (or the
+/// run is aborted).
+/// @param params Run parameters.
+/// @param task Main scenario coroutine.
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return 0 if succeed, -1 if fails or the run was aborted.
+int scenario_run(const scenario_params_t &params, scenario_task_t task,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/// Start an independent client, running concurrently with the caller.
+void scenario_spawn(scenario_task_t task);
+
+/// Current time (monotonic clock, same as 'utils_gettime_monot_usecs()').
+uint64_t scenario_now_usecs();
+
+/// Suspend until the given monotonic time.
+scenario_sleep_awaiter_t scenario_sleep_until(uint64_t monot_usecs);
+
+/// Suspend for the given time.
+scenario_sleep_awaiter_t scenario_sleep_for(uint64_t usecs);
+
+/// GET a URI (path and optional query string) from the target server.
+/// @return The response ('scenario_response_t').
+scenario_request_awaiter_t scenario_request(const std::string &uri);
+
+/// GET a URI from the given local address (e.g. one of the 127.0.0.0/8
+/// loopback range to emulate a distinct client).
+/// @return The response ('scenario_response_t').
+scenario_request_awaiter_t scenario_request_from(const std::string &uri,
+        const std::string &source);
+
+/// GET a URI with 'count' concurrent requests and wait for all of them.
+/// @return The responses ('std::vector<scenario_response_t>').
+scenario_burst_awaiter_t scenario_burst(const std::string &uri,
+        unsigned int count);
+
+#endif /* SCENARIO_H_ */
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "scenario_counters.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <math.h>
+#include <utils/utils_logs.h>
+
+// **** Definitions ****
+
+/// Counters context structure
+typedef struct scenario_counters_ctx_s {
+    utils_logs_ctx_t *utils_logs_ctx;
+    utils_perf_counters_ctx_t *nginx_counters_ctx;
+    utils_perf_counters_ctx_t *generator_counters_ctx;
+} scenario_counters_ctx_t;
+
+// **** Prototypes ****
+
+static double per_request(int64_t value, uint64_t requests_num);
+static double ratio(int64_t num, int64_t den);
+
+// **** Implementations ****
+
+scenario_counters_ctx_t* scenario_counters_open(
+        const std::vector<pid_t> &nginx_workers,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    pid_t self = getpid();
+
+    CHECK_DO(!nginx_workers.empty(), return nullptr);
+
+    scenario_counters_ctx_t *ctx = new scenario_counters_ctx_t();
+    ctx->utils_logs_ctx = LOG_CTX_GET();
+    ctx->nginx_counters_ctx = utils_perf_counters_open(nginx_workers.data(),
+            nginx_workers.size(), 0, LOG_CTX_GET());
+    ctx->generator_counters_ctx = utils_perf_counters_open(&self, 1, 1,
+            LOG_CTX_GET());
+    if (ctx->nginx_counters_ctx == nullptr ||
+            ctx->generator_counters_ctx == nullptr) {
+        LOGE("Could not start the event counters\n");
+        scenario_counters_close(&ctx);
+        return nullptr;
+    }
+    return ctx;
+}
+
+void scenario_counters_close(
+        scenario_counters_ctx_t **ref_scenario_counters_ctx)
+{
+    scenario_counters_ctx_t *ctx;
+
+    if (ref_scenario_counters_ctx == nullptr ||
+            (ctx = *ref_scenario_counters_ctx) == nullptr)
+        return;
+
+    utils_perf_counters_close(&ctx->nginx_counters_ctx);
+    utils_perf_counters_close(&ctx->generator_counters_ctx);
+    delete ctx;
+    *ref_scenario_counters_ctx = nullptr;
+}
+
+int scenario_counters_read(scenario_counters_ctx_t *ctx,
+        uint64_t requests_num, scenario_counters_t *scenario_counters)
+{
+    LOG_CTX_INIT(nullptr);
+
+    CHECK_DO(ctx != nullptr && scenario_counters != nullptr, return -1);
+    LOG_CTX_SET(ctx->utils_logs_ctx);
+
+    scenario_counters->requests_num = requests_num;
+    CHECK_DO(utils_perf_counters_read(ctx->nginx_counters_ctx,
+            scenario_counters->nginx) == 0, return -1);
+    CHECK_DO(utils_perf_counters_read(ctx->generator_counters_ctx,
+            scenario_counters->generator) == 0, return -1);
+    return 0;
+}
+
+int scenario_counters_write(const scenario_counters_t &sc,
+        const std::string &results_path, const std::string &plotdata_path)
+{
+    LOG_CTX_INIT(nullptr);
+
+    FILE *resultsfile = fopen(results_path.c_str(), "wb");
+    CHECK_DO(resultsfile != nullptr, return -1);
+    FILE *plotdatafile = fopen(plotdata_path.c_str(), "wb");
+    CHECK_DO(plotdatafile != nullptr, fclose(resultsfile); return -1);
+
+    // Results table (also printed to the console)
+    FILE *outs[2] = {stdout, resultsfile};
+    for (int o = 0; o < 2; o++) {
+        fprintf(outs[o], "\nCounters per request (%" PRIu64 " requests):\n"
+                "%-20s %16s %16s\n", sc.requests_num, "",
+                "nginx workers", "generator");
+        fprintf(outs[o], "%-20s %16.3f %16.3f\n", "IPC",
+                ratio(sc.nginx[UTILS_PERF_INSTRUCTIONS],
+                        sc.nginx[UTILS_PERF_CYCLES]),
+                ratio(sc.generator[UTILS_PERF_INSTRUCTIONS],
+                        sc.generator[UTILS_PERF_CYCLES]));
+        for (int c = 0; c < UTILS_PERF_COUNTER_ENUM_MAX; c++)
+            fprintf(outs[o], "%-20s %16.3f %16.3f\n",
+                    utils_perf_counter_lut[c],
+                    per_request(sc.nginx[c], sc.requests_num),
+                    per_request(sc.generator[c], sc.requests_num));
+    }
+
+    // Plot data (gnuplot takes 'nan' as a missing value)
+    fprintf(plotdatafile, "IPC %f %f\n",
+            ratio(sc.nginx[UTILS_PERF_INSTRUCTIONS],
+                    sc.nginx[UTILS_PERF_CYCLES]),
+            ratio(sc.generator[UTILS_PERF_INSTRUCTIONS],
+                    sc.generator[UTILS_PERF_CYCLES]));
+    for (int c = 0; c < UTILS_PERF_COUNTER_ENUM_MAX; c++)
+        fprintf(plotdatafile, "%s/req %f %f\n", utils_perf_counter_lut[c],
+                per_request(sc.nginx[c], sc.requests_num),
+                per_request(sc.generator[c], sc.requests_num));
+
+    fclose(plotdatafile);
+    fclose(resultsfile);
+    return 0;
+}
+
+static double per_request(int64_t value, uint64_t requests_num)
+{
+    if (value < 0 || requests_num == 0)
+        return NAN;
+    return (double)value / requests_num;
+}
+
+static double ratio(int64_t num, int64_t den)
+{
+    if (num < 0 || den <= 0)
+        return NAN;
+    return (double)num / den;
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file scenario_counters.h
+/// @brief Per-scenario hardware and software event counters.
+///
+/// Counts cycles, instructions, LLC misses, branch misses, context switches
+/// and CPU migrations (see 'utils/utils_perf.h') separately for the nginx
+/// worker group and for the load generator (this very process), and outputs
+/// them normalized to per-request figures.
+
+#ifndef SCENARIO_COUNTERS_H_
+#define SCENARIO_COUNTERS_H_
+
+#include <sys/types.h>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+#include <utils/utils_perf.h>
+
+// **** Definitions ****
+
+// Forward declarations
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+typedef struct scenario_counters_ctx_s scenario_counters_ctx_t;
+
+/// Counter totals of a scenario (-1 for counters not available)
+typedef struct scenario_counters_s {
+    int64_t nginx[UTILS_PERF_COUNTER_ENUM_MAX];
+    int64_t generator[UTILS_PERF_COUNTER_ENUM_MAX];
+    /// Number of requests issued by the generator along the scenario
+    uint64_t requests_num;
+} scenario_counters_t;
+
+// **** Prototypes ****
+
+/// Start counting on the given nginx workers and on the generator process
+/// (the latter including all the threads it launches from now on).
+/// @param nginx_workers Nginx worker processes.
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return Pointer to the counters context structure, NULL if fails.
+scenario_counters_ctx_t* scenario_counters_open(
+        const std::vector<pid_t> &nginx_workers,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/// Release the counters.
+/// @param ref_scenario_counters_ctx Reference to the pointer to the counters
+/// context structure. Pointer is set to NULL on return.
+void scenario_counters_close(
+        scenario_counters_ctx_t **ref_scenario_counters_ctx);
+
+/// Read the counter totals.
+/// @param scenario_counters_ctx Pointer to the counters context structure.
+/// @param requests_num Number of requests issued along the scenario.
+/// @param scenario_counters Returned counter totals.
+/// @return 0 if succeed, -1 otherwise.
+int scenario_counters_read(scenario_counters_ctx_t *scenario_counters_ctx,
+        uint64_t requests_num, scenario_counters_t *scenario_counters);
+
+/// Print the per-request figures and write them to the given files.
+/// @param scenario_counters Counter totals of the scenario.
+/// @param results_path Output path of the human-readable results table.
+/// @param plotdata_path Output path of the gnuplot data file (one row per
+/// metric: 'label nginx generator').
+/// @return 0 if succeed, -1 otherwise.
+int scenario_counters_write(const scenario_counters_t &scenario_counters,
+        const std::string &results_path, const std::string &plotdata_path);
+
+#endif /* SCENARIO_COUNTERS_H_ */
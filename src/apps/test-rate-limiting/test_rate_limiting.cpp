@@ -32,10 +32,16 @@
 #include <signal.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <ftw.h>
 #include <termios.h>
+#include <getopt.h>
+#include <dirent.h>
 #include <thread>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <vector>
@@ -45,6 +51,19 @@
 #include <utils/libcurl_wrap.h>
 #include <utils/utils_time.h>
 #include <utils/utils_files.h>
+#include <utils/utils_cgroup.h>
+#include <utils/utils_ring.h>
+
+#include "generator_monitor.h"
+#include "memory_bench.h"
+#include "zone_sizing.h"
+#include "metrics_endpoint.h"
+#include "nginx_profiler.h"
+#include "origin_server.h"
+#include "results_summary.h"
+#include "scenario.h"
+#include "scenario_counters.h"
+#include "trace_export.h"
 
 /// Path where all temporary files created by this example will be stored
 /// This path is completely removed when tests end
@@ -66,6 +85,7 @@
 #define NGINX_CONFFILE TEST_DIR "/nginx.conf"
 #define NGINX_PIDFILE TEST_DIR "/nginx.pid"
 #define NGINX_STATSLOG TEST_DIR "/proxy_stats.log"
+#define NGINX_WORKER_CONNECTIONS 1024
 ///@}
 
 ///@{
@@ -83,7 +103,10 @@
 /// Statistics related definitions.
 #define STATS_PORT "8887"
 #define CLIENT_STATSLOG TEST_DIR "/client_stats.log"
+#define COUNTERS_PLOTDATA TEST_DIR "/counters.dat"
 #define TIME_NORMFACTOR_MSECS 1000
+/// Client statistics samples queued between two drains (one sample period)
+#define CLIENT_STATS_RING_SIZE (64 * 1024)
 ///@}
 
 ///@{
@@ -91,6 +114,64 @@
 #define CLIENT_HDRHOST1 "origin1.example.inet"
 ///@}
 
+///@{
+/// Generator self-instrumentation related definitions.
+#define GENERATOR_LAG_MAX_MSECS_DEFAULT 10
+#define CALIBRATION_BURST 100 // Largest burst used in the settings
+#define CALIBRATION_PATH "/null"
+///@}
+
+///@{
+/// Per call-site log rate limiting: error storms (e.g. nginx rejecting
+/// requests) are folded into one "suppressed N similar" line per second.
+#define LOGS_RATE_LIMIT_BURST 10
+#define LOGS_RATE_LIMIT_INTERVAL_MSECS 1000
+///@}
+
+///@{
+/// Memory benchmark related definitions.
+#define MEMBENCH_SLOW_MAX_DEFAULT 100
+#define MEMBENCH_BODY_FILE TEST_DIR "/large.bin"
+#define MEMBENCH_BODY_SIZE (1024 * 1024)
+#define MEMBENCH_IDLE_PATH "/idle"
+#define MEMBENCH_SLOW_PATH "/bench/large"
+#define MEMBENCH_NORMAL_PATH "/bench/small"
+///@}
+
+///@{
+/// Shared zones sizing related definitions.
+#define ZONESIZING_STEPS 10
+///@}
+
+///@{
+/// Repeated trials related definitions.
+#define TRIALS_MAX_DEFAULT 1
+#define TRIALS_MIN 3
+#define TRIALS_CI_PCT_DEFAULT 5
+///@}
+
+///@{
+/// Resource isolation related definitions (cgroup v2; paths relative to the
+/// hierarchy root).
+#define CGROUP_NGINX "test-rate-limiting/nginx"
+#define CGROUP_GENERATOR "test-rate-limiting/generator"
+///@}
+
+///@{
+/// Trace export related definitions: trace process tracks.
+#define TRACE_PID_GENERATOR 1 // Client requests (one thread track each)
+#define TRACE_PID_SAMPLER 2 // Proxy statistics sampler counters
+#define TRACE_PID_NGINX 3 // Nginx life-cycle events
+/// Track of the first concurrency slot of the coroutine scenarios (above
+/// any thread ID, 'pid_max' being at most 2^22)
+#define TRACE_TID_SCENARIO_SLOT0 (1 << 24)
+///@}
+
+///@{
+/// Profiler related definitions.
+#define PROFILE_FREQ_HZ_DEFAULT 999
+///@}
+
 typedef struct nginx_wrapper_ctx_s nginx_wrapper_ctx_t;
 typedef struct setting_ctx_s setting_ctx_t;
 
@@ -104,23 +185,133 @@ typedef struct setting_ctx_s {
     std::string rps_limit;
     std::string reqburst;
     std::string burstdelay;
+    /// Built-in origin route table of each phase of the setting, switched
+    /// to with 'origin_phase()' (phase 0 is applied when the setting starts);
+    /// the default or command-line table is used if empty
+    std::vector<std::vector<origin_route_t> > origin_phases = {};
 } setting_ctx_t;
 
+/// Command-line options
+typedef struct options_ctx_s {
+    /// Profile the nginx workers along each setting
+    int flag_profile;
+    /// Profiler sampling frequency
+    uint32_t profile_freq_hz;
+    /// Collect hardware/software event counters along each setting
+    int flag_counters;
+    /// Export the timeline of each setting as a Chrome/Perfetto trace
+    int flag_trace;
+    /// Serve the client-side metrics to Prometheus on this port if non-null
+    const char *prometheus_port;
+    /// Maximum generator send lag (99th percentile) for a run to be valid
+    uint32_t lag_max_msecs;
+    /// Run the memory benchmark (instead of the settings) up to this number
+    /// of idle connections if non-zero
+    uint32_t membench_idle_max;
+    /// Memory benchmark maximum number of slow readers
+    uint32_t membench_slow_max;
+    /// Run the shared zones sizing (instead of the settings) up to this
+    /// number of client keys if non-zero
+    uint32_t zonesizing_keys_max;
+    /// Number of client keys the zone sizes are recommended for
+    uint32_t zonesizing_keys_target;
+    /// Maximum number of trials per setting
+    uint32_t trials_max;
+    /// Target 95% confidence interval half-width (percentage of the mean)
+    uint32_t ci_pct;
+    /// Compare the summaries of these two output directories and exit if
+    /// non-null
+    const char *compare_dir_base;
+    const char *compare_dir_new;
+    /// Constrained-container emulation: limits of the nginx proxy and of the
+    /// generator cgroups (cgroups are only used if any limit is set)
+    utils_cgroup_limits_t nginx_cgroup;
+    utils_cgroup_limits_t generator_cgroup;
+    /// Serve the origin from the built-in programmable server instead of
+    /// nginx
+    int flag_builtin_origin;
+    /// Built-in origin route table file (default routes if null)
+    const char *origin_routes_file;
+    /// Trace to this binary log file (see 'utils-logs-decode') instead of
+    /// the standard output if non-null
+    const char *binary_log_path;
+} options_ctx_t;
+
+/// Client statistics sample (a line of the client statistics log)
+typedef struct client_stat_s {
+    float t;
+    uint64_t response_msecs;
+    float lag_msecs;
+} client_stat_t;
+
+/// Long-only command-line options
+enum {
+    OPT_NGINX_CPU_MAX = 256,
+    OPT_NGINX_CPUS,
+    OPT_NGINX_MEMORY_MAX,
+    OPT_GENERATOR_CPU_MAX,
+    OPT_GENERATOR_CPUS,
+    OPT_GENERATOR_MEMORY_MAX,
+    OPT_ZONE_TARGET,
+    OPT_BINARY_LOG
+};
+
 // **** Prototypes ****
 
+static void usage(const char *prog_name);
+static int parse_options(int argc, char* argv[]);
 static int select_stdin();
+static void http_get(const char *port, const char *uri, const char *query_str,
+        const char* headers_array[], unsigned int parallel_cnt,
+        utils_logs_ctx_t *const utils_logs_ctx);
 static void http_get_nginx(const char *uri, const char *query_str,
         const char* headers_array[], unsigned int parallel_cnt,
         utils_logs_ctx_t *const utils_logs_ctx);
-static void nginx_wrapper_open(char *argv[]);
+static void generator_wait(uint64_t usecs);
+static void clients_stats_drain(bool flag_discard);
+static void client_request_done(const char *uri,
+        const scenario_response_t &response, int tid,
+        utils_logs_ctx_t *const utils_logs_ctx);
+static void scenario_nginx(scenario_task_t task,
+        utils_logs_ctx_t *const utils_logs_ctx);
+static scenario_task_t scenario_client_retry(std::string uri,
+        unsigned int retries_max, uint64_t backoff_usecs);
+static scenario_task_t scenario_overlapping_retry();
+static int calibrate_generator(utils_logs_ctx_t *const utils_logs_ctx);
+static int run_memory_bench(char *nginx_argv[],
+        utils_logs_ctx_t *const utils_logs_ctx);
+static int run_zone_sizing(char *nginx_argv[],
+        utils_logs_ctx_t *const utils_logs_ctx);
+static int run_setting_trial(setting_ctx_t *setting_ctx, uint32_t trial,
+        char *nginx_argv[], std::map<std::string, double> &metrics,
+        utils_logs_ctx_t *const utils_logs_ctx);
+static void statslog_count_limit_req(long offset,
+        std::map<std::string, double> &metrics);
+static void cgroup_throttling_metrics(utils_cgroup_ctx_t *utils_cgroup_ctx,
+        const utils_cgroup_stats_t &stats0, const std::string &tag,
+        std::map<std::string, double> &metrics);
+static void nginx_wrapper_open(char *argv[],
+        utils_cgroup_ctx_t *utils_cgroup_ctx);
 static void nginx_wrapper_close(const char *fullpath_pidfile,
         utils_logs_ctx_t *utils_logs_ctx);
+static pid_t nginx_wrapper_get_pid(const char *fullpath_pidfile,
+        utils_logs_ctx_t *utils_logs_ctx);
+static std::vector<pid_t> nginx_wrapper_get_workers(
+        const char *fullpath_pidfile, utils_logs_ctx_t *utils_logs_ctx);
+static uint64_t nginx_wrapper_get_cputime_usecs(
+        const std::vector<pid_t> &workers);
 static void main_proc_quit_signal_handler(int intId);
 static void configure_proxy(std::string rpszone_size,
         std::string rps_limit, std::string reqburst, std::string burstdelay,
+        unsigned int worker_connections, int flag_client_keys,
         utils_logs_ctx_t *const utils_logs_ctx);
 static void configure_origin(utils_logs_ctx_t *const utils_logs_ctx);
+static std::vector<origin_route_t> origin_default_routes();
+static std::vector<origin_route_t> origin_degraded_routes();
+static void origin_phase(const setting_ctx_t *setting_ctx, size_t phase,
+        utils_logs_ctx_t *const utils_logs_ctx);
 static void plottingThr(const setting_ctx_t *setting_ctx,
+        const std::string output_prefix,
         utils_logs_ctx_t *const utils_logs_ctx);
 extern char **environ;
 
@@ -156,15 +347,65 @@ static const char *example_nginx_integration_scheme = "\n\n"
         "\n\n";
 
 
+/// Command-line options (defaults)
+static options_ctx_t options = {
+        .flag_profile = 0,
+        .profile_freq_hz = PROFILE_FREQ_HZ_DEFAULT,
+        .flag_counters = 0,
+        .flag_trace = 0,
+        .prometheus_port = nullptr,
+        .lag_max_msecs = GENERATOR_LAG_MAX_MSECS_DEFAULT,
+        .membench_idle_max = 0,
+        .membench_slow_max = MEMBENCH_SLOW_MAX_DEFAULT,
+        .zonesizing_keys_max = 0,
+        .zonesizing_keys_target = 0,
+        .trials_max = TRIALS_MAX_DEFAULT,
+        .ci_pct = TRIALS_CI_PCT_DEFAULT,
+        .compare_dir_base = nullptr,
+        .compare_dir_new = nullptr,
+        .nginx_cgroup = {nullptr, nullptr, nullptr},
+        .generator_cgroup = {nullptr, nullptr, nullptr},
+        .flag_builtin_origin = 0,
+        .origin_routes_file = nullptr,
+        .binary_log_path = nullptr
+};
+
 /// If this flag is set the app. should exit ASAP.
 static volatile int flag_exit = 0, flag_exit_plotting_thr = 0;
 
 static std::vector<std::thread> clients_threads;
-static std::vector<std::string> clients_stats;
-static std::mutex clients_stats_mutex;
+/// Client statistics: queued lock-free by the clients on request completion,
+/// drained by the plotting thread (or by the calibration, which discards them)
+static utils_ring_mpsc<client_stat_t> clients_stats_ring(
+        CLIENT_STATS_RING_SIZE);
+static std::vector<client_stat_t> clients_stats;
+static std::atomic<uint64_t> clients_stats_dropped(0);
+static std::atomic<uint64_t> clients_requests_cnt(0);
 static volatile int burst_level = 0;
 static volatile uint64_t t0_msecs = 0;
 
+/// Generator self-instrumentation
+static generator_monitor_ctx_t *generator_monitor_ctx = nullptr;
+/// Verdict of the last run, to be rendered in the plot (empty if valid)
+static std::string generator_invalid_reason;
+static std::mutex generator_invalid_reason_mutex;
+
+/// Nginx proxy and generator cgroups (null if not isolated)
+static utils_cgroup_ctx_t *nginx_cgroup_ctx = nullptr;
+static utils_cgroup_ctx_t *generator_cgroup_ctx = nullptr;
+
+/// Timeline trace of the current trial (null if not exported)
+static trace_export_ctx_t *trace_export_ctx = nullptr;
+
+/// Prometheus metrics endpoint (null if not served)
+static metrics_endpoint_ctx_t *metrics_endpoint_ctx = nullptr;
+
+/// Built-in origin server (null if the nginx origin is used). Settings may
+/// reconfigure it between phases with 'origin_phase()'.
+static origin_server_ctx_t *origin_server_ctx = nullptr;
+/// Built-in origin route table restored after each setting
+static std::vector<origin_route_t> origin_routes;
+
 static setting_ctx_s settings[] = {
         {
                 .fxn = [](const setting_ctx_t *setting_ctx,
@@ -204,7 +445,7 @@ static setting_ctx_s settings[] = {
 
                     http_get_nginx("/test-path/myfile", "any", nullptr, 40,
                             LOG_CTX_GET());
-                    usleep(1200 * 1000);
+                    generator_wait(1200 * 1000);
                     http_get_nginx("/test-path/myfile", "any", nullptr, 20,
                             LOG_CTX_GET());
 
@@ -223,7 +464,7 @@ static setting_ctx_s settings[] = {
 
                     http_get_nginx("/test-path/slow-reply", "any", nullptr, 40,
                             LOG_CTX_GET());
-                    usleep(1200 * 1000);
+                    generator_wait(1200 * 1000);
                     http_get_nginx("/test-path/slow-reply", "any", nullptr, 20,
                             LOG_CTX_GET());
 
@@ -242,7 +483,7 @@ static setting_ctx_s settings[] = {
 
                     http_get_nginx("/test-path/myfile", "any", nullptr, 40,
                             LOG_CTX_GET());
-                    usleep(700 * 1000);
+                    generator_wait(700 * 1000);
                     http_get_nginx("/test-path/myfile", "any", nullptr, 20,
                             LOG_CTX_GET());
 
@@ -261,7 +502,7 @@ static setting_ctx_s settings[] = {
 
                     http_get_nginx("/test-path/slow-reply", "any", nullptr, 40,
                             LOG_CTX_GET());
-                    usleep(700 * 1000);
+                    generator_wait(700 * 1000);
                     http_get_nginx("/test-path/slow-reply", "any", nullptr, 20,
                             LOG_CTX_GET());
 
@@ -281,7 +522,7 @@ static setting_ctx_s settings[] = {
                     for (int i = 0; i < 40 ; i++) {
                         http_get_nginx("/test-path/myfile", "any", nullptr, 1,
                                 LOG_CTX_GET());
-                        usleep(25 * 1000);
+                        generator_wait(25 * 1000);
                     }
 
                 },
@@ -300,7 +541,7 @@ static setting_ctx_s settings[] = {
                     for (int i = 0; i < 40 ; i++) {
                         http_get_nginx("/test-path/myfile", "any", nullptr, 4,
                                 LOG_CTX_GET());
-                        usleep(100 * 1000);
+                        generator_wait(100 * 1000);
                     }
 
                 },
@@ -318,10 +559,10 @@ static setting_ctx_s settings[] = {
 
                     http_get_nginx("/test-path/media.mp4", "t0=0&res=720x480",
                             nullptr, 50, LOG_CTX_GET());
-                    usleep(1600 * 1000);
+                    generator_wait(1600 * 1000);
                     http_get_nginx("/test-path/media.mp4", "t0=0&res=720x480",
                             nullptr, 18, LOG_CTX_GET());
-                    usleep(1000 * 1000);
+                    generator_wait(1000 * 1000);
                     http_get_nginx("/test-path/media.mp4", "t0=0&res=720x480",
                             nullptr, 5, LOG_CTX_GET());
 
@@ -341,7 +582,7 @@ static setting_ctx_s settings[] = {
                     for (int i = 0; i < 5 ; i++) {
                         http_get_nginx("/test-path/media.mp4",
                                 "t0=0&res=720x480", nullptr, 8, LOG_CTX_GET());
-                        usleep(1000 * 1000);
+                        generator_wait(1000 * 1000);
                     }
 
                 },
@@ -360,7 +601,7 @@ static setting_ctx_s settings[] = {
                     for (int i = 0; i < 40 ; i++) {
                         http_get_nginx("/test-path/media.mp4",
                                 "t0=0&res=720x480", nullptr, 1, LOG_CTX_GET());
-                        usleep(125 * 1000);
+                        generator_wait(125 * 1000);
                     }
 
                 },
@@ -408,7 +649,7 @@ static setting_ctx_s settings[] = {
 
                     http_get_nginx("/test-path/myfile", "any", nullptr, 50,
                                                 LOG_CTX_GET());
-                    usleep(1000 * 1000);
+                    generator_wait(1000 * 1000);
                     http_get_nginx("/test-path/myfile", "any", nullptr, 50,
                                                 LOG_CTX_GET());
 
@@ -421,6 +662,46 @@ static setting_ctx_s settings[] = {
                 .reqburst = "burst=50",
                 .burstdelay = "delay=25"
         },
+        {
+                .fxn = [](const setting_ctx_t *setting_ctx,
+                        utils_logs_ctx_t *const __utils_logs_ctx) -> void {
+
+                    scenario_nginx(scenario_overlapping_retry(),
+                            LOG_CTX_GET());
+
+                },
+                .title = "setting-12-retry",
+                .description = "Sequence: 40 clients retrying on 503 "
+                        "(backoff 0.2, x3), overlapped at 0.5 by "
+                        "req-burst=20, wait end",
+                .rpszone_size = "10m",
+                .rps_limit = "10",
+                .reqburst = "burst=20",
+                .burstdelay = "delay=10"
+        },
+        {
+                .fxn = [](const setting_ctx_t *setting_ctx,
+                        utils_logs_ctx_t *const __utils_logs_ctx) -> void {
+
+                    http_get_nginx("/test-path/myfile", "any", nullptr, 40,
+                            LOG_CTX_GET());
+                    generator_wait(1000 * 1000);
+                    origin_phase(setting_ctx, 1, LOG_CTX_GET());
+                    http_get_nginx("/test-path/myfile", "any", nullptr, 20,
+                            LOG_CTX_GET());
+
+                },
+                .title = "setting-13-origin-degraded",
+                .description = "Sequence: req-burst=40, wait 1.0, "
+                        "origin degrades (built-in origin only), "
+                        "req-burst=20, wait end",
+                .rpszone_size = "10m",
+                .rps_limit = "10",
+                .reqburst = "burst=20",
+                .burstdelay = "delay=10",
+                .origin_phases = {origin_default_routes(),
+                        origin_degraded_routes()}
+        },
         {.fxn = nullptr}
 };
 
@@ -428,8 +709,43 @@ int main(int argc, char* argv[])
 {
     sigset_t set;
     struct termios terminal_settings, old_terminal_settings;
-    std::thread plottingThread;
-    LOG_CTX_INIT(utils_logs_open(NULL, NULL));
+    results_summary_ctx_t *results_summary_ctx = nullptr;
+    LOG_CTX_INIT(utils_logs_open_async(0));
+
+    if (parse_options(argc, argv) != 0) {
+        usage(argv[0]);
+        utils_logs_close(&LOG_CTX_GET());
+        return EXIT_FAILURE;
+    }
+
+    // Comparison mode: no test is run
+    if (options.compare_dir_base != nullptr) {
+        int regressions = results_summary_compare(options.compare_dir_base,
+                options.compare_dir_new, LOG_CTX_GET());
+        utils_logs_close(&LOG_CTX_GET());
+        return regressions == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    if (options.binary_log_path != nullptr) {
+        utils_logs_ctx_t *utils_logs_ctx = utils_logs_open_binary(
+                options.binary_log_path, 0);
+        if (utils_logs_ctx == nullptr) {
+            LOGE("Could not open binary log file '%s'\n",
+                    options.binary_log_path);
+            utils_logs_close(&LOG_CTX_GET());
+            return EXIT_FAILURE;
+        }
+        utils_logs_close(&LOG_CTX_GET());
+        LOG_CTX_SET(utils_logs_ctx);
+    }
+    utils_logs_set_rate_limit(LOG_CTX_GET(), LOGS_RATE_LIMIT_BURST,
+            LOGS_RATE_LIMIT_INTERVAL_MSECS);
+
+    // Calibrate the TSC clock (binary log time-stamps) before any load
+    if (utils_tsc_calibrate(LOG_CTX_GET()) != 0)
+        LOGD("TSC clock: %" PRIu64 " Hz\n", utils_tsc_hz());
+    else
+        LOGW("TSC clock not usable; time-stamps use clock_gettime()\n");
 
     // Change the file-mode mask to be able to write to any files
     umask(0);
@@ -467,69 +783,134 @@ int main(int argc, char* argv[])
     mkdir(TEST_DIR, 0777);
     mkdir(NGINX_CACHE_FOLDER, 0777);
 
+    // Serve the client-side metrics if requested
+    if (options.prometheus_port != nullptr)
+        CHECK_DO((metrics_endpoint_ctx = metrics_endpoint_open(
+                options.prometheus_port, LOG_CTX_GET())) != nullptr,
+                goto end);
+
+    // Create the isolation cgroups if requested
+    if (options.nginx_cgroup.cpu_max != nullptr ||
+            options.nginx_cgroup.cpuset_cpus != nullptr ||
+            options.nginx_cgroup.memory_max != nullptr ||
+            options.generator_cgroup.cpu_max != nullptr ||
+            options.generator_cgroup.cpuset_cpus != nullptr ||
+            options.generator_cgroup.memory_max != nullptr) {
+        CHECK_DO((nginx_cgroup_ctx = utils_cgroup_open(CGROUP_NGINX,
+                &options.nginx_cgroup, LOG_CTX_GET())) != nullptr, goto end);
+        CHECK_DO((generator_cgroup_ctx = utils_cgroup_open(CGROUP_GENERATOR,
+                &options.generator_cgroup, LOG_CTX_GET())) != nullptr,
+                goto end);
+    }
+
     // Launch origin server
+    if (options.membench_idle_max > 0)
+        CHECK_DO(memory_bench_create_body(MEMBENCH_BODY_FILE,
+                MEMBENCH_BODY_SIZE) == 0, goto end);
     printf("\nLaunching origin...");
-    configure_origin(LOG_CTX_GET());
-    nginx_wrapper_open(nginx_argv[0]);
+    if (options.flag_builtin_origin) {
+        if (options.origin_routes_file == nullptr)
+            origin_routes = origin_default_routes();
+        else
+            CHECK_DO(origin_server_parse_routes(options.origin_routes_file,
+                    origin_routes, LOG_CTX_GET()) == 0, goto end);
+        CHECK_DO((origin_server_ctx = origin_server_open(ORIGIN_HOST,
+                ORIGIN_PORT, origin_routes, LOG_CTX_GET())) != nullptr,
+                goto end);
+    } else {
+        configure_origin(LOG_CTX_GET());
+        nginx_wrapper_open(nginx_argv[0], nullptr);
+    }
 
     // Just wait an instant to make sure server thread is up...
     if(interr_usleep(interr_usleep_uptr.get(), 1 * 1000 * 1000) == EINTR)
         goto end;
 
+    // Move the generator (this process, with all its threads) into its cgroup.
+    // The nginx origin, already forked, is left out of both cgroups; the
+    // built-in one is a thread of this process, so it is moved along and
+    // shares the generator limits (cgroup v2 moves whole processes).
+    if (generator_cgroup_ctx != nullptr &&
+            utils_cgroup_attach(generator_cgroup_ctx, getpid()) != 0) {
+        LOGE("Could not move the generator into its cgroup: %s\n",
+                strerror(errno));
+        goto end;
+    }
+
+    // Measure the generator limits against the (null) origin
+    generator_monitor_ctx = generator_monitor_open(
+            (uint64_t)options.lag_max_msecs * 1000, LOG_CTX_GET());
+    if (calibrate_generator(LOG_CTX_GET()) != 0)
+        goto end;
+
+    // Memory benchmark mode replaces the rate-limiting settings
+    if (options.membench_idle_max > 0) {
+        run_memory_bench(nginx_argv[1], LOG_CTX_GET());
+        goto end;
+    }
+
+    // Shared zones sizing mode replaces the rate-limiting settings too
+    if (options.zonesizing_keys_max > 0) {
+        run_zone_sizing(nginx_argv[1], LOG_CTX_GET());
+        goto end;
+    }
+
     // Apply the different test-settings
     for (int i = 0; settings[i].fxn != nullptr; i++) {
         setting_ctx_t *setting_ctx = &settings[i];
 
-        // Launch Nginx proxy
-        configure_proxy(setting_ctx->rpszone_size, setting_ctx->rps_limit,
-                setting_ctx->reqburst, setting_ctx->burstdelay, LOG_CTX_GET());
-        nginx_wrapper_open(nginx_argv[1]);
-
-        // Wait an instant to make sure server thread is up...
-        if (interr_usleep(interr_usleep_uptr.get(), 1* 1000* 1000) == EINTR)
-            goto end;
-
-        // Launch plotting/sampling thread and apply setting function
-        flag_exit_plotting_thr = 0;
-        burst_level = 0;
-        t0_msecs = utils_gettime_msecs(LOG_CTX_GET()); // test initial time
-        plottingThread = std::thread(plottingThr, setting_ctx, LOG_CTX_GET());
-        setting_ctx->fxn(setting_ctx, LOG_CTX_GET());
-
-        // Join all client threads
-        for (unsigned int cli = 0; cli < clients_threads.size(); cli++)
-            clients_threads[cli].join();
-        clients_threads.clear();
-
-        // Wait for delayed requests to finalize (to be able to plot them)
-        while (!flag_exit && burst_level > 0) {
-            if (interr_usleep(interr_usleep_uptr.get(), 100 * 1000) == EINTR)
+        results_summary_ctx = results_summary_open(setting_ctx->title,
+                setting_ctx->description, {
+                        {"rpszone_size", setting_ctx->rpszone_size},
+                        {"rps_limit", setting_ctx->rps_limit},
+                        {"reqburst", setting_ctx->reqburst},
+                        {"burstdelay", setting_ctx->burstdelay}
+                }, LOG_CTX_GET());
+
+        // Repeat the setting until the results are stable enough (or the
+        // maximum number of trials is reached)
+        for (uint32_t trial = 1; trial <= options.trials_max; trial++) {
+            std::map<std::string, double> metrics;
+
+            if (options.trials_max > 1)
+                printf("\n'%s': trial %u (max. %u)\n",
+                        setting_ctx->title.c_str(), trial, options.trials_max);
+            if (run_setting_trial(setting_ctx, trial, nginx_argv[1], metrics,
+                    LOG_CTX_GET()) != 0)
                 goto end;
-        }
-
-        // Join plotter thread
-        flag_exit_plotting_thr = 1;
-        plottingThread.join();
-        if (interr_usleep(interr_usleep_uptr.get(), 2 * 1000 * 1000) == EINTR)
-            goto end;
+            results_summary_add_trial(results_summary_ctx, metrics);
 
-        // Kill nginx-proxy
-        nginx_wrapper_close(NGINX_PIDFILE, LOG_CTX_GET());
+            if (results_summary_converged(results_summary_ctx,
+                    std::min<uint32_t>(TRIALS_MIN, options.trials_max),
+                    (double)options.ci_pct / 100))
+                break;
+        }
 
-        // Remove some log files
-        unlink(CLIENT_STATSLOG);
+        results_summary_write(results_summary_ctx, std::string(OUTPUT_DIR) +
+                "/" + setting_ctx->title + "_summary.json");
+        results_summary_close(&results_summary_ctx);
     }
 
     // Exit app
 end:
     printf("\n\n=================== End of example ======================\n");
     flag_exit = 1;
+    results_summary_close(&results_summary_ctx);
+    generator_monitor_close(&generator_monitor_ctx);
+    metrics_endpoint_close(&metrics_endpoint_ctx);
 
     // Restore terminal
     tcsetattr(fileno(stdin), TCSANOW, &old_terminal_settings);
 
-    // Kill nginx-origin
-    nginx_wrapper_close(ORIGIN_PIDFILE, LOG_CTX_GET());
+    // Kill nginx-origin (or stop the built-in one)
+    if (origin_server_ctx != nullptr)
+        origin_server_close(&origin_server_ctx);
+    else
+        nginx_wrapper_close(ORIGIN_PIDFILE, LOG_CTX_GET());
+
+    // Leave and remove the isolation cgroups
+    utils_cgroup_close(&generator_cgroup_ctx);
+    utils_cgroup_close(&nginx_cgroup_ctx);
 
     // Remove example target directory
     utils_rmpath(TEST_DIR, LOG_CTX_GET());
@@ -539,6 +920,267 @@ end:
     return 0;
 }
 
+static void usage(const char *prog_name)
+{
+    printf("\nUsage: %s [OPTIONS]\n\n"
+            "Options:\n"
+            "  -p, --profile          Sample the nginx workers CPU-clock along "
+            "each setting\n"
+            "                         and output folded stacks and a "
+            "flame-graph next to\n"
+            "                         the setting plot.\n"
+            "  -f, --profile-freq=HZ  Profiler sampling frequency "
+            "(default: %d Hz).\n"
+            "  -c, --counters         Count cycles, instructions, LLC misses, "
+            "branch misses,\n"
+            "                         context switches and migrations of the "
+            "nginx workers\n"
+            "                         and of the generator along each setting "
+            "(per-request\n"
+            "                         figures are added to the setting plot).\n"
+            "  -T, --trace            Export the timeline of each setting "
+            "(client requests\n"
+            "                         and their phases, sampler readings and "
+            "nginx\n"
+            "                         events) as a Chrome trace JSON file, to "
+            "be loaded\n"
+            "                         in 'chrome://tracing' or "
+            "'ui.perfetto.dev'.\n"
+            "  -P, --prometheus=PORT  Serve the client-side metrics "
+            "(response time and send\n"
+            "                         lag histograms, requests in flight, "
+            "scenario markers)\n"
+            "                         in Prometheus format at "
+            "'http://<host>:PORT/metrics'.\n"
+            "  -l, --max-lag=MSECS    Maximum generator send lag (99th "
+            "percentile) for a\n"
+            "                         run to be valid (default: %d ms).\n"
+            "  -m, --memory-bench=N   Instead of the settings, measure the "
+            "nginx workers\n"
+            "                         memory and normal clients time-to-serve "
+            "with up to N\n"
+            "                         idle keep-alive connections (e.g. "
+            "100000) and then\n"
+            "                         with a growing number of slow readers.\n"
+            "  -s, --slow-readers=N   Memory benchmark maximum number of slow "
+            "readers\n"
+            "                         (default: %d).\n"
+            "  -Z, --zone-sizing=N    Instead of the settings, grow the number "
+            "of distinct\n"
+            "                         client keys up to N (e.g. 20000) and "
+            "report the\n"
+            "                         limit_req and VTS shared zones footprint "
+            "per key,\n"
+            "                         their capacity and allocation failures.\n"
+            "      --zone-target=N    Recommend the zone sizes for N keys "
+            "(default: the\n"
+            "                         -Z value).\n"
+            "  -t, --trials=N         Repeat each setting up to N times, "
+            "stopping as soon as\n"
+            "                         the throughput and median latency "
+            "confidence\n"
+            "                         intervals are narrow enough (at least "
+            "%d trials).\n"
+            "                         A '<setting>_summary.json' file is "
+            "output per setting;\n"
+            "                         the plot, profile, counters and trace "
+            "of each trial\n"
+            "                         are suffixed with '_trial<N>' "
+            "(default: %d).\n"
+            "  -i, --ci=PCT           Target 95%% confidence interval "
+            "half-width, in\n"
+            "                         percentage of the mean (default: "
+            "%d%%).\n"
+            "  -C, --compare BASE NEW Compare the setting summaries of "
+            "directory NEW\n"
+            "                         against those of directory BASE and "
+            "exit with a\n"
+            "                         non-zero status if any metric "
+            "significantly\n"
+            "                         regressed.\n"
+            "  --nginx-cpu-max=QUOTA/PERIOD\n"
+            "                         Run the nginx proxy in a cgroup with "
+            "the given CPU\n"
+            "                         bandwidth, in microseconds (e.g. "
+            "50000/100000 for\n"
+            "                         half a CPU); CFS throttling is added to "
+            "the plot.\n"
+            "  --nginx-cpus=LIST      Restrict the nginx proxy to the given "
+            "CPUs (e.g. 0-1).\n"
+            "  --nginx-memory-max=BYTES\n"
+            "                         Limit the nginx proxy memory (e.g. "
+            "256M).\n"
+            "  --generator-cpu-max=QUOTA/PERIOD, --generator-cpus=LIST,\n"
+            "  --generator-memory-max=BYTES\n"
+            "                         Same limits for the generator (this "
+            "process, and\n"
+            "                         thus the built-in origin if '-O' is "
+            "given).\n"
+            "                         Cgroup options require a cgroup v2 "
+            "hierarchy and\n"
+            "                         root privileges.\n"
+            "  -O, --builtin-origin[=ROUTES]\n"
+            "                         Serve the origin from a built-in epoll "
+            "server instead\n"
+            "                         of nginx. Each line of the ROUTES file "
+            "is:\n"
+            "                         URI [latency=SPEC] "
+            "[status=CODE[:WEIGHT],...]\n"
+            "                             [body=BYTES] "
+            "[cache-control=VALUE]\n"
+            "                         with SPEC 'const:US', "
+            "'lognormal:MEDIAN_US:SIGMA',\n"
+            "                         'bimodal:FAST_US:SLOW_US:SLOW_FRACTION' "
+            "or\n"
+            "                         'trace:FILE'; a trailing '*' in URI "
+            "matches any\n"
+            "                         suffix. Without ROUTES, the nginx "
+            "origin replies are\n"
+            "                         emulated. Settings with origin phases "
+            "(e.g. origin\n"
+            "                         degradation) replace the routes while "
+            "they run.\n"
+            "  --binary-log=FILE      Trace to the binary log FILE instead of "
+            "the standard\n"
+            "                         output: arguments are stored raw, "
+            "without formatting,\n"
+            "                         so that traces stay cheap under load. "
+            "Render it with\n"
+            "                         'utils-logs-decode FILE'.\n"
+            "  -h, --help             Show this help and exit.\n\n",
+            prog_name, PROFILE_FREQ_HZ_DEFAULT,
+            GENERATOR_LAG_MAX_MSECS_DEFAULT, MEMBENCH_SLOW_MAX_DEFAULT,
+            TRIALS_MIN, TRIALS_MAX_DEFAULT, TRIALS_CI_PCT_DEFAULT);
+}
+
+static int parse_options(int argc, char* argv[])
+{
+    static const struct option long_options[] = {
+            {"profile", no_argument, nullptr, 'p'},
+            {"profile-freq", required_argument, nullptr, 'f'},
+            {"counters", no_argument, nullptr, 'c'},
+            {"trace", no_argument, nullptr, 'T'},
+            {"prometheus", required_argument, nullptr, 'P'},
+            {"max-lag", required_argument, nullptr, 'l'},
+            {"memory-bench", required_argument, nullptr, 'm'},
+            {"slow-readers", required_argument, nullptr, 's'},
+            {"zone-sizing", required_argument, nullptr, 'Z'},
+            {"zone-target", required_argument, nullptr, OPT_ZONE_TARGET},
+            {"trials", required_argument, nullptr, 't'},
+            {"ci", required_argument, nullptr, 'i'},
+            {"compare", required_argument, nullptr, 'C'},
+            {"nginx-cpu-max", required_argument, nullptr, OPT_NGINX_CPU_MAX},
+            {"nginx-cpus", required_argument, nullptr, OPT_NGINX_CPUS},
+            {"nginx-memory-max", required_argument, nullptr,
+                    OPT_NGINX_MEMORY_MAX},
+            {"generator-cpu-max", required_argument, nullptr,
+                    OPT_GENERATOR_CPU_MAX},
+            {"generator-cpus", required_argument, nullptr, OPT_GENERATOR_CPUS},
+            {"generator-memory-max", required_argument, nullptr,
+                    OPT_GENERATOR_MEMORY_MAX},
+            {"builtin-origin", optional_argument, nullptr, 'O'},
+            {"binary-log", required_argument, nullptr, OPT_BINARY_LOG},
+            {"help", no_argument, nullptr, 'h'},
+            {nullptr, 0, nullptr, 0}
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "pf:cTP:l:m:s:Z:t:i:C:O::h",
+            long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'p':
+            options.flag_profile = 1;
+            break;
+        case 'f':
+            options.profile_freq_hz = strtoul(optarg, nullptr, 10);
+            if (options.profile_freq_hz == 0)
+                return -1;
+            break;
+        case 'c':
+            options.flag_counters = 1;
+            break;
+        case 'T':
+            options.flag_trace = 1;
+            break;
+        case 'P':
+            if (strtoul(optarg, nullptr, 10) == 0)
+                return -1;
+            options.prometheus_port = optarg;
+            break;
+        case 'l':
+            options.lag_max_msecs = strtoul(optarg, nullptr, 10);
+            if (options.lag_max_msecs == 0)
+                return -1;
+            break;
+        case 'm':
+            options.membench_idle_max = strtoul(optarg, nullptr, 10);
+            if (options.membench_idle_max == 0)
+                return -1;
+            break;
+        case 's':
+            options.membench_slow_max = strtoul(optarg, nullptr, 10);
+            break;
+        case 'Z':
+            options.zonesizing_keys_max = strtoul(optarg, nullptr, 10);
+            if (options.zonesizing_keys_max == 0)
+                return -1;
+            break;
+        case OPT_ZONE_TARGET:
+            options.zonesizing_keys_target = strtoul(optarg, nullptr, 10);
+            if (options.zonesizing_keys_target == 0)
+                return -1;
+            break;
+        case 't':
+            options.trials_max = strtoul(optarg, nullptr, 10);
+            if (options.trials_max == 0)
+                return -1;
+            break;
+        case 'i':
+            options.ci_pct = strtoul(optarg, nullptr, 10);
+            if (options.ci_pct == 0)
+                return -1;
+            break;
+        case 'C':
+            // Second directory is the next (non-option) argument
+            if (optind >= argc)
+                return -1;
+            options.compare_dir_base = optarg;
+            options.compare_dir_new = argv[optind++];
+            break;
+        case OPT_NGINX_CPU_MAX:
+        case OPT_GENERATOR_CPU_MAX:
+            // 'QUOTA/PERIOD' to the 'cpu.max' format ('QUOTA PERIOD')
+            std::replace(optarg, optarg + strlen(optarg), '/', ' ');
+            (opt == OPT_NGINX_CPU_MAX ? options.nginx_cgroup :
+                    options.generator_cgroup).cpu_max = optarg;
+            break;
+        case OPT_NGINX_CPUS:
+            options.nginx_cgroup.cpuset_cpus = optarg;
+            break;
+        case OPT_GENERATOR_CPUS:
+            options.generator_cgroup.cpuset_cpus = optarg;
+            break;
+        case OPT_NGINX_MEMORY_MAX:
+            options.nginx_cgroup.memory_max = optarg;
+            break;
+        case OPT_GENERATOR_MEMORY_MAX:
+            options.generator_cgroup.memory_max = optarg;
+            break;
+        case 'O':
+            options.flag_builtin_origin = 1;
+            options.origin_routes_file = optarg;
+            break;
+        case OPT_BINARY_LOG:
+            options.binary_log_path = optarg;
+            break;
+        case 'h':
+        default:
+            return -1;
+        }
+    }
+    return 0;
+}
+
 static int select_stdin()
 {
    int ret_char;
@@ -550,52 +1192,547 @@ static int select_stdin()
    return ret_char;
 }
 
-static void curl_req(const char *uri, const char *query_str,
-        const char* headers_array[], utils_logs_ctx_t *const __utils_logs_ctx)
+static void curl_req(const char *port, const char *uri,
+        const char *query_str, const char* headers_array[],
+        uint64_t intended_usecs, utils_logs_ctx_t *const __utils_logs_ctx)
 {
-    long http_ret_code;
+    long http_ret_code = 0;
     char *response_str = nullptr;
+    // Bodies are only counted
+    libcurl_wrap_sink_t sink = {};
+    sink.type = LIBCURL_WRAP_SINK_DISCARD;
     const libcurl_wrap_req_ctx_t libcurl_wrap_req_ctx = {
             .method = LIBCURL_WRAP_METHOD_GET, .headers = headers_array,
-            .host = NGINX_HOST, .port = NGINX_PORT,
+            .host = NGINX_HOST, .port = port,
             .location = uri, .qstring = query_str,
-            .body = nullptr, .tout = 5, .flag_libcurl_verbose = 0
+            .body = nullptr, .tout = 5, .flag_libcurl_verbose = 0,
+            .sink = &sink, .source = nullptr
     };
     libcurl_wrap_stats_ctx_t stats_ctx = {};
 
+    clients_requests_cnt++;
+    metrics_endpoint_begin(metrics_endpoint_ctx);
+    uint64_t sent_usecs = utils_gettime_monot_usecs(LOG_CTX_GET());
     if (libcurl_wrap_cli_request(&libcurl_wrap_req_ctx, nullptr,
-            &response_str, &http_ret_code, nullptr, &stats_ctx) != 0)
+            &response_str, &http_ret_code, nullptr, &stats_ctx) != 0) {
         LOGE("Error while requesting GET to address %s:%s%s\n",
                 libcurl_wrap_req_ctx.host, libcurl_wrap_req_ctx.port,
                 libcurl_wrap_req_ctx.location);
-    else {
-        char line[256];
+        http_ret_code = 0;
+    }
+
+    scenario_response_t response = {};
+    response.http_code = http_ret_code;
+    response.intended_usecs = intended_usecs;
+    response.sent_usecs = sent_usecs;
+    response.stats = stats_ctx;
+    client_request_done(uri, response, (int)syscall(SYS_gettid),
+            LOG_CTX_GET());
+
+    if (response_str != nullptr)
+        free(response_str);
+}
+
+/// Account a finished request (client statistics, generator monitor,
+/// metrics endpoint and trace).
+/// @param tid Trace track of the request.
+static void client_request_done(const char *uri,
+        const scenario_response_t &response, int tid,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    const long http_ret_code = response.http_code;
+    const uint64_t intended_usecs = response.intended_usecs;
+    const uint64_t sent_usecs = response.sent_usecs;
+    const libcurl_wrap_stats_ctx_t &stats_ctx = response.stats;
+
+    if (http_ret_code != 0) {
+        client_stat_t client_stat;
 
         uint64_t tcurr = utils_gettime_msecs(LOG_CTX_GET()) - t0_msecs;
-        float t = (float)tcurr / TIME_NORMFACTOR_MSECS;
-        uint64_t responseTimem_sec = stats_ctx.time_total_usecs / 1000;
-        sprintf(line, "%.1f %lu\n", t, responseTimem_sec);
+        client_stat.t = (float)tcurr / TIME_NORMFACTOR_MSECS;
+        client_stat.response_msecs = stats_ctx.time_total_usecs / 1000;
+        client_stat.lag_msecs = (float)(sent_usecs - std::min(sent_usecs,
+                intended_usecs)) / 1000;
+        if (!clients_stats_ring.push(client_stat))
+            clients_stats_dropped++;
+    }
 
-        std::lock_guard<std::mutex> lck(clients_stats_mutex);
-        clients_stats.push_back(line);
+    generator_monitor_request(generator_monitor_ctx, intended_usecs,
+            sent_usecs, stats_ctx.time_total_usecs, http_ret_code,
+            utils_gettime_thread_cputime_usecs(LOG_CTX_GET()));
+    metrics_endpoint_end(metrics_endpoint_ctx, sent_usecs -
+            std::min(sent_usecs, intended_usecs), stats_ctx.time_total_usecs,
+            http_ret_code);
+
+    // Export the request and its phases
+    if (trace_export_ctx != nullptr) {
+        uint64_t total_usecs = http_ret_code != 0 ?
+                stats_ctx.time_total_usecs :
+                utils_gettime_monot_usecs(LOG_CTX_GET()) - sent_usecs;
+
+        if (sent_usecs > intended_usecs)
+            trace_export_slice(trace_export_ctx, TRACE_PID_GENERATOR, tid,
+                    "send lag", intended_usecs, sent_usecs - intended_usecs);
+        trace_export_slice(trace_export_ctx, TRACE_PID_GENERATOR, tid,
+                std::string("GET ") + uri + (http_ret_code != 0 ? "" :
+                " (failed)"), sent_usecs, total_usecs, {
+                        {"status", (double)http_ret_code},
+                        {"send_lag_usecs", (double)(sent_usecs -
+                                std::min(sent_usecs, intended_usecs))},
+                        {"bytes", (double)stats_ctx.download_size_bytes}
+                });
+        if (http_ret_code != 0) {
+            trace_export_slice(trace_export_ctx, TRACE_PID_GENERATOR, tid,
+                    "connect", sent_usecs, stats_ctx.time_connect_usecs);
+            trace_export_slice(trace_export_ctx, TRACE_PID_GENERATOR, tid,
+                    "wait first byte", sent_usecs +
+                    stats_ctx.time_connect_usecs,
+                    stats_ctx.time_first_byte_usecs -
+                    std::min(stats_ctx.time_first_byte_usecs,
+                    stats_ctx.time_connect_usecs));
+            trace_export_slice(trace_export_ctx, TRACE_PID_GENERATOR, tid,
+                    "transfer", sent_usecs + stats_ctx.time_first_byte_usecs,
+                    total_usecs - std::min(total_usecs,
+                    stats_ctx.time_first_byte_usecs));
+        }
     }
+}
 
-    if (response_str != nullptr)
-        free(response_str);
+/// Play a coroutine scenario against the nginx proxy. Returns when all its
+/// clients are done.
+static void scenario_nginx(scenario_task_t task,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    scenario_params_t params;
+
+    params.host = NGINX_HOST;
+    params.port = NGINX_PORT;
+    params.tout_secs = 5;
+    params.flag_exit = &flag_exit;
+    params.on_request = [](const std::string &uri) {
+        clients_requests_cnt++;
+        metrics_endpoint_begin(metrics_endpoint_ctx);
+    };
+    params.on_response = [=](const std::string &uri,
+            const scenario_response_t &response) {
+        client_request_done(uri.c_str(), response, TRACE_TID_SCENARIO_SLOT0 +
+                response.slot, LOG_CTX_GET());
+    };
+    if (scenario_run(params, std::move(task), LOG_CTX_GET()) != 0)
+        LOGW("Scenario aborted\n");
 }
 
-static void http_get_nginx(const char *uri, const char *query_str,
+/// Client requesting 'uri' and retrying while rejected by the rate limiter
+/// (503), with exponential backoff and full jitter.
+static scenario_task_t scenario_client_retry(std::string uri,
+        unsigned int retries_max, uint64_t backoff_usecs)
+{
+    for (unsigned int retry = 0; ; retry++) {
+        scenario_response_t response = co_await scenario_request(uri);
+        if (response.http_code != 503 || retry >= retries_max)
+            co_return;
+        co_await scenario_sleep_for((uint64_t)rand() %
+                ((backoff_usecs << retry) + 1));
+    }
+}
+
+/// Independent retrying clients arriving at once, overlapped by a burst of
+/// clients not retrying.
+static scenario_task_t scenario_overlapping_retry()
+{
+    uint64_t t0_usecs = scenario_now_usecs();
+
+    for (int i = 0; i < 40; i++)
+        scenario_spawn(scenario_client_retry("/test-path/myfile?any", 3,
+                200 * 1000));
+    co_await scenario_sleep_until(t0_usecs + 500 * 1000);
+    co_await scenario_burst("/test-path/myfile?any", 20);
+}
+
+static void http_get(const char *port, const char *uri, const char *query_str,
         const char* headers_array[], unsigned int parallel_cnt,
         utils_logs_ctx_t *const utils_logs_ctx)
 {
     LOG_CTX_INIT(utils_logs_ctx);
 
     LOGD("\nPerforming x%u GET request: '%s:%s%s?%s'\n", parallel_cnt,
-            NGINX_HOST, NGINX_PORT, uri, query_str);
+            NGINX_HOST, port, uri, query_str);
 
+    // All the requests of a burst share the same intended send time
+    uint64_t intended_usecs = generator_monitor_intended_usecs(
+            generator_monitor_ctx);
     for (unsigned int i = 0; i < parallel_cnt; i++)
-        clients_threads.push_back(std::thread(curl_req, uri, query_str,
-                headers_array, LOG_CTX_GET()));
+        clients_threads.push_back(std::thread(curl_req, port, uri, query_str,
+                headers_array, intended_usecs, LOG_CTX_GET()));
+}
+
+static void http_get_nginx(const char *uri, const char *query_str,
+        const char* headers_array[], unsigned int parallel_cnt,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    http_get(NGINX_PORT, uri, query_str, headers_array, parallel_cnt,
+            utils_logs_ctx);
+}
+
+/// Wait between bursts of a setting. The schedule is absolute (see
+/// 'generator_monitor_wait()'): a late burst does not delay the next ones.
+static void generator_wait(uint64_t usecs)
+{
+    generator_monitor_wait(generator_monitor_ctx, usecs);
+}
+
+/// Move the queued client statistics to 'clients_stats' (or discard them).
+/// Only one thread at a time drains the queue.
+static void clients_stats_drain(bool flag_discard)
+{
+    client_stat_t client_stat;
+
+    while (clients_stats_ring.pop(client_stat)) {
+        if (!flag_discard)
+            clients_stats.push_back(client_stat);
+    }
+}
+
+/// Calibration pass: play the heaviest burst pattern of the settings against
+/// a null origin location (no proxy, no rate limiting) to measure the
+/// generator own lag and response time floor.
+static int calibrate_generator(utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    generator_report_t generator_report;
+
+    printf("\nCalibrating generator against null origin...\n");
+    metrics_endpoint_scenario(metrics_endpoint_ctx, "calibration", 1);
+    t0_msecs = utils_gettime_msecs(LOG_CTX_GET());
+    generator_monitor_start(generator_monitor_ctx);
+    http_get(ORIGIN_PORT, CALIBRATION_PATH, nullptr, nullptr,
+            CALIBRATION_BURST, LOG_CTX_GET());
+    generator_wait(1000 * 1000);
+    for (int i = 0; i < 40 && !flag_exit; i++) {
+        http_get(ORIGIN_PORT, CALIBRATION_PATH, nullptr, nullptr, 1,
+                LOG_CTX_GET());
+        generator_wait(25 * 1000);
+    }
+    generator_monitor_sched_end(generator_monitor_ctx);
+
+    for (unsigned int cli = 0; cli < clients_threads.size(); cli++)
+        clients_threads[cli].join();
+    clients_threads.clear();
+    clients_stats_drain(true);
+
+    CHECK_DO(generator_monitor_stop(generator_monitor_ctx,
+            &generator_report) == 0, return -1);
+    generator_report_print(generator_report, "calibration, null origin");
+    metrics_endpoint_scenario(metrics_endpoint_ctx, "", 0);
+    if (!generator_report.flag_valid)
+        printf("WARNING: the generator can not sustain the calibration load "
+                "on this host; setting results are likely to be invalid\n");
+    return flag_exit ? -1 : 0;
+}
+
+static int run_memory_bench(char *nginx_argv[],
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    int ret_code;
+
+    // Size the proxy for the whole population (plus some margin)
+    configure_proxy("10m", "10", "burst=20", "delay=10",
+            options.membench_idle_max + options.membench_slow_max +
+            NGINX_WORKER_CONNECTIONS, 0, LOG_CTX_GET());
+    nginx_wrapper_open(nginx_argv, nginx_cgroup_ctx);
+    if (interr_usleep(interr_usleep_uptr.get(), 1 * 1000 * 1000) == EINTR) {
+        nginx_wrapper_close(NGINX_PIDFILE, LOG_CTX_GET());
+        return -1;
+    }
+
+    memory_bench_params_t params = {
+            .host = NGINX_HOST, .port = NGINX_PORT,
+            .idle_location = MEMBENCH_IDLE_PATH,
+            .slow_location = MEMBENCH_SLOW_PATH,
+            .normal_location = MEMBENCH_NORMAL_PATH,
+            .nginx_workers = nginx_wrapper_get_workers(NGINX_PIDFILE,
+                    LOG_CTX_GET()),
+            .idle_max = options.membench_idle_max,
+            .slow_max = options.membench_slow_max,
+            .data_prefix = TEST_DIR "/memory-bench",
+            .output_prefix = OUTPUT_DIR "/memory-bench"
+    };
+    ret_code = memory_bench_run(params, &flag_exit, LOG_CTX_GET());
+
+    nginx_wrapper_close(NGINX_PIDFILE, LOG_CTX_GET());
+    return ret_code;
+}
+
+static int run_zone_sizing(char *nginx_argv[],
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    int ret_code;
+
+    // Default zone sizes, and a VTS filter key per client
+    configure_proxy("1m", "10", "burst=20", "delay=10",
+            NGINX_WORKER_CONNECTIONS, 1, LOG_CTX_GET());
+    nginx_wrapper_open(nginx_argv, nginx_cgroup_ctx);
+    if (interr_usleep(interr_usleep_uptr.get(), 1 * 1000 * 1000) == EINTR) {
+        nginx_wrapper_close(NGINX_PIDFILE, LOG_CTX_GET());
+        return -1;
+    }
+
+    zone_sizing_params_t params = {
+            .host = NGINX_HOST, .port = NGINX_PORT,
+            .location = "/test-path/myfile",
+            .status_host = NGINX_HOST, .status_port = STATS_PORT,
+            .status_location = "/status/format/json",
+            .keys_max = options.zonesizing_keys_max,
+            .steps = ZONESIZING_STEPS,
+            .keys_target = options.zonesizing_keys_target > 0 ?
+                    options.zonesizing_keys_target :
+                    options.zonesizing_keys_max,
+            .output_prefix = OUTPUT_DIR "/zone-sizing"
+    };
+    ret_code = zone_sizing_run(params, &flag_exit, LOG_CTX_GET());
+
+    nginx_wrapper_close(NGINX_PIDFILE, LOG_CTX_GET());
+    return ret_code;
+}
+
+/// Play one trial of a setting against a fresh nginx proxy, plot it and
+/// collect the trial metrics (see 'results_summary.h').
+/// @return 0 if succeed, -1 if the application was interrupted.
+static int run_setting_trial(setting_ctx_t *setting_ctx, uint32_t trial,
+        char *nginx_argv[], std::map<std::string, double> &metrics,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    std::thread plottingThread;
+    nginx_profiler_ctx_t *nginx_profiler_ctx = nullptr;
+    scenario_counters_ctx_t *scenario_counters_ctx = nullptr;
+    scenario_counters_t scenario_counters;
+    generator_report_t generator_report;
+    std::vector<pid_t> nginx_workers;
+    uint64_t nginx_cputime0_usecs = 0, nginx_cputime_usecs;
+    struct stat statslog_stat;
+    long statslog_offset = 0;
+    utils_cgroup_stats_t nginx_cgroup0 = {}, generator_cgroup0 = {};
+    int ret_code = -1;
+    // Outputs of the trial (the trial number is told apart if repeated)
+    const std::string output_prefix = std::string(OUTPUT_DIR) + "/" +
+            setting_ctx->title + (options.trials_max > 1 ? "_trial" +
+            std::to_string(trial) : "");
+
+    // Start the timeline trace (before nginx, to get its start event)
+    if (options.flag_trace) {
+        trace_export_ctx = trace_export_open(output_prefix + "_trace.json",
+                LOG_CTX_GET());
+        trace_export_process_name(trace_export_ctx, TRACE_PID_GENERATOR,
+                "generator: " + setting_ctx->title);
+        trace_export_process_name(trace_export_ctx, TRACE_PID_SAMPLER,
+                "proxy statistics sampler");
+        trace_export_process_name(trace_export_ctx, TRACE_PID_NGINX,
+                "nginx");
+    }
+
+    metrics_endpoint_scenario(metrics_endpoint_ctx, setting_ctx->title, trial);
+
+    // Launch Nginx proxy
+    configure_proxy(setting_ctx->rpszone_size, setting_ctx->rps_limit,
+            setting_ctx->reqburst, setting_ctx->burstdelay,
+            NGINX_WORKER_CONNECTIONS, 0, LOG_CTX_GET());
+    nginx_wrapper_open(nginx_argv, nginx_cgroup_ctx);
+
+    // Wait an instant to make sure server thread is up...
+    if (interr_usleep(interr_usleep_uptr.get(), 1* 1000* 1000) == EINTR)
+        goto end;
+
+    // Only the requests of this trial are to be accounted
+    nginx_workers = nginx_wrapper_get_workers(NGINX_PIDFILE, LOG_CTX_GET());
+    nginx_cputime0_usecs = nginx_wrapper_get_cputime_usecs(nginx_workers);
+    if (stat(NGINX_STATSLOG, &statslog_stat) == 0)
+        statslog_offset = (long)statslog_stat.st_size;
+    if (nginx_cgroup_ctx != nullptr)
+        utils_cgroup_get_stats(nginx_cgroup_ctx, &nginx_cgroup0);
+    if (generator_cgroup_ctx != nullptr)
+        utils_cgroup_get_stats(generator_cgroup_ctx, &generator_cgroup0);
+
+    // Attach the profiler to the (fresh) nginx workers if requested
+    if (options.flag_profile)
+        nginx_profiler_ctx = nginx_profiler_open(nginx_workers,
+                options.profile_freq_hz, LOG_CTX_GET());
+
+    // Start the event counters if requested
+    clients_requests_cnt = 0;
+    unlink(COUNTERS_PLOTDATA);
+    if (options.flag_counters)
+        scenario_counters_ctx = scenario_counters_open(nginx_workers,
+                LOG_CTX_GET());
+
+    // Launch plotting/sampling thread and apply setting function
+    flag_exit_plotting_thr = 0;
+    burst_level = 0;
+    t0_msecs = utils_gettime_msecs(LOG_CTX_GET()); // test initial time
+    plottingThread = std::thread(plottingThr, setting_ctx, output_prefix,
+            LOG_CTX_GET());
+    generator_monitor_start(generator_monitor_ctx);
+    origin_phase(setting_ctx, 0, LOG_CTX_GET());
+    setting_ctx->fxn(setting_ctx, LOG_CTX_GET());
+    generator_monitor_sched_end(generator_monitor_ctx);
+
+    // Join all client threads
+    for (unsigned int cli = 0; cli < clients_threads.size(); cli++)
+        clients_threads[cli].join();
+    clients_threads.clear();
+    if (!setting_ctx->origin_phases.empty())
+        origin_server_configure(origin_server_ctx, origin_routes);
+
+    // Check whether the generator was the bottleneck
+    if (generator_monitor_stop(generator_monitor_ctx,
+            &generator_report) == 0) {
+        generator_report_print(generator_report, setting_ctx->title);
+        {
+            std::lock_guard<std::mutex> lck(generator_invalid_reason_mutex);
+            generator_invalid_reason = generator_report.invalid_reason;
+        }
+        metrics["requests"] = generator_report.requests_num;
+        metrics["responses_2xx"] = generator_report.responses_2xx;
+        metrics["responses_other"] = generator_report.responses_other;
+        metrics["failed"] = generator_report.failed;
+        metrics["throughput_rps"] = generator_report.throughput_rps;
+        metrics["latency_p50_ms"] =
+                (double)generator_report.resp_p50_usecs / 1000;
+        metrics["latency_p90_ms"] =
+                (double)generator_report.resp_p90_usecs / 1000;
+        metrics["latency_p99_ms"] =
+                (double)generator_report.resp_p99_usecs / 1000;
+        metrics["latency_max_ms"] =
+                (double)generator_report.resp_max_usecs / 1000;
+        metrics["send_lag_p99_ms"] =
+                (double)generator_report.lag_p99_usecs / 1000;
+        metrics["generator_cpu_utilisation"] =
+                generator_report.cpu_utilisation;
+        metrics["valid"] = generator_report.flag_valid ? 1 : 0;
+    }
+
+    // Wait for delayed requests to finalize (to be able to plot them)
+    while (!flag_exit && burst_level > 0) {
+        if (interr_usleep(interr_usleep_uptr.get(), 100 * 1000) == EINTR)
+            goto end;
+    }
+
+    // Nginx side figures
+    nginx_cputime_usecs = nginx_wrapper_get_cputime_usecs(nginx_workers) -
+            nginx_cputime0_usecs;
+    metrics["nginx_cpu_ms"] = (double)nginx_cputime_usecs / 1000;
+    if (clients_requests_cnt > 0)
+        metrics["nginx_cpu_usecs_per_req"] = (double)nginx_cputime_usecs /
+                clients_requests_cnt;
+    statslog_count_limit_req(statslog_offset, metrics);
+    cgroup_throttling_metrics(nginx_cgroup_ctx, nginx_cgroup0, "nginx",
+            metrics);
+    cgroup_throttling_metrics(generator_cgroup_ctx, generator_cgroup0,
+            "generator", metrics);
+
+    // Output the setting counters (before the plotter renders them)
+    if (scenario_counters_ctx != nullptr) {
+        if (scenario_counters_read(scenario_counters_ctx,
+                clients_requests_cnt, &scenario_counters) == 0) {
+            scenario_counters_write(scenario_counters,
+                    output_prefix + "_counters.txt", COUNTERS_PLOTDATA);
+            for (int c = 0; c < UTILS_PERF_COUNTER_ENUM_MAX &&
+                    scenario_counters.requests_num > 0; c++) {
+                std::string label = utils_perf_counter_lut[c];
+                if (scenario_counters.nginx[c] >= 0)
+                    metrics["nginx_" + label + "_per_req"] =
+                            (double)scenario_counters.nginx[c] /
+                            scenario_counters.requests_num;
+                if (scenario_counters.generator[c] >= 0)
+                    metrics["generator_" + label + "_per_req"] =
+                            (double)scenario_counters.generator[c] /
+                            scenario_counters.requests_num;
+            }
+        }
+        scenario_counters_close(&scenario_counters_ctx);
+    }
+
+    // Join plotter thread
+    flag_exit_plotting_thr = 1;
+    plottingThread.join();
+
+    // Output the setting profile next to the plot
+    if (nginx_profiler_ctx != nullptr)
+        nginx_profiler_dump(nginx_profiler_ctx, output_prefix +
+                "_profile.folded", output_prefix + "_flamegraph.svg",
+                "nginx workers: " + setting_ctx->title);
+
+    if (interr_usleep(interr_usleep_uptr.get(), 2 * 1000 * 1000) == EINTR)
+        goto end;
+
+    ret_code = 0;
+end:
+    if (plottingThread.joinable()) {
+        flag_exit_plotting_thr = 1;
+        plottingThread.join();
+    }
+    nginx_profiler_close(&nginx_profiler_ctx);
+    scenario_counters_close(&scenario_counters_ctx);
+
+    // Kill nginx-proxy
+    nginx_wrapper_close(NGINX_PIDFILE, LOG_CTX_GET());
+    trace_export_close(&trace_export_ctx);
+    metrics_endpoint_scenario(metrics_endpoint_ctx, "", 0);
+
+    // Remove some log files
+    unlink(CLIENT_STATSLOG);
+    return ret_code;
+}
+
+/// Count the proxy 'limit_req' verdicts logged from the given offset of the
+/// statistics log on (lines formatted as '$msec, $status, $limit_req_status').
+static void statslog_count_limit_req(long offset,
+        std::map<std::string, double> &metrics)
+{
+    const char *line;
+    size_t size;
+    utils_files_records_t records;
+    uint64_t passed = 0, delayed = 0, rejected = 0;
+
+    // Mapped rather than read: the log of a long trial is large
+    utils_files_map_t *statslog = utils_files_map_open(NGINX_STATSLOG,
+            nullptr);
+    if (statslog == nullptr)
+        return;
+    utils_files_records_init(&records, statslog, (size_t)offset, '\n');
+    while (utils_files_records_next(&records, &line, &size)) {
+        const char *status = (const char*)memrchr(line, ' ', size);
+        if (status == nullptr)
+            continue;
+        status++;
+        size -= status - line;
+        if (size >= 6 && memcmp(status, "PASSED", 6) == 0)
+            passed++;
+        else if (size >= 7 && memcmp(status, "DELAYED", 7) == 0)
+            delayed++;
+        else if (size >= 8 && memcmp(status, "REJECTED", 8) == 0)
+            rejected++;
+    }
+    utils_files_map_close(&statslog);
+
+    metrics["limit_req_passed"] = passed;
+    metrics["limit_req_delayed"] = delayed;
+    metrics["limit_req_rejected"] = rejected;
+}
+
+/// Add the CFS throttling undergone by a cgroup since the given statistics
+/// were taken to the trial metrics (nothing if the cgroup is not used).
+static void cgroup_throttling_metrics(utils_cgroup_ctx_t *utils_cgroup_ctx,
+        const utils_cgroup_stats_t &stats0, const std::string &tag,
+        std::map<std::string, double> &metrics)
+{
+    utils_cgroup_stats_t stats;
+
+    if (utils_cgroup_ctx == nullptr ||
+            utils_cgroup_get_stats(utils_cgroup_ctx, &stats) != 0)
+        return;
+    metrics[tag + "_cpu_throttled_ms"] =
+            (double)(stats.throttled_usec - stats0.throttled_usec) / 1000;
+    metrics[tag + "_cpu_throttled_periods"] =
+            stats.nr_throttled - stats0.nr_throttled;
 }
 
 static void main_proc_quit_signal_handler(int intId)
@@ -606,7 +1743,8 @@ static void main_proc_quit_signal_handler(int intId)
     interr_usleep_unblock(interr_usleep_uptr.get());
 }
 
-static void nginx_wrapper_open(char *argv[])
+static void nginx_wrapper_open(char *argv[],
+        utils_cgroup_ctx_t *utils_cgroup_ctx)
 {
     printf("\nNginx process starting PID is %d.\nCommand: '%s %s %s'\n",
             (int)getpid(), argv[0], argv[1], argv[2]);
@@ -620,6 +1758,9 @@ static void nginx_wrapper_open(char *argv[])
     else if(cpid > 0)
     {
         // Parent code
+        trace_export_instant(trace_export_ctx, TRACE_PID_NGINX,
+                std::string("nginx start: ") + basename(argv[2]),
+                utils_gettime_monot_usecs(nullptr), {{"pid", (double)cpid}});
         return;
     }
 
@@ -629,6 +1770,13 @@ static void nginx_wrapper_open(char *argv[])
         printf("\nCould not create a new SID for the process\n");
         exit(EXIT_FAILURE);
     }
+
+    // Enter the cgroup before exec so that master and workers are born in it
+    if(utils_cgroup_ctx != nullptr &&
+            utils_cgroup_attach(utils_cgroup_ctx, getpid()) != 0) {
+        perror("\nCould not move nginx into its cgroup");
+        exit(EXIT_FAILURE);
+    }
     execvpe(argv[0], argv, environ);
 
     // The 'execvpe()' function return only if an error has occurred
@@ -639,19 +1787,15 @@ static void nginx_wrapper_close(const char *fullpath_pidfile,
         utils_logs_ctx_t *utils_logs_ctx)
 {
     pid_t cpid;
-    int status, filedesc;
-    char strpid[32] = {0};
+    int status;
     LOG_CTX_INIT(utils_logs_ctx);
 
     // Check arguments
     CHECK_DO(fullpath_pidfile != NULL, return);
 
     // Get process PID
-    filedesc = open(fullpath_pidfile, O_RDONLY);
-    CHECK_DO(filedesc >= 0, return);
-    CHECK_DO(read(filedesc, &strpid, sizeof(strpid)) > 0, return);
-    close(filedesc);
-    cpid = strtol(strpid, NULL, 10);
+    CHECK_DO((cpid = nginx_wrapper_get_pid(fullpath_pidfile, LOG_CTX_GET()))
+            > 0, return);
 
     // Signal nginx to quit gracefully; Nginx can be signaled as follows:
     // - quit – Shut down gracefully;
@@ -659,6 +1803,8 @@ static void nginx_wrapper_close(const char *fullpath_pidfile,
     // - reopen – Reopen log files;
     // - stop – Shut down immediately (fast shutdown).
     printf("\nSignaling nginx to exit (sent to pid= %d)\n", cpid);
+    trace_export_instant(trace_export_ctx, TRACE_PID_NGINX, "nginx quit",
+            utils_gettime_monot_usecs(LOG_CTX_GET()), {{"pid", (double)cpid}});
     CHECK(kill(cpid, SIGQUIT) == 0);
 
     // Wait nginx to finalize
@@ -684,11 +1830,106 @@ static void nginx_wrapper_close(const char *fullpath_pidfile,
 
     } while(!WIFEXITED(status) && !WIFSIGNALED(status) && tries < maxTries);
 
+    trace_export_instant(trace_export_ctx, TRACE_PID_NGINX, "nginx exit",
+            utils_gettime_monot_usecs(LOG_CTX_GET()), {{"pid", (double)cpid},
+            {"status", WIFEXITED(status) ? (double)WEXITSTATUS(status) : -1}});
+
     return;
 }
 
+static pid_t nginx_wrapper_get_pid(const char *fullpath_pidfile,
+        utils_logs_ctx_t *utils_logs_ctx)
+{
+    int filedesc;
+    char strpid[32] = {0};
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    // Check arguments
+    CHECK_DO(fullpath_pidfile != NULL, return -1);
+
+    filedesc = open(fullpath_pidfile, O_RDONLY);
+    CHECK_DO(filedesc >= 0, return -1);
+    if (read(filedesc, &strpid, sizeof(strpid) - 1) <= 0) {
+        LOGE("Could not read PID file '%s'\n", fullpath_pidfile);
+        close(filedesc);
+        return -1;
+    }
+    close(filedesc);
+    return (pid_t)strtol(strpid, NULL, 10);
+}
+
+static std::vector<pid_t> nginx_wrapper_get_workers(
+        const char *fullpath_pidfile, utils_logs_ctx_t *utils_logs_ctx)
+{
+    std::vector<pid_t> workers;
+    pid_t master;
+    DIR *dir;
+    struct dirent *entry;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    CHECK_DO((master = nginx_wrapper_get_pid(fullpath_pidfile, LOG_CTX_GET()))
+            > 0, return workers);
+
+    // Workers are the children of the master process
+    CHECK_DO((dir = opendir("/proc")) != NULL, return workers);
+    while ((entry = readdir(dir)) != NULL) {
+        char path[64], stat[512];
+        int ppid = 0;
+        pid_t pid = (pid_t)strtol(entry->d_name, NULL, 10);
+        if (pid <= 0)
+            continue;
+
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+        FILE *statfile = fopen(path, "r");
+        if (statfile == NULL)
+            continue;
+        if (fgets(stat, sizeof(stat), statfile) != NULL) {
+            // Format: "pid (comm) state ppid ..."; 'comm' may contain spaces
+            char *p = strrchr(stat, ')');
+            if (p != NULL && sscanf(p + 1, " %*c %d", &ppid) == 1 &&
+                    ppid == master)
+                workers.push_back(pid);
+        }
+        fclose(statfile);
+    }
+    closedir(dir);
+
+    if (workers.empty())
+        LOGW("No worker processes found for nginx master %d\n", master);
+    return workers;
+}
+
+/// Sum of the user and system CPU time consumed so far by the given
+/// processes (terminated processes are silently skipped).
+static uint64_t nginx_wrapper_get_cputime_usecs(
+        const std::vector<pid_t> &workers)
+{
+    uint64_t ticks = 0;
+    long ticks_per_sec = sysconf(_SC_CLK_TCK);
+
+    for (pid_t pid: workers) {
+        char path[64], stat[512];
+        unsigned long utime, stime;
+
+        snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+        FILE *statfile = fopen(path, "r");
+        if (statfile == NULL)
+            continue;
+        if (fgets(stat, sizeof(stat), statfile) != NULL) {
+            // Fields 14 and 15 (counted from "pid (comm)" on)
+            char *p = strrchr(stat, ')');
+            if (p != NULL && sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u "
+                    "%*u %*u %*u %lu %lu", &utime, &stime) == 2)
+                ticks += utime + stime;
+        }
+        fclose(statfile);
+    }
+    return ticks_per_sec > 0 ? ticks * 1000000 / ticks_per_sec : 0;
+}
+
 static void configure_proxy(std::string rpszone_size,
         std::string rps_limit, std::string reqburst, std::string burstdelay,
+        unsigned int worker_connections, int flag_client_keys,
         utils_logs_ctx_t *const __utils_logs_ctx)
 {
     std::string nginx_conf = R"(
@@ -698,9 +1939,10 @@ worker_processes auto;
 error_log /dev/stderr )" NGINX_LOGLEVEL R"(;
 thread_pool tcdn_webcache_thread_pool threads=8;
 events {
-    worker_connections 1024;
+    worker_connections )" + std::to_string(worker_connections) + R"(;
 }
-worker_rlimit_nofile 30000;
+worker_rlimit_nofile )" + std::to_string(std::max(30000u,
+        worker_connections + 1024)) + R"(;
 pid )" NGINX_PIDFILE R"(;
 http {
     include )" MIME_TYPES_FILE R"(;
@@ -710,7 +1952,7 @@ http {
         server )" ORIGIN_HOST ":" ORIGIN_PORT R"(;
     }
 
-    log_format stats-log '$msec, $status';
+    log_format stats-log '$msec, $status, $limit_req_status';
     access_log )" NGINX_STATSLOG R"( stats-log;
 
     vhost_traffic_status_zone;
@@ -720,11 +1962,24 @@ http {
 
     server {
         listen )" NGINX_HOST ":" NGINX_PORT R"(;
-        server_name nginx-proxy;
+        server_name nginx-proxy;)" + (flag_client_keys ? R"(
+        vhost_traffic_status_filter_by_set_key $remote_addr )"
+        R"(client::$server_name;)" : "") + R"(
         location /test-path {
             proxy_pass http://backend;
             limit_req zone=mylimit )" + reqburst + " " + burstdelay + R"(;
         }
+        # Memory benchmark locations (see 'memory_bench.h')
+        location = )" MEMBENCH_IDLE_PATH R"( {
+            access_log off;
+            keepalive_timeout 3600s;
+            keepalive_requests 1000000;
+            return 204;
+        }
+        location /bench {
+            access_log off;
+            proxy_pass http://backend;
+        }
     }
     server {
         listen )" NGINX_HOST ":" STATS_PORT R"(;
@@ -769,6 +2024,14 @@ static void configure_origin(utils_logs_ctx_t *const __utils_logs_ctx)
             location ~ /(.*) {
                 return 200 "Server 'Origin-1' received HTTP request";
             }
+            location = )" CALIBRATION_PATH R"( {
+                access_log off;
+                return 204;
+            }
+            location = )" MEMBENCH_SLOW_PATH R"( {
+                access_log off;
+                alias )" MEMBENCH_BODY_FILE R"(;
+            }
             location = /test-path/slow-reply {
                 echo_sleep 1.0;
                 echo "Server 'Origin-1' received HTTP request; response delayed";
@@ -780,12 +2043,64 @@ static void configure_origin(utils_logs_ctx_t *const __utils_logs_ctx)
             0, LOG_CTX_GET());
 }
 
+/// Built-in origin routes emulating the nginx origin above.
+static std::vector<origin_route_t> origin_default_routes()
+{
+    std::vector<origin_route_t> routes(4);
+
+    routes[0].uri = CALIBRATION_PATH;
+    routes[0].statuses.push_back(std::make_pair(204, 1.0));
+    routes[1].uri = MEMBENCH_SLOW_PATH;
+    routes[1].body_size = MEMBENCH_BODY_SIZE;
+    routes[2].uri = "/test-path/slow-reply";
+    routes[2].latency.usecs = 1000 * 1000;
+    routes[2].body_size = 40;
+    routes[3].uri = "*";
+    routes[3].body_size = strlen("Server 'Origin-1' received HTTP request");
+    return routes;
+}
+
+/// Built-in origin routes of a degraded origin: as the default ones, but
+/// most replies are slowed down to 0.2 secs and 1 in 10 to 1 sec.
+static std::vector<origin_route_t> origin_degraded_routes()
+{
+    std::vector<origin_route_t> routes = origin_default_routes();
+    origin_latency_t &latency = routes.back().latency;
+
+    latency.type = ORIGIN_LATENCY_BIMODAL;
+    latency.usecs = 200 * 1000;
+    latency.slow_usecs = 1000 * 1000;
+    latency.slow_fraction = 0.1;
+    return routes;
+}
+
+/// Switch the built-in origin to the route table of the given phase of the
+/// setting (no-op if the setting has no such phase, or with the nginx
+/// origin).
+static void origin_phase(const setting_ctx_t *setting_ctx, size_t phase,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    if (phase >= setting_ctx->origin_phases.size())
+        return;
+    if (origin_server_configure(origin_server_ctx,
+            setting_ctx->origin_phases[phase]) != 0)
+        LOGE("Could not switch the origin to phase %zu of '%s'\n", phase,
+                setting_ctx->title.c_str());
+    trace_export_instant(trace_export_ctx, TRACE_PID_GENERATOR,
+            "origin phase " + std::to_string(phase),
+            utils_gettime_monot_usecs(LOG_CTX_GET()));
+}
+
 typedef struct trace_stats_ctx_s {
     FILE *const statsfile;
     int tot_accepted_prev;
     int tot_req_prev;
     int tot_2xx_prev;
     int tot_5xx_prev;
+    utils_cgroup_stats_t nginx_cgroup_prev;
+    utils_cgroup_stats_t generator_cgroup_prev;
+    /// Current sample time (monotonic clock, for the trace export)
+    uint64_t ts_usecs;
 } trace_stats_ctx_t;
 
 static void trace_stats_irequests(const struct json_object * jobj,
@@ -800,6 +2115,9 @@ static void trace_stats_irequests(const struct json_object * jobj,
     int tot_accepted = json_object_get_int(accepted);
 
     fprintf(ctx->statsfile, " %d", tot_accepted - ctx->tot_accepted_prev - 1);
+    trace_export_counter(trace_export_ctx, TRACE_PID_SAMPLER,
+            "proxy accepted connections", ctx->ts_usecs,
+            {{"accepted", tot_accepted - ctx->tot_accepted_prev - 1}});
 
     ctx->tot_accepted_prev = tot_accepted;
 }
@@ -838,6 +2156,14 @@ static void trace_stats_responses(const struct json_object * jobj,
 
     fprintf(ctx->statsfile, " %d %d %d %d", tot_req - ctx->tot_req_prev,
             tot_2xx - ctx->tot_2xx_prev, tot_5xx- ctx->tot_5xx_prev, level);
+    trace_export_counter(trace_export_ctx, TRACE_PID_SAMPLER,
+            "proxy responses", ctx->ts_usecs, {
+                    {"responded", tot_req - ctx->tot_req_prev},
+                    {"2xx", tot_2xx - ctx->tot_2xx_prev},
+                    {"5xx", tot_5xx- ctx->tot_5xx_prev}
+            });
+    trace_export_counter(trace_export_ctx, TRACE_PID_SAMPLER,
+            "burst queue level", ctx->ts_usecs, {{"level", level}});
 
     ctx->tot_req_prev = tot_req;
     ctx->tot_2xx_prev = tot_2xx;
@@ -862,14 +2188,42 @@ static void trace_stats(const char *stats, trace_stats_ctx_t *ctx,
     CHECK(flag_obj_freed == 1);
 }
 
+/// Trace the CFS throttling of a cgroup along the last sample period:
+/// number of throttled periods and throttled time in milliseconds (zeros if
+/// the cgroup is not used).
+static void trace_cgroup_stats(utils_cgroup_ctx_t *utils_cgroup_ctx,
+        const char *tag, utils_cgroup_stats_t *prev, trace_stats_ctx_t *ctx)
+{
+    utils_cgroup_stats_t stats;
+
+    if (utils_cgroup_ctx == nullptr ||
+            utils_cgroup_get_stats(utils_cgroup_ctx, &stats) != 0) {
+        fprintf(ctx->statsfile, " 0 0");
+        return;
+    }
+    fprintf(ctx->statsfile, " %lu %.1f",
+            (unsigned long)(stats.nr_throttled - prev->nr_throttled),
+            (float)(stats.throttled_usec - prev->throttled_usec) / 1000);
+    trace_export_counter(trace_export_ctx, TRACE_PID_SAMPLER,
+            std::string(tag) + " CFS throttling", ctx->ts_usecs, {
+                    {"throttled_periods", (double)(stats.nr_throttled -
+                            prev->nr_throttled)},
+                    {"throttled_usecs", (double)(stats.throttled_usec -
+                            prev->throttled_usec)}
+            });
+    *prev = stats;
+}
+
 static void plottingThr(const setting_ctx_t *setting_ctx,
+        const std::string output_prefix,
         utils_logs_ctx_t *const __utils_logs_ctx)
 {
     const libcurl_wrap_req_ctx_t libcurl_wrap_req_ctx = {
             .method = LIBCURL_WRAP_METHOD_GET, .headers = nullptr,
             .host = NGINX_HOST, .port = STATS_PORT,
             .location = "/status/format/json", .qstring = nullptr,
-            .body = nullptr, .tout = 5, .flag_libcurl_verbose = 0
+            .body = nullptr, .tout = 5, .flag_libcurl_verbose = 0,
+            .sink = nullptr, .source = nullptr
     };
 
     FILE *statsfile = fopen(TEST_DIR "/stats.dat", "wb");
@@ -880,41 +2234,82 @@ static void plottingThr(const setting_ctx_t *setting_ctx,
             .tot_accepted_prev = 0,
             .tot_req_prev = 0,
             .tot_2xx_prev = 0,
-            .tot_5xx_prev = 0
+            .tot_5xx_prev = 0,
+            .nginx_cgroup_prev = {},
+            .generator_cgroup_prev = {},
+            .ts_usecs = 0
     };
+    if (nginx_cgroup_ctx != nullptr)
+        utils_cgroup_get_stats(nginx_cgroup_ctx,
+                &trace_stats_ctx.nginx_cgroup_prev);
+    if (generator_cgroup_ctx != nullptr)
+        utils_cgroup_get_stats(generator_cgroup_ctx,
+                &trace_stats_ctx.generator_cgroup_prev);
 
     uint64_t tstart = utils_gettime_msecs(LOG_CTX_GET());
 
+    // Keep the status connection open from sample to sample (the sampler
+    // neither pays a connect per sample nor adds to the accepted count)
+    libcurl_wrap_session_t *status_session = libcurl_wrap_session_open(1,
+            LOG_CTX_GET());
+    uint64_t logs_suppressed_prev = utils_logs_suppressed(LOG_CTX_GET());
+
     while (!flag_exit && !flag_exit_plotting_thr) {
         long http_ret_code;
         char *response = nullptr;
 
-        int ret_code = libcurl_wrap_cli_request(&libcurl_wrap_req_ctx,
+        int ret_code = status_session != nullptr ?
+                libcurl_wrap_session_request(status_session,
+                &libcurl_wrap_req_ctx, nullptr, &response, &http_ret_code,
+                nullptr, nullptr) :
+                libcurl_wrap_cli_request(&libcurl_wrap_req_ctx,
                 nullptr, &response, &http_ret_code, nullptr, nullptr);
         CHECK(ret_code == 0 && response != nullptr);
 
         // Trace time
         uint64_t tcurr = utils_gettime_msecs(LOG_CTX_GET());
+        trace_stats_ctx.ts_usecs = utils_gettime_monot_usecs(LOG_CTX_GET());
         fprintf(statsfile, "%.1f", (float)(tcurr - tstart) / 1000);
 
         // Trace rest of stats
         trace_stats(response, &trace_stats_ctx, LOG_CTX_GET());
+        trace_cgroup_stats(nginx_cgroup_ctx, "nginx",
+                &trace_stats_ctx.nginx_cgroup_prev, &trace_stats_ctx);
+        trace_cgroup_stats(generator_cgroup_ctx, "generator",
+                &trace_stats_ctx.generator_cgroup_prev, &trace_stats_ctx);
         fprintf(statsfile, "\n");
+
+        // Traces folded by the log rate limiting along the sample period
+        uint64_t logs_suppressed = utils_logs_suppressed(LOG_CTX_GET());
+        trace_export_counter(trace_export_ctx, TRACE_PID_SAMPLER,
+                "suppressed log traces", trace_stats_ctx.ts_usecs,
+                {{"suppressed", (double)(logs_suppressed -
+                        logs_suppressed_prev)}});
+        logs_suppressed_prev = logs_suppressed;
         fflush(statsfile);
 
         if (response != nullptr)
             free(response);
+        clients_stats_drain(false);
 
         usleep(100 * 1000); // 100 milliseconds sample period
     }
+    libcurl_wrap_session_close(&status_session);
+    clients_stats_drain(false);
+    if (clients_stats_dropped.load() > 0)
+        LOGW("Client statistics ring full: %lu samples dropped\n",
+                clients_stats_dropped.exchange(0));
 
     // Print clients statistics log file
-    FILE *clistatsfile = fopen(CLIENT_STATSLOG, "wb");
+    utils_files_writer_t *clistatsfile = utils_files_writer_open(
+            CLIENT_STATSLOG, UTILS_FILES_WRITER_ATOMIC, 0, LOG_CTX_GET());
     CHECK(clistatsfile != nullptr);
     for (unsigned int i = 0; i < clients_stats.size(); i++)
-        fprintf(clistatsfile, "%s", clients_stats[i].c_str());
+        utils_files_writer_printf(clistatsfile, "%.1f %lu %.3f\n",
+                clients_stats[i].t, clients_stats[i].response_msecs,
+                clients_stats[i].lag_msecs);
     clients_stats.clear();
-    fclose(clistatsfile);
+    CHECK(utils_files_writer_close(&clistatsfile) == 0);
 
     // Plot
     FILE *gnuplot = popen("gnuplot", "w");
@@ -923,15 +2318,22 @@ static void plottingThr(const setting_ctx_t *setting_ctx,
     //fprintf(gnuplot, "set terminal\n");
     fprintf(gnuplot, "set term svg enhanced background rgb 'white' "
             "size 3440,1440\n");
-    std::string plotpath = std::string(OUTPUT_DIR) + "/" + setting_ctx->title +
-            "_plot.svg";
+    std::string plotpath = output_prefix + "_plot.svg";
     fprintf(gnuplot, "set output '%s'\n", plotpath.c_str());
     std::string plottitle = (std::string)"Plot tag: " + setting_ctx->title + "\\n";//"\"this is a\\n two line title\"";
     plottitle += "Parameters: " + setting_ctx->rps_limit + "r/s; " +
             setting_ctx->reqburst + "; " + setting_ctx->burstdelay + "\\n";
     plottitle += setting_ctx->description + "\\n";
-    fprintf(gnuplot, "set multiplot layout 2,1 title \"%s\" enhanced font 'Arial,18'\n",
-            plottitle.c_str());
+    {
+        std::lock_guard<std::mutex> lck(generator_invalid_reason_mutex);
+        if (!generator_invalid_reason.empty())
+            plottitle += "INVALID RUN (client was the bottleneck): " +
+                    generator_invalid_reason + "\\n";
+    }
+    bool flag_plot_counters = access(COUNTERS_PLOTDATA, R_OK) == 0;
+    bool flag_plot_throttling = nginx_cgroup_ctx != nullptr;
+    fprintf(gnuplot, "set multiplot layout %d,1 title \"%s\" enhanced font 'Arial,18'\n",
+            2 + flag_plot_counters + flag_plot_throttling, plottitle.c_str());
     fprintf(gnuplot, "set tmargin 1\n");
     fprintf(gnuplot, "set bmargin 3\n");
     fprintf(gnuplot, "set lmargin 10\n");
@@ -975,8 +2377,48 @@ static void plottingThr(const setting_ctx_t *setting_ctx,
     fprintf(gnuplot, "set ylabel 'milliseconds'\n");
     fprintf(gnuplot, "plot "
             "'" CLIENT_STATSLOG "' using 1:2 "
-                    "title 'client total response time' linecolor rgb 'magenta'"
+                    "title 'client total response time' linecolor rgb 'magenta', "
+            "'" CLIENT_STATSLOG "' using 1:3 "
+                    "title 'client send lag' linecolor rgb 'dark-orange'"
             "\n");
+
+    // Optional plot: CFS throttling of the isolation cgroups (to be compared
+    // against the burst queue level and the response times above)
+    if (flag_plot_throttling) {
+        fprintf(gnuplot, "set style data steps\n");
+        fprintf(gnuplot, "set ylabel 'throttled msecs / 100 msecs'\n");
+        fprintf(gnuplot, "set y2label 'throttled periods'\n");
+        fprintf(gnuplot, "set y2tics\n");
+        fprintf(gnuplot, "plot "
+                "'" TEST_DIR "/stats.dat' using 1:8 "
+                        "title 'nginx throttled time' linecolor rgb 'blue', "
+                "'" TEST_DIR "/stats.dat' using 1:10 "
+                        "title 'generator throttled time' "
+                        "linecolor rgb 'orange', "
+                "'" TEST_DIR "/stats.dat' using 1:7 axes x1y2 "
+                        "title 'nginx throttled periods' "
+                        "linecolor rgb 'cyan'"
+                "\n");
+        fprintf(gnuplot, "unset y2tics\n");
+        fprintf(gnuplot, "unset y2label\n");
+    }
+
+    // Third plot (optional): per-request event counters
+    if (flag_plot_counters) {
+        fprintf(gnuplot, "set style data histograms\n");
+        fprintf(gnuplot, "set style histogram clustered\n");
+        fprintf(gnuplot, "set autoscale x\n");
+        fprintf(gnuplot, "set xtics autofreq\n");
+        fprintf(gnuplot, "unset xlabel\n");
+        fprintf(gnuplot, "set logscale y\n");
+        fprintf(gnuplot, "set ylabel 'events per request'\n");
+        fprintf(gnuplot, "plot "
+                "'" COUNTERS_PLOTDATA "' using 2:xtic(1) "
+                        "title 'nginx workers' linecolor rgb 'blue', "
+                "'" COUNTERS_PLOTDATA "' using 3:xtic(1) "
+                        "title 'generator' linecolor rgb 'orange'"
+                "\n");
+    }
     //fprintf(gnuplot, "replot\n");
     fprintf(gnuplot, "unset multiplot\n");
     //fprintf(gnuplot, "unset output\n");
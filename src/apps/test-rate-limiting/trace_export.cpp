@@ -0,0 +1,185 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "trace_export.h"
+
+#include <stdio.h>
+#include <cmath>
+#include <mutex>
+#include <utils/utils_logs.h>
+
+// **** Definitions ****
+
+/// Output stream buffer size
+#define TRACE_EXPORT_BUF_SIZE (1024 * 1024)
+
+/// Export context structure
+typedef struct trace_export_ctx_s {
+    utils_logs_ctx_t *utils_logs_ctx;
+    std::mutex file_mutex;
+    FILE *file;
+    char *buf;
+    bool flag_first_event;
+} trace_export_ctx_t;
+
+// **** Prototypes ****
+
+static void event_write(trace_export_ctx_t *ctx, const std::string &event);
+static std::string json_string(const std::string &str);
+static std::string json_values(const trace_export_values_t &values);
+
+// **** Implementations ****
+
+trace_export_ctx_t* trace_export_open(const std::string &path,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        LOGE("Could not open trace file '%s'\n", path.c_str());
+        return nullptr;
+    }
+
+    trace_export_ctx_t *ctx = new trace_export_ctx_t();
+    ctx->utils_logs_ctx = LOG_CTX_GET();
+    ctx->file = file;
+    ctx->buf = new char[TRACE_EXPORT_BUF_SIZE];
+    setvbuf(ctx->file, ctx->buf, _IOFBF, TRACE_EXPORT_BUF_SIZE);
+    ctx->flag_first_event = true;
+    fprintf(ctx->file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    return ctx;
+}
+
+void trace_export_close(trace_export_ctx_t **ref_trace_export_ctx)
+{
+    trace_export_ctx_t *ctx;
+
+    if (ref_trace_export_ctx == nullptr ||
+            (ctx = *ref_trace_export_ctx) == nullptr)
+        return;
+
+    fprintf(ctx->file, "\n]}\n");
+    fclose(ctx->file);
+    delete[] ctx->buf;
+    delete ctx;
+    *ref_trace_export_ctx = nullptr;
+}
+
+void trace_export_process_name(trace_export_ctx_t *trace_export_ctx, int pid,
+        const std::string &name)
+{
+    if (trace_export_ctx == nullptr)
+        return;
+
+    event_write(trace_export_ctx, "{\"ph\":\"M\",\"name\":\"process_name\","
+            "\"pid\":" + std::to_string(pid) + ",\"args\":{\"name\":" +
+            json_string(name) + "}}");
+}
+
+void trace_export_slice(trace_export_ctx_t *trace_export_ctx, int pid,
+        int tid, const std::string &name, uint64_t ts_usecs,
+        uint64_t dur_usecs, const trace_export_values_t &args)
+{
+    if (trace_export_ctx == nullptr)
+        return;
+
+    event_write(trace_export_ctx, "{\"ph\":\"X\",\"name\":" +
+            json_string(name) + ",\"pid\":" + std::to_string(pid) +
+            ",\"tid\":" + std::to_string(tid) + ",\"ts\":" +
+            std::to_string(ts_usecs) + ",\"dur\":" +
+            std::to_string(dur_usecs) + (args.empty() ? "" : ",\"args\":" +
+            json_values(args)) + "}");
+}
+
+void trace_export_instant(trace_export_ctx_t *trace_export_ctx, int pid,
+        const std::string &name, uint64_t ts_usecs,
+        const trace_export_values_t &args)
+{
+    if (trace_export_ctx == nullptr)
+        return;
+
+    event_write(trace_export_ctx, "{\"ph\":\"i\",\"s\":\"p\",\"name\":" +
+            json_string(name) + ",\"pid\":" + std::to_string(pid) +
+            ",\"tid\":0,\"ts\":" + std::to_string(ts_usecs) +
+            (args.empty() ? "" : ",\"args\":" + json_values(args)) + "}");
+}
+
+void trace_export_counter(trace_export_ctx_t *trace_export_ctx, int pid,
+        const std::string &name, uint64_t ts_usecs,
+        const trace_export_values_t &values)
+{
+    if (trace_export_ctx == nullptr)
+        return;
+
+    event_write(trace_export_ctx, "{\"ph\":\"C\",\"name\":" +
+            json_string(name) + ",\"pid\":" + std::to_string(pid) +
+            ",\"ts\":" + std::to_string(ts_usecs) + ",\"args\":" +
+            json_values(values) + "}");
+}
+
+static void event_write(trace_export_ctx_t *ctx, const std::string &event)
+{
+    std::lock_guard<std::mutex> lck(ctx->file_mutex);
+    if (!ctx->flag_first_event)
+        fputs(",\n", ctx->file);
+    ctx->flag_first_event = false;
+    fputs(event.c_str(), ctx->file);
+}
+
+static std::string json_string(const std::string &str)
+{
+    std::string escaped = "\"";
+
+    for (char c: str) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char)c < 0x20) {
+            char hex[8];
+            snprintf(hex, sizeof(hex), "\\u%04x", (unsigned char)c);
+            escaped += hex;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped + "\"";
+}
+
+static std::string json_values(const trace_export_values_t &values)
+{
+    std::string obj = "{";
+
+    for (auto it = values.begin(); it != values.end(); ++it) {
+        char value[32];
+        if (!std::isfinite(it->second))
+            continue; // Not representable in JSON
+        // Integral values (the common case) are output without decimals
+        snprintf(value, sizeof(value), "%.15g", it->second);
+        if (obj.size() > 1)
+            obj += ',';
+        obj += json_string(it->first);
+        obj += ':';
+        obj += value;
+    }
+    return obj + "}";
+}
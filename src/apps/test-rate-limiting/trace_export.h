@@ -0,0 +1,92 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file trace_export.h
+/// @brief Scenario timeline export in the Chrome trace event JSON format.
+///
+/// The output loads in 'chrome://tracing' and in the Perfetto UI
+/// ('ui.perfetto.dev'). Events are streamed to the output file as they are
+/// emitted (nothing is kept in memory), so traces with millions of events
+/// are feasible. Timestamps are given in microseconds of the monotonic clock
+/// (see 'utils_gettime_monot_usecs()').
+/// All the functions are thread-safe; calls on a null instance are no-ops,
+/// so call-sites need not check whether the export is enabled.
+
+#ifndef TRACE_EXPORT_H_
+#define TRACE_EXPORT_H_
+
+#include <inttypes.h>
+#include <map>
+#include <string>
+
+// **** Definitions ****
+
+// Forward declarations
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+typedef struct trace_export_ctx_s trace_export_ctx_t;
+
+/// Numeric event arguments or counter values, by name
+typedef std::map<std::string, double> trace_export_values_t;
+
+// **** Prototypes ****
+
+/// Create the trace file and write the trace header.
+/// @param path Output path.
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return Pointer to the export context structure, NULL if fails.
+trace_export_ctx_t* trace_export_open(const std::string &path,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/// Terminate the trace (the file is not valid JSON until then) and release
+/// the export.
+/// @param ref_trace_export_ctx Reference to the pointer to the export
+/// context structure. Pointer is set to NULL on return.
+void trace_export_close(trace_export_ctx_t **ref_trace_export_ctx);
+
+/// Name a process track (trace processes are just track groups; any
+/// identifier can be used).
+void trace_export_process_name(trace_export_ctx_t *trace_export_ctx, int pid,
+        const std::string &name);
+
+/// Emit a slice (complete event). Slices of the same thread track must nest
+/// properly: phases of a request are given as slices enclosed in the slice
+/// of the whole request.
+/// @param args Optional arguments shown along the slice.
+void trace_export_slice(trace_export_ctx_t *trace_export_ctx, int pid,
+        int tid, const std::string &name, uint64_t ts_usecs,
+        uint64_t dur_usecs, const trace_export_values_t &args =
+        trace_export_values_t());
+
+/// Emit a process-wide instant event.
+void trace_export_instant(trace_export_ctx_t *trace_export_ctx, int pid,
+        const std::string &name, uint64_t ts_usecs,
+        const trace_export_values_t &args = trace_export_values_t());
+
+/// Emit a counter sample; each value is plotted as a series of the counter
+/// track.
+void trace_export_counter(trace_export_ctx_t *trace_export_ctx, int pid,
+        const std::string &name, uint64_t ts_usecs,
+        const trace_export_values_t &values);
+
+#endif /* TRACE_EXPORT_H_ */
@@ -0,0 +1,397 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "zone_sizing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <arpa/inet.h>
+#include <map>
+#include <vector>
+#include <json-c/json.h>
+#include <utils/utils_logs.h>
+#include <utils/libcurl_wrap.h>
+#include "scenario.h"
+
+// **** Definitions ****
+
+/// Key requests in flight at a time
+#define ZONE_SIZING_INFLIGHT 128
+
+/// First key source address (127.1.0.0; keys do not collide with the
+/// 127.0.0.0/16 addresses used by the rest of the test)
+#define ZONE_SIZING_SRCADDR_BASE ((127u << 24) | (1u << 16))
+
+/// Recommended sizes: headroom over the fitted need, and granularity
+#define ZONE_SIZING_HEADROOM 1.25
+#define ZONE_SIZING_ROUND_BYTES (64 * 1024)
+
+/// A zone is deemed over-provisioned beyond this factor of its recommended
+/// size
+#define ZONE_SIZING_OVER_FACTOR 2
+
+/// Zone reading at a step
+typedef struct zone_sample_s {
+    uint32_t keys;
+    /// Pages in use
+    uint64_t used_bytes;
+    /// Allocation failures (cumulative)
+    uint64_t fails;
+    /// Nodes held (VTS zone only, zero otherwise)
+    uint64_t nodes;
+} zone_sample_t;
+
+/// Zone
+typedef struct zone_s {
+    /// The VTS zone (as opposed to e.g. a limit_req zone)
+    bool flag_vts;
+    /// Configured size, and size available for allocations (pages)
+    uint64_t size;
+    uint64_t pages_bytes;
+    std::vector<zone_sample_t> samples;
+} zone_t;
+
+typedef std::map<std::string, zone_t> zones_t;
+
+// **** Prototypes ****
+
+static int keys_send(const zone_sizing_params_t &params, uint32_t keys_from,
+        uint32_t keys_to, volatile int *flag_exit,
+        utils_logs_ctx_t *const utils_logs_ctx);
+static scenario_task_t keys_spawn(std::string uri, uint32_t *next,
+        uint32_t end, uint32_t *failed);
+static scenario_task_t keys_client(std::string uri, uint32_t *next,
+        uint32_t end, uint32_t *failed);
+static int status_read(const zone_sizing_params_t &params, uint32_t keys,
+        libcurl_wrap_session_t *session, zones_t &zones,
+        utils_logs_ctx_t *const utils_logs_ctx);
+static void results_output(const zone_sizing_params_t &params,
+        const zones_t &zones, utils_logs_ctx_t *const utils_logs_ctx);
+static std::string size_string(uint64_t bytes);
+
+// **** Implementations ****
+
+int zone_sizing_run(const zone_sizing_params_t &params,
+        volatile int *flag_exit, utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    zones_t zones;
+    uint32_t keys = 0;
+    libcurl_wrap_session_t *status_session = nullptr;
+    int ret_code = -1;
+
+    CHECK_DO(params.keys_max > 0 && params.steps > 0, return -1);
+    CHECK_DO(params.keys_max < (1u << 24) - (1u << 16), return -1);
+
+    status_session = libcurl_wrap_session_open(1, LOG_CTX_GET());
+    CHECK_DO(status_session != nullptr, goto end);
+
+    printf("\nShared zones sizing: up to %u keys in %u steps (recommendations "
+            "for %u keys)\n", params.keys_max, params.steps,
+            params.keys_target);
+    printf("%10s  %-32s %14s %10s %10s\n", "keys", "zone", "used KiB",
+            "fails", "nodes");
+
+    CHECK_DO(status_read(params, 0, status_session, zones,
+            LOG_CTX_GET()) == 0, goto end);
+    for (uint32_t step = 1; step <= params.steps; step++) {
+        uint32_t keys_to = (uint32_t)((uint64_t)params.keys_max * step /
+                params.steps);
+
+        if (keys_send(params, keys, keys_to, flag_exit, LOG_CTX_GET()) != 0)
+            goto end;
+        keys = keys_to;
+        CHECK_DO(status_read(params, keys, status_session, zones,
+                LOG_CTX_GET()) == 0, goto end);
+
+        for (zones_t::const_iterator it = zones.begin(); it != zones.end();
+                ++it) {
+            const zone_sample_t &smp = it->second.samples.back();
+            printf("%10u  %-32s %14.1f %10" PRIu64 " %10" PRIu64 "\n", keys,
+                    it->first.c_str(), (double)smp.used_bytes / 1024,
+                    smp.fails, smp.nodes);
+        }
+    }
+
+    results_output(params, zones, LOG_CTX_GET());
+    ret_code = 0;
+end:
+    libcurl_wrap_session_close(&status_session);
+    return ret_code;
+}
+
+/// Request the location once per key in [keys_from, keys_to).
+static int keys_send(const zone_sizing_params_t &params, uint32_t keys_from,
+        uint32_t keys_to, volatile int *flag_exit,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    scenario_params_t scenario_params;
+    uint32_t next = keys_from, failed = 0;
+
+    scenario_params.host = params.host;
+    scenario_params.port = params.port;
+    scenario_params.tout_secs = 5;
+    scenario_params.flag_exit = flag_exit;
+    if (scenario_run(scenario_params, keys_spawn(params.location, &next,
+            keys_to, &failed), LOG_CTX_GET()) != 0)
+        return -1;
+    if (failed > 0)
+        LOGW("%u of the keys %u to %u failed to be requested\n", failed,
+                keys_from, keys_to - 1);
+    return 0;
+}
+
+static scenario_task_t keys_spawn(std::string uri, uint32_t *next,
+        uint32_t end, uint32_t *failed)
+{
+    for (int i = 0; i < ZONE_SIZING_INFLIGHT; i++)
+        scenario_spawn(keys_client(uri, next, end, failed));
+    co_return;
+}
+
+/// Request the location from the next keys source addresses until 'end'.
+static scenario_task_t keys_client(std::string uri, uint32_t *next,
+        uint32_t end, uint32_t *failed)
+{
+    while (*next < end) {
+        struct in_addr addr;
+        char source[INET_ADDRSTRLEN];
+
+        addr.s_addr = htonl(ZONE_SIZING_SRCADDR_BASE + (*next)++);
+        inet_ntop(AF_INET, &addr, source, sizeof(source));
+        scenario_response_t response = co_await scenario_request_from(uri,
+                source);
+        if (response.http_code == 0)
+            (*failed)++;
+    }
+}
+
+/// Read the slab report of every zone (and the VTS zone nodes).
+static int status_read(const zone_sizing_params_t &params, uint32_t keys,
+        libcurl_wrap_session_t *session, zones_t &zones,
+        utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    long http_code = 0;
+    char *response_str = nullptr;
+    const libcurl_wrap_req_ctx_t req_ctx = {
+            .method = LIBCURL_WRAP_METHOD_GET, .headers = nullptr,
+            .host = params.status_host, .port = params.status_port,
+            .location = params.status_location, .qstring = nullptr,
+            .body = nullptr, .tout = 5, .flag_libcurl_verbose = 0,
+            .sink = nullptr, .source = nullptr
+    };
+    struct json_object *jobj = nullptr, *jshared, *jslab, *jval;
+    std::string vts_name;
+    uint64_t vts_nodes = 0;
+    int ret_code = -1;
+
+    if (libcurl_wrap_session_request(session, &req_ctx, nullptr,
+            &response_str, &http_code, nullptr, nullptr) != 0 ||
+            http_code != 200 || response_str == nullptr) {
+        LOGE("Could not read the status at %s:%s%s\n", params.status_host,
+                params.status_port, params.status_location);
+        goto end;
+    }
+    CHECK_DO((jobj = json_tokener_parse(response_str)) != nullptr, goto end);
+    if (!json_object_object_get_ex(jobj, "slabZones", &jslab)) {
+        LOGE("No slab report in the status (VTS module without "
+                "'slabZones')\n");
+        goto end;
+    }
+    if (json_object_object_get_ex(jobj, "sharedZones", &jshared)) {
+        if (json_object_object_get_ex(jshared, "name", &jval))
+            vts_name = json_object_get_string(jval);
+        if (json_object_object_get_ex(jshared, "usedNode", &jval))
+            vts_nodes = (uint64_t)json_object_get_int64(jval);
+    }
+
+    // (scoped: the iteration macro declares variables)
+    {
+        json_object_object_foreach(jslab, name, jzone) {
+            struct json_object *jslots;
+            zone_t &zone = zones[name];
+            zone_sample_t smp = {};
+            uint64_t page_size = 0, pages = 0, free_pages = 0;
+
+            if (json_object_object_get_ex(jzone, "size", &jval))
+                zone.size = (uint64_t)json_object_get_int64(jval);
+            if (json_object_object_get_ex(jzone, "pageSize", &jval))
+                page_size = (uint64_t)json_object_get_int64(jval);
+            if (json_object_object_get_ex(jzone, "pages", &jval))
+                pages = (uint64_t)json_object_get_int64(jval);
+            if (json_object_object_get_ex(jzone, "freePages", &jval))
+                free_pages = (uint64_t)json_object_get_int64(jval);
+            if (json_object_object_get_ex(jzone, "slots", &jslots)) {
+                for (size_t i = 0; i < json_object_array_length(jslots); i++) {
+                    if (json_object_object_get_ex(json_object_array_get_idx(
+                            jslots, i), "fails", &jval))
+                        smp.fails += (uint64_t)json_object_get_int64(jval);
+                }
+            }
+            zone.flag_vts = vts_name == name;
+            zone.pages_bytes = pages * page_size;
+            smp.keys = keys;
+            smp.used_bytes = (pages - std::min(pages, free_pages)) * page_size;
+            smp.nodes = zone.flag_vts ? vts_nodes : 0;
+            zone.samples.push_back(smp);
+        }
+    }
+    ret_code = 0;
+end:
+    if (jobj != nullptr)
+        json_object_put(jobj);
+    if (response_str != nullptr)
+        free(response_str);
+    return ret_code;
+}
+
+/// Fit, recommend, print and save.
+static void results_output(const zone_sizing_params_t &params,
+        const zones_t &zones, utils_logs_ctx_t *const __utils_logs_ctx)
+{
+    std::string path = params.output_prefix + ".json";
+    json_object *jobj = json_object_new_object();
+    json_object *jzones = json_object_new_object();
+
+    json_object_object_add(jobj, "keys_max",
+            json_object_new_int64(params.keys_max));
+    json_object_object_add(jobj, "keys_target",
+            json_object_new_int64(params.keys_target));
+
+    printf("\n%-32s %10s %10s %12s %10s %10s %10s  %s\n", "zone", "size",
+            "fixed KiB", "bytes/key", "capacity", "lost keys", "recommend",
+            "verdict");
+    for (zones_t::const_iterator it = zones.begin(); it != zones.end(); ++it) {
+        const zone_t &zone = it->second;
+        const zone_sample_t &first = zone.samples.front();
+        const zone_sample_t &last = zone.samples.back();
+        double sx = 0, sy = 0, sxx = 0, sxy = 0, n = 0;
+        double fixed = 0, per_key = 0, capacity = INFINITY;
+        uint64_t recommended = 0, lost;
+        const char *verdict = "unknown";
+
+        // Least-squares of the used memory against the keys held: the keys
+        // sent until the first allocation failure (the zone is saturated
+        // then), or the VTS nodes (a VTS node takes whole pages, whose
+        // allocation failures are not counted in the slots)
+        for (size_t i = 0; i < zone.samples.size(); i++) {
+            const zone_sample_t &smp = zone.samples[i];
+            double x = zone.flag_vts ? (double)(smp.nodes - first.nodes) :
+                    (double)smp.keys;
+            if (!zone.flag_vts && smp.fails != first.fails)
+                break;
+            sx += x;
+            sy += (double)smp.used_bytes;
+            sxx += x * x;
+            sxy += x * smp.used_bytes;
+            n++;
+        }
+        // Keys lost: evicted (limit_req) or not tracked (VTS)
+        lost = zone.flag_vts ? last.keys - std::min<uint64_t>(last.keys,
+                last.nodes - first.nodes) : last.fails - first.fails;
+        if (n >= 2 && n * sxx - sx * sx > 0) {
+            per_key = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+            fixed = (sy - per_key * sx) / n;
+            if (per_key > 0)
+                capacity = ((double)zone.pages_bytes - fixed) / per_key;
+            // Scale by the zone own overhead (slab pool header and page
+            // descriptors) and round
+            double need = (fixed + per_key * params.keys_target) *
+                    ZONE_SIZING_HEADROOM * zone.size /
+                    std::max<uint64_t>(zone.pages_bytes, 1);
+            recommended = (uint64_t)ceil(need / ZONE_SIZING_ROUND_BYTES) *
+                    ZONE_SIZING_ROUND_BYTES;
+            verdict = zone.size < recommended ? "under-provisioned" :
+                    zone.size > ZONE_SIZING_OVER_FACTOR * recommended ?
+                    "over-provisioned" : "ok";
+        }
+
+        printf("%-32s %10s %10.1f %12.1f %10.0f %10" PRIu64 " %10s  %s\n",
+                it->first.c_str(), size_string(zone.size).c_str(),
+                fixed / 1024, per_key, capacity, lost,
+                recommended ? size_string(recommended).c_str() : "-",
+                verdict);
+
+        json_object *jzone = json_object_new_object();
+        json_object_object_add(jzone, "vts",
+                json_object_new_boolean(zone.flag_vts));
+        json_object_object_add(jzone, "size",
+                json_object_new_int64((int64_t)zone.size));
+        json_object_object_add(jzone, "fixed_bytes",
+                json_object_new_double(fixed));
+        json_object_object_add(jzone, "bytes_per_key",
+                json_object_new_double(per_key));
+        json_object_object_add(jzone, "fit_points",
+                json_object_new_int((int)n));
+        if (std::isfinite(capacity))
+            json_object_object_add(jzone, "capacity_keys",
+                    json_object_new_int64((int64_t)capacity));
+        json_object_object_add(jzone, "alloc_fails",
+                json_object_new_int64((int64_t)(last.fails - first.fails)));
+        json_object_object_add(jzone, zone.flag_vts ? "untracked_keys" :
+                "evicted_keys", json_object_new_int64((int64_t)lost));
+        if (recommended > 0) {
+            json_object_object_add(jzone, "recommended_size",
+                    json_object_new_string(size_string(recommended).c_str()));
+            json_object_object_add(jzone, "recommended_bytes",
+                    json_object_new_int64((int64_t)recommended));
+        }
+        json_object_object_add(jzone, "verdict",
+                json_object_new_string(verdict));
+
+        json_object *jsamples = json_object_new_array();
+        for (size_t i = 0; i < zone.samples.size(); i++) {
+            json_object *jsmp = json_object_new_object();
+            json_object_object_add(jsmp, "keys",
+                    json_object_new_int64(zone.samples[i].keys));
+            json_object_object_add(jsmp, "used_bytes",
+                    json_object_new_int64((int64_t)zone.samples[i].used_bytes));
+            json_object_object_add(jsmp, "fails",
+                    json_object_new_int64((int64_t)zone.samples[i].fails));
+            if (zone.flag_vts)
+                json_object_object_add(jsmp, "nodes",
+                        json_object_new_int64((int64_t)zone.samples[i].nodes));
+            json_object_array_add(jsamples, jsmp);
+        }
+        json_object_object_add(jzone, "samples", jsamples);
+        json_object_object_add(jzones, it->first.c_str(), jzone);
+    }
+    json_object_object_add(jobj, "zones", jzones);
+
+    if (json_object_to_file_ext(path.c_str(), jobj,
+            JSON_C_TO_STRING_PRETTY) == 0)
+        printf("\nZone sizing results written to '%s'\n", path.c_str());
+    else
+        LOGE("Could not write '%s'\n", path.c_str());
+    json_object_put(jobj);
+}
+
+/// Size in nginx configuration syntax (e.g. "10m", "320k").
+static std::string size_string(uint64_t bytes)
+{
+    if (bytes % (1024 * 1024) == 0)
+        return std::to_string(bytes / (1024 * 1024)) + "m";
+    return std::to_string((bytes + 1023) / 1024) + "k";
+}
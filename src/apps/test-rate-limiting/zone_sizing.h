@@ -0,0 +1,84 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file zone_sizing.h
+/// @brief Shared memory zones footprint versus key cardinality.
+///
+/// Grows the number of distinct client keys seen by the nginx proxy step by
+/// step (each key being a distinct loopback source address, so it is both a
+/// '$binary_remote_addr' rate-limiting key and a per-client VTS filter key).
+/// After each step the slab allocator report of every shared zone is read
+/// from the VTS JSON status ('slabZones', plus 'sharedZones' for the VTS
+/// zone nodes). Then, per zone:
+/// - the used memory is fitted linearly against the number of keys held
+/// (fixed overhead and bytes per key): the keys sent until the first
+/// allocation failure, or the VTS nodes;
+/// - lost keys are counted: in a limit_req zone each allocation failure
+/// forces the eviction of the least recently used key (whose rate state is
+/// lost), while the VTS zone just stops tracking new keys;
+/// - a zone size is recommended for the target number of keys.
+
+#ifndef ZONE_SIZING_H_
+#define ZONE_SIZING_H_
+
+#include <inttypes.h>
+#include <string>
+
+// **** Definitions ****
+
+// Forward declarations
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+
+/// Sizing parameters
+typedef struct zone_sizing_params_s {
+    /// Nginx proxy address
+    const char *host;
+    const char *port;
+    /// Location using the zones (requested once per key)
+    const char *location;
+    /// VTS JSON status address and location
+    const char *status_host;
+    const char *status_port;
+    const char *status_location;
+    /// Maximum number of keys and number of steps to reach it
+    uint32_t keys_max;
+    uint32_t steps;
+    /// Number of keys the recommended sizes are computed for
+    uint32_t keys_target;
+    /// Path prefix of the results file ('<prefix>.json')
+    std::string output_prefix;
+} zone_sizing_params_t;
+
+// **** Prototypes ****
+
+/// Run the sizing (blocking).
+/// @param params Sizing parameters.
+/// @param flag_exit Pointer to the application exit flag; the sizing
+/// returns as soon as it is set.
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return 0 if succeed, -1 otherwise.
+int zone_sizing_run(const zone_sizing_params_t &params,
+        volatile int *flag_exit, utils_logs_ctx_t *const utils_logs_ctx);
+
+#endif /* ZONE_SIZING_H_ */
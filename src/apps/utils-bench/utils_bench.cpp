@@ -0,0 +1,779 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file utils_bench.cpp
+/// @brief Microbenchmarks of the utils library.
+///
+/// Each benchmark runs a batch of operations per repetition, after a few
+/// warm-up repetitions, on a (optionally) pinned CPU. The median and the
+/// median absolute deviation (MAD) of the time per operation over the
+/// repetitions are printed and written as JSON, so that they can be tracked
+/// (and compared) across commits.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sched.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <utils/utils_logs.h>
+#include <utils/utils_time.h>
+#include <utils/utils_timer.h>
+#include <utils/utils_files.h>
+#include <utils/interr_usleep.h>
+#include <utils/libcurl_wrap.h>
+#include <utils/utils_ring.h>
+#include <utils/utils_pool.h>
+#include <utils/utils_arena.h>
+
+// **** Definitions ****
+
+/// Default results file
+#define RESULTS_FILE_DEFAULT PREFIX "/tmp/utils_bench.json"
+
+/// Scratch folder of the file benchmarks (removed on exit)
+#define BENCH_DIR PREFIX "/tmp/utils_bench"
+
+#define WARMUP_REPS_DEFAULT 3
+#define REPS_DEFAULT 15
+
+/// Size of the file written and scanned by the file benchmarks
+#define FILE_BENCH_SIZE (64 * 1024 * 1024)
+#define FILE_BENCH_LINE "0123456789abcdef0123456789abcdef0123456789abcdef01234\n"
+
+/// Traces per repetition of the asynchronous logs benchmark, ring size (room
+/// for all of them) and time left to the back-end to drain them
+#define LOGS_ASYNC_OPS 10000
+#define LOGS_ASYNC_RING_SIZE (2 * 1024 * 1024)
+#define LOGS_ASYNC_DRAIN_USECS (50 * 1000)
+
+/// Local origin of the request benchmarks
+#define ORIGIN_HOST "127.0.0.1"
+#define ORIGIN_RESPONSE "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello"
+
+/// A benchmark
+typedef struct bench_s {
+    const char *name;
+    /// Operations per repetition
+    uint64_t ops;
+    /// Bytes processed per operation (throughput is reported if non-zero)
+    uint64_t bytes_per_op;
+    /// Run the given number of operations, return the time they took
+    /// [nanoseconds] or zero on error
+    std::function<uint64_t(uint64_t ops)> run;
+} bench_t;
+
+/// Statistics of a benchmark over its repetitions [nanoseconds/operation]
+typedef struct bench_result_s {
+    const bench_t *bench;
+    uint32_t reps;
+    double median;
+    double mad;
+    double min;
+} bench_result_t;
+
+/// Command-line options
+typedef struct options_ctx_s {
+    const char *results_file;
+    /// Pin the benchmarks to this CPU if non-negative
+    int cpu;
+    uint32_t warmup_reps;
+    uint32_t reps;
+    /// Run only the benchmarks whose name contains this string if non-null
+    const char *filter;
+    /// Label of the results (e.g. the commit they were taken at)
+    const char *tag;
+} options_ctx_t;
+
+/// Single connection HTTP/1.1 responder (one connection at a time, which is
+/// all the sequential request benchmarks need)
+typedef struct origin_ctx_s {
+    int listen_fd;
+    int port;
+    std::atomic<bool> flag_exit;
+    std::thread thread;
+} origin_ctx_t;
+
+static options_ctx_t options = {
+        .results_file = RESULTS_FILE_DEFAULT,
+        .cpu = -1,
+        .warmup_reps = WARMUP_REPS_DEFAULT,
+        .reps = REPS_DEFAULT,
+        .filter = nullptr,
+        .tag = nullptr
+};
+
+// **** Prototypes ****
+
+static void usage(const char *prog_name);
+static int parse_options(int argc, char* argv[]);
+static uint64_t now_nsecs();
+static bench_result_t bench_run(const bench_t &bench);
+static int results_write(const std::vector<bench_result_t> &results);
+static void logs_discard(void *opaque_logger_ctx_ptr,
+        utils_logs_level_t utils_logs_level, const char *fileName,
+        int lineNo, const char *funcName, const char *format, va_list args);
+static uint64_t logs_async(utils_logs_ctx_t *utils_logs_ctx, uint64_t ops);
+static uint64_t usleep_wakeup(uint64_t ops);
+static int records_input_write(const char *path);
+static int origin_open(origin_ctx_t *origin);
+static void origin_close(origin_ctx_t *origin);
+static void origin_thr(origin_ctx_t *origin);
+
+// **** Implementations ****
+
+int main(int argc, char* argv[])
+{
+    std::vector<bench_t> benches;
+    std::vector<bench_result_t> results;
+    origin_ctx_t origin;
+    int ret = EXIT_FAILURE;
+
+    origin.listen_fd = -1;
+    if (parse_options(argc, argv) != 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.cpu >= 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(options.cpu, &cpuset);
+        if (sched_setaffinity(0, sizeof(cpuset), &cpuset) != 0) {
+            fprintf(stderr, "Could not pin to CPU %d: %s\n", options.cpu,
+                    strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    uint64_t logs_discarded = 0;
+    utils_logs_ctx_t *logs_ctx = utils_logs_open(&logs_discarded,
+            logs_discard);
+    utils_logs_ctx_t *logs_binary_ctx = nullptr, *logs_async_ctx = nullptr;
+    libcurl_wrap_session_t *session = nullptr;
+    utils_timer_wheel_t *timer_wheel = nullptr;
+    std::vector<utils_timer_t> timers(1024);
+    std::string port;
+    std::string file_path = BENCH_DIR "/records.txt";
+    std::string records_path = BENCH_DIR "/records_input.txt";
+    std::string binary_log_path = BENCH_DIR "/binary.log";
+    const size_t line_size = strlen(FILE_BENCH_LINE);
+
+    utils_tsc_calibrate(nullptr); // falls back on 'clock_gettime()'
+    libcurl_wrap_init_global();
+    utils_files_mkpath(BENCH_DIR, 0755, nullptr);
+    if (logs_ctx == nullptr || origin_open(&origin) != 0 ||
+            (session = libcurl_wrap_session_open(1, nullptr)) == nullptr ||
+            (timer_wheel = utils_timer_wheel_open(0, nullptr)) == nullptr ||
+            records_input_write(records_path.c_str()) != 0) {
+        fprintf(stderr, "Could not set the benchmarks up\n");
+        goto end;
+    }
+    logs_binary_ctx = utils_logs_open_binary(binary_log_path.c_str(), 0);
+    logs_async_ctx = utils_logs_open_async(LOGS_ASYNC_RING_SIZE);
+    port = std::to_string(origin.port);
+
+    // Clocks
+    benches.push_back({"utils_gettime_monot_usecs", 1000000, 0,
+            [](uint64_t ops) {
+                uint64_t t0 = now_nsecs(), sum = 0;
+                for (uint64_t i = 0; i < ops; i++)
+                    sum += utils_gettime_monot_usecs(nullptr);
+                __asm__ volatile("" :: "r"(sum));
+                return now_nsecs() - t0;
+            }});
+    benches.push_back({"utils_gettime_msecs", 1000000, 0,
+            [](uint64_t ops) {
+                uint64_t t0 = now_nsecs(), sum = 0;
+                for (uint64_t i = 0; i < ops; i++)
+                    sum += utils_gettime_msecs(nullptr);
+                __asm__ volatile("" :: "r"(sum));
+                return now_nsecs() - t0;
+            }});
+    benches.push_back({"utils_gettime_tsc_monot_nsecs", 1000000, 0,
+            [](uint64_t ops) {
+                uint64_t t0 = now_nsecs(), sum = 0;
+                for (uint64_t i = 0; i < ops; i++)
+                    sum += utils_gettime_tsc_monot_nsecs();
+                __asm__ volatile("" :: "r"(sum));
+                return now_nsecs() - t0;
+            }});
+    benches.push_back({"utils_gettime_thread_cputime_usecs", 100000, 0,
+            [](uint64_t ops) {
+                uint64_t t0 = now_nsecs(), sum = 0;
+                for (uint64_t i = 0; i < ops; i++)
+                    sum += utils_gettime_thread_cputime_usecs(nullptr);
+                __asm__ volatile("" :: "r"(sum));
+                return now_nsecs() - t0;
+            }});
+
+    // Logs: formatting and dispatch to a discarding back-end, producer side
+    // of the asynchronous back-end, and binary records (no formatting)
+    benches.push_back({"utils_logs_trace", 100000, 0,
+            [logs_ctx](uint64_t ops) {
+                uint64_t t0 = now_nsecs();
+                for (uint64_t i = 0; i < ops; i++)
+                    utils_logs_trace(logs_ctx, UTILS_LOGS_DBG, __FILE__,
+                            __LINE__, __func__, "Request %lu done: %d %s\n",
+                            (unsigned long)i, 200, "/test-path/myfile");
+                return now_nsecs() - t0;
+            }});
+    if (logs_async_ctx != nullptr)
+        benches.push_back({"utils_logs_trace_async", LOGS_ASYNC_OPS, 0,
+                [logs_async_ctx](uint64_t ops) {
+                    return logs_async(logs_async_ctx, ops);
+                }});
+    if (logs_binary_ctx != nullptr)
+        benches.push_back({"utils_logs_trace_binary", 100000, 0,
+                [logs_binary_ctx](uint64_t ops) {
+                    LOG_CTX_INIT(logs_binary_ctx);
+                    uint64_t t0 = now_nsecs();
+                    for (uint64_t i = 0; i < ops; i++)
+                        LOGD("Request %lu done: %d %s\n", (unsigned long)i,
+                                200, "/test-path/myfile");
+                    return now_nsecs() - t0;
+                }});
+
+    // Wake-up latency of a thread blocked in 'interr_usleep()'
+    benches.push_back({"interr_usleep_wakeup", 20, 0, usleep_wakeup});
+
+    // Timer wheel
+    benches.push_back({"utils_timer_wheel_add_cancel", 1000000, 0,
+            [timer_wheel, &timers](uint64_t ops) {
+                for (size_t i = 0; i < timers.size(); i++)
+                    utils_timer_init(&timers[i], nullptr, nullptr);
+                uint64_t now = utils_gettime_monot_usecs(nullptr);
+                uint64_t t0 = now_nsecs();
+                for (uint64_t i = 0; i < ops; i++) {
+                    utils_timer_t *timer = &timers[i % timers.size()];
+                    utils_timer_wheel_add(timer_wheel, timer,
+                            now + 1000000 + (i * 7919) % 10000000);
+                    if (i >= timers.size() / 2)
+                        utils_timer_wheel_cancel(timer_wheel,
+                                &timers[(i - timers.size() / 2) %
+                                timers.size()]);
+                }
+                uint64_t elapsed = now_nsecs() - t0;
+                for (size_t i = 0; i < timers.size(); i++)
+                    utils_timer_wheel_cancel(timer_wheel, &timers[i]);
+                return elapsed;
+            }});
+
+    // Requests against the local origin: a new connection per request, and
+    // a session reusing its connection
+    benches.push_back({"libcurl_wrap_cli_request", 200, 0,
+            [&port](uint64_t ops) {
+                libcurl_wrap_sink_t sink = {};
+                sink.type = LIBCURL_WRAP_SINK_DISCARD;
+                libcurl_wrap_req_ctx_t req_ctx = {};
+                req_ctx.method = LIBCURL_WRAP_METHOD_GET;
+                req_ctx.host = ORIGIN_HOST;
+                req_ctx.port = port.c_str();
+                req_ctx.location = "/bench";
+                req_ctx.tout = 5;
+                req_ctx.sink = &sink;
+                uint64_t t0 = now_nsecs();
+                for (uint64_t i = 0; i < ops; i++) {
+                    long http_code = 0;
+                    char *response = nullptr; // not used with a sink
+                    if (libcurl_wrap_cli_request(&req_ctx, nullptr,
+                            &response, &http_code, nullptr, nullptr) != 0 ||
+                            http_code != 200)
+                        return (uint64_t)0;
+                }
+                return now_nsecs() - t0;
+            }});
+    benches.push_back({"libcurl_wrap_session_request", 2000, 0,
+            [&port, session](uint64_t ops) {
+                libcurl_wrap_sink_t sink = {};
+                sink.type = LIBCURL_WRAP_SINK_DISCARD;
+                libcurl_wrap_req_ctx_t req_ctx = {};
+                req_ctx.method = LIBCURL_WRAP_METHOD_GET;
+                req_ctx.host = ORIGIN_HOST;
+                req_ctx.port = port.c_str();
+                req_ctx.location = "/bench";
+                req_ctx.tout = 5;
+                req_ctx.sink = &sink;
+                uint64_t t0 = now_nsecs();
+                for (uint64_t i = 0; i < ops; i++) {
+                    long http_code = 0;
+                    char *response = nullptr;
+                    if (libcurl_wrap_session_request(session, &req_ctx,
+                            nullptr, &response, &http_code, nullptr,
+                            nullptr) != 0 || http_code != 200)
+                        return (uint64_t)0;
+                }
+                return now_nsecs() - t0;
+            }});
+
+    // Files: buffered writes, and mapped scans of an input of their own
+    benches.push_back({"utils_files_writer_write", FILE_BENCH_SIZE /
+            line_size, line_size,
+            [&file_path, line_size](uint64_t ops) {
+                uint64_t t0 = now_nsecs();
+                utils_files_writer_t *writer = utils_files_writer_open(
+                        file_path.c_str(), 0, 0, nullptr);
+                for (uint64_t i = 0; i < ops; i++)
+                    utils_files_writer_write(writer, FILE_BENCH_LINE,
+                            line_size);
+                if (utils_files_writer_close(&writer) != 0)
+                    return (uint64_t)0;
+                return now_nsecs() - t0;
+            }});
+    benches.push_back({"utils_files_records_next", FILE_BENCH_SIZE /
+            line_size, line_size,
+            [&records_path](uint64_t ops) {
+                utils_files_records_t records;
+                const char *record;
+                size_t size, sum = 0;
+                uint64_t i, t0 = now_nsecs();
+                utils_files_map_t *map = utils_files_map_open(
+                        records_path.c_str(), nullptr);
+                if (map == nullptr)
+                    return (uint64_t)0;
+                utils_files_records_init(&records, map, 0, '\n');
+                for (i = 0; i < ops &&
+                        utils_files_records_next(&records, &record, &size);
+                        i++)
+                    sum += size + (size_t)record[0];
+                utils_files_map_close(&map);
+                __asm__ volatile("" :: "r"(sum));
+                if (i < ops)
+                    return (uint64_t)0; // input shorter than expected
+                return now_nsecs() - t0;
+            }});
+    benches.push_back({"utils_files_dump2file", 1000, 0,
+            [](uint64_t ops) {
+                uint64_t t0 = now_nsecs();
+                for (uint64_t i = 0; i < ops; i++)
+                    utils_files_dump2file(FILE_BENCH_LINE, BENCH_DIR
+                            "/dump.txt", 0, 0, 0, nullptr);
+                return now_nsecs() - t0;
+            }});
+
+    // Containers of the request paths (push and pop of one item)
+    benches.push_back({"utils_ring_spsc_push_pop", 1000000, 0,
+            [](uint64_t ops) {
+                utils_ring_spsc<uint64_t> ring(1024);
+                uint64_t item = 0, sum = 0;
+                uint64_t t0 = now_nsecs();
+                for (uint64_t i = 0; i < ops; i++) {
+                    ring.push(i);
+                    ring.pop(item);
+                    sum += item;
+                }
+                __asm__ volatile("" :: "r"(sum));
+                return now_nsecs() - t0;
+            }});
+    benches.push_back({"utils_ring_mpsc_push_pop", 1000000, 0,
+            [](uint64_t ops) {
+                utils_ring_mpsc<uint64_t> ring(1024);
+                uint64_t item = 0, sum = 0;
+                uint64_t t0 = now_nsecs();
+                for (uint64_t i = 0; i < ops; i++) {
+                    ring.push(i);
+                    ring.pop(item);
+                    sum += item;
+                }
+                __asm__ volatile("" :: "r"(sum));
+                return now_nsecs() - t0;
+            }});
+    benches.push_back({"utils_pool_get_put", 1000000, 0,
+            [](uint64_t ops) {
+                utils_pool<std::array<char, 256> > pool;
+                std::array<char, 256> *objs[16];
+                uint64_t t0 = now_nsecs();
+                for (uint64_t i = 0; i < ops; i += 16) {
+                    for (int j = 0; j < 16; j++)
+                        objs[j] = pool.get();
+                    for (int j = 0; j < 16; j++)
+                        pool.put(objs[j]);
+                }
+                return now_nsecs() - t0;
+            }});
+    benches.push_back({"new_delete", 1000000, 0,
+            [](uint64_t ops) {
+                std::array<char, 256> *objs[16];
+                uint64_t t0 = now_nsecs();
+                for (uint64_t i = 0; i < ops; i += 16) {
+                    for (int j = 0; j < 16; j++) {
+                        objs[j] = new std::array<char, 256>();
+                        __asm__ volatile("" :: "r"(objs[j]) : "memory");
+                    }
+                    for (int j = 0; j < 16; j++)
+                        delete objs[j];
+                }
+                return now_nsecs() - t0;
+            }});
+    benches.push_back({"utils_arena_alloc", 1000000, 0,
+            [](uint64_t ops) {
+                static thread_local utils_arena arena;
+                uint64_t t0 = now_nsecs();
+                for (uint64_t i = 0; i < ops; i++) {
+                    void *p = arena.alloc(64);
+                    __asm__ volatile("" :: "r"(p) : "memory");
+                    if ((i & 1023) == 1023)
+                        arena.reset();
+                }
+                arena.reset();
+                return now_nsecs() - t0;
+            }});
+
+    printf("%-36s %12s %10s %12s %10s\n", "benchmark", "median[ns]",
+            "mad[ns]", "min[ns]", "MB/s");
+    for (size_t i = 0; i < benches.size(); i++) {
+        if (options.filter != nullptr &&
+                strstr(benches[i].name, options.filter) == nullptr)
+            continue;
+        bench_result_t result = bench_run(benches[i]);
+        if (result.reps == 0) {
+            fprintf(stderr, "Benchmark '%s' failed\n", benches[i].name);
+            continue;
+        }
+        printf("%-36s %12.1f %10.1f %12.1f", benches[i].name, result.median,
+                result.mad, result.min);
+        if (benches[i].bytes_per_op != 0)
+            printf(" %10.1f", benches[i].bytes_per_op * 1e3 / result.median);
+        printf("\n");
+        results.push_back(result);
+    }
+
+    if (results_write(results) == 0) {
+        printf("\nResults written to '%s'\n", options.results_file);
+        ret = EXIT_SUCCESS;
+    }
+end:
+    utils_timer_wheel_close(&timer_wheel);
+    libcurl_wrap_session_close(&session);
+    origin_close(&origin);
+    libcurl_wrap_deinit_global();
+    utils_logs_close(&logs_async_ctx);
+    utils_logs_close(&logs_binary_ctx);
+    utils_logs_close(&logs_ctx);
+    utils_rmpath(BENCH_DIR, nullptr);
+    return ret;
+}
+
+static void usage(const char *prog_name)
+{
+    printf("\nUsage: %s [OPTIONS]\n\n"
+            "Options:\n"
+            "  -o, --output=FILE    Results JSON file (default: '%s').\n"
+            "  -c, --cpu=CPU        Pin the benchmarks to the given CPU.\n"
+            "  -w, --warmup=N       Warm-up repetitions (default: %d).\n"
+            "  -r, --reps=N         Measured repetitions (default: %d).\n"
+            "  -f, --filter=STRING  Only run the benchmarks whose name "
+            "contains STRING.\n"
+            "  -t, --tag=STRING     Label stored with the results (e.g. the "
+            "commit id).\n"
+            "  -h, --help           Print this help.\n\n", prog_name,
+            RESULTS_FILE_DEFAULT, WARMUP_REPS_DEFAULT, REPS_DEFAULT);
+}
+
+static int parse_options(int argc, char* argv[])
+{
+    static const struct option long_options[] = {
+            {"output", required_argument, nullptr, 'o'},
+            {"cpu", required_argument, nullptr, 'c'},
+            {"warmup", required_argument, nullptr, 'w'},
+            {"reps", required_argument, nullptr, 'r'},
+            {"filter", required_argument, nullptr, 'f'},
+            {"tag", required_argument, nullptr, 't'},
+            {"help", no_argument, nullptr, 'h'},
+            {nullptr, 0, nullptr, 0}
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "o:c:w:r:f:t:h", long_options,
+            nullptr)) != -1) {
+        switch (opt) {
+        case 'o':
+            options.results_file = optarg;
+            break;
+        case 'c':
+            options.cpu = atoi(optarg);
+            break;
+        case 'w':
+            options.warmup_reps = (uint32_t)atoi(optarg);
+            break;
+        case 'r':
+            options.reps = (uint32_t)atoi(optarg);
+            if (options.reps == 0)
+                return -1;
+            break;
+        case 'f':
+            options.filter = optarg;
+            break;
+        case 't':
+            options.tag = optarg;
+            break;
+        case 'h':
+        default:
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static uint64_t now_nsecs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/// Run the warm-up and the measured repetitions of a benchmark.
+/// @return The statistics ('reps' is zero if the benchmark failed).
+static bench_result_t bench_run(const bench_t &bench)
+{
+    bench_result_t result = {&bench, 0, 0, 0, 0};
+    std::vector<double> samples, deviations;
+
+    for (uint32_t i = 0; i < options.warmup_reps + options.reps; i++) {
+        uint64_t nsecs = bench.run(bench.ops);
+        if (nsecs == 0)
+            return result;
+        if (i >= options.warmup_reps)
+            samples.push_back((double)nsecs / bench.ops);
+    }
+
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    result.median = n % 2 ? samples[n / 2] :
+            (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    for (size_t i = 0; i < n; i++)
+        deviations.push_back(std::abs(samples[i] - result.median));
+    std::sort(deviations.begin(), deviations.end());
+    result.mad = n % 2 ? deviations[n / 2] :
+            (deviations[n / 2 - 1] + deviations[n / 2]) / 2;
+    result.min = samples[0];
+    result.reps = (uint32_t)n;
+    return result;
+}
+
+/// Write the results as JSON (replacing the results file atomically).
+static int results_write(const std::vector<bench_result_t> &results)
+{
+    struct utsname uts = {};
+    char date[32] = "";
+    time_t now = time(nullptr);
+    struct tm tm;
+
+    uname(&uts);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&now, &tm));
+    utils_files_writer_t *writer = utils_files_writer_open(
+            options.results_file, UTILS_FILES_WRITER_ATOMIC, 0, nullptr);
+    if (writer == nullptr)
+        return -1;
+    utils_files_writer_printf(writer, "{\n  \"tag\": \"%s\",\n"
+            "  \"date\": \"%s\",\n  \"host\": \"%s\",\n"
+            "  \"kernel\": \"%s\",\n  \"cpu\": %d,\n"
+            "  \"warmup_reps\": %u,\n  \"benchmarks\": [",
+            options.tag != nullptr ? options.tag : "", date, uts.nodename,
+            uts.release, options.cpu, options.warmup_reps);
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result_t &result = results[i];
+        utils_files_writer_printf(writer, "%s\n    {\"name\": \"%s\", "
+                "\"unit\": \"ns/op\", \"ops\": %lu, \"reps\": %u, "
+                "\"median\": %.3f, \"mad\": %.3f, \"min\": %.3f",
+                i > 0 ? "," : "", result.bench->name,
+                (unsigned long)result.bench->ops, result.reps, result.median,
+                result.mad, result.min);
+        if (result.bench->bytes_per_op != 0)
+            utils_files_writer_printf(writer, ", \"mb_per_sec\": %.3f",
+                    result.bench->bytes_per_op * 1e3 / result.median);
+        utils_files_writer_printf(writer, "}");
+    }
+    utils_files_writer_printf(writer, "\n  ]\n}\n");
+    return utils_files_writer_close(&writer);
+}
+
+static void logs_discard(void *opaque_logger_ctx_ptr,
+        utils_logs_level_t utils_logs_level, const char *fileName,
+        int lineNo, const char *funcName, const char *format, va_list args)
+{
+    char buf[256];
+
+    // Formatted as any back-end would, then dropped
+    vsnprintf(buf, sizeof(buf), format, args);
+    (*(uint64_t*)opaque_logger_ctx_ptr)++;
+}
+
+/// Producer side of the asynchronous back-end. The instance (and thus the
+/// thread ring, already warm after the first repetition) is kept along the
+/// repetitions; the back-end output goes to '/dev/null', and each repetition
+/// waits for its traces to be drained.
+static uint64_t logs_async(utils_logs_ctx_t *__utils_logs_ctx, uint64_t ops)
+{
+    uint64_t t0, elapsed, dropped0 = utils_logs_dropped(LOG_CTX_GET());
+    int stdout_fd, null_fd;
+
+    fflush(stdout);
+    if ((stdout_fd = dup(STDOUT_FILENO)) < 0)
+        return 0;
+    if ((null_fd = open("/dev/null", O_WRONLY)) < 0) {
+        close(stdout_fd);
+        return 0;
+    }
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    t0 = now_nsecs();
+    for (uint64_t i = 0; i < ops; i++)
+        LOGD("Request %lu done: %d %s\n", (unsigned long)i, 200,
+                "/test-path/myfile");
+    elapsed = now_nsecs() - t0;
+    usleep(LOGS_ASYNC_DRAIN_USECS);
+
+    fflush(stdout);
+    dup2(stdout_fd, STDOUT_FILENO);
+    close(stdout_fd);
+    return utils_logs_dropped(LOG_CTX_GET()) == dropped0 ? elapsed : 0;
+}
+
+/// Write the input of the record scan benchmark ('FILE_BENCH_SIZE' bytes of
+/// 'FILE_BENCH_LINE' records), independently of the write benchmark.
+/// @return 0 if succeed, -1 otherwise.
+static int records_input_write(const char *path)
+{
+    const size_t line_size = strlen(FILE_BENCH_LINE);
+    utils_files_writer_t *writer = utils_files_writer_open(path, 0, 0,
+            nullptr);
+
+    if (writer == nullptr)
+        return -1;
+    for (size_t i = 0; i < FILE_BENCH_SIZE / line_size; i++)
+        utils_files_writer_write(writer, FILE_BENCH_LINE, line_size);
+    return utils_files_writer_close(&writer);
+}
+
+/// Time from 'interr_usleep_unblock()' to the return of the blocked sleeper.
+static uint64_t usleep_wakeup(uint64_t ops)
+{
+    uint64_t total = 0;
+
+    for (uint64_t i = 0; i < ops; i++) {
+        std::atomic<int> state(0);
+        std::atomic<uint64_t> t_wake(0);
+        interr_usleep_ctx_t *ctx = interr_usleep_open(nullptr);
+        if (ctx == nullptr)
+            return 0;
+        std::thread sleeper([&]() {
+            state = 1;
+            interr_usleep(ctx, 10 * 1000 * 1000);
+            t_wake = now_nsecs();
+        });
+        while (state.load() == 0)
+            std::this_thread::yield();
+        usleep(1000); // let it block
+        uint64_t t0 = now_nsecs();
+        interr_usleep_unblock(ctx);
+        sleeper.join();
+        total += t_wake.load() - t0;
+        interr_usleep_close(&ctx);
+    }
+    return total;
+}
+
+static int origin_open(origin_ctx_t *origin)
+{
+    struct sockaddr_in addr = {};
+    socklen_t addr_len = sizeof(addr);
+    int on = 1;
+
+    origin->flag_exit = false;
+    origin->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (origin->listen_fd < 0)
+        return -1;
+    setsockopt(origin->listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0; // any free port
+    if (bind(origin->listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+            listen(origin->listen_fd, 16) != 0 ||
+            getsockname(origin->listen_fd, (struct sockaddr*)&addr,
+            &addr_len) != 0) {
+        close(origin->listen_fd);
+        origin->listen_fd = -1;
+        return -1;
+    }
+    origin->port = ntohs(addr.sin_port);
+    origin->thread = std::thread(origin_thr, origin);
+    return 0;
+}
+
+static void origin_close(origin_ctx_t *origin)
+{
+    if (origin->listen_fd < 0)
+        return;
+    origin->flag_exit = true;
+    shutdown(origin->listen_fd, SHUT_RDWR); // unblocks 'accept()'
+    if (origin->thread.joinable())
+        origin->thread.join();
+    close(origin->listen_fd);
+    origin->listen_fd = -1;
+}
+
+static void origin_thr(origin_ctx_t *origin)
+{
+    char buf[4096];
+
+    while (!origin->flag_exit) {
+        int fd = accept4(origin->listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        // Requests have no body: answer each header block
+        std::string request;
+        for (;;) {
+            ssize_t ret = recv(fd, buf, sizeof(buf), 0);
+            if (ret <= 0)
+                break;
+            request.append(buf, (size_t)ret);
+            size_t end;
+            while ((end = request.find("\r\n\r\n")) != std::string::npos) {
+                request.erase(0, end + 4);
+                if (send(fd, ORIGIN_RESPONSE, strlen(ORIGIN_RESPONSE),
+                        MSG_NOSIGNAL) < 0)
+                    break;
+            }
+        }
+        close(fd);
+    }
+}
@@ -0,0 +1,336 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file utils_test.cpp
+/// @brief Functional tests of the header-only containers of the utils library
+/// (rings, object pool and arena).
+///
+/// Each test prints its name and verdict; the exit status is non-zero if any
+/// of them failed, so that 'make check' can gate on it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+#include <vector>
+#include <utils/utils_ring.h>
+#include <utils/utils_pool.h>
+#include <utils/utils_arena.h>
+
+// **** Definitions ****
+
+/// Fail the running test (reporting the failed condition) if the condition
+/// does not hold
+#define CHECK(COND) \
+    do { \
+        if (!(COND)) { \
+            fprintf(stderr, "%s:%d: check '%s' failed\n", __FILE__, \
+                    __LINE__, #COND); \
+            return false; \
+        } \
+    } while (0)
+
+/// Producer threads and items per producer of the MPSC ordering test
+#define MPSC_PRODUCERS 4
+#define MPSC_ITEMS_PER_PRODUCER 200000
+/// The MPSC ordering test fails if nothing was consumed for this long [secs]
+#define MPSC_STALL_SECS 5
+
+/// A test
+typedef struct test_s {
+    const char *name;
+    bool (*run)();
+} test_t;
+
+/// Pool object counting its live instances
+typedef struct pool_obj_s {
+    static int live;
+    uint64_t value;
+    explicit pool_obj_s(uint64_t value): value(value) {
+        live++;
+    }
+    ~pool_obj_s() {
+        live--;
+    }
+} pool_obj_t;
+
+int pool_obj_t::live = 0;
+
+// **** Prototypes ****
+
+template<typename RING> static bool ring_full_empty();
+template<typename RING> static bool ring_wraparound();
+static bool ring_mpsc_producers();
+static bool pool_reuse();
+static bool arena_mark_rewind();
+
+// **** Implementations ****
+
+int main(int argc, char* argv[])
+{
+    static const test_t tests[] = {
+        {"utils_ring_spsc_full_empty",
+                ring_full_empty<utils_ring_spsc<uint64_t> >},
+        {"utils_ring_spsc_wraparound",
+                ring_wraparound<utils_ring_spsc<uint64_t> >},
+        {"utils_ring_mpsc_full_empty",
+                ring_full_empty<utils_ring_mpsc<uint64_t> >},
+        {"utils_ring_mpsc_wraparound",
+                ring_wraparound<utils_ring_mpsc<uint64_t> >},
+        {"utils_ring_mpsc_producers", ring_mpsc_producers},
+        {"utils_pool_reuse", pool_reuse},
+        {"utils_arena_mark_rewind", arena_mark_rewind}
+    };
+    int failed = 0;
+
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (argc > 1 && strstr(tests[i].name, argv[1]) == nullptr)
+            continue;
+        bool ok = tests[i].run();
+        printf("%-32s %s\n", tests[i].name, ok ? "OK" : "FAILED");
+        if (!ok)
+            failed++;
+    }
+    if (failed)
+        printf("%d test(s) failed\n", failed);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * The capacity is rounded up to a power of two, a full ring refuses items
+ * and an empty one yields none; items come out in order.
+ */
+template<typename RING>
+static bool ring_full_empty()
+{
+    RING ring(5);
+    uint64_t item;
+
+    CHECK(ring.capacity() == 8);
+    CHECK(!ring.pop(item));
+    for (uint64_t i = 0; i < ring.capacity(); i++)
+        CHECK(ring.push(i));
+    CHECK(!ring.push(100));
+    for (uint64_t i = 0; i < ring.capacity(); i++) {
+        CHECK(ring.pop(item));
+        CHECK(item == i);
+    }
+    CHECK(!ring.pop(item));
+
+    // A freed cell can be filled again
+    CHECK(ring.push(200));
+    CHECK(ring.pop(item) && item == 200);
+    CHECK(!ring.pop(item));
+    return true;
+}
+
+/**
+ * Keep the ring partly full over many laps, so that the indices wrap the
+ * cells (and run far past the capacity) while full and empty keep being
+ * told apart.
+ */
+template<typename RING>
+static bool ring_wraparound()
+{
+    RING ring(4);
+    uint64_t in = 0, out = 0, item;
+
+    for (int lap = 0; lap < 1000; lap++) {
+        // Top up to full, then drain all but one (or all, every 7 laps)
+        while (ring.push(in))
+            in++;
+        CHECK(in - out == ring.capacity());
+        size_t keep = (lap % 7 == 0) ? 0 : 1;
+        while (in - out > keep) {
+            CHECK(ring.pop(item));
+            CHECK(item == out);
+            out++;
+        }
+        if (keep == 0)
+            CHECK(!ring.pop(item));
+    }
+    CHECK(in > 100 * ring.capacity());
+    return true;
+}
+
+/**
+ * Several producers push concurrently into a small MPSC ring (retrying when
+ * full): the consumer gets every item exactly once, and the items of each
+ * producer in the order they were pushed.
+ */
+static bool ring_mpsc_producers()
+{
+    utils_ring_mpsc<uint64_t> ring(64);
+    std::vector<std::thread> producers;
+    std::vector<uint64_t> next(MPSC_PRODUCERS, 0);
+    uint64_t total = 0, item;
+    std::atomic<int> producers_done(0);
+    std::atomic<bool> flag_exit(false);
+    bool flag_ordered = true;
+    auto progress = std::chrono::steady_clock::now();
+
+    for (uint64_t p = 0; p < MPSC_PRODUCERS; p++) {
+        producers.emplace_back([&ring, &producers_done, &flag_exit, p]() {
+            for (uint64_t i = 0; i < MPSC_ITEMS_PER_PRODUCER; i++) {
+                while (!ring.push((p << 32) | i)) {
+                    if (flag_exit)
+                        return;
+                    std::this_thread::yield();
+                }
+            }
+            producers_done++;
+        });
+    }
+    while (total < (uint64_t)MPSC_PRODUCERS * MPSC_ITEMS_PER_PRODUCER) {
+        if (!ring.pop(item)) {
+            if (producers_done < MPSC_PRODUCERS) {
+                if (std::chrono::steady_clock::now() - progress >
+                        std::chrono::seconds(MPSC_STALL_SECS)) {
+                    fprintf(stderr, "Ring stalled\n");
+                    break;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            if (!ring.pop(item))
+                break; // all pushed and still empty: items were lost
+        }
+        progress = std::chrono::steady_clock::now();
+        // Keep draining on error: the producers block on a full ring
+        uint64_t p = item >> 32;
+        if (p >= MPSC_PRODUCERS || (item & 0xffffffffu) != next[p]) {
+            if (flag_ordered)
+                fprintf(stderr, "Unexpected item %#llx\n",
+                        (unsigned long long)item);
+            flag_ordered = false;
+            p %= MPSC_PRODUCERS;
+        }
+        next[p]++;
+        total++;
+    }
+    flag_exit = true;
+    for (size_t i = 0; i < producers.size(); i++)
+        producers[i].join();
+    CHECK(flag_ordered);
+    CHECK(!ring.pop(item));
+    for (uint64_t p = 0; p < MPSC_PRODUCERS; p++)
+        CHECK(next[p] == MPSC_ITEMS_PER_PRODUCER);
+    return true;
+}
+
+/**
+ * Objects put back are constructed and destroyed, and their memory is
+ * handed out again: a warm pool does not grow.
+ */
+static bool pool_reuse()
+{
+    std::set<pool_obj_t*> seen;
+    std::vector<pool_obj_t*> objs;
+
+    {
+        utils_pool<pool_obj_t> pool(4);
+
+        pool_obj_t *obj = pool.get(1);
+        CHECK(obj->value == 1 && pool.in_use() == 1 && pool_obj_t::live == 1);
+        pool.put(obj);
+        CHECK(pool.in_use() == 0 && pool_obj_t::live == 0);
+        pool_obj_t *again = pool.get(2);
+        CHECK(again == obj && again->value == 2);
+        pool.put(again);
+        pool.put(nullptr);
+        CHECK(pool.in_use() == 0);
+
+        // Span several slabs, then check that the same memory comes back
+        for (uint64_t i = 0; i < 10; i++) {
+            objs.push_back(pool.get(i));
+            seen.insert(objs.back());
+        }
+        CHECK(seen.size() == 10 && pool.in_use() == 10);
+        for (size_t i = 0; i < objs.size(); i++)
+            CHECK(objs[i]->value == i);
+        for (size_t i = 0; i < objs.size(); i++)
+            pool.put(objs[i]);
+        CHECK(pool.in_use() == 0 && pool_obj_t::live == 0);
+        objs.clear();
+        for (uint64_t i = 0; i < 12; i++) {
+            objs.push_back(pool.get(i));
+            if (i < 10)
+                CHECK(seen.count(objs.back()) == 1);
+        }
+        for (size_t i = 0; i < objs.size(); i++)
+            pool.put(objs[i]);
+    }
+    CHECK(pool_obj_t::live == 0);
+    return true;
+}
+
+/**
+ * Rewinding to a mark hands out again the memory allocated after it, within
+ * a chunk and across chunks; reset goes back to the first chunk. Alignments
+ * are honoured.
+ */
+static bool arena_mark_rewind()
+{
+    utils_arena arena(1024);
+
+    char *first = (char*)arena.alloc(10, 1);
+    utils_arena::mark_t mark = arena.mark();
+    char *a = (char*)arena.alloc(100, 1);
+    CHECK(a == first + 10);
+    arena.rewind(mark);
+    char *b = (char*)arena.alloc(100, 1);
+    CHECK(b == a);
+
+    // Alignment
+    void *p = arena.alloc(8, 64);
+    CHECK(((uintptr_t)p & 63) == 0);
+    uint64_t *u = arena.make<uint64_t>(42);
+    CHECK(((uintptr_t)u & (alignof(uint64_t) - 1)) == 0 && *u == 42);
+
+    // Rewind across chunks (the later chunks are kept and reused)
+    mark = arena.mark();
+    char *c = (char*)arena.alloc(1, 1);
+    std::vector<char*> spilled;
+    for (int i = 0; i < 5; i++)
+        spilled.push_back((char*)arena.alloc(700, 1));
+    arena.rewind(mark);
+    CHECK((char*)arena.alloc(1, 1) == c);
+    std::vector<char*> again;
+    for (int i = 0; i < 5; i++)
+        again.push_back((char*)arena.alloc(700, 1));
+    CHECK(again == spilled);
+
+    // Larger than a chunk
+    char *big = (char*)arena.alloc(4096, 1);
+    memset(big, 0xa5, 4096);
+    CHECK(strcmp(arena.strdup("arena"), "arena") == 0);
+
+    arena.reset();
+    CHECK((char*)arena.alloc(10, 1) == first);
+    return true;
+}
@@ -30,10 +30,13 @@
 #include "interr_usleep.h"
 
 #include <stdlib.h>
-#include <pthread.h>
+#include <unistd.h>
 #include <errno.h>
+#include <sys/eventfd.h>
 
 #include "utils_logs.h"
+#include "utils_time.h"
+#include "utils_timer.h"
 
 /* **** Definitions **** */
 
@@ -43,20 +46,20 @@
 typedef struct interr_usleep_ctx_s {
     utils_logs_ctx_t *utils_logs_ctx;
     volatile int flag_must_release_logs_ctx;
-    volatile int flag_exit;
-    pthread_mutex_t interr_mutex;
-    pthread_cond_t interr_signal;
+    /**
+     * Exit signal: written once by 'interr_usleep_unblock()' and never read,
+     * so that it stays readable (and every sleeper is woken up) for good
+     */
+    int event_fd;
 } interr_usleep_ctx_t;
 
 /**
- * MACRO used to unlock internal MUTEX:
- * sets exit flag and send signal to eventually unlock MUTEX
+ * MACRO used to unlock the sleepers: sets the exit signal
  */
 #define UNLOCK() \
-        interr_usleep_ctx->flag_exit= 1; \
-        pthread_mutex_lock(&interr_usleep_ctx->interr_mutex); \
-        pthread_cond_broadcast(&interr_usleep_ctx->interr_signal); \
-        pthread_mutex_unlock(&interr_usleep_ctx->interr_mutex);
+        if(write(interr_usleep_ctx->event_fd, &one, sizeof(one))< 0) { \
+            /* Counter saturated: already signalled */ \
+        }
 
 /* **** Prototypes **** */
 
@@ -64,8 +67,7 @@ typedef struct interr_usleep_ctx_s {
 
 interr_usleep_ctx_t* interr_usleep_open(utils_logs_ctx_t *const utils_logs_ctx)
 {
-    pthread_condattr_t condattr;
-    int ret_code, end_code= -1;
+    int end_code= -1;
     interr_usleep_ctx_t *interr_usleep_ctx= NULL;
     LOG_CTX_INIT(NULL);
 
@@ -76,6 +78,7 @@ interr_usleep_ctx_t* interr_usleep_open(utils_logs_ctx_t *const utils_logs_ctx)
     interr_usleep_ctx= (interr_usleep_ctx_t*)calloc(1, sizeof(
             interr_usleep_ctx_t));
     CHECK_DO(interr_usleep_ctx!= NULL, goto end);
+    interr_usleep_ctx->event_fd= -1;
 
     /* **** Initialize context structure **** */
 
@@ -89,16 +92,8 @@ interr_usleep_ctx_t* interr_usleep_open(utils_logs_ctx_t *const utils_logs_ctx)
     CHECK_DO(interr_usleep_ctx->utils_logs_ctx!= NULL, goto end);
     LOG_CTX_SET(interr_usleep_ctx->utils_logs_ctx);
 
-    interr_usleep_ctx->flag_exit= 0;
-
-    ret_code= pthread_mutex_init(&interr_usleep_ctx->interr_mutex, NULL);
-    CHECK_DO(ret_code== 0, goto end);
-
-    pthread_condattr_init(&condattr);
-    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
-    ret_code= pthread_cond_init(&interr_usleep_ctx->interr_signal,
-            &condattr);
-    CHECK_DO(ret_code== 0, goto end);
+    interr_usleep_ctx->event_fd= eventfd(0, EFD_NONBLOCK| EFD_CLOEXEC);
+    CHECK_DO(interr_usleep_ctx->event_fd>= 0, goto end);
 
     end_code= 0;
 end:
@@ -110,20 +105,17 @@ end:
 void interr_usleep_close(interr_usleep_ctx_t **ref_interr_usleep_ctx)
 {
     interr_usleep_ctx_t *interr_usleep_ctx;
-    LOG_CTX_INIT(NULL);
+    uint64_t one= 1;
 
     if(ref_interr_usleep_ctx== NULL ||
             (interr_usleep_ctx= *ref_interr_usleep_ctx)== NULL)
         return;
 
-    LOG_CTX_SET(interr_usleep_ctx->utils_logs_ctx);
-
-    /* Set exit flag and send signal to eventually unlock MUTEX */
-    UNLOCK();
-
-    /* Release MUTEX and conditional */
-    CHECK(pthread_mutex_destroy(&interr_usleep_ctx->interr_mutex)== 0);
-    CHECK(pthread_cond_destroy(&interr_usleep_ctx->interr_signal)== 0);
+    /* Set the exit signal, then release it */
+    if(interr_usleep_ctx->event_fd>= 0) {
+        UNLOCK();
+        close(interr_usleep_ctx->event_fd);
+    }
 
     /* Release logger if it was internally allocated */
     if(interr_usleep_ctx->flag_must_release_logs_ctx!= 0) {
@@ -137,22 +129,19 @@ void interr_usleep_close(interr_usleep_ctx_t **ref_interr_usleep_ctx)
 
 void interr_usleep_unblock(interr_usleep_ctx_t *interr_usleep_ctx)
 {
-    //LOG_CTX_INIT(NULL);
+    uint64_t one= 1;
 
     /* Check arguments */
     if(interr_usleep_ctx== NULL)
         return;
 
-    //LOG_CTX_SET(interr_usleep_ctx->utils_logs_ctx);
-
-    /* Set exit flag and send signal to eventually unlock MUTEX */
+    /* Set the exit signal (async-signal safe) */
     UNLOCK();
 }
 
 int interr_usleep(interr_usleep_ctx_t *interr_usleep_ctx, uint32_t usec)
 {
-    uint64_t curr_nsec;
-    struct timespec monotime_curr, monotime_tout;
+    uint64_t deadline_usecs;
     int ret_code;
     LOG_CTX_INIT(NULL);
 
@@ -161,27 +150,19 @@ int interr_usleep(interr_usleep_ctx_t *interr_usleep_ctx, uint32_t usec)
 
     LOG_CTX_SET(interr_usleep_ctx->utils_logs_ctx);
 
-    /* Get current time */
-    CHECK_DO(clock_gettime(CLOCK_MONOTONIC, &monotime_curr)== 0,
-            return -1);
-    curr_nsec= (uint64_t)monotime_curr.tv_sec*1000000000+
-            (uint64_t)monotime_curr.tv_nsec;
-
-    /* Compute time-out */
-    curr_nsec+= ((uint64_t)usec)* 1000;
-    monotime_tout.tv_sec= curr_nsec/ 1000000000;
-    monotime_tout.tv_nsec= curr_nsec% 1000000000;
-
-    /* While exit is not signaled, block for the given time */
-    pthread_mutex_lock(&interr_usleep_ctx->interr_mutex);
-    ret_code= 0;
-    while(interr_usleep_ctx->flag_exit== 0 && ret_code!= ETIMEDOUT) {
-        ret_code= pthread_cond_timedwait(
-                &interr_usleep_ctx->interr_signal,
-                &interr_usleep_ctx->interr_mutex, &monotime_tout);
-    }
-    pthread_mutex_unlock(&interr_usleep_ctx->interr_mutex);
-    return (ret_code== ETIMEDOUT)? 0: EINTR;
+    /* Block until the deadline unless exit is signaled (any number of
+     * threads may be sleeping on the same instance)
+     */
+    deadline_usecs= utils_gettime_monot_usecs(LOG_CTX_GET())+ usec;
+    ret_code= utils_timer_wait_fd(interr_usleep_ctx->event_fd,
+            deadline_usecs);
+    CHECK_DO(ret_code>= 0, return -1);
+    return (ret_code== 0)? 0: EINTR;
+}
+
+int interr_usleep_get_fd(interr_usleep_ctx_t *interr_usleep_ctx)
+{
+    return interr_usleep_ctx!= NULL? interr_usleep_ctx->event_fd: -1;
 }
 
 void interr_usleep_close_uptr(interr_usleep_ctx_t *p)
@@ -28,6 +28,9 @@
  * This module ("interruptible usleep") implements a wrapper to the
  * 'usleep()' function to provide the possibility to interrupt the sleep state
  * by 'unlocking' the module instance handler.
+ * It is built on the timer service (see 'utils_timer.h'): the exit signal is
+ * an 'eventfd', so any number of threads may sleep on the same instance and
+ * event loops may wait on it together with their sockets.
  * @author Rafael Antoniello
  */
 
@@ -87,6 +90,16 @@ void interr_usleep_unblock(interr_usleep_ctx_t *interr_usleep_ctx);
  */
 int interr_usleep(interr_usleep_ctx_t *interr_usleep_ctx, uint32_t usec);
 
+/**
+ * Get the exit signal file descriptor, which becomes readable (for good) on
+ * 'interr_usleep_unblock()'. It is to be watched (EPOLLIN) by event loops
+ * that have to be interrupted too; it must not be read.
+ * @param Pointer to the interruptible module instance context structure,
+ * that was obtained in a previous call to the 'interr_usleep_open()' function.
+ * @return The file descriptor, -1 if the instance is NULL.
+ */
+int interr_usleep_get_fd(interr_usleep_ctx_t *interr_usleep_ctx);
+
 /**
  * Deleter function for the interruptible sleep module. This function is used
  * essentially in C++ applications using this module for releasing smart
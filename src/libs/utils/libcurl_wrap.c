@@ -27,6 +27,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
 
 #include <curl/curl.h>
 
@@ -55,6 +63,29 @@
  */
 #define HDRS_MAX_SIZE 512
 
+/**
+ * Maximum number of events handled per event loop wait.
+ */
+#define LOOP_EVENTS_MAX 1024
+
+/**
+ * Initial capacity of the response buffers when the size is not known
+ * (they are doubled as needed).
+ */
+#define WRITE_MEM_SIZE_MIN 1024
+
+/**
+ * We set a maximum Content-Length to pre-size the response buffers for the
+ * sake of security (above it, they are grown as the body arrives).
+ */
+#define WRITE_MEM_PRESIZE_MAX (1024* 1024* 256)
+
+/**
+ * 64-bit FNV-1a hash parameters (discard sink).
+ */
+#define FNV1A_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV1A_PRIME 0x100000001b3ULL
+
 /**
  * Curl memory context structure used for reading.
  * This type will be used as the private data passed to the *read* callback
@@ -64,6 +95,25 @@
 typedef struct curl_read_mem_ctx_s {
     const char *p_read;
     size_t size_left;
+    /**
+     * Body source (NULL if the body is a character string).
+     */
+    libcurl_wrap_source_t *source;
+    /**
+     * Set if there is a body, and its size (-1 if not known).
+     */
+    int flag_body;
+    int64_t size;
+    /**
+     * Set if the body is read from memory ('p_read'): character strings,
+     * buffers and mapped files.
+     */
+    int flag_mem;
+    /**
+     * Mapping of a regular file source.
+     */
+    void *map;
+    size_t map_size;
     utils_logs_ctx_t *utils_logs_ctx;
 } curl_read_mem_ctx_t;
 
@@ -74,11 +124,146 @@ typedef struct curl_read_mem_ctx_s {
  * (refer to function 'curl_write_body_callback()').
  */
 typedef struct curl_write_mem_ctx_s {
+    /**
+     * Received data (NULL-terminated), its size and the buffer capacity.
+     */
     char *data;
     size_t size;
+    size_t capacity;
+    /**
+     * Sink receiving the data instead (NULL to keep it in memory).
+     */
+    libcurl_wrap_sink_t *sink;
+    /**
+     * Set to drop the data (e.g. unwanted headers).
+     */
+    int flag_discard;
+    /**
+     * Handle of the transfer (to pre-size the buffer from Content-Length).
+     */
+    CURL *curl;
     utils_logs_ctx_t *utils_logs_ctx;
 } curl_write_mem_ctx_t;
 
+/**
+ * Handle context structure.
+ * Keeps a libcurl handle together with the state it was left in by the last
+ * request it served, so that only the options that change are set again.
+ */
+typedef struct libcurl_wrap_handle_s {
+    CURL *curl;
+    /**
+     * Share object the handle is attached to (NULL for one-shot handles).
+     */
+    CURLSH *share;
+    /**
+     * Set if the handle has only the default options set
+     * (see 'handle_set_defaults()').
+     */
+    int flag_clean;
+    /**
+     * Method the handle is set up for (LIBCURL_WRAP_METHOD_MAX if unknown).
+     */
+    libcurl_wrap_method_t method;
+    /**
+     * URL buffer (reused from request to request).
+     */
+    char *url;
+    size_t url_size;
+    /**
+     * Headers list currently set, time-out and verbosity.
+     */
+    struct curl_slist *hdr_list;
+    long tout;
+    int flag_verbose;
+    /**
+     * Next idle handle in the session pool.
+     */
+    struct libcurl_wrap_handle_s *next;
+} libcurl_wrap_handle_t;
+
+/**
+ * Session context structure.
+ */
+struct libcurl_wrap_session_s {
+    /**
+     * Share object (DNS, connections and SSL sessions caches) and the locks
+     * protecting each of the shared data.
+     */
+    CURLSH *share;
+    pthread_mutex_t share_mutex[CURL_LOCK_DATA_LAST];
+    /**
+     * Pool of idle handles (a LIFO, so that the most recently used handle,
+     * with its cached state, is reused first).
+     */
+    pthread_mutex_t pool_mutex;
+    libcurl_wrap_handle_t *pool;
+    size_t pool_num;
+    size_t pool_max;
+    utils_logs_ctx_t *utils_logs_ctx;
+};
+
+/**
+ * Request in flight on an event loop.
+ */
+typedef struct libcurl_wrap_xfer_s {
+    libcurl_wrap_handle_t *handle;
+    /**
+     * Copy of the request body (the caller's is only valid on submission).
+     */
+    char *body;
+    curl_read_mem_ctx_t curl_read_mem_ctx;
+    curl_write_mem_ctx_t curl_write_mem_ctx;
+    curl_write_mem_ctx_t curl_write_mem_ctx_hdr;
+    libcurl_wrap_done_cb_t done_cb;
+    void *userdata;
+    /**
+     * Requests in flight list.
+     */
+    struct libcurl_wrap_xfer_s *prev;
+    struct libcurl_wrap_xfer_s *next;
+} libcurl_wrap_xfer_t;
+
+/**
+ * Completion queue node (the result must be the first member, so that the
+ * node is released from the result pointer).
+ */
+typedef struct libcurl_wrap_result_node_s {
+    libcurl_wrap_result_t result;
+    struct libcurl_wrap_result_node_s *next;
+} libcurl_wrap_result_node_t;
+
+/**
+ * Event loop context structure.
+ */
+struct libcurl_wrap_loop_s {
+    CURLM *multi;
+    /**
+     * Epoll instance (transfers sockets and libcurl timer), libcurl timer
+     * and completion queue eventfd.
+     */
+    int epoll_fd;
+    int timer_fd;
+    int event_fd;
+    /**
+     * Pool of idle handles (LIFO, as in the sessions).
+     */
+    libcurl_wrap_handle_t *pool;
+    size_t pool_num;
+    size_t pool_max;
+    /**
+     * Requests in flight.
+     */
+    libcurl_wrap_xfer_t *xfers;
+    size_t xfers_num;
+    /**
+     * Completion queue (FIFO).
+     */
+    libcurl_wrap_result_node_t *queue_head;
+    libcurl_wrap_result_node_t *queue_tail;
+    utils_logs_ctx_t *utils_logs_ctx;
+};
+
 /**
  * Using POST with HTTP 1.1 implies the use of a "Expect: 100-continue" header.
  * We can disable this header with CURLOPT_HTTPHEADER as usual.
@@ -87,26 +272,76 @@ typedef struct curl_write_mem_ctx_s {
 
 /* **** Prototypes **** */
 
-static int libcurl_wrap_cli_request_post_options(CURL *curl, const char *body,
+static libcurl_wrap_handle_t* handle_open(CURLSH *share,
+        utils_logs_ctx_t *const utils_logs_ctx);
+static void handle_close(libcurl_wrap_handle_t **ref_handle);
+static int handle_set_defaults(libcurl_wrap_handle_t *handle,
+        utils_logs_ctx_t *const utils_logs_ctx);
+static int handle_request(libcurl_wrap_handle_t *handle,
+        const libcurl_wrap_req_ctx_t *libcurl_wrap_req_ctx,
+        utils_logs_ctx_t *const utils_logs_ctx, char **ref_response_str,
+        long *ref_http_ret_code, char **ref_headers_out_str,
+        libcurl_wrap_stats_ctx_t *const stats_ctx);
+static int handle_setup(libcurl_wrap_handle_t *handle,
+        const libcurl_wrap_req_ctx_t *libcurl_wrap_req_ctx, const char *body,
+        curl_read_mem_ctx_t *const curl_read_mem_ctx,
+        curl_write_mem_ctx_t *const curl_write_mem_ctx,
+        curl_write_mem_ctx_t *const curl_write_mem_ctx_hdr,
+        utils_logs_ctx_t *const utils_logs_ctx);
+static int handle_collect(libcurl_wrap_handle_t *handle,
+        curl_write_mem_ctx_t *const curl_write_mem_ctx,
+        curl_write_mem_ctx_t *const curl_write_mem_ctx_hdr,
+        utils_logs_ctx_t *const utils_logs_ctx, char **ref_response_str,
+        long *ref_http_ret_code, char **ref_headers_out_str,
+        libcurl_wrap_stats_ctx_t *const stats_ctx);
+static void write_mem_ctx_release(curl_write_mem_ctx_t *curl_write_mem_ctx);
+
+static libcurl_wrap_handle_t* loop_handle_checkout(
+        libcurl_wrap_loop_t *libcurl_wrap_loop);
+static void loop_handle_checkin(libcurl_wrap_loop_t *libcurl_wrap_loop,
+        libcurl_wrap_handle_t **ref_handle);
+static void loop_xfer_close(libcurl_wrap_loop_t *libcurl_wrap_loop,
+        libcurl_wrap_xfer_t **ref_xfer);
+static void loop_check_done(libcurl_wrap_loop_t *libcurl_wrap_loop);
+static int loop_socket_callback(CURL *curl, curl_socket_t s, int what,
+        void *userp, void *socketp);
+static int loop_timer_callback(CURLM *multi, long timeout_ms, void *userp);
+
+static int libcurl_wrap_cli_request_post_options(CURL *curl,
         curl_read_mem_ctx_t *const curl_read_mem_ctx,
         const char **headers, struct curl_slist **ref_hdr_list,
         utils_logs_ctx_t *const utils_logs_ctx);
 
-static int libcurl_wrap_cli_request_put_options(CURL *curl, const char *body,
+static int libcurl_wrap_cli_request_put_options(CURL *curl,
         curl_read_mem_ctx_t *const curl_read_mem_ctx,
         const char **headers, struct curl_slist **ref_hdr_list,
         utils_logs_ctx_t *const utils_logs_ctx);
 
+static int read_mem_ctx_setup(curl_read_mem_ctx_t *const curl_read_mem_ctx,
+        const char *body, libcurl_wrap_source_t *source,
+        utils_logs_ctx_t *const utils_logs_ctx);
+static void read_mem_ctx_release(curl_read_mem_ctx_t *curl_read_mem_ctx);
+static int read_mem_ctx_chunked(const curl_read_mem_ctx_t *curl_read_mem_ctx);
+
 static void set_headers(CURL *curl, const char **headers,
         struct curl_slist **ref_hdr_list,
         utils_logs_ctx_t *const utils_logs_ctx);
 static int find_header(const char **headers, const char *hdr_needle,
         const char *val_needle, utils_logs_ctx_t *const utils_logs_ctx);
+static int match_headers(const char **headers,
+        const struct curl_slist *hdr_list);
+
+static void share_lock_callback(CURL *curl, curl_lock_data data,
+        curl_lock_access access, void *userp);
+static void share_unlock_callback(CURL *curl, curl_lock_data data,
+        void *userp);
 
 static size_t curl_read_body_callback(void *dest, size_t size, size_t nmemb,
         void *userp);
 static size_t curl_write_body_callback(void *contents, size_t size,
         size_t nmemb, void *userp);
+static size_t write_sink(libcurl_wrap_sink_t *sink, const char *contents,
+        size_t size, utils_logs_ctx_t *const utils_logs_ctx);
 
 /* **** Implementations **** */
 
@@ -128,18 +363,8 @@ int libcurl_wrap_cli_request(
         long *ref_http_ret_code, char **ref_headers_out_str,
         libcurl_wrap_stats_ctx_t *const stats_ctx)
 {
-    CURLcode curl_code;
-    libcurl_wrap_method_t method_code;
-    const char *host, *port, *location, *qstring;
-    int idx, ret_code, end_code= -1, flag_attach_query= 0;
-    CURL *curl= NULL;
-    size_t url_size= 0;
-    char *url= NULL;
-    struct curl_slist *hdr_list= NULL;
-    struct curl_read_mem_ctx_s curl_read_mem_ctx= {0};
-    struct curl_write_mem_ctx_s curl_write_mem_ctx= {0};
-    struct curl_write_mem_ctx_s curl_write_mem_ctx_hdr= {0};
-    long http_ret_code= 404; // Initialize to 'Not Found'
+    int end_code;
+    libcurl_wrap_handle_t *handle= NULL;
     LOG_CTX_INIT(utils_logs_ctx);
 
     /* Check arguments.
@@ -152,23 +377,574 @@ int libcurl_wrap_cli_request(
     CHECK_DO(ref_http_ret_code!= NULL, return -1);
 
     /* Unless we succeed, we set error 404 by default */
-    *ref_http_ret_code= http_ret_code;
+    *ref_http_ret_code= 404;
 
-    /* Get method */
-    method_code= libcurl_wrap_req_ctx->method;
-    CHECK_DO(method_code< LIBCURL_WRAP_METHOD_MAX, goto end);
+    /* Get a (one-shot) handle */
+    handle= handle_open(NULL, LOG_CTX_GET());
+    CHECK_DO(handle!= NULL, return -1);
+
+    end_code= handle_request(handle, libcurl_wrap_req_ctx, LOG_CTX_GET(),
+            ref_response_str, ref_http_ret_code, ref_headers_out_str,
+            stats_ctx);
+
+    handle_close(&handle);
+    return end_code;
+}
+
+libcurl_wrap_session_t* libcurl_wrap_session_open(size_t pool_max,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    int i, ret_code;
+    libcurl_wrap_session_t *libcurl_wrap_session= NULL;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    libcurl_wrap_session= (libcurl_wrap_session_t*)calloc(1, sizeof(
+            libcurl_wrap_session_t));
+    CHECK_DO(libcurl_wrap_session!= NULL, return NULL);
+
+    libcurl_wrap_session->pool_max= pool_max;
+    libcurl_wrap_session->utils_logs_ctx= LOG_CTX_GET();
+
+    for(i= 0; i< CURL_LOCK_DATA_LAST; i++) {
+        ret_code= pthread_mutex_init(&libcurl_wrap_session->share_mutex[i],
+                NULL);
+        CHECK_DO(ret_code== 0, goto end);
+    }
+    ret_code= pthread_mutex_init(&libcurl_wrap_session->pool_mutex, NULL);
+    CHECK_DO(ret_code== 0, goto end);
+
+    /* Share the DNS cache, the connections cache and the SSL sessions among
+     * all the session handles
+     */
+    libcurl_wrap_session->share= curl_share_init();
+    CHECK_DO(libcurl_wrap_session->share!= NULL, goto end);
+    CHECK_DO(curl_share_setopt(libcurl_wrap_session->share,
+            CURLSHOPT_LOCKFUNC, share_lock_callback)== CURLSHE_OK, goto end);
+    CHECK_DO(curl_share_setopt(libcurl_wrap_session->share,
+            CURLSHOPT_UNLOCKFUNC, share_unlock_callback)== CURLSHE_OK,
+            goto end);
+    CHECK_DO(curl_share_setopt(libcurl_wrap_session->share, CURLSHOPT_USERDATA,
+            libcurl_wrap_session)== CURLSHE_OK, goto end);
+    CHECK_DO(curl_share_setopt(libcurl_wrap_session->share, CURLSHOPT_SHARE,
+            CURL_LOCK_DATA_DNS)== CURLSHE_OK, goto end);
+    CHECK_DO(curl_share_setopt(libcurl_wrap_session->share, CURLSHOPT_SHARE,
+            CURL_LOCK_DATA_CONNECT)== CURLSHE_OK, goto end);
+    CHECK_DO(curl_share_setopt(libcurl_wrap_session->share, CURLSHOPT_SHARE,
+            CURL_LOCK_DATA_SSL_SESSION)== CURLSHE_OK, goto end);
+
+    return libcurl_wrap_session;
+end:
+    libcurl_wrap_session_close(&libcurl_wrap_session);
+    return NULL;
+}
+
+void libcurl_wrap_session_close(
+        libcurl_wrap_session_t **ref_libcurl_wrap_session)
+{
+    int i;
+    libcurl_wrap_session_t *libcurl_wrap_session;
+
+    if(ref_libcurl_wrap_session== NULL ||
+            (libcurl_wrap_session= *ref_libcurl_wrap_session)== NULL)
+        return;
+
+    /* Release the handles before the share they are attached to */
+    while(libcurl_wrap_session->pool!= NULL) {
+        libcurl_wrap_handle_t *handle= libcurl_wrap_session->pool;
+        libcurl_wrap_session->pool= handle->next;
+        handle_close(&handle);
+    }
+    if(libcurl_wrap_session->share!= NULL) {
+        curl_share_cleanup(libcurl_wrap_session->share);
+        libcurl_wrap_session->share= NULL;
+    }
+
+    /* Destroying a mutex that was never initialized (zeroed) is harmless in
+     * the Linux implementation.
+     */
+    pthread_mutex_destroy(&libcurl_wrap_session->pool_mutex);
+    for(i= 0; i< CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_destroy(&libcurl_wrap_session->share_mutex[i]);
+
+    free(libcurl_wrap_session);
+    *ref_libcurl_wrap_session= NULL;
+}
+
+int libcurl_wrap_session_request(libcurl_wrap_session_t *libcurl_wrap_session,
+        const libcurl_wrap_req_ctx_t *libcurl_wrap_req_ctx,
+        utils_logs_ctx_t *const utils_logs_ctx, char **ref_response_str,
+        long *ref_http_ret_code, char **ref_headers_out_str,
+        libcurl_wrap_stats_ctx_t *const stats_ctx)
+{
+    int end_code;
+    libcurl_wrap_handle_t *handle;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    /* Check arguments.
+     * Parameter 'utils_logs_ctx' is allowed to be NULL.
+     * Parameter 'ref_headers_out_str' is allowed to be NULL.
+     * Parameter 'stats_ctx' is allowed to be NULL.
+     */
+    CHECK_DO(libcurl_wrap_session!= NULL, return -1);
+    CHECK_DO(libcurl_wrap_req_ctx!= NULL, return -1);
+    CHECK_DO(ref_response_str!= NULL, return -1);
+    CHECK_DO(ref_http_ret_code!= NULL, return -1);
+
+    /* Unless we succeed, we set error 404 by default */
+    *ref_http_ret_code= 404;
+
+    /* Check-out an idle handle (or create a new one) */
+    pthread_mutex_lock(&libcurl_wrap_session->pool_mutex);
+    handle= libcurl_wrap_session->pool;
+    if(handle!= NULL) {
+        libcurl_wrap_session->pool= handle->next;
+        libcurl_wrap_session->pool_num--;
+    }
+    pthread_mutex_unlock(&libcurl_wrap_session->pool_mutex);
+    if(handle== NULL)
+        handle= handle_open(libcurl_wrap_session->share, LOG_CTX_GET());
+    CHECK_DO(handle!= NULL, return -1);
+
+    end_code= handle_request(handle, libcurl_wrap_req_ctx, LOG_CTX_GET(),
+            ref_response_str, ref_http_ret_code, ref_headers_out_str,
+            stats_ctx);
+
+    /* Check-in the handle (release it if the pool is full) */
+    pthread_mutex_lock(&libcurl_wrap_session->pool_mutex);
+    if(libcurl_wrap_session->pool_num< libcurl_wrap_session->pool_max) {
+        handle->next= libcurl_wrap_session->pool;
+        libcurl_wrap_session->pool= handle;
+        libcurl_wrap_session->pool_num++;
+        handle= NULL;
+    }
+    pthread_mutex_unlock(&libcurl_wrap_session->pool_mutex);
+    if(handle!= NULL)
+        handle_close(&handle);
+
+    return end_code;
+}
+
+libcurl_wrap_loop_t* libcurl_wrap_loop_open(size_t pool_max,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    struct epoll_event ev= {0};
+    libcurl_wrap_loop_t *libcurl_wrap_loop= NULL;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    libcurl_wrap_loop= (libcurl_wrap_loop_t*)calloc(1, sizeof(
+            libcurl_wrap_loop_t));
+    CHECK_DO(libcurl_wrap_loop!= NULL, return NULL);
+
+    libcurl_wrap_loop->epoll_fd= -1;
+    libcurl_wrap_loop->timer_fd= -1;
+    libcurl_wrap_loop->event_fd= -1;
+    libcurl_wrap_loop->pool_max= pool_max;
+    libcurl_wrap_loop->utils_logs_ctx= LOG_CTX_GET();
+
+    libcurl_wrap_loop->epoll_fd= epoll_create1(EPOLL_CLOEXEC);
+    CHECK_DO(libcurl_wrap_loop->epoll_fd>= 0, goto end);
+    libcurl_wrap_loop->timer_fd= timerfd_create(CLOCK_MONOTONIC,
+            TFD_NONBLOCK| TFD_CLOEXEC);
+    CHECK_DO(libcurl_wrap_loop->timer_fd>= 0, goto end);
+    libcurl_wrap_loop->event_fd= eventfd(0, EFD_NONBLOCK| EFD_CLOEXEC);
+    CHECK_DO(libcurl_wrap_loop->event_fd>= 0, goto end);
+
+    /* The libcurl timer is watched together with the transfers sockets */
+    ev.events= EPOLLIN;
+    ev.data.fd= libcurl_wrap_loop->timer_fd;
+    CHECK_DO(epoll_ctl(libcurl_wrap_loop->epoll_fd, EPOLL_CTL_ADD,
+            libcurl_wrap_loop->timer_fd, &ev)== 0, goto end);
+
+    libcurl_wrap_loop->multi= curl_multi_init();
+    CHECK_DO(libcurl_wrap_loop->multi!= NULL, goto end);
+    CHECK_DO(curl_multi_setopt(libcurl_wrap_loop->multi,
+            CURLMOPT_SOCKETFUNCTION, loop_socket_callback)== CURLM_OK,
+            goto end);
+    CHECK_DO(curl_multi_setopt(libcurl_wrap_loop->multi, CURLMOPT_SOCKETDATA,
+            libcurl_wrap_loop)== CURLM_OK, goto end);
+    CHECK_DO(curl_multi_setopt(libcurl_wrap_loop->multi,
+            CURLMOPT_TIMERFUNCTION, loop_timer_callback)== CURLM_OK,
+            goto end);
+    CHECK_DO(curl_multi_setopt(libcurl_wrap_loop->multi, CURLMOPT_TIMERDATA,
+            libcurl_wrap_loop)== CURLM_OK, goto end);
+
+    return libcurl_wrap_loop;
+end:
+    libcurl_wrap_loop_close(&libcurl_wrap_loop);
+    return NULL;
+}
+
+void libcurl_wrap_loop_close(libcurl_wrap_loop_t **ref_libcurl_wrap_loop)
+{
+    libcurl_wrap_loop_t *libcurl_wrap_loop;
+
+    if(ref_libcurl_wrap_loop== NULL ||
+            (libcurl_wrap_loop= *ref_libcurl_wrap_loop)== NULL)
+        return;
+
+    /* Abort the requests in flight and drop the queued results */
+    while(libcurl_wrap_loop->xfers!= NULL) {
+        libcurl_wrap_xfer_t *xfer= libcurl_wrap_loop->xfers;
+        loop_xfer_close(libcurl_wrap_loop, &xfer);
+    }
+    while(libcurl_wrap_loop->queue_head!= NULL) {
+        libcurl_wrap_result_t *result=
+                &libcurl_wrap_loop->queue_head->result;
+        libcurl_wrap_loop->queue_head= libcurl_wrap_loop->queue_head->next;
+        libcurl_wrap_result_release(&result);
+    }
+    libcurl_wrap_loop->queue_tail= NULL;
+
+    /* Release the handles before the multi handle */
+    while(libcurl_wrap_loop->pool!= NULL) {
+        libcurl_wrap_handle_t *handle= libcurl_wrap_loop->pool;
+        libcurl_wrap_loop->pool= handle->next;
+        handle_close(&handle);
+    }
+    if(libcurl_wrap_loop->multi!= NULL) {
+        curl_multi_cleanup(libcurl_wrap_loop->multi);
+        libcurl_wrap_loop->multi= NULL;
+    }
+
+    if(libcurl_wrap_loop->event_fd>= 0)
+        close(libcurl_wrap_loop->event_fd);
+    if(libcurl_wrap_loop->timer_fd>= 0)
+        close(libcurl_wrap_loop->timer_fd);
+    if(libcurl_wrap_loop->epoll_fd>= 0)
+        close(libcurl_wrap_loop->epoll_fd);
+
+    free(libcurl_wrap_loop);
+    *ref_libcurl_wrap_loop= NULL;
+}
+
+void libcurl_wrap_loop_close_uptr(libcurl_wrap_loop_t *p)
+{
+    libcurl_wrap_loop_close(&p);
+}
+
+int libcurl_wrap_loop_submit(libcurl_wrap_loop_t *libcurl_wrap_loop,
+        const libcurl_wrap_req_ctx_t *libcurl_wrap_req_ctx,
+        libcurl_wrap_done_cb_t done_cb, void *userdata)
+{
+    int ret_code;
+    libcurl_wrap_xfer_t *xfer= NULL;
+    LOG_CTX_INIT(NULL);
+
+    /* Check arguments.
+     * Parameter 'done_cb' is allowed to be NULL.
+     * Parameter 'userdata' is allowed to be NULL.
+     */
+    CHECK_DO(libcurl_wrap_loop!= NULL, return -1);
+    CHECK_DO(libcurl_wrap_req_ctx!= NULL, return -1);
+
+    LOG_CTX_SET(libcurl_wrap_loop->utils_logs_ctx);
+
+    xfer= (libcurl_wrap_xfer_t*)calloc(1, sizeof(libcurl_wrap_xfer_t));
+    CHECK_DO(xfer!= NULL, return -1);
+    xfer->done_cb= done_cb;
+    xfer->userdata= userdata;
+
+    /* Link it in first, so that the error path releases everything */
+    xfer->next= libcurl_wrap_loop->xfers;
+    if(xfer->next!= NULL)
+        xfer->next->prev= xfer;
+    libcurl_wrap_loop->xfers= xfer;
+    libcurl_wrap_loop->xfers_num++;
+
+    if(libcurl_wrap_req_ctx->body!= NULL &&
+            libcurl_wrap_req_ctx->source== NULL) {
+        xfer->body= strdup(libcurl_wrap_req_ctx->body);
+        CHECK_DO(xfer->body!= NULL, goto end);
+    }
+
+    xfer->handle= loop_handle_checkout(libcurl_wrap_loop);
+    CHECK_DO(xfer->handle!= NULL, goto end);
+
+    ret_code= handle_setup(xfer->handle, libcurl_wrap_req_ctx, xfer->body,
+            &xfer->curl_read_mem_ctx, &xfer->curl_write_mem_ctx,
+            &xfer->curl_write_mem_ctx_hdr, LOG_CTX_GET());
+    CHECK_DO(ret_code== 0, goto end);
+    CHECK_DO(curl_easy_setopt(xfer->handle->curl, CURLOPT_PRIVATE, xfer)==
+            CURLE_OK, goto end);
+
+    /* The transfer is started from the loop (libcurl arms the timer) */
+    LOGD("Submitting HTTP-%s to address %s\n",
+            libcurl_wrap_method_lut[xfer->handle->method], xfer->handle->url);
+    CHECK_DO(curl_multi_add_handle(libcurl_wrap_loop->multi,
+            xfer->handle->curl)== CURLM_OK, goto end);
+    return 0;
+end:
+    loop_xfer_close(libcurl_wrap_loop, &xfer);
+    return -1;
+}
+
+int libcurl_wrap_loop_run(libcurl_wrap_loop_t *libcurl_wrap_loop,
+        int tout_msecs)
+{
+    int i, n, running;
+    struct epoll_event events[LOOP_EVENTS_MAX];
+    LOG_CTX_INIT(NULL);
+
+    /* Check arguments */
+    CHECK_DO(libcurl_wrap_loop!= NULL, return -1);
+
+    LOG_CTX_SET(libcurl_wrap_loop->utils_logs_ctx);
+
+    n= epoll_wait(libcurl_wrap_loop->epoll_fd, events, LOOP_EVENTS_MAX,
+            tout_msecs);
+    if(n< 0) {
+        CHECK_DO(errno== EINTR, return -1);
+        n= 0;
+    }
+
+    for(i= 0; i< n; i++) {
+        int fd= events[i].data.fd, flags= 0;
+
+        if(fd== libcurl_wrap_loop->timer_fd) {
+            uint64_t expirations;
+            if(read(fd, &expirations, sizeof(expirations))< 0) {
+                // Spurious wake-up (e.g. re-armed meanwhile): nothing to do
+            }
+            curl_multi_socket_action(libcurl_wrap_loop->multi,
+                    CURL_SOCKET_TIMEOUT, 0, &running);
+            continue;
+        }
+        if(events[i].events& EPOLLIN)
+            flags|= CURL_CSELECT_IN;
+        if(events[i].events& EPOLLOUT)
+            flags|= CURL_CSELECT_OUT;
+        if(events[i].events& (EPOLLERR| EPOLLHUP))
+            flags|= CURL_CSELECT_ERR;
+        curl_multi_socket_action(libcurl_wrap_loop->multi, fd, flags,
+                &running);
+    }
+
+    loop_check_done(libcurl_wrap_loop);
+    return (int)libcurl_wrap_loop->xfers_num;
+}
+
+int libcurl_wrap_loop_get_fd(libcurl_wrap_loop_t *libcurl_wrap_loop)
+{
+    return libcurl_wrap_loop!= NULL? libcurl_wrap_loop->epoll_fd: -1;
+}
+
+int libcurl_wrap_loop_get_eventfd(libcurl_wrap_loop_t *libcurl_wrap_loop)
+{
+    return libcurl_wrap_loop!= NULL? libcurl_wrap_loop->event_fd: -1;
+}
+
+libcurl_wrap_result_t* libcurl_wrap_loop_pop(
+        libcurl_wrap_loop_t *libcurl_wrap_loop)
+{
+    libcurl_wrap_result_node_t *node;
+
+    if(libcurl_wrap_loop== NULL ||
+            (node= libcurl_wrap_loop->queue_head)== NULL)
+        return NULL;
+
+    libcurl_wrap_loop->queue_head= node->next;
+    node->next= NULL;
+    if(libcurl_wrap_loop->queue_head== NULL) {
+        uint64_t count;
+        libcurl_wrap_loop->queue_tail= NULL;
+        /* Queue drained: the eventfd stops being readable */
+        if(read(libcurl_wrap_loop->event_fd, &count, sizeof(count))< 0) {
+            // Nothing signalled (EAGAIN)
+        }
+    }
+    return &node->result;
+}
+
+void libcurl_wrap_result_release(
+        libcurl_wrap_result_t **ref_libcurl_wrap_result)
+{
+    libcurl_wrap_result_t *libcurl_wrap_result;
+
+    if(ref_libcurl_wrap_result== NULL ||
+            (libcurl_wrap_result= *ref_libcurl_wrap_result)== NULL)
+        return;
+
+    if(libcurl_wrap_result->response_str!= NULL)
+        free(libcurl_wrap_result->response_str);
+    if(libcurl_wrap_result->headers_out_str!= NULL)
+        free(libcurl_wrap_result->headers_out_str);
+    free((libcurl_wrap_result_node_t*)libcurl_wrap_result);
+    *ref_libcurl_wrap_result= NULL;
+}
+
+static libcurl_wrap_handle_t* handle_open(CURLSH *share,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    libcurl_wrap_handle_t *handle= NULL;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    /* Check arguments */
+    // Parameter 'share' is allowed to be NULL.
+    // Parameter 'utils_logs_ctx' is allowed to be NULL.
+
+    handle= (libcurl_wrap_handle_t*)calloc(1, sizeof(libcurl_wrap_handle_t));
+    CHECK_DO(handle!= NULL, return NULL);
+
+    handle->share= share;
+    handle->method= LIBCURL_WRAP_METHOD_MAX;
+    handle->tout= -1;
 
     /* Get a curl handle */
-    curl= curl_easy_init();
-    CHECK_DO(curl!= NULL, goto end);
+    handle->curl= curl_easy_init();
+    CHECK_DO(handle->curl!= NULL, goto end);
+    CHECK_DO(handle_set_defaults(handle, LOG_CTX_GET())== 0, goto end);
+    return handle;
+end:
+    handle_close(&handle);
+    return NULL;
+}
+
+static void handle_close(libcurl_wrap_handle_t **ref_handle)
+{
+    libcurl_wrap_handle_t *handle;
+
+    if(ref_handle== NULL || (handle= *ref_handle)== NULL)
+        return;
+
+    if(handle->curl!= NULL) {
+        curl_easy_cleanup(handle->curl);
+        handle->curl= NULL;
+    }
+    if(handle->url!= NULL) {
+        free(handle->url);
+        handle->url= NULL;
+    }
+    if(handle->hdr_list!= NULL) {
+        curl_slist_free_all(handle->hdr_list);
+        handle->hdr_list= NULL;
+    }
+    free(handle);
+    *ref_handle= NULL;
+}
+
+/**
+ * Set the options common to every request (after creating the handle or
+ * resetting it).
+ */
+static int handle_set_defaults(libcurl_wrap_handle_t *handle,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    CURL *curl= handle->curl;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    if(handle->share!= NULL)
+        CHECK_DO(curl_easy_setopt(curl, CURLOPT_SHARE, handle->share)==
+                CURLE_OK, return -1);
+
+    /* Send all data (and header-data) to this function */
+    CHECK_DO(curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION,
+            curl_write_body_callback)== CURLE_OK, return -1);
+    CHECK_DO(curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION,
+            curl_write_body_callback)== CURLE_OK, return -1);
+
+    CHECK_DO(curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L)== CURLE_OK,
+            return -1);
+
+    handle->flag_clean= 1;
+    return 0;
+}
+
+/**
+ * Perform a request on a handle, setting only the options that changed
+ * since the last request served by the handle.
+ */
+static int handle_request(libcurl_wrap_handle_t *handle,
+        const libcurl_wrap_req_ctx_t *libcurl_wrap_req_ctx,
+        utils_logs_ctx_t *const utils_logs_ctx, char **ref_response_str,
+        long *ref_http_ret_code, char **ref_headers_out_str,
+        libcurl_wrap_stats_ctx_t *const stats_ctx)
+{
+    CURLcode curl_code;
+    int ret_code, end_code= -1;
+    struct curl_read_mem_ctx_s curl_read_mem_ctx= {0};
+    struct curl_write_mem_ctx_s curl_write_mem_ctx= {0};
+    struct curl_write_mem_ctx_s curl_write_mem_ctx_hdr= {0};
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    /* Do not keep the headers unless requested */
+    curl_write_mem_ctx_hdr.flag_discard= ref_headers_out_str== NULL;
+
+    /* Set the request up (the body related options point to this call
+     * stack, but are reset before any other method is used)
+     */
+    ret_code= handle_setup(handle, libcurl_wrap_req_ctx,
+            libcurl_wrap_req_ctx->body, &curl_read_mem_ctx,
+            &curl_write_mem_ctx, &curl_write_mem_ctx_hdr, LOG_CTX_GET());
+    CHECK_DO(ret_code== 0, goto end);
+
+    /* Perform the request */
+    LOGD("Requesting HTTP-%s to address %s\n",
+            libcurl_wrap_method_lut[handle->method], handle->url);
+    if((curl_code= curl_easy_perform(handle->curl))!= CURLE_OK) {
+        LOGE("curl_easy_perform() failed: %s; while requesting HTTP-%s to address %s\n", curl_easy_strerror(curl_code),
+                libcurl_wrap_method_lut[handle->method], handle->url);
+        end_code = curl_code;
+        goto end;
+    }
+
+    end_code= handle_collect(handle, &curl_write_mem_ctx,
+            &curl_write_mem_ctx_hdr, LOG_CTX_GET(), ref_response_str,
+            ref_http_ret_code, ref_headers_out_str, stats_ctx);
+end:
+    read_mem_ctx_release(&curl_read_mem_ctx);
+    write_mem_ctx_release(&curl_write_mem_ctx);
+    write_mem_ctx_release(&curl_write_mem_ctx_hdr);
+    return end_code;
+}
+
+/**
+ * Set a handle up for a request (everything but performing it). The body
+ * and the read and write contexts must outlive the transfer.
+ */
+static int handle_setup(libcurl_wrap_handle_t *handle,
+        const libcurl_wrap_req_ctx_t *libcurl_wrap_req_ctx, const char *body,
+        curl_read_mem_ctx_t *const curl_read_mem_ctx,
+        curl_write_mem_ctx_t *const curl_write_mem_ctx,
+        curl_write_mem_ctx_t *const curl_write_mem_ctx_hdr,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    libcurl_wrap_method_t method_code;
+    const char *host, *port, *location, *qstring;
+    int idx, ret_code, flag_attach_query= 0, flag_verbose;
+    CURL *curl= handle->curl;
+    size_t url_size= 0;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    /* Get method */
+    method_code= libcurl_wrap_req_ctx->method;
+    CHECK_DO(method_code< LIBCURL_WRAP_METHOD_MAX, return -1);
 
     /* Check 'host':'port''location'?'qstring' */
     host= libcurl_wrap_req_ctx->host;
     port= libcurl_wrap_req_ctx->port;
-    CHECK_DO(host!= NULL && port!= NULL, goto end);
+    CHECK_DO(host!= NULL && port!= NULL, return -1);
     location= libcurl_wrap_req_ctx->location; // Allowed to be NULL
     qstring= libcurl_wrap_req_ctx->qstring; // Allowed to be NULL
 
+    /* Other methods than GET leave options behind (upload, read callback,
+     * body size...): start over from a clean handle (the connections and
+     * the caches are kept).
+     */
+    if(!handle->flag_clean && (method_code!= LIBCURL_WRAP_METHOD_GET ||
+            handle->method!= LIBCURL_WRAP_METHOD_GET)) {
+        curl_easy_reset(curl);
+        if(handle->hdr_list!= NULL) {
+            curl_slist_free_all(handle->hdr_list);
+            handle->hdr_list= NULL;
+        }
+        handle->tout= -1;
+        handle->flag_verbose= 0;
+        CHECK_DO(handle_set_defaults(handle, LOG_CTX_GET())== 0, return -1);
+    }
+    /* Until the request is set up, the handle state is undetermined */
+    handle->flag_clean= 0;
+    handle->method= LIBCURL_WRAP_METHOD_MAX;
+
     /* Compute complete request URL size */
     url_size= strlen(host)+ 1/*":"*/+ strlen(port)+ 1/*NULL-char*/;
     if(location!= NULL)
@@ -177,91 +953,135 @@ int libcurl_wrap_cli_request(
             qstring!= NULL && strlen(qstring)> 0;
     if(flag_attach_query!= 0 && qstring!= NULL)
         url_size+= 1/*"?"*/+ strlen(qstring);
-    CHECK_DO(url_size> 0 && url_size< URL_MAX_SIZE, goto end);
-
-    /* Allocate and compose URL */
-    url= (char*)calloc(1, url_size);
-    CHECK_DO(url!= NULL, goto end);
-    snprintf(url, url_size, "%s:%s%s%s%s", host, port,
+    CHECK_DO(url_size> 0 && url_size< URL_MAX_SIZE, return -1);
+
+    /* Compose URL (in the handle buffer, grown as needed) */
+    if(url_size> handle->url_size) {
+        char *url= (char*)realloc(handle->url, url_size);
+        CHECK_DO(url!= NULL, return -1);
+        handle->url= url;
+        handle->url_size= url_size;
+    }
+    snprintf(handle->url, url_size, "%s:%s%s%s%s", host, port,
             location!= NULL? location: "",
             flag_attach_query? "?": "", flag_attach_query? qstring: "");
 
     /* Set the URL that is about to receive the request */
-    CHECK_DO(curl_easy_setopt(curl, CURLOPT_URL, url)== CURLE_OK, goto end);
+    CHECK_DO(curl_easy_setopt(curl, CURLOPT_URL, handle->url)== CURLE_OK,
+            return -1);
 
     /* Treat POST options if applicable */
     if(method_code== LIBCURL_WRAP_METHOD_POST) {
+        ret_code= read_mem_ctx_setup(curl_read_mem_ctx, body,
+                libcurl_wrap_req_ctx->source, LOG_CTX_GET());
+        CHECK_DO(ret_code== 0, return -1);
         ret_code= libcurl_wrap_cli_request_post_options(curl,
-                libcurl_wrap_req_ctx->body, &curl_read_mem_ctx,
-                libcurl_wrap_req_ctx->headers, &hdr_list, LOG_CTX_GET());
-        CHECK_DO(ret_code== 0, goto end);
+                curl_read_mem_ctx, libcurl_wrap_req_ctx->headers,
+                &handle->hdr_list, LOG_CTX_GET());
+        CHECK_DO(ret_code== 0, return -1);
     } else if(method_code== LIBCURL_WRAP_METHOD_PUT) {
+        ret_code= read_mem_ctx_setup(curl_read_mem_ctx, body,
+                libcurl_wrap_req_ctx->source, LOG_CTX_GET());
+        CHECK_DO(ret_code== 0, return -1);
         ret_code= libcurl_wrap_cli_request_put_options(curl,
-                libcurl_wrap_req_ctx->body, &curl_read_mem_ctx,
-                libcurl_wrap_req_ctx->headers, &hdr_list, LOG_CTX_GET());
-        CHECK_DO(ret_code== 0, goto end);
+                curl_read_mem_ctx, libcurl_wrap_req_ctx->headers,
+                &handle->hdr_list, LOG_CTX_GET());
+        CHECK_DO(ret_code== 0, return -1);
     }
 
-    /* Set headers if applicable */
-    set_headers(curl, libcurl_wrap_req_ctx->headers, &hdr_list, LOG_CTX_GET());
-
-    /* Send all data to this function */
-    CHECK_DO(curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION,
-            curl_write_body_callback)== CURLE_OK, goto end);
-
-    /* We pass our 'chunk' structure to the callback function
-     * (it will grown as needed by reallocation).
+    /* Set headers if applicable (kept as is if the same as in the previous
+     * GET request of the handle)
      */
-    curl_write_mem_ctx.data= (char*)calloc(1, 1);
-    CHECK_DO(curl_write_mem_ctx.data!= NULL, goto end);
-    curl_write_mem_ctx.size= 0; // no data at this point yet
-    curl_write_mem_ctx.utils_logs_ctx= LOG_CTX_GET();
-    CHECK_DO(curl_easy_setopt(curl, CURLOPT_WRITEDATA,
-            (void*)&curl_write_mem_ctx)== CURLE_OK, goto end);
+    if(method_code!= LIBCURL_WRAP_METHOD_GET ||
+            !match_headers(libcurl_wrap_req_ctx->headers, handle->hdr_list)) {
+        if(method_code== LIBCURL_WRAP_METHOD_GET &&
+                handle->hdr_list!= NULL) {
+            curl_slist_free_all(handle->hdr_list);
+            handle->hdr_list= NULL;
+            CHECK_DO(curl_easy_setopt(curl, CURLOPT_HTTPHEADER, NULL)==
+                    CURLE_OK, return -1);
+        }
+        set_headers(curl, libcurl_wrap_req_ctx->headers, &handle->hdr_list,
+                LOG_CTX_GET());
 
-    /* Send all header-data to this function */
-    CHECK_DO(curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION,
-            curl_write_body_callback)== CURLE_OK, goto end);
+        /* Some servers don't like requests that are made without a
+         * user-agent field, so we provide one.
+         */
+        idx= find_header(libcurl_wrap_req_ctx->headers, "User-Agent", NULL,
+                LOG_CTX_GET());
+        CHECK_DO(curl_easy_setopt(curl, CURLOPT_USERAGENT, idx>= 0?
+                libcurl_wrap_req_ctx->headers[idx]: NULL)== CURLE_OK,
+                return -1);
+    }
 
-    /* We pass our 'chunk' structure to the callback function
-     * (it will grown as needed by reallocation).
+    /* We pass our 'chunk' structure to the callback function (the buffer
+     * is allocated on the first chunk, pre-sized from the Content-Length if
+     * known) or to the sink, if any.
      */
-    curl_write_mem_ctx_hdr.data= (char*)calloc(1, 1);
-    CHECK_DO(curl_write_mem_ctx_hdr.data!= NULL, goto end);
-    curl_write_mem_ctx_hdr.size= 0; // no data at this point yet
-    curl_write_mem_ctx_hdr.utils_logs_ctx= LOG_CTX_GET();
+    curl_write_mem_ctx->data= NULL;
+    curl_write_mem_ctx->size= 0; // no data at this point yet
+    curl_write_mem_ctx->capacity= 0;
+    curl_write_mem_ctx->sink= libcurl_wrap_req_ctx->sink;
+    curl_write_mem_ctx->curl= curl;
+    curl_write_mem_ctx->utils_logs_ctx= LOG_CTX_GET();
+    if(curl_write_mem_ctx->sink!= NULL) {
+        libcurl_wrap_sink_t *sink= curl_write_mem_ctx->sink;
+        CHECK_DO(sink->type< LIBCURL_WRAP_SINK_MAX, return -1);
+        CHECK_DO(sink->type!= LIBCURL_WRAP_SINK_FD || sink->fd>= 0,
+                return -1);
+        CHECK_DO(sink->type!= LIBCURL_WRAP_SINK_ARENA || sink->arena!= NULL,
+                return -1);
+        sink->size= 0;
+        sink->hash= FNV1A_OFFSET_BASIS;
+    }
+    CHECK_DO(curl_easy_setopt(curl, CURLOPT_WRITEDATA,
+            (void*)curl_write_mem_ctx)== CURLE_OK, return -1);
+
+    /* Same for the header-data */
+    curl_write_mem_ctx_hdr->data= NULL;
+    curl_write_mem_ctx_hdr->size= 0; // no data at this point yet
+    curl_write_mem_ctx_hdr->capacity= 0;
+    curl_write_mem_ctx_hdr->sink= NULL;
+    curl_write_mem_ctx_hdr->curl= NULL; // Headers size is not known
+    curl_write_mem_ctx_hdr->utils_logs_ctx= LOG_CTX_GET();
     CHECK_DO(curl_easy_setopt(curl, CURLOPT_HEADERDATA,
-            (void*)&curl_write_mem_ctx_hdr)== CURLE_OK, goto end);
+            (void*)curl_write_mem_ctx_hdr)== CURLE_OK, return -1);
 
     /* Get verbose debug output if applicable */
-    if(libcurl_wrap_req_ctx->flag_libcurl_verbose!= 0)
-        CHECK_DO(curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L)== CURLE_OK,
-                goto end);
-
-    /* Some servers don't like requests that are made without a user-agent
-     * field, so we provide one.
-     */
-    idx= find_header(libcurl_wrap_req_ctx->headers, "User-Agent", NULL,
-            LOG_CTX_GET());
-    if(idx>= 0) { // Header not found -> index== -1
-        CHECK_DO(curl_easy_setopt(curl, CURLOPT_USERAGENT,
-                libcurl_wrap_req_ctx->headers[idx])== CURLE_OK, goto end);
+    flag_verbose= libcurl_wrap_req_ctx->flag_libcurl_verbose!= 0;
+    if(flag_verbose!= handle->flag_verbose) {
+        CHECK_DO(curl_easy_setopt(curl, CURLOPT_VERBOSE, (long)flag_verbose)==
+                CURLE_OK, return -1);
+        handle->flag_verbose= flag_verbose;
     }
 
     /* Set time-out*/
-    CHECK_DO(curl_easy_setopt(curl, CURLOPT_TIMEOUT,
-            libcurl_wrap_req_ctx->tout)== CURLE_OK, goto end);
+    if(libcurl_wrap_req_ctx->tout!= handle->tout) {
+        CHECK_DO(curl_easy_setopt(curl, CURLOPT_TIMEOUT,
+                libcurl_wrap_req_ctx->tout)== CURLE_OK, return -1);
+        handle->tout= libcurl_wrap_req_ctx->tout;
+    }
 
-    CHECK_DO(curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L)== CURLE_OK, goto end);
+    /* The handle is set up for this method */
+    handle->method= method_code;
+    return 0;
+}
 
-    /* Perform the request */
-    LOGD("Requesting HTTP-%s to address %s\n", libcurl_wrap_method_lut[method_code], url);
-    if((curl_code= curl_easy_perform(curl))!= CURLE_OK) {
-        LOGE("curl_easy_perform() failed: %s; while requesting HTTP-%s to address %s\n", curl_easy_strerror(curl_code),
-                libcurl_wrap_method_lut[method_code], url);
-        end_code = curl_code;
-        goto end;
-    }
+/**
+ * Collect the outcome of a request successfully performed on a handle.
+ * The response and the output headers are handed over from the write
+ * contexts.
+ */
+static int handle_collect(libcurl_wrap_handle_t *handle,
+        curl_write_mem_ctx_t *const curl_write_mem_ctx,
+        curl_write_mem_ctx_t *const curl_write_mem_ctx_hdr,
+        utils_logs_ctx_t *const utils_logs_ctx, char **ref_response_str,
+        long *ref_http_ret_code, char **ref_headers_out_str,
+        libcurl_wrap_stats_ctx_t *const stats_ctx)
+{
+    CURL *curl= handle->curl;
+    long http_ret_code= 404; // Initialize to 'Not Found'
+    LOG_CTX_INIT(utils_logs_ctx);
 
     /* Populate statistics context structure if it was required */
     if(stats_ctx != NULL)
@@ -285,50 +1105,212 @@ int libcurl_wrap_cli_request(
     }
 
     /* Prepare response data if applicable */
-    if(curl_write_mem_ctx.size> 0) {
-        *ref_response_str= curl_write_mem_ctx.data;
-        curl_write_mem_ctx.data= NULL; // Avoid double referencing
-        curl_write_mem_ctx.size= 0;
+    if(curl_write_mem_ctx->size> 0) {
+        *ref_response_str= curl_write_mem_ctx->data;
+        curl_write_mem_ctx->data= NULL; // Avoid double referencing
+        curl_write_mem_ctx->size= 0;
     }
 
     /* Prepare response output headers if applicable */
-    if(ref_headers_out_str != NULL && curl_write_mem_ctx_hdr.size> 0) {
-        *ref_headers_out_str= curl_write_mem_ctx_hdr.data;
-        curl_write_mem_ctx_hdr.data= NULL; // Avoid double referencing
-        curl_write_mem_ctx_hdr.size= 0;
+    if(ref_headers_out_str != NULL && curl_write_mem_ctx_hdr->size> 0) {
+        *ref_headers_out_str= curl_write_mem_ctx_hdr->data;
+        curl_write_mem_ctx_hdr->data= NULL; // Avoid double referencing
+        curl_write_mem_ctx_hdr->size= 0;
     }
 
     /* Prepare response code */
     CHECK_DO(curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_ret_code)==
-            CURLE_OK, goto end);
+            CURLE_OK, return -1);
     *ref_http_ret_code= http_ret_code;
+    return 0;
+}
 
-    end_code= 0; // succeed
-end:
-    if(curl!= NULL) {
-        curl_easy_cleanup(curl);
-        curl= NULL;
+static void write_mem_ctx_release(curl_write_mem_ctx_t *curl_write_mem_ctx)
+{
+    if(curl_write_mem_ctx->data!= NULL) {
+        free(curl_write_mem_ctx->data);
+        curl_write_mem_ctx->data= NULL;
     }
-    if(url!= NULL) {
-        free(url);
-        url= NULL;
+    curl_write_mem_ctx->size= 0;
+    curl_write_mem_ctx->capacity= 0;
+}
+
+static libcurl_wrap_handle_t* loop_handle_checkout(
+        libcurl_wrap_loop_t *libcurl_wrap_loop)
+{
+    libcurl_wrap_handle_t *handle= libcurl_wrap_loop->pool;
+
+    if(handle!= NULL) {
+        libcurl_wrap_loop->pool= handle->next;
+        libcurl_wrap_loop->pool_num--;
+        handle->next= NULL;
+        return handle;
     }
-    if(hdr_list!= NULL) {
-        curl_slist_free_all(hdr_list);
-        hdr_list= NULL;
+    /* The multi handle keeps the connections and DNS caches: no share */
+    return handle_open(NULL, libcurl_wrap_loop->utils_logs_ctx);
+}
+
+static void loop_handle_checkin(libcurl_wrap_loop_t *libcurl_wrap_loop,
+        libcurl_wrap_handle_t **ref_handle)
+{
+    libcurl_wrap_handle_t *handle= *ref_handle;
+
+    if(libcurl_wrap_loop->pool_num< libcurl_wrap_loop->pool_max) {
+        handle->next= libcurl_wrap_loop->pool;
+        libcurl_wrap_loop->pool= handle;
+        libcurl_wrap_loop->pool_num++;
+        *ref_handle= NULL;
+        return;
     }
-    if(curl_write_mem_ctx.data!= NULL) {
-        free(curl_write_mem_ctx.data);
-        curl_write_mem_ctx.data= NULL;
+    handle_close(ref_handle);
+}
+
+/**
+ * Detach a request from the loop (and from the multi handle if it was added)
+ * and release it.
+ */
+static void loop_xfer_close(libcurl_wrap_loop_t *libcurl_wrap_loop,
+        libcurl_wrap_xfer_t **ref_xfer)
+{
+    libcurl_wrap_xfer_t *xfer= *ref_xfer;
+
+    if(xfer->handle!= NULL) {
+        /* Removing a handle that was not added is harmless */
+        curl_multi_remove_handle(libcurl_wrap_loop->multi,
+                xfer->handle->curl);
+        loop_handle_checkin(libcurl_wrap_loop, &xfer->handle);
     }
-    if(curl_write_mem_ctx_hdr.data!= NULL) {
-        free(curl_write_mem_ctx_hdr.data);
-        curl_write_mem_ctx_hdr.data= NULL;
+
+    if(xfer->prev!= NULL)
+        xfer->prev->next= xfer->next;
+    else
+        libcurl_wrap_loop->xfers= xfer->next;
+    if(xfer->next!= NULL)
+        xfer->next->prev= xfer->prev;
+    libcurl_wrap_loop->xfers_num--;
+
+    read_mem_ctx_release(&xfer->curl_read_mem_ctx);
+    write_mem_ctx_release(&xfer->curl_write_mem_ctx);
+    write_mem_ctx_release(&xfer->curl_write_mem_ctx_hdr);
+    if(xfer->body!= NULL)
+        free(xfer->body);
+    free(xfer);
+    *ref_xfer= NULL;
+}
+
+/**
+ * Complete the finished requests: call their callback, or queue their
+ * result and signal the completion eventfd.
+ */
+static void loop_check_done(libcurl_wrap_loop_t *libcurl_wrap_loop)
+{
+    CURLMsg *msg;
+    int msgs_left;
+    LOG_CTX_INIT(libcurl_wrap_loop->utils_logs_ctx);
+
+    while((msg= curl_multi_info_read(libcurl_wrap_loop->multi, &msgs_left))!=
+            NULL) {
+        CURLcode curl_code;
+        libcurl_wrap_done_cb_t done_cb;
+        libcurl_wrap_xfer_t *xfer= NULL;
+        libcurl_wrap_result_node_t *node;
+
+        if(msg->msg!= CURLMSG_DONE)
+            continue;
+        curl_code= msg->data.result; // 'msg' is not valid after removal
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char**)&xfer);
+        CHECK_DO(xfer!= NULL, continue);
+
+        node= (libcurl_wrap_result_node_t*)calloc(1, sizeof(
+                libcurl_wrap_result_node_t));
+        if(node== NULL) {
+            LOGE("Could not allocate result; dropping it\n");
+            loop_xfer_close(libcurl_wrap_loop, &xfer);
+            continue;
+        }
+        node->result.userdata= xfer->userdata;
+        node->result.http_ret_code= 404;
+        if(curl_code!= CURLE_OK) {
+            LOGE("Transfer failed: %s; while requesting HTTP-%s to address %s\n", curl_easy_strerror(curl_code),
+                    libcurl_wrap_method_lut[xfer->handle->method], xfer->handle->url);
+            node->result.end_code= curl_code;
+        } else {
+            node->result.end_code= handle_collect(xfer->handle,
+                    &xfer->curl_write_mem_ctx, &xfer->curl_write_mem_ctx_hdr,
+                    LOG_CTX_GET(), &node->result.response_str,
+                    &node->result.http_ret_code,
+                    &node->result.headers_out_str, &node->result.stats);
+        }
+        done_cb= xfer->done_cb;
+        loop_xfer_close(libcurl_wrap_loop, &xfer);
+
+        if(done_cb!= NULL) {
+            libcurl_wrap_result_t *result= &node->result;
+            done_cb(libcurl_wrap_loop, result);
+            libcurl_wrap_result_release(&result);
+        } else {
+            uint64_t one= 1;
+            if(libcurl_wrap_loop->queue_tail!= NULL)
+                libcurl_wrap_loop->queue_tail->next= node;
+            else
+                libcurl_wrap_loop->queue_head= node;
+            libcurl_wrap_loop->queue_tail= node;
+            CHECK(write(libcurl_wrap_loop->event_fd, &one, sizeof(one))==
+                    sizeof(one));
+        }
     }
-    return end_code;
 }
 
-static int libcurl_wrap_cli_request_post_options(CURL *curl, const char *body,
+static int loop_socket_callback(CURL *curl, curl_socket_t s, int what,
+        void *userp, void *socketp)
+{
+    struct epoll_event ev= {0};
+    libcurl_wrap_loop_t *libcurl_wrap_loop= (libcurl_wrap_loop_t*)userp;
+    LOG_CTX_INIT(libcurl_wrap_loop->utils_logs_ctx);
+
+    ev.data.fd= s;
+    if(what== CURL_POLL_REMOVE) {
+        /* The socket may be already closed: ignore the outcome */
+        epoll_ctl(libcurl_wrap_loop->epoll_fd, EPOLL_CTL_DEL, s, &ev);
+        return 0;
+    }
+    if(what& CURL_POLL_IN)
+        ev.events|= EPOLLIN;
+    if(what& CURL_POLL_OUT)
+        ev.events|= EPOLLOUT;
+    if(socketp== NULL) {
+        /* New socket: mark it as known to the loop */
+        CHECK_DO(epoll_ctl(libcurl_wrap_loop->epoll_fd, EPOLL_CTL_ADD, s,
+                &ev)== 0, return -1);
+        curl_multi_assign(libcurl_wrap_loop->multi, s, libcurl_wrap_loop);
+    } else {
+        CHECK_DO(epoll_ctl(libcurl_wrap_loop->epoll_fd, EPOLL_CTL_MOD, s,
+                &ev)== 0, return -1);
+    }
+    return 0;
+}
+
+static int loop_timer_callback(CURLM *multi, long timeout_ms, void *userp)
+{
+    struct itimerspec its= {{0}}; // Zeroed: disarm
+    libcurl_wrap_loop_t *libcurl_wrap_loop= (libcurl_wrap_loop_t*)userp;
+    LOG_CTX_INIT(libcurl_wrap_loop->utils_logs_ctx);
+
+    /* libcurl must not be called back from here: a zero time-out is served
+     * on the next loop run, as soon as the timer fires.
+     */
+    if(timeout_ms> 0) {
+        its.it_value.tv_sec= timeout_ms/ 1000;
+        its.it_value.tv_nsec= (timeout_ms% 1000)* 1000000;
+    } else if(timeout_ms== 0) {
+        its.it_value.tv_nsec= 1; // All-zero would disarm the timer
+    }
+    CHECK_DO(timerfd_settime(libcurl_wrap_loop->timer_fd, 0, &its, NULL)== 0,
+            return -1);
+    return 0;
+}
+
+static int libcurl_wrap_cli_request_post_options(CURL *curl,
         curl_read_mem_ctx_t *const curl_read_mem_ctx,
         const char **headers, struct curl_slist **ref_hdr_list,
         utils_logs_ctx_t *const utils_logs_ctx)
@@ -338,7 +1320,6 @@ static int libcurl_wrap_cli_request_post_options(CURL *curl, const char *body,
 
     /* Check arguments */
     CHECK_DO(curl!= NULL, return -1);
-    // Parameter 'body' is allowed to be NULL.
     CHECK_DO(curl_read_mem_ctx!= NULL, return -1);
     // Parameter 'headers' is allowed to be NULL.
     CHECK_DO(ref_hdr_list!= NULL, return -1); //*ref_hdr_list may be NULL
@@ -348,28 +1329,26 @@ static int libcurl_wrap_cli_request_post_options(CURL *curl, const char *body,
     CHECK_DO(curl_easy_setopt(curl, CURLOPT_POST, 1L)== CURLE_OK, return -1);
 
     /* Configure body sending related function */
-    if(body!= NULL) {
+    if(curl_read_mem_ctx->flag_body) {
         /* Set our read function -used to SEND data- if applicable */
         CHECK_DO(curl_easy_setopt(curl, CURLOPT_READFUNCTION,
                 curl_read_body_callback)== CURLE_OK, return -1);
 
         /* Context structure pointer to pass to our read function */
-        curl_read_mem_ctx->p_read= body;
-        curl_read_mem_ctx->size_left= strlen(body);
-        curl_read_mem_ctx->utils_logs_ctx= LOG_CTX_GET();
         CHECK_DO(curl_easy_setopt(curl, CURLOPT_READDATA, curl_read_mem_ctx)==
                 CURLE_OK, return -1);
     }
 
-    /* If transfer is not chunked, set the expected POST size.
-     * NOTE: To POST large amounts of data, consider
-     * CURLOPT_POSTFIELDSIZE_LARGE.
+    /* If transfer is not chunked, set the expected POST size (chunked
+     * transfer is requested by header, and used if the size is not known).
      */
     idx= find_header(headers, "Transfer-Encoding", "chunked", LOG_CTX_GET());
-    if(idx< 0) { // Header not found -> index== -1
-        CHECK_DO(curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE,
-                (long)curl_read_mem_ctx->size_left)== CURLE_OK, return -1);
-    }
+    if(idx< 0 && read_mem_ctx_chunked(curl_read_mem_ctx))
+        *ref_hdr_list= curl_slist_append(*ref_hdr_list,
+                "Transfer-Encoding: chunked");
+    else if(idx< 0) // Header not found -> index== -1
+        CHECK_DO(curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+                (curl_off_t)curl_read_mem_ctx->size)== CURLE_OK, return -1);
 
 #ifndef DISABLE_EXPECT
     /* A less good option would be to enforce HTTP 1.0, but that might
@@ -380,16 +1359,16 @@ static int libcurl_wrap_cli_request_post_options(CURL *curl, const char *body,
     return 0;
 }
 
-static int libcurl_wrap_cli_request_put_options(CURL *curl, const char *body,
+static int libcurl_wrap_cli_request_put_options(CURL *curl,
         curl_read_mem_ctx_t *const curl_read_mem_ctx,
         const char **headers, struct curl_slist **ref_hdr_list,
         utils_logs_ctx_t *const utils_logs_ctx)
 {
+    int idx;
     LOG_CTX_INIT(utils_logs_ctx);
 
     /* Check arguments */
     CHECK_DO(curl!= NULL, return -1);
-    // Parameter 'body' is allowed to be NULL.
     CHECK_DO(curl_read_mem_ctx!= NULL, return -1);
     // Parameter 'headers' is allowed to be NULL.
     CHECK_DO(ref_hdr_list!= NULL, return -1); //*ref_hdr_list may be NULL
@@ -399,9 +1378,7 @@ static int libcurl_wrap_cli_request_put_options(CURL *curl, const char *body,
     CHECK_DO(curl_easy_setopt(curl, CURLOPT_PUT, 1L)== CURLE_OK, return -1);
 
     /* Configure body sending related function */
-    if(body!= NULL) {
-        //printf("body: '%s' (%d)\n", body, (int)strlen(body)); // commment-me
-
+    if(curl_read_mem_ctx->flag_body) {
         /* enable uploading */
         CHECK_DO(curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L)== CURLE_OK,
                 return -1);
@@ -411,22 +1388,116 @@ static int libcurl_wrap_cli_request_put_options(CURL *curl, const char *body,
                 curl_read_body_callback)== CURLE_OK, return -1);
 
         /* Context structure pointer to pass to our read function */
-        curl_read_mem_ctx->p_read= body;
-        curl_read_mem_ctx->size_left= strlen(body);
-        curl_read_mem_ctx->utils_logs_ctx= LOG_CTX_GET();
         CHECK_DO(curl_easy_setopt(curl, CURLOPT_READDATA, curl_read_mem_ctx)==
                 CURLE_OK, return -1);
 
         /* Provide the size of the upload, we specicially typecast the value
          * to curl_off_t since we must be sure to use the correct data size.
+         * Otherwise, the body is sent chunked.
          */
-        CHECK_DO(curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, (curl_off_t)
-                curl_read_mem_ctx->size_left)== CURLE_OK, return -1);
+        idx= find_header(headers, "Transfer-Encoding", "chunked",
+                LOG_CTX_GET());
+        if(idx< 0 && read_mem_ctx_chunked(curl_read_mem_ctx))
+            *ref_hdr_list= curl_slist_append(*ref_hdr_list,
+                    "Transfer-Encoding: chunked");
+        else if(idx< 0)
+            CHECK_DO(curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE,
+                    (curl_off_t)curl_read_mem_ctx->size)== CURLE_OK,
+                    return -1);
+    }
+
+    return 0;
+}
+
+/**
+ * Prepare the reading context of a request body: either a character string
+ * or a body source (if given, the string is ignored).
+ */
+static int read_mem_ctx_setup(curl_read_mem_ctx_t *const curl_read_mem_ctx,
+        const char *body, libcurl_wrap_source_t *source,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    struct stat st;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    curl_read_mem_ctx->utils_logs_ctx= LOG_CTX_GET();
+    curl_read_mem_ctx->size= 0;
+
+    if(source== NULL) {
+        if(body!= NULL) {
+            curl_read_mem_ctx->p_read= body;
+            curl_read_mem_ctx->size_left= strlen(body);
+            curl_read_mem_ctx->size= (int64_t)curl_read_mem_ctx->size_left;
+            curl_read_mem_ctx->flag_mem= 1;
+            curl_read_mem_ctx->flag_body= 1;
+        }
+        return 0;
     }
 
+    curl_read_mem_ctx->source= source;
+    curl_read_mem_ctx->flag_body= 1;
+    curl_read_mem_ctx->size= source->size< 0? -1: source->size;
+    source->sent= 0;
+
+    switch(source->type) {
+    case LIBCURL_WRAP_SOURCE_BUFFER:
+        CHECK_DO(source->buf!= NULL || source->buf_size== 0, return -1);
+        curl_read_mem_ctx->p_read= source->buf;
+        curl_read_mem_ctx->size_left= source->buf_size;
+        curl_read_mem_ctx->size= (int64_t)source->buf_size;
+        curl_read_mem_ctx->flag_mem= 1;
+        break;
+    case LIBCURL_WRAP_SOURCE_FD:
+        CHECK_DO(source->fd>= 0, return -1);
+        CHECK_DO(fstat(source->fd, &st)== 0, return -1);
+        if(!S_ISREG(st.st_mode))
+            break; // Read as it comes
+        /* Regular file: send it from a (read-only) mapping */
+        curl_read_mem_ctx->size= (int64_t)st.st_size;
+        curl_read_mem_ctx->flag_mem= 1;
+        if(st.st_size== 0)
+            break;
+        curl_read_mem_ctx->map= mmap(NULL, (size_t)st.st_size, PROT_READ,
+                MAP_PRIVATE, source->fd, 0);
+        CHECK_DO(curl_read_mem_ctx->map!= MAP_FAILED,
+                curl_read_mem_ctx->map= NULL; return -1);
+        curl_read_mem_ctx->map_size= (size_t)st.st_size;
+        madvise(curl_read_mem_ctx->map, curl_read_mem_ctx->map_size,
+                MADV_SEQUENTIAL);
+        curl_read_mem_ctx->p_read= (const char*)curl_read_mem_ctx->map;
+        curl_read_mem_ctx->size_left= curl_read_mem_ctx->map_size;
+        break;
+    case LIBCURL_WRAP_SOURCE_GENERATOR:
+        CHECK_DO(source->gen_fxn!= NULL, return -1);
+        break;
+    default:
+        LOGE("Unknown body source type %d\n", (int)source->type);
+        return -1;
+    }
     return 0;
 }
 
+static void read_mem_ctx_release(curl_read_mem_ctx_t *curl_read_mem_ctx)
+{
+    if(curl_read_mem_ctx->map!= NULL) {
+        munmap(curl_read_mem_ctx->map, curl_read_mem_ctx->map_size);
+        curl_read_mem_ctx->map= NULL;
+        curl_read_mem_ctx->map_size= 0;
+    }
+}
+
+/**
+ * Check if a request body is to be sent chunked (size not known, or chunked
+ * transfer requested by the body source).
+ */
+static int read_mem_ctx_chunked(const curl_read_mem_ctx_t *curl_read_mem_ctx)
+{
+    if(!curl_read_mem_ctx->flag_body)
+        return 0;
+    return curl_read_mem_ctx->size< 0 || (curl_read_mem_ctx->source!= NULL &&
+            curl_read_mem_ctx->source->flag_chunked);
+}
+
 static void set_headers(CURL *curl, const char **headers,
         struct curl_slist **ref_hdr_list,
         utils_logs_ctx_t *const utils_logs_ctx)
@@ -508,7 +1579,7 @@ static int find_header(const char **headers, const char *hdr_needle,
                 // match header and do not need to match value (= NULL) or
                 // match header and match value
                 flag_match_found= 1;
-                LOGD("header: %s (tag size= %d)\n", hdr,
+                LOGD("header: %s (tag size= %zu)\n", hdr,
                         hdr_tag_size); //comment-me
                 break;
             }
@@ -517,40 +1588,113 @@ static int find_header(const char **headers, const char *hdr_needle,
     return flag_match_found!= 0? i: -1;
 }
 
+/**
+ * Check if a headers array is the one a libcurl list was built from.
+ */
+static int match_headers(const char **headers,
+        const struct curl_slist *hdr_list)
+{
+    int i;
+
+    for(i= 0; headers!= NULL && i< HDRS_MAX_NUM && headers[i]!= NULL; i++) {
+        if(hdr_list== NULL || strcmp(headers[i], hdr_list->data)!= 0)
+            return 0;
+        hdr_list= hdr_list->next;
+    }
+    return hdr_list== NULL;
+}
+
+static void share_lock_callback(CURL *curl, curl_lock_data data,
+        curl_lock_access access, void *userp)
+{
+    libcurl_wrap_session_t *libcurl_wrap_session=
+            (libcurl_wrap_session_t*)userp;
+
+    if(data< CURL_LOCK_DATA_LAST)
+        pthread_mutex_lock(&libcurl_wrap_session->share_mutex[data]);
+}
+
+static void share_unlock_callback(CURL *curl, curl_lock_data data,
+        void *userp)
+{
+    libcurl_wrap_session_t *libcurl_wrap_session=
+            (libcurl_wrap_session_t*)userp;
+
+    if(data< CURL_LOCK_DATA_LAST)
+        pthread_mutex_unlock(&libcurl_wrap_session->share_mutex[data]);
+}
+
 static size_t curl_read_body_callback(void *dest, size_t size, size_t nmemb,
         void *userp)
 {
+    ssize_t read_size;
     size_t size_left;
     curl_read_mem_ctx_t *curl_read_mem_ctx= (curl_read_mem_ctx_t*)userp;
     size_t max_read_size= size* nmemb;
+    libcurl_wrap_source_t *source;
     LOG_CTX_INIT(NULL);
 
     /* Check arguments */
-    CHECK_DO(curl_read_mem_ctx!= NULL, return 0);
-    CHECK_DO(curl_read_mem_ctx->p_read!= NULL, return 0);
-    CHECK_DO(dest!= NULL, return 0);
+    CHECK_DO(curl_read_mem_ctx!= NULL, return CURL_READFUNC_ABORT);
+    CHECK_DO(dest!= NULL, return CURL_READFUNC_ABORT);
 
     // Member 'curl_read_mem_ctx->utils_logs_ctx' is allowed to be NULL.
     LOG_CTX_SET(curl_read_mem_ctx->utils_logs_ctx);
 
-    /* Sanity check: 'size_left' and 'max_read_size' */
-    if(max_read_size== 0 || (size_left= curl_read_mem_ctx->size_left)== 0)
+    /* Sanity check: 'max_read_size' */
+    if(max_read_size== 0)
         return 0;
 
-    /* Copy as much as possible from the source to the destination */
-    if(size_left> max_read_size)
-        size_left= max_read_size;
-    memcpy(dest, curl_read_mem_ctx->p_read, size_left);
-
-    /* Update reading context structure members */
-    curl_read_mem_ctx->p_read+= size_left;
-    curl_read_mem_ctx->size_left-= size_left;
+    source= curl_read_mem_ctx->source; // Allowed to be NULL
+
+    if(curl_read_mem_ctx->flag_mem) {
+        /* Sanity check: 'size_left' */
+        if((size_left= curl_read_mem_ctx->size_left)== 0)
+            return 0;
+        CHECK_DO(curl_read_mem_ctx->p_read!= NULL,
+                return CURL_READFUNC_ABORT);
+
+        /* Copy as much as possible from the source to the destination */
+        if(size_left> max_read_size)
+            size_left= max_read_size;
+        memcpy(dest, curl_read_mem_ctx->p_read, size_left);
+
+        /* Update reading context structure members */
+        curl_read_mem_ctx->p_read+= size_left;
+        curl_read_mem_ctx->size_left-= size_left;
+        if(source!= NULL)
+            source->sent+= size_left;
+        return size_left;
+    }
 
-    return size_left;
+    /* Read from the source straight into the libcurl buffer */
+    CHECK_DO(source!= NULL, return CURL_READFUNC_ABORT);
+    if(source->type== LIBCURL_WRAP_SOURCE_FD) {
+        do {
+            read_size= read(source->fd, dest, max_read_size);
+        } while(read_size< 0 && errno== EINTR);
+        if(read_size< 0) {
+            LOGE("Could not read from body source file descriptor %d: %s\n",
+                    source->fd, strerror(errno));
+            return CURL_READFUNC_ABORT;
+        }
+    } else {
+        read_size= source->gen_fxn((char*)dest, max_read_size, source->sent,
+                source->gen_opaque);
+        if(read_size< 0 || (size_t)read_size> max_read_size) {
+            LOGE("Body source generator failed\n");
+            return CURL_READFUNC_ABORT;
+        }
+    }
+    source->sent+= (uint64_t)read_size;
+    return (size_t)read_size;
 }
 
 /**
  * Memory write callback used by our lib-curl handler to get request body.
+ * The data is handed to the sink if any, otherwise it is appended to a
+ * buffer that is pre-sized from the Content-Length (if known) and doubled
+ * as needed, so that the body is copied only once.
  * @param contents Pointer to a (partial) chunk of the body content
  * @param size [bytes] of the units in which the chunk is received
  * @param nmemb number of size-units received composing the chunk
@@ -560,14 +1704,12 @@ static size_t curl_read_body_callback(void *dest, size_t size, size_t nmemb,
 static size_t curl_write_body_callback(void *contents, size_t size,
         size_t nmemb, void *userp)
 {
-    char *p_data;
-    size_t realsize= size* nmemb;
+    size_t realsize= size* nmemb, size_needed;
     curl_write_mem_ctx_t *curl_write_mem_ctx= (curl_write_mem_ctx_t*)userp;
     LOG_CTX_INIT(NULL);
 
     /* Check arguments */
     CHECK_DO(curl_write_mem_ctx!= NULL, return 0);
-    CHECK_DO(curl_write_mem_ctx->data!= NULL, return 0);
     CHECK_DO(contents!= NULL, return 0);
 
     // Member 'curl_write_mem_ctx->utils_logs_ctx' is allowed to be NULL.
@@ -577,10 +1719,34 @@ static size_t curl_write_body_callback(void *contents, size_t size,
     if(size== 0 || nmemb== 0)
         return 0;
 
-    p_data= (char*)realloc(curl_write_mem_ctx->data, curl_write_mem_ctx->size+
-            realsize+ 1);
-    CHECK_DO(p_data!= NULL, return 0);
-    curl_write_mem_ctx->data= p_data;
+    if(curl_write_mem_ctx->flag_discard)
+        return realsize;
+    if(curl_write_mem_ctx->sink!= NULL)
+        return write_sink(curl_write_mem_ctx->sink, (const char*)contents,
+                realsize, LOG_CTX_GET());
+
+    /* Grow the buffer if needed (room for the 'NULL' character included) */
+    size_needed= curl_write_mem_ctx->size+ realsize+ 1;
+    if(size_needed> curl_write_mem_ctx->capacity) {
+        char *p_data;
+        size_t capacity= curl_write_mem_ctx->capacity* 2;
+        if(curl_write_mem_ctx->data== NULL) {
+            curl_off_t content_length= -1;
+            capacity= WRITE_MEM_SIZE_MIN;
+            if(curl_write_mem_ctx->curl!= NULL &&
+                    curl_easy_getinfo(curl_write_mem_ctx->curl,
+                    CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length)==
+                    CURLE_OK && content_length> 0 &&
+                    content_length< WRITE_MEM_PRESIZE_MAX)
+                capacity= (size_t)content_length+ 1;
+        }
+        if(capacity< size_needed)
+            capacity= size_needed;
+        p_data= (char*)realloc(curl_write_mem_ctx->data, capacity);
+        CHECK_DO(p_data!= NULL, return 0);
+        curl_write_mem_ctx->data= p_data;
+        curl_write_mem_ctx->capacity= capacity;
+    }
 
     memcpy(&curl_write_mem_ctx->data[curl_write_mem_ctx->size], contents,
             realsize);
@@ -590,4 +1756,54 @@ static size_t curl_write_body_callback(void *contents, size_t size,
     return realsize;
 }
 
+/**
+ * Hand a chunk of the body to a sink.
+ * @return Number of bytes processed (less than 'size' aborts the transfer).
+ */
+static size_t write_sink(libcurl_wrap_sink_t *sink, const char *contents,
+        size_t size, utils_logs_ctx_t *const utils_logs_ctx)
+{
+    size_t i;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    switch(sink->type) {
+    case LIBCURL_WRAP_SINK_DISCARD:
+        if(sink->flag_hash) {
+            uint64_t hash= sink->hash;
+            for(i= 0; i< size; i++) {
+                hash^= (uint8_t)contents[i];
+                hash*= FNV1A_PRIME;
+            }
+            sink->hash= hash;
+        }
+        break;
+    case LIBCURL_WRAP_SINK_FD:
+        for(i= 0; i< size;) {
+            ssize_t written= write(sink->fd, contents+ i, size- i);
+            if(written< 0 && errno== EINTR)
+                continue;
+            if(written<= 0) {
+                LOGE("Could not write to sink file descriptor %d: %s\n",
+                        sink->fd, strerror(errno));
+                return i;
+            }
+            i+= (size_t)written;
+        }
+        break;
+    case LIBCURL_WRAP_SINK_ARENA:
+        if(sink->size+ size> sink->arena_size) {
+            LOGE("Response body does not fit the sink arena (%zu bytes)\n",
+                    sink->arena_size);
+            return 0;
+        }
+        memcpy(sink->arena+ sink->size, contents, size);
+        break;
+    default:
+        LOGE("Unknown sink type %d\n", (int)sink->type);
+        return 0;
+    }
+    sink->size+= size;
+    return size;
+}
+
 const char* libcurl_wrap_method_lut[] = {"GET", "POST", "PUT", "n/a"};
@@ -36,11 +36,14 @@ extern "C" {
 
 #include <stdio.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 /* **** Definitions **** */
 
 /* Forward declarations */
 typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+typedef struct libcurl_wrap_session_s libcurl_wrap_session_t;
+typedef struct libcurl_wrap_loop_s libcurl_wrap_loop_t;
 
 /**
  * Supported methods enumerator.
@@ -52,6 +55,138 @@ typedef enum method_enum {
     LIBCURL_WRAP_METHOD_MAX
 } libcurl_wrap_method_t;
 
+/**
+ * Response body sink types enumerator.
+ */
+typedef enum libcurl_wrap_sink_type_enum {
+    /**
+     * Count the bytes received (and optionally hash them) and drop them.
+     */
+    LIBCURL_WRAP_SINK_DISCARD= 0,
+    /**
+     * Write the body to a file descriptor, straight from the libcurl receive
+     * buffer.
+     */
+    LIBCURL_WRAP_SINK_FD,
+    /**
+     * Copy the body into a caller-supplied buffer (the transfer fails if the
+     * body does not fit).
+     */
+    LIBCURL_WRAP_SINK_ARENA,
+    LIBCURL_WRAP_SINK_MAX
+} libcurl_wrap_sink_type_t;
+
+/**
+ * Response body sink context structure.
+ * By default (no sink) the body is returned as a character string, in a
+ * buffer pre-sized from the Content-Length header (grown geometrically if
+ * unknown). A sink receives the body instead, in constant memory.
+ */
+typedef struct libcurl_wrap_sink_s {
+    /**
+     * Sink type. Mandatory.
+     */
+    libcurl_wrap_sink_type_t type;
+    /**
+     * Set this flag to non-zero to compute a 64-bit FNV-1a hash of the body
+     * (discard sink only).
+     */
+    int flag_hash;
+    /**
+     * File descriptor to write to (file descriptor sink only).
+     */
+    int fd;
+    /**
+     * Buffer to copy to, and its size (arena sink only).
+     */
+    char *arena;
+    size_t arena_size;
+
+    /* **** Outputs (updated as the body is received) **** */
+    /**
+     * Bytes received.
+     */
+    uint64_t size;
+    /**
+     * Hash of the bytes received (if 'flag_hash' is set).
+     */
+    uint64_t hash;
+} libcurl_wrap_sink_t;
+
+/**
+ * Request body source types enumerator.
+ */
+typedef enum libcurl_wrap_source_type_enum {
+    /**
+     * Send a (pointer, length) buffer (may hold any byte, NUL included).
+     */
+    LIBCURL_WRAP_SOURCE_BUFFER= 0,
+    /**
+     * Send the content of a file descriptor. Regular files are sent whole
+     * from a read-only mapping; other descriptors (pipes, sockets...) are
+     * read from straight into the libcurl send buffer until end-of-file.
+     */
+    LIBCURL_WRAP_SOURCE_FD,
+    /**
+     * Send what a generator callback produces (e.g. synthetic payloads).
+     */
+    LIBCURL_WRAP_SOURCE_GENERATOR,
+    LIBCURL_WRAP_SOURCE_MAX
+} libcurl_wrap_source_type_t;
+
+/**
+ * Body generator callback type.
+ * @param dest Buffer to fill in.
+ * @param size Size of the buffer [bytes].
+ * @param offset Number of bytes of the body produced so far.
+ * @param gen_opaque Opaque user data (see 'libcurl_wrap_source_t').
+ * @return Number of bytes written into the buffer (0 at the end of the
+ * body), or a negative value to abort the transfer.
+ */
+typedef ssize_t (*libcurl_wrap_source_gen_fxn_t)(char *dest, size_t size,
+        uint64_t offset, void *gen_opaque);
+
+/**
+ * Request body source context structure (POST and PUT methods).
+ */
+typedef struct libcurl_wrap_source_s {
+    /**
+     * Source type. Mandatory.
+     */
+    libcurl_wrap_source_type_t type;
+    /**
+     * Buffer to send and its size (buffer source only).
+     */
+    const char *buf;
+    size_t buf_size;
+    /**
+     * File descriptor to send (file descriptor source only).
+     */
+    int fd;
+    /**
+     * Generator callback and its opaque user data (generator source only).
+     */
+    libcurl_wrap_source_gen_fxn_t gen_fxn;
+    void *gen_opaque;
+    /**
+     * Body size, for the sources whose size is not known beforehand
+     * (generators and non-regular file descriptors). Set to -1 if not
+     * known; the body is then sent with chunked transfer encoding.
+     */
+    int64_t size;
+    /**
+     * Set this flag to non-zero to send the body with chunked transfer
+     * encoding even if its size is known.
+     */
+    int flag_chunked;
+
+    /* **** Outputs (updated as the body is sent) **** */
+    /**
+     * Bytes sent.
+     */
+    uint64_t sent;
+} libcurl_wrap_source_t;
+
 /**
  * HTTP-request context structure.
  */
@@ -85,7 +220,8 @@ typedef struct libcurl_wrap_req_ctx_s {
      */
     const char *qstring;
     /**
-     * Request content body if applicable.
+     * Request content body if applicable, as a NULL-terminated character
+     * string (see field 'source' for binary or large bodies).
      * This field is optional (can be set to NULL).
      */
     const char *body;
@@ -100,6 +236,19 @@ typedef struct libcurl_wrap_req_ctx_s {
      * (disabled by default).
      */
     volatile int flag_libcurl_verbose;
+    /**
+     * Response body sink. The response character string is not returned
+     * when a sink is used. The sink must outlive the request (i.e. until
+     * the completion, for the requests submitted to an event loop).
+     * This field is optional (can be set to NULL).
+     */
+    libcurl_wrap_sink_t *sink;
+    /**
+     * Request body source. If set, field 'body' is ignored. The source
+     * (and the buffer it refers to) must outlive the request.
+     * This field is optional (can be set to NULL).
+     */
+    libcurl_wrap_source_t *source;
     // Reserved for future use: add new features here
 } libcurl_wrap_req_ctx_t;
 
@@ -141,6 +290,45 @@ typedef struct libcurl_wrap_stats_ctx_s {
     int64_t download_size_bytes;
 } libcurl_wrap_stats_ctx_t;
 
+/**
+ * Result of a request performed on an event loop
+ * (see 'libcurl_wrap_loop_submit()').
+ */
+typedef struct libcurl_wrap_result_s {
+    /**
+     * Return code of the request: 0 on success, non-zero error code
+     * otherwise (same as 'libcurl_wrap_cli_request()' return value).
+     */
+    int end_code;
+    /**
+     * HTTP status code (404 if the request failed).
+     */
+    long http_ret_code;
+    /**
+     * Response body and output headers (NULL if empty). These are released
+     * together with the result; set them to NULL to keep them (the caller
+     * then has to release them with 'free()').
+     */
+    char *response_str;
+    char *headers_out_str;
+    /**
+     * Request statistics.
+     */
+    libcurl_wrap_stats_ctx_t stats;
+    /**
+     * Opaque user data passed to 'libcurl_wrap_loop_submit()'.
+     */
+    void *userdata;
+} libcurl_wrap_result_t;
+
+/**
+ * Request completion callback type.
+ * It is called from 'libcurl_wrap_loop_run()', and may submit new requests
+ * to the same loop. The result is released when the callback returns.
+ */
+typedef void (*libcurl_wrap_done_cb_t)(libcurl_wrap_loop_t *libcurl_wrap_loop,
+        libcurl_wrap_result_t *libcurl_wrap_result);
+
 /* **** Prototypes **** */
 
 /**
@@ -178,6 +366,149 @@ int libcurl_wrap_cli_request(const libcurl_wrap_req_ctx_t *libcurl_wrap_req_ctx,
         utils_logs_ctx_t *const utils_logs_ctx, char **ref_response_str, long *ref_http_ret_code,
         char **ref_headers_out_str, libcurl_wrap_stats_ctx_t *const stats_ctx);
 
+/**
+ * Open a persistent client session.
+ * A session keeps a pool of configured libcurl handles, and shares the DNS
+ * cache, the connections cache and the SSL sessions among them, so that
+ * consecutive requests (even from different threads) reuse the established
+ * connections. Per request, only the options that changed since the last
+ * request served by the same handle are set again (e.g. a handle serving
+ * a GET with the same headers as its previous one only sets the URL).
+ * @param pool_max Maximum number of idle handles kept in the pool (handles
+ * are created on demand; those checked-in when the pool is full are
+ * released).
+ * @param utils_logs_ctx Externally defined logger. This parameter is not
+ * mandatory, thus it can be left to NULL.
+ * @return Pointer to the session context structure ("handler") on success,
+ * NULL if fails.
+ */
+libcurl_wrap_session_t* libcurl_wrap_session_open(size_t pool_max,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/**
+ * Close a session, releasing its handles and the shared caches.
+ * All the requests performed on the session must have returned.
+ * @param ref_libcurl_wrap_session Reference to the pointer to the session
+ * context structure obtained in a previous call to
+ * 'libcurl_wrap_session_open()'. Pointer is set to NULL on return.
+ */
+void libcurl_wrap_session_close(
+        libcurl_wrap_session_t **ref_libcurl_wrap_session);
+
+/**
+ * Perform an HTTP request on a session.
+ * Same as 'libcurl_wrap_cli_request()', but on a pooled handle. This
+ * function is thread-safe.
+ * @param libcurl_wrap_session Pointer to the session context structure.
+ * See 'libcurl_wrap_cli_request()' for the rest of the parameters and the
+ * return value.
+ */
+int libcurl_wrap_session_request(libcurl_wrap_session_t *libcurl_wrap_session,
+        const libcurl_wrap_req_ctx_t *libcurl_wrap_req_ctx,
+        utils_logs_ctx_t *const utils_logs_ctx, char **ref_response_str, long *ref_http_ret_code,
+        char **ref_headers_out_str, libcurl_wrap_stats_ctx_t *const stats_ctx);
+
+/**
+ * Open a non-blocking request event loop.
+ * The loop drives a libcurl multi handle with 'curl_multi_socket_action()'
+ * over its own epoll instance (the transfers sockets and a timer for the
+ * libcurl time-outs), so that a single thread can keep tens of thousands of
+ * concurrent transfers in flight (provided the open files limit allows it).
+ * Requests are submitted with 'libcurl_wrap_loop_submit()' and completed in
+ * 'libcurl_wrap_loop_run()', either by calling the given callback or by
+ * queueing the result (see 'libcurl_wrap_loop_pop()').
+ * The loop is not thread-safe: it must be used from one thread at a time.
+ * @param pool_max Maximum number of idle handles kept for reuse (see
+ * 'libcurl_wrap_session_open()').
+ * @param utils_logs_ctx Externally defined logger. This parameter is not
+ * mandatory, thus it can be left to NULL.
+ * @return Pointer to the loop context structure ("handler") on success,
+ * NULL if fails.
+ */
+libcurl_wrap_loop_t* libcurl_wrap_loop_open(size_t pool_max,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/**
+ * Close an event loop. The requests still in flight are aborted (without
+ * calling their callbacks) and the queued results are released.
+ * @param ref_libcurl_wrap_loop Reference to the pointer to the loop context
+ * structure obtained in a previous call to 'libcurl_wrap_loop_open()'.
+ * Pointer is set to NULL on return.
+ */
+void libcurl_wrap_loop_close(libcurl_wrap_loop_t **ref_libcurl_wrap_loop);
+
+/**
+ * Deleter function for the event loop, for releasing smart pointers in C++
+ * applications.
+ * @param p Pointer to the loop context structure to be released.
+ */
+void libcurl_wrap_loop_close_uptr(libcurl_wrap_loop_t *p);
+
+/**
+ * Submit an HTTP request to an event loop. This function does not block:
+ * the request is performed in the following calls to
+ * 'libcurl_wrap_loop_run()'.
+ * The request context structure, and all the strings it points to, are
+ * only used during this call.
+ * @param libcurl_wrap_loop Pointer to the loop context structure.
+ * @param libcurl_wrap_req_ctx Request context structure.
+ * @param done_cb Completion callback. This parameter is not mandatory: if
+ * NULL, the result is queued instead (see 'libcurl_wrap_loop_pop()').
+ * @param userdata Opaque user data, returned in the result.
+ * @return Return 0 on success (the request is in flight), non-zero error
+ * code otherwise (the request was not submitted).
+ */
+int libcurl_wrap_loop_submit(libcurl_wrap_loop_t *libcurl_wrap_loop,
+        const libcurl_wrap_req_ctx_t *libcurl_wrap_req_ctx,
+        libcurl_wrap_done_cb_t done_cb, void *userdata);
+
+/**
+ * Run the event loop once: wait for the transfers sockets or the libcurl
+ * timer to be ready (at most the given time), perform the due work and
+ * complete the finished requests.
+ * @param libcurl_wrap_loop Pointer to the loop context structure.
+ * @param tout_msecs Maximum time to wait in milliseconds (0 not to wait,
+ * -1 to wait indefinitely).
+ * @return Number of requests still in flight, or a negative value if fails.
+ */
+int libcurl_wrap_loop_run(libcurl_wrap_loop_t *libcurl_wrap_loop,
+        int tout_msecs);
+
+/**
+ * Get the file descriptor to integrate the loop into an external event loop
+ * (epoll, poll, select...). The descriptor becomes readable when
+ * 'libcurl_wrap_loop_run()' has work to do; then call it with a zero
+ * time-out.
+ * @param libcurl_wrap_loop Pointer to the loop context structure.
+ * @return The file descriptor (owned by the loop).
+ */
+int libcurl_wrap_loop_get_fd(libcurl_wrap_loop_t *libcurl_wrap_loop);
+
+/**
+ * Get the completion queue eventfd. The descriptor is readable while there
+ * are queued results (i.e. of requests submitted without a callback).
+ * @param libcurl_wrap_loop Pointer to the loop context structure.
+ * @return The file descriptor (owned by the loop).
+ */
+int libcurl_wrap_loop_get_eventfd(libcurl_wrap_loop_t *libcurl_wrap_loop);
+
+/**
+ * Pop the oldest result from the completion queue.
+ * @param libcurl_wrap_loop Pointer to the loop context structure.
+ * @return Pointer to the result, to be released with
+ * 'libcurl_wrap_result_release()', or NULL if the queue is empty.
+ */
+libcurl_wrap_result_t* libcurl_wrap_loop_pop(
+        libcurl_wrap_loop_t *libcurl_wrap_loop);
+
+/**
+ * Release a result obtained from 'libcurl_wrap_loop_pop()'.
+ * @param ref_libcurl_wrap_result Reference to the pointer to the result.
+ * Pointer is set to NULL on return.
+ */
+void libcurl_wrap_result_release(
+        libcurl_wrap_result_t **ref_libcurl_wrap_result);
+
 /**
  * Supported methods code to readable format lookup table
  */
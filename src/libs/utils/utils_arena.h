@@ -0,0 +1,161 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file utils_arena.h
+/// @brief Bump allocator with bulk reset (C++ header-only).
+///
+/// Memory is handed out sequentially from large chunks and never freed one allocation at a time: everything is
+/// released at once with 'reset()' (e.g. at the end of each scenario), or back to a mark with 'rewind()' (e.g.
+/// temporaries of a single request). Chunks are kept across resets, so a warm arena does not allocate at all.
+/// An arena is not thread-safe; the intended use is one arena per thread ('thread_local').
+
+#ifndef UTILS_UTILS_ARENA_H_
+#define UTILS_UTILS_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class utils_arena
+{
+public:
+    /// Position of an arena (see 'mark()')
+    typedef struct utils_arena_mark_s
+    {
+        size_t chunk;
+        size_t used;
+    } mark_t;
+
+    /// @param chunk_size Size of the chunks; larger allocations get a chunk of their own.
+    explicit utils_arena(size_t chunk_size = 64 * 1024): chunk_size(chunk_size)
+    {
+    }
+
+    ~utils_arena()
+    {
+        for(size_t i = 0; i < chunks.size(); i++)
+            delete[] chunks[i].data;
+    }
+
+    utils_arena(const utils_arena&) = delete;
+    utils_arena& operator=(const utils_arena&) = delete;
+
+    /// Allocate memory, valid until the arena is reset (or rewound past it).
+    /// @return Pointer to the memory ('std::bad_alloc' is thrown if a chunk can not be allocated).
+    void* alloc(size_t size, size_t align = alignof(std::max_align_t))
+    {
+        for(;;)
+        {
+            if(cur < chunks.size())
+            {
+                chunk_t &chunk = chunks[cur];
+                size_t offset = (((uintptr_t)chunk.data + used + align - 1) & ~(uintptr_t)(align - 1)) -
+                        (uintptr_t)chunk.data;
+                if(offset + size <= chunk.size)
+                {
+                    used = offset + size;
+                    return chunk.data + offset;
+                }
+            }
+            next_chunk(size + align);
+        }
+    }
+
+    /// Copy a string into the arena.
+    char* strdup(const char *str, size_t len)
+    {
+        char *p = (char*)alloc(len + 1, 1);
+        memcpy(p, str, len);
+        p[len] = 0;
+        return p;
+    }
+
+    char* strdup(const char *str)
+    {
+        return strdup(str, strlen(str));
+    }
+
+    /// Construct an object in the arena. Its destructor is never called, hence the restriction.
+    template<typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new(alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /// @return Current position, to go back to with 'rewind()'.
+    mark_t mark() const
+    {
+        mark_t mark = { cur, used };
+        return mark;
+    }
+
+    /// Release the allocations made since the given mark.
+    void rewind(const mark_t &mark)
+    {
+        cur = mark.chunk;
+        used = mark.used;
+    }
+
+    /// Release all the allocations (the chunks are kept for reuse).
+    void reset()
+    {
+        cur = 0;
+        used = 0;
+    }
+
+private:
+    typedef struct chunk_s
+    {
+        char *data;
+        size_t size;
+    } chunk_t;
+
+    /// Move to the next chunk that can hold 'size' bytes, allocating it if needed
+    void next_chunk(size_t size)
+    {
+        used = 0;
+        if(cur < chunks.size())
+            cur++;
+        while(cur < chunks.size() && chunks[cur].size < size)
+            cur++; // too small for this one; reused after the next reset
+        if(cur < chunks.size())
+            return;
+        chunk_t chunk;
+        chunk.size = size > chunk_size ? size : chunk_size;
+        chunk.data = new char[chunk.size];
+        chunks.push_back(chunk);
+    }
+
+    size_t chunk_size;
+    size_t cur = 0; ///< Chunk being used
+    size_t used = 0; ///< Bytes used in the chunk being used
+    std::vector<chunk_t> chunks;
+};
+
+#endif /* UTILS_UTILS_ARENA_H_ */
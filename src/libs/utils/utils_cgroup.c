@@ -0,0 +1,342 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file utils_cgroup.c
+ * @author Rafael Antoniello
+ */
+
+#include "utils_cgroup.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "utils_logs.h"
+
+/* **** Definitions **** */
+
+/**
+ * Cgroup context structure.
+ */
+typedef struct utils_cgroup_ctx_s {
+    utils_logs_ctx_t *utils_logs_ctx;
+    /** Absolute path of the cgroup directory */
+    char path[PATH_MAX];
+    /** Length of the cgroup v2 mount-point prefix of 'path' */
+    size_t root_len;
+    /**
+     * Absolute path of the cgroup the calling process was in at opening;
+     * processes are moved back there on closing.
+     */
+    char origin_path[PATH_MAX];
+} utils_cgroup_ctx_t;
+
+/* **** Prototypes **** */
+
+static int cgroup2_mountpoint(char *mnt, size_t size);
+static int cgroup_own_path(char *path, size_t size);
+static int cgroup_file_path(char path[PATH_MAX], const char *dir,
+        const char *file);
+static int cgroup_write(const char *dir, const char *file, const char *value);
+static int cgroup_enable_controllers(const char *dir,
+        const utils_cgroup_limits_t *limits,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/* **** Implementations **** */
+
+utils_cgroup_ctx_t* utils_cgroup_open(const char *name,
+        const utils_cgroup_limits_t *limits,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    size_t i;
+    char mnt[PATH_MAX], own[PATH_MAX], dir[PATH_MAX];
+    int end_code= -1;
+    utils_cgroup_ctx_t *ctx= NULL;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    /* Check arguments */
+    CHECK_DO(name!= NULL && name[0]!= '\0' && name[0]!= '/', return NULL);
+    // Parameter 'limits' is allowed to be NULL.
+    // Parameter 'utils_logs_ctx' is allowed to be NULL.
+
+    /* Allocate context structure */
+    ctx= (utils_cgroup_ctx_t*)calloc(1, sizeof(utils_cgroup_ctx_t));
+    CHECK_DO(ctx!= NULL, goto end);
+
+    /* **** Initialize context structure **** */
+
+    ctx->utils_logs_ctx= utils_logs_ctx;
+
+    if(cgroup2_mountpoint(mnt, sizeof(mnt))!= 0) {
+        LOGE("No cgroup v2 hierarchy is mounted\n");
+        goto end;
+    }
+    CHECK_DO(cgroup_own_path(own, sizeof(own))== 0, goto end);
+    CHECK_DO(cgroup_file_path(ctx->origin_path, mnt,
+            strcmp(own, "/")!= 0? own+ 1: "")== 0, goto end);
+    ctx->root_len= strlen(mnt);
+
+    /* Create each level of the path, enabling the needed controllers on its
+     * parent first (controllers must be enabled all the way down) */
+    CHECK_DO(cgroup_file_path(dir, mnt, name)== 0, goto end);
+    for(i= ctx->root_len; dir[i]!= '\0';) {
+        char saved;
+        size_t next= i+ 1;
+
+        while(dir[next]!= '/' && dir[next]!= '\0')
+            next++;
+
+        dir[i]= '\0'; // 'dir' is now the parent level
+        if(cgroup_enable_controllers(dir, limits, LOG_CTX_GET())!= 0)
+            goto end;
+        dir[i]= '/';
+
+        saved= dir[next];
+        dir[next]= '\0';
+        if(mkdir(dir, 0755)!= 0 && errno!= EEXIST) {
+            LOGE("Could not create cgroup '%s': %s\n", dir, strerror(errno));
+            goto end;
+        }
+        dir[next]= saved;
+        i= next;
+    }
+    snprintf(ctx->path, sizeof(ctx->path), "%s", dir);
+
+    /* Apply limits */
+    if(limits!= NULL) {
+        const char *files[]= {"cpu.max", "cpuset.cpus", "memory.max"};
+        const char *values[]= {limits->cpu_max, limits->cpuset_cpus,
+                limits->memory_max};
+        for(i= 0; i< sizeof(files)/ sizeof(files[0]); i++) {
+            if(values[i]== NULL)
+                continue;
+            if(cgroup_write(ctx->path, files[i], values[i])!= 0) {
+                LOGE("Could not set '%s' to '%s' in cgroup '%s': %s\n",
+                        files[i], values[i], ctx->path, strerror(errno));
+                goto end;
+            }
+        }
+    }
+
+    end_code= 0;
+end:
+    if(end_code!= 0)
+        utils_cgroup_close(&ctx);
+    return ctx;
+}
+
+void utils_cgroup_close(utils_cgroup_ctx_t **ref_utils_cgroup_ctx)
+{
+    utils_cgroup_ctx_t *ctx;
+    char path[PATH_MAX];
+    FILE *procs;
+    int pid;
+
+    if(ref_utils_cgroup_ctx== NULL || (ctx= *ref_utils_cgroup_ctx)== NULL)
+        return;
+
+    if(ctx->path[0]!= '\0') {
+        LOG_CTX_INIT(ctx->utils_logs_ctx);
+
+        /* Move the remaining processes out of the cgroup */
+        if(cgroup_file_path(path, ctx->path, "cgroup.procs")== 0 &&
+                (procs= fopen(path, "r"))!= NULL) {
+            while(fscanf(procs, "%d", &pid)== 1) {
+                char strpid[16];
+                snprintf(strpid, sizeof(strpid), "%d", pid);
+                if(cgroup_write(ctx->origin_path, "cgroup.procs", strpid)!= 0)
+                    LOGW("Could not move process %d out of cgroup '%s': "
+                            "%s\n", pid, ctx->path, strerror(errno));
+            }
+            fclose(procs);
+        }
+
+        /* Remove the cgroup and the parent levels left empty */
+        snprintf(path, sizeof(path), "%s", ctx->path);
+        if(rmdir(path)!= 0)
+            LOGW("Could not remove cgroup '%s': %s\n", path, strerror(errno));
+        else {
+            char *p;
+            while((p= strrchr(path, '/'))!= NULL &&
+                    (size_t)(p- path)> ctx->root_len) {
+                *p= '\0';
+                if(rmdir(path)!= 0)
+                    break; // Still in use (e.g. by a sibling cgroup)
+            }
+        }
+    }
+
+    free(ctx);
+    *ref_utils_cgroup_ctx= NULL;
+}
+
+int utils_cgroup_attach(utils_cgroup_ctx_t *utils_cgroup_ctx, pid_t pid)
+{
+    char strpid[16];
+
+    if(utils_cgroup_ctx== NULL) {
+        errno= EINVAL;
+        return -1;
+    }
+
+    snprintf(strpid, sizeof(strpid), "%d", (int)pid);
+    return cgroup_write(utils_cgroup_ctx->path, "cgroup.procs", strpid);
+}
+
+int utils_cgroup_get_stats(utils_cgroup_ctx_t *utils_cgroup_ctx,
+        utils_cgroup_stats_t *stats)
+{
+    char path[PATH_MAX], key[64];
+    unsigned long long value;
+    FILE *file;
+    LOG_CTX_INIT(NULL);
+
+    /* Check arguments */
+    CHECK_DO(utils_cgroup_ctx!= NULL && stats!= NULL, return -1);
+
+    LOG_CTX_SET(utils_cgroup_ctx->utils_logs_ctx);
+    memset(stats, 0, sizeof(utils_cgroup_stats_t));
+
+    CHECK_DO(cgroup_file_path(path, utils_cgroup_ctx->path, "cpu.stat")== 0,
+            return -1);
+    CHECK_DO((file= fopen(path, "r"))!= NULL, return -1);
+    while(fscanf(file, "%63s %llu", key, &value)== 2) {
+        if(strcmp(key, "usage_usec")== 0)
+            stats->usage_usec= value;
+        else if(strcmp(key, "nr_periods")== 0)
+            stats->nr_periods= value;
+        else if(strcmp(key, "nr_throttled")== 0)
+            stats->nr_throttled= value;
+        else if(strcmp(key, "throttled_usec")== 0)
+            stats->throttled_usec= value;
+    }
+    fclose(file);
+
+    if(cgroup_file_path(path, utils_cgroup_ctx->path, "memory.current")== 0
+            && (file= fopen(path, "r"))!= NULL) {
+        if(fscanf(file, "%llu", &value)== 1)
+            stats->memory_current= value;
+        fclose(file);
+    }
+    return 0;
+}
+
+static int cgroup2_mountpoint(char *mnt, size_t size)
+{
+    char dev[256], dir[PATH_MAX], type[64];
+    int ret_code= -1;
+    FILE *mounts;
+
+    if((mounts= fopen("/proc/self/mounts", "r"))== NULL)
+        return -1;
+    while(fscanf(mounts, "%255s %4095s %63s %*[^\n]", dev, dir, type)== 3) {
+        if(strcmp(type, "cgroup2")== 0) {
+            snprintf(mnt, size, "%s", dir);
+            ret_code= 0;
+            break;
+        }
+    }
+    fclose(mounts);
+    return ret_code;
+}
+
+static int cgroup_own_path(char *path, size_t size)
+{
+    char line[PATH_MAX+ 16];
+    int ret_code= -1;
+    FILE *cgroup;
+
+    /* The unified hierarchy entry is formatted as "0::<path>" */
+    if((cgroup= fopen("/proc/self/cgroup", "r"))== NULL)
+        return -1;
+    while(fgets(line, sizeof(line), cgroup)!= NULL) {
+        if(strncmp(line, "0::", 3)== 0) {
+            line[strcspn(line, "\n")]= '\0';
+            if((size_t)snprintf(path, size, "%s", line+ 3)< size)
+                ret_code= 0;
+            break;
+        }
+    }
+    fclose(cgroup);
+    return ret_code;
+}
+
+static int cgroup_file_path(char path[PATH_MAX], const char *dir,
+        const char *file)
+{
+    int len= snprintf(path, PATH_MAX, "%s%s%s", dir, file[0]!= '\0'? "/": "",
+            file);
+    if(len< 0 || len>= PATH_MAX) {
+        errno= ENAMETOOLONG;
+        return -1;
+    }
+    return 0;
+}
+
+static int cgroup_write(const char *dir, const char *file, const char *value)
+{
+    char path[PATH_MAX];
+    ssize_t len= strlen(value);
+    int fd, ret_code= -1;
+
+    if(cgroup_file_path(path, dir, file)!= 0)
+        return -1;
+    if((fd= open(path, O_WRONLY))< 0)
+        return -1;
+    if(write(fd, value, len)== len)
+        ret_code= 0;
+    close(fd);
+    return ret_code;
+}
+
+static int cgroup_enable_controllers(const char *dir,
+        const utils_cgroup_limits_t *limits,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    const char *controllers[]= {"+cpu", "+cpuset", "+memory"};
+    size_t i;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    if(limits== NULL)
+        return 0;
+
+    const char *values[]= {limits->cpu_max, limits->cpuset_cpus,
+            limits->memory_max};
+    for(i= 0; i< sizeof(controllers)/ sizeof(controllers[0]); i++) {
+        if(values[i]== NULL)
+            continue;
+        if(cgroup_write(dir, "cgroup.subtree_control", controllers[i])!= 0) {
+            LOGE("Could not enable controller '%s' in cgroup '%s': %s\n",
+                    controllers[i]+ 1, dir, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file utils_cgroup.h
+ * @brief Minimal control-group (cgroup v2) management.
+ * Creates a cgroup below the root of the unified hierarchy, applies CPU
+ * bandwidth, CPU set and memory limits to it, moves processes into it and
+ * reads back its CPU throttling statistics.
+ * Creating cgroups and enabling controllers requires write access to the
+ * cgroup v2 root (usually root privileges).
+ */
+
+#ifndef UTILS_CGROUP_H_
+#define UTILS_CGROUP_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+/* **** Definitions **** */
+
+/* Forward declarations */
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+typedef struct utils_cgroup_ctx_s utils_cgroup_ctx_t;
+
+/**
+ * Cgroup limits. Each field is written as is to the cgroup interface file of
+ * the same name; set it to NULL to leave the corresponding resource
+ * unlimited.
+ */
+typedef struct utils_cgroup_limits_s {
+    /** 'cpu.max': "$QUOTA $PERIOD" in microseconds (e.g. "50000 100000") */
+    const char *cpu_max;
+    /** 'cpuset.cpus': CPU list (e.g. "0-1,4") */
+    const char *cpuset_cpus;
+    /** 'memory.max': bytes, suffixes K, M and G accepted (e.g. "256M") */
+    const char *memory_max;
+} utils_cgroup_limits_t;
+
+/**
+ * Cgroup statistics.
+ */
+typedef struct utils_cgroup_stats_s {
+    /** Total CPU time consumed by the cgroup processes */
+    uint64_t usage_usec;
+    /** CFS bandwidth enforcement periods elapsed */
+    uint64_t nr_periods;
+    /** Periods in which the cgroup was throttled (quota exhausted) */
+    uint64_t nr_throttled;
+    /** Total time the cgroup processes were throttled */
+    uint64_t throttled_usec;
+    /** Current memory usage in bytes (zero if not available) */
+    uint64_t memory_current;
+} utils_cgroup_stats_t;
+
+/* **** Prototypes **** */
+
+/**
+ * Creates (or reuses) a cgroup and applies the given limits.
+ * The required controllers are enabled along the way from the root of the
+ * hierarchy.
+ * @param name Cgroup path relative to the cgroup v2 root; may be nested
+ * (e.g. "my-app/server").
+ * @param limits Limits to apply. This is an optional field (can be set to
+ * NULL to create an unlimited cgroup, e.g. only for accounting).
+ * @param utils_logs_ctx Externally defined logger. This is an optional field
+ * (can be set to NULL).
+ * @return Pointer to the cgroup instance context structure ("handler") on
+ * success, NULL if fails (e.g. no cgroup v2 hierarchy is mounted, not
+ * enough privileges or controller not available).
+ */
+utils_cgroup_ctx_t* utils_cgroup_open(const char *name,
+        const utils_cgroup_limits_t *limits,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/**
+ * Moves any process left in the cgroup back to the cgroup the calling
+ * process was in when the instance was opened, and removes the cgroup (and
+ * its parents if they become empty).
+ * @param ref_utils_cgroup_ctx Reference to the pointer to the cgroup
+ * instance context structure obtained in a previous call to
+ * 'utils_cgroup_open()'. Pointer is set to NULL on return.
+ */
+void utils_cgroup_close(utils_cgroup_ctx_t **ref_utils_cgroup_ctx);
+
+/**
+ * Moves a process (including all its threads) into the cgroup. Processes
+ * forked afterwards by the moved process are born in the cgroup.
+ * This function does not log nor allocate memory, so it can be called from
+ * a child process between 'fork()' and 'exec()'.
+ * @param utils_cgroup_ctx Pointer to the cgroup instance context structure.
+ * @param pid Process ID.
+ * @return 0 on success; on failure, -1 is returned and errno is set
+ * accordingly.
+ */
+int utils_cgroup_attach(utils_cgroup_ctx_t *utils_cgroup_ctx, pid_t pid);
+
+/**
+ * Reads the cgroup statistics ('cpu.stat' and 'memory.current').
+ * Throttling figures are zero if the CPU controller is not enabled.
+ * @param utils_cgroup_ctx Pointer to the cgroup instance context structure.
+ * @param stats Structure where to return the statistics.
+ * @return 0 on success, -1 on error.
+ */
+int utils_cgroup_get_stats(utils_cgroup_ctx_t *utils_cgroup_ctx,
+        utils_cgroup_stats_t *stats);
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
+
+#endif /* UTILS_CGROUP_H_ */
@@ -24,19 +24,64 @@
 
 #include "utils_files.h"
 
-#include <iostream>
-#include <fstream>
 #include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <ftw.h>
+#include <dirent.h>
 #include <libgen.h>
 
 #include "utils_logs.h"
 
 
+/// Buffers of a writer, written with a single 'pwritev()' call once all of them are full
+#define WRITER_BUFS_NUM 8
+
+#define WRITER_BUF_SIZE_DEFAULT (256 * 1024)
+
+/// Consumed mapped pages are released by chunks of this size
+#define RECORDS_RELEASE_SIZE (64 * 1024 * 1024)
+
+#define FILE_MODE (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
+
+
+typedef struct utils_files_map_s
+{
+    char *data;
+    size_t size;
+} utils_files_map_t;
+
+
+typedef struct utils_files_writer_s
+{
+    utils_logs_ctx_t *utils_logs_ctx;
+    int fd;
+    int flags;
+    int flag_error;
+    std::string path;
+    /// Temporary file renamed over 'path' on close (atomic mode)
+    std::string tmp_path;
+    /// Next write offset (unless appending)
+    off_t offset;
+    size_t buf_size;
+    char *bufs[WRITER_BUFS_NUM];
+    size_t bufs_used[WRITER_BUFS_NUM];
+    /// Buffer being filled
+    int buf_idx;
+} utils_files_writer_t;
+
+
+static int writer_submit(utils_files_writer_t *utils_files_writer, const void *data, size_t size);
+
+
 void utils_files_dump2file(const char *str2dump, const char *filePath, int doTruncateFile, int doCreatePath,
         int mkdirMode, utils_logs_ctx_t *const utils_logs_ctx)
 {
@@ -57,18 +102,18 @@ void utils_files_dump2file(const char *str2dump, const char *filePath, int doTru
     LOGD("Storing string into file '%s' (trace truncated if exceeds %d bytes): \n'%.*s'\n\n",
             filePath, UTILS_LOGS_TRACE_MAX_SIZE, UTILS_LOGS_TRACE_MAX_SIZE, str2dump);
 
-    int fd = doTruncateFile ? open(filePath, O_RDWR|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH) :
-            open(filePath, O_RDWR|O_APPEND|O_CREAT, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
-    if(fd < 0) {
-        LOGE("Could not open file '%s' (errno: %d)\n", filePath, errno);
-        return;
-    }
+    // Truncating is replacing: readers never see a partially written file. The string is written with a single
+    // call (never buffered), so the buffer is kept minimal.
     size_t str2dump_len = strlen(str2dump);
-    if(write(fd, str2dump, str2dump_len) != (ssize_t)str2dump_len)
+    utils_files_writer_t *utils_files_writer = utils_files_writer_open(filePath,
+            doTruncateFile ? UTILS_FILES_WRITER_ATOMIC : UTILS_FILES_WRITER_APPEND, 1, LOG_CTX_GET());
+    if(utils_files_writer == NULL)
+        return;
+    utils_files_writer_write(utils_files_writer, str2dump, str2dump_len);
+    if(utils_files_writer_close(&utils_files_writer) != 0)
     {
-        LOGE("Could not write to file '%s' (errno: %d)\n", filePath, errno);
+        LOGE("Could not write to file '%s'\n", filePath);
     }
-    CHECK(close(fd) == 0);
 }
 
 
@@ -100,30 +145,60 @@ int utils_files_mkpath(const char *path, int mkdirMode, utils_logs_ctx_t *const
 }
 
 
-static int unlink_files(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftwbuf)
+/// Remove an entry of the given folder, recursively if it is a folder.
+/// @param type Entry type if known from 'readdir()' (DT_UNKNOWN otherwise).
+static void rmpath_at(int dirfd, const char *name, unsigned char type, utils_logs_ctx_t *const utils_logs_ctx)
 {
-    if(sb->st_mode & S_IFREG)
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    // Anything but a folder goes with a single call
+    if(type != DT_DIR)
     {
-        unlink(fpath);
+        if(unlinkat(dirfd, name, 0) == 0 || errno == ENOENT)
+            return;
+        if(errno != EISDIR && errno != EPERM)
+        {
+            LOGE("Could not remove '%s' (errno: %d)\n", name, errno);
+            return;
+        }
     }
-    return 0; //tell nftw() to continue
-}
-
 
-static int rm_dirs(const char *fpath, const struct stat *sb, int tflag, struct FTW *ftwbuf)
-{
-    if(sb->st_mode & S_IFDIR)
+    int fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if(fd < 0)
+    {
+        if(errno != ENOENT)
+            LOGE("Could not open folder '%s' (errno: %d)\n", name, errno);
+        return;
+    }
+    DIR *dir = fdopendir(fd);
+    if(dir == NULL)
+    {
+        LOGE("Could not read folder '%s' (errno: %d)\n", name, errno);
+        close(fd);
+        return;
+    }
+    struct dirent *entry;
+    while((entry = readdir(dir)) != NULL)
     {
-        rmdir(fpath);
+        if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        rmpath_at(fd, entry->d_name, entry->d_type, utils_logs_ctx);
     }
-    return 0; //tell nftw() to continue
+    closedir(dir); // closes 'fd'
+
+    if(unlinkat(dirfd, name, AT_REMOVEDIR) != 0 && errno != ENOENT)
+        LOGE("Could not remove folder '%s' (errno: %d)\n", name, errno);
 }
 
 
 void utils_rmpath(const char *path, utils_logs_ctx_t *const utils_logs_ctx)
 {
-    nftw(path, unlink_files, 4, 0);
-    nftw(path, rm_dirs, 4, FTW_DEPTH);
+    LOG_CTX_INIT(utils_logs_ctx); // parameter 'utils_logs_ctx' allowed to be NULL
+
+    // Check arguments
+    CHECK_DO(path != NULL && *path != 0, return);
+
+    rmpath_at(AT_FDCWD, path, DT_UNKNOWN, LOG_CTX_GET());
 }
 
 
@@ -134,23 +209,425 @@ char* utils_files_file2buf(const char *filePath, utils_logs_ctx_t *const utils_l
     // Check arguments
     CHECK_DO(filePath != NULL, return nullptr);
 
-    char *buf = nullptr;
-    std::ifstream fileIfStream(filePath, std::ios::in | std::ios::binary | std::ios::ate);
-    if(fileIfStream.is_open())
+    struct stat st;
+    int fd = open(filePath, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        LOGW("Error while opening file '%s'.\n", filePath);
+        return nullptr;
+    }
+
+    // Sized from the file, but read to the end: pseudo-files (e.g. '/proc') report no size
+    size_t capacity = (fstat(fd, &st) == 0 && st.st_size > 0) ? (size_t)st.st_size + 1 : 4096, size = 0;
+    char *buf = (char*)malloc(capacity);
+    if(buf == nullptr)
+        LOGE("Could not allocate reading buffer of size %zu.\n", capacity);
+    while(buf != nullptr)
     {
-        size_t file_size = fileIfStream.tellg();
-        buf = (char*)calloc(1, file_size + 1);
-        if(buf != nullptr)
+        if(size + 1 == capacity)
         {
-            fileIfStream.seekg(0, std::ios::beg); // rewind, opened at pos. end
-            fileIfStream.read(buf, file_size);
+            char *p = (char*)realloc(buf, capacity * 2);
+            if(p == nullptr)
+            {
+                LOGE("Could not allocate reading buffer of size %zu.\n", capacity * 2);
+                free(buf);
+                buf = nullptr;
+                break;
+            }
+            buf = p;
+            capacity *= 2;
         }
-        else
-            LOGE("Could not allocate reading buffer of size %zu.\n", file_size);
+        ssize_t ret = read(fd, buf + size, capacity - size - 1);
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret < 0)
+        {
+            LOGE("Could not read file '%s' (errno: %d)\n", filePath, errno);
+            free(buf);
+            buf = nullptr;
+            break;
+        }
+        if(ret == 0)
+        {
+            buf[size] = 0; // 'NULL' character
+            break;
+        }
+        size += (size_t)ret;
     }
-    else
-        LOGW("Error while opening file '%s'.\n", filePath);
+    close(fd);
 
     return buf;
 }
 
+
+utils_files_map_t* utils_files_map_open(const char *filePath, utils_logs_ctx_t *const utils_logs_ctx)
+{
+    struct stat st;
+    LOG_CTX_INIT(utils_logs_ctx); // parameter 'utils_logs_ctx' allowed to be NULL
+
+    // Check arguments
+    CHECK_DO(filePath != NULL, return NULL);
+
+    int fd = open(filePath, O_RDONLY | O_CLOEXEC);
+    if(fd < 0)
+    {
+        LOGE("Could not open file '%s' (errno: %d)\n", filePath, errno);
+        return NULL;
+    }
+    if(fstat(fd, &st) != 0)
+    {
+        LOGE("Could not get the size of file '%s' (errno: %d)\n", filePath, errno);
+        close(fd);
+        return NULL;
+    }
+
+    utils_files_map_t *utils_files_map = (utils_files_map_t*)calloc(1, sizeof(utils_files_map_t));
+    CHECK_DO(utils_files_map != NULL, close(fd); return NULL);
+
+    // Nothing to map (mapping zero bytes is an error)
+    if(st.st_size == 0)
+    {
+        close(fd);
+        return utils_files_map;
+    }
+
+    void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file
+    if(addr == MAP_FAILED)
+    {
+        LOGE("Could not map file '%s' (errno: %d)\n", filePath, errno);
+        free(utils_files_map);
+        return NULL;
+    }
+    madvise(addr, (size_t)st.st_size, MADV_SEQUENTIAL); // advisory only
+    utils_files_map->data = (char*)addr;
+    utils_files_map->size = (size_t)st.st_size;
+    return utils_files_map;
+}
+
+
+void utils_files_map_close(utils_files_map_t **ref_utils_files_map)
+{
+    utils_files_map_t *utils_files_map;
+
+    if(ref_utils_files_map == NULL || (utils_files_map = *ref_utils_files_map) == NULL)
+        return;
+
+    if(utils_files_map->data != NULL)
+        munmap(utils_files_map->data, utils_files_map->size);
+    free(utils_files_map);
+    *ref_utils_files_map = NULL;
+}
+
+
+const char* utils_files_map_data(const utils_files_map_t *utils_files_map)
+{
+    return utils_files_map != NULL ? utils_files_map->data : NULL;
+}
+
+
+size_t utils_files_map_size(const utils_files_map_t *utils_files_map)
+{
+    return utils_files_map != NULL ? utils_files_map->size : 0;
+}
+
+
+void utils_files_records_init(utils_files_records_t *utils_files_records, const utils_files_map_t *utils_files_map,
+        size_t offset, char delim)
+{
+    if(utils_files_records == NULL)
+        return;
+
+    utils_files_records->pos = utils_files_records->end = utils_files_records->release = NULL;
+    utils_files_records->delim = delim;
+    if(utils_files_map == NULL || utils_files_map->data == NULL)
+        return;
+
+    if(offset > utils_files_map->size)
+        offset = utils_files_map->size;
+    utils_files_records->pos = utils_files_map->data + offset;
+    utils_files_records->end = utils_files_map->data + utils_files_map->size;
+    utils_files_records->release = utils_files_map->data;
+}
+
+
+int utils_files_records_next(utils_files_records_t *utils_files_records, const char **ref_record, size_t *ref_size)
+{
+    const char *pos, *delim;
+
+    if(utils_files_records == NULL || (pos = utils_files_records->pos) == utils_files_records->end)
+        return 0;
+
+    delim = (const char*)memchr(pos, utils_files_records->delim, utils_files_records->end - pos);
+    *ref_record = pos;
+    if(delim != NULL)
+    {
+        *ref_size = delim - pos;
+        utils_files_records->pos = delim + 1;
+    }
+    else
+    {
+        *ref_size = utils_files_records->end - pos;
+        utils_files_records->pos = utils_files_records->end;
+    }
+
+    // Release the pages behind (the mapping is page aligned); they are read back from the file if touched again
+    if((size_t)(pos - utils_files_records->release) >= RECORDS_RELEASE_SIZE)
+    {
+        size_t size = (size_t)(pos - utils_files_records->release) & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+        madvise((void*)utils_files_records->release, size, MADV_DONTNEED);
+        utils_files_records->release += size;
+    }
+    return 1;
+}
+
+
+utils_files_writer_t* utils_files_writer_open(const char *filePath, int flags, size_t buf_size,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    LOG_CTX_INIT(utils_logs_ctx); // parameter 'utils_logs_ctx' allowed to be NULL
+
+    // Check arguments
+    CHECK_DO(filePath != NULL && *filePath != 0, return NULL);
+    CHECK_DO(!((flags & UTILS_FILES_WRITER_APPEND) && (flags & UTILS_FILES_WRITER_ATOMIC)), return NULL);
+
+    utils_files_writer_t *utils_files_writer = new utils_files_writer_t();
+    utils_files_writer->utils_logs_ctx = LOG_CTX_GET();
+    utils_files_writer->flags = flags;
+    utils_files_writer->path = filePath;
+    utils_files_writer->buf_size = buf_size > 0 ? buf_size : WRITER_BUF_SIZE_DEFAULT;
+
+    if(flags & UTILS_FILES_WRITER_ATOMIC)
+    {
+        std::string tmp_path = utils_files_writer->path + ".XXXXXX";
+        utils_files_writer->fd = mkostemp(&tmp_path[0], O_CLOEXEC);
+        if(utils_files_writer->fd >= 0)
+        {
+            utils_files_writer->tmp_path = tmp_path;
+            fchmod(utils_files_writer->fd, FILE_MODE); // 'mkostemp()' creates it private
+        }
+    }
+    else
+    {
+        utils_files_writer->fd = open(filePath, O_WRONLY | O_CREAT | O_CLOEXEC |
+                ((flags & UTILS_FILES_WRITER_APPEND) ? O_APPEND : O_TRUNC), FILE_MODE);
+    }
+    if(utils_files_writer->fd < 0)
+    {
+        LOGE("Could not open file '%s' (errno: %d)\n", filePath, errno);
+        delete utils_files_writer;
+        return NULL;
+    }
+
+    utils_files_writer->bufs[0] = (char*)malloc(utils_files_writer->buf_size);
+    if(utils_files_writer->bufs[0] == NULL)
+    {
+        LOGE("Could not allocate writer buffer of size %zu.\n", utils_files_writer->buf_size);
+        utils_files_writer->flag_error = 1;
+        utils_files_writer_close(&utils_files_writer);
+        return NULL;
+    }
+    return utils_files_writer;
+}
+
+
+int utils_files_writer_write(utils_files_writer_t *utils_files_writer, const void *data, size_t size)
+{
+    const char *p = (const char*)data;
+
+    if(utils_files_writer == NULL || utils_files_writer->flag_error)
+        return -1;
+
+    // Large chunks are not copied
+    if(size >= utils_files_writer->buf_size)
+        return writer_submit(utils_files_writer, data, size);
+
+    while(size > 0)
+    {
+        int idx = utils_files_writer->buf_idx;
+        size_t used = utils_files_writer->bufs_used[idx];
+        size_t chunk = utils_files_writer->buf_size - used;
+
+        if(chunk == 0)
+        {
+            // Next buffer (allocated on first use), or write them all if this was the last one
+            if(idx + 1 == WRITER_BUFS_NUM)
+            {
+                if(writer_submit(utils_files_writer, NULL, 0) != 0)
+                    return -1;
+                continue;
+            }
+            if(utils_files_writer->bufs[idx + 1] == NULL &&
+                    (utils_files_writer->bufs[idx + 1] = (char*)malloc(utils_files_writer->buf_size)) == NULL)
+            {
+                // Carry on with the buffers we have
+                if(writer_submit(utils_files_writer, NULL, 0) != 0)
+                    return -1;
+                continue;
+            }
+            utils_files_writer->buf_idx = idx + 1;
+            continue;
+        }
+        if(chunk > size)
+            chunk = size;
+        memcpy(utils_files_writer->bufs[idx] + used, p, chunk);
+        utils_files_writer->bufs_used[idx] += chunk;
+        p += chunk;
+        size -= chunk;
+    }
+    return 0;
+}
+
+
+int utils_files_writer_printf(utils_files_writer_t *utils_files_writer, const char *format, ...)
+{
+    va_list args;
+    int len;
+
+    if(utils_files_writer == NULL || utils_files_writer->flag_error)
+        return -1;
+
+    // Format in place if it fits in the room left in the current buffer
+    int idx = utils_files_writer->buf_idx;
+    size_t used = utils_files_writer->bufs_used[idx];
+    va_start(args, format);
+    len = vsnprintf(utils_files_writer->bufs[idx] + used, utils_files_writer->buf_size - used, format, args);
+    va_end(args);
+    if(len < 0)
+        return -1;
+    if((size_t)len < utils_files_writer->buf_size - used)
+    {
+        utils_files_writer->bufs_used[idx] += (size_t)len;
+        return 0;
+    }
+
+    // Otherwise format it aside
+    char *str = (char*)malloc((size_t)len + 1);
+    if(str == NULL)
+        return -1;
+    va_start(args, format);
+    vsnprintf(str, (size_t)len + 1, format, args);
+    va_end(args);
+    int ret = utils_files_writer_write(utils_files_writer, str, (size_t)len);
+    free(str);
+    return ret;
+}
+
+
+int utils_files_writer_flush(utils_files_writer_t *utils_files_writer)
+{
+    if(utils_files_writer == NULL || utils_files_writer->flag_error)
+        return -1;
+
+    return writer_submit(utils_files_writer, NULL, 0);
+}
+
+
+int utils_files_writer_close(utils_files_writer_t **ref_utils_files_writer)
+{
+    utils_files_writer_t *utils_files_writer;
+    int ret = 0;
+
+    if(ref_utils_files_writer == NULL || (utils_files_writer = *ref_utils_files_writer) == NULL)
+        return -1;
+
+    LOG_CTX_INIT(utils_files_writer->utils_logs_ctx);
+
+    if(utils_files_writer_flush(utils_files_writer) != 0)
+        ret = -1;
+
+    // A renamed file must be complete on the disk before the rename is
+    if(ret == 0 && (utils_files_writer->flags & (UTILS_FILES_WRITER_ATOMIC | UTILS_FILES_WRITER_SYNC)) &&
+            fdatasync(utils_files_writer->fd) != 0)
+    {
+        LOGE("Could not sync file '%s' (errno: %d)\n", utils_files_writer->path.c_str(), errno);
+        ret = -1;
+    }
+    if(close(utils_files_writer->fd) != 0)
+        ret = -1;
+
+    if(!utils_files_writer->tmp_path.empty())
+    {
+        if(ret == 0 && rename(utils_files_writer->tmp_path.c_str(), utils_files_writer->path.c_str()) != 0)
+        {
+            LOGE("Could not replace file '%s' (errno: %d)\n", utils_files_writer->path.c_str(), errno);
+            ret = -1;
+        }
+        if(ret != 0)
+        {
+            unlink(utils_files_writer->tmp_path.c_str());
+        }
+        else
+        {
+            // Make the rename itself durable
+            std::string dir_path = utils_files_writer->path;
+            int dir_fd = open(dirname(&dir_path[0]), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if(dir_fd >= 0)
+            {
+                fsync(dir_fd);
+                close(dir_fd);
+            }
+        }
+    }
+
+    for(int i = 0; i < WRITER_BUFS_NUM; i++)
+        free(utils_files_writer->bufs[i]);
+    delete utils_files_writer;
+    *ref_utils_files_writer = NULL;
+    return ret;
+}
+
+
+/// Write the buffered data, followed by the given chunk if any, with as few calls as possible.
+/// @return 0 on success, -1 on error (the writer is then in error state).
+static int writer_submit(utils_files_writer_t *utils_files_writer, const void *data, size_t size)
+{
+    struct iovec iov[WRITER_BUFS_NUM + 1], *p_iov = iov;
+    int iovcnt = 0;
+    LOG_CTX_INIT(utils_files_writer->utils_logs_ctx);
+
+    for(int i = 0; i <= utils_files_writer->buf_idx; i++)
+    {
+        if(utils_files_writer->bufs_used[i] == 0)
+            continue;
+        iov[iovcnt].iov_base = utils_files_writer->bufs[i];
+        iov[iovcnt++].iov_len = utils_files_writer->bufs_used[i];
+        utils_files_writer->bufs_used[i] = 0;
+    }
+    utils_files_writer->buf_idx = 0;
+    if(size > 0)
+    {
+        iov[iovcnt].iov_base = (void*)data;
+        iov[iovcnt++].iov_len = size;
+    }
+
+    while(iovcnt > 0)
+    {
+        ssize_t ret = (utils_files_writer->flags & UTILS_FILES_WRITER_APPEND) ? writev(utils_files_writer->fd, p_iov,
+                iovcnt) : pwritev(utils_files_writer->fd, p_iov, iovcnt, utils_files_writer->offset);
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret <= 0)
+        {
+            LOGE("Could not write to file '%s' (errno: %d)\n", utils_files_writer->path.c_str(), errno);
+            utils_files_writer->flag_error = 1;
+            return -1;
+        }
+        utils_files_writer->offset += ret;
+
+        // Skip what was written (short writes)
+        while(iovcnt > 0 && (size_t)ret >= p_iov->iov_len)
+        {
+            ret -= p_iov->iov_len;
+            p_iov++;
+            iovcnt--;
+        }
+        if(iovcnt > 0)
+        {
+            p_iov->iov_base = (char*)p_iov->iov_base + ret;
+            p_iov->iov_len -= ret;
+        }
+    }
+    return 0;
+}
+
@@ -29,14 +29,37 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 // **** Definitions ****
 
 // Forward declarations
 typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+typedef struct utils_files_map_s utils_files_map_t;
+typedef struct utils_files_writer_s utils_files_writer_t;
+
+/// Zero-copy record iterator over a mapped file (see 'utils_files_records_init()'). It is a plain structure so that it
+/// lives on the stack; its members are private.
+typedef struct utils_files_records_s {
+    const char *pos;
+    const char *end;
+    /// Beginning of the consumed pages not released yet
+    const char *release;
+    char delim;
+} utils_files_records_t;
+
+/// Writer flag: append to the file (the file is truncated otherwise).
+#define UTILS_FILES_WRITER_APPEND 1
+/// Writer flag: replace the file atomically. The data is written to a temporary file in the same folder, which is
+/// synced and renamed over the file on close: readers (and crashes) see either the old or the new whole content.
+#define UTILS_FILES_WRITER_ATOMIC 2
+/// Writer flag: sync the file data to the disk on close.
+#define UTILS_FILES_WRITER_SYNC 4
 
 // **** Prototypes ****
 
 /// Store given character string into file.
+/// When truncating, the file is replaced atomically (see 'UTILS_FILES_WRITER_ATOMIC').
 /// @param str2dump Pointer to the character string to store/dump.
 /// @param filePath Name of the file, including the complete path, where to store the string.
 /// @param doTruncateFile Set to non-zero to truncate the file before storing the string.
@@ -56,6 +79,10 @@ void utils_files_dump2file(const char *str2dump, const char *filePath, int doTru
 /// @return 0 if succeed; on failure, -1 is returned and errno is set accordingly.
 int utils_files_mkpath(const char *path, int mkdirMode, utils_logs_ctx_t *const utils_logs_ctx);
 
+/// Remove a file or a folder tree (symbolic links are removed, not followed), in a single pass: each folder is
+/// opened once and its entries are removed relative to it ('openat()'/'unlinkat()'). A missing path is not an error.
+/// @param path Path to remove.
+/// @param utils_logs_ctx Pointer to generic logger context structure.
 void utils_rmpath(const char *path, utils_logs_ctx_t *const utils_logs_ctx);
 
 /// Reads content from given file path and stores it in a heap-allocated character buffer.
@@ -66,6 +93,71 @@ void utils_rmpath(const char *path, utils_logs_ctx_t *const utils_logs_ctx);
 /// occurred.
 char* utils_files_file2buf(const char *completeFilePath, utils_logs_ctx_t *const utils_logs_ctx);
 
+/// Map a file read-only in memory, advised for sequential access ('MADV_SEQUENTIAL': aggressive read-ahead, and
+/// pages dropped behind). Multi-GB files are read without copies nor heap buffers.
+/// @param filePath Name of the file, including the complete path.
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return Pointer to the mapped file on success (an empty file maps to no data), NULL if fails.
+utils_files_map_t* utils_files_map_open(const char *filePath, utils_logs_ctx_t *const utils_logs_ctx);
+
+/// Unmap a file.
+/// @param ref_utils_files_map Reference to the pointer obtained with 'utils_files_map_open()'. Pointer is set to NULL
+/// on return.
+void utils_files_map_close(utils_files_map_t **ref_utils_files_map);
+
+/// @return Mapped file content (not NULL-terminated), NULL if the file is empty.
+const char* utils_files_map_data(const utils_files_map_t *utils_files_map);
+
+/// @return Mapped file size in bytes.
+size_t utils_files_map_size(const utils_files_map_t *utils_files_map);
+
+/// Initialize a record iterator (e.g. the lines of an access log).
+/// @param utils_files_records Pointer to the iterator.
+/// @param utils_files_map Mapped file.
+/// @param offset Offset in bytes to start from (e.g. the file size at the beginning of a test).
+/// @param delim Record delimiter (e.g. '\n').
+void utils_files_records_init(utils_files_records_t *utils_files_records, const utils_files_map_t *utils_files_map,
+        size_t offset, char delim);
+
+/// Get the next record. The record points into the mapping: it is not NULL-terminated and it is valid until the file
+/// is unmapped. The pages behind the iterator are released on the way, so that scanning a file larger than the
+/// memory does not evict anything else.
+/// @param utils_files_records Pointer to the iterator.
+/// @param ref_record Where to return the record (delimiter excluded).
+/// @param ref_size Where to return the record size in bytes.
+/// @return 1 if a record is returned, 0 at the end of the file. A last record without delimiter is returned too.
+int utils_files_records_next(utils_files_records_t *utils_files_records, const char **ref_record, size_t *ref_size);
+
+/// Open a buffered writer. Data is copied to a set of buffers that are written with a single 'pwritev()' call once
+/// all of them are full (or on flush), so that writing many small records costs few system calls.
+/// @param filePath Name of the file, including the complete path. It is created if it does not exist.
+/// @param flags Bitwise OR of 'UTILS_FILES_WRITER_*' flags.
+/// @param buf_size Size in bytes of each buffer (0 for the default of 256 KiB).
+/// @param utils_logs_ctx Pointer to generic logger context structure.
+/// @return Pointer to the writer on success, NULL if fails.
+utils_files_writer_t* utils_files_writer_open(const char *filePath, int flags, size_t buf_size,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/// Write data. Chunks of at least the buffer size are written directly (not copied), batched with the buffered data.
+/// @return 0 on success, -1 if this or a previous write failed.
+int utils_files_writer_write(utils_files_writer_t *utils_files_writer, const void *data, size_t size);
+
+/// Write formatted data (see 'printf()'), formatted directly in the buffers.
+/// @return 0 on success, -1 if this or a previous write failed.
+int utils_files_writer_printf(utils_files_writer_t *utils_files_writer, const char *format, ...)
+        __attribute__((format(printf, 2, 3)));
+
+/// Write the buffered data to the file.
+/// @return 0 on success, -1 if this or a previous write failed.
+int utils_files_writer_flush(utils_files_writer_t *utils_files_writer);
+
+/// Flush and close a writer; in atomic mode the file is replaced, unless a write failed (then the temporary file is
+/// removed and the file is left untouched).
+/// @param ref_utils_files_writer Reference to the pointer obtained with 'utils_files_writer_open()'. Pointer is set
+/// to NULL on return.
+/// @return 0 if all the data reached the file, -1 otherwise.
+int utils_files_writer_close(utils_files_writer_t **ref_utils_files_writer);
+
 #ifdef __cplusplus
 } //extern "C"
 #endif
@@ -27,23 +27,256 @@
 
 extern "C" {
 #include "utils_logs.h"
+#include "utils_time.h"
 }
 
 #include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
 #include <string>
+#include <thread>
+#include <vector>
 
 /// Color codes for terminal
 #define CNRM "\x1B[0m"
 #define CRED "\033[1;31m" // Bold-red
 #define CYEL "\x1B[33m"
 
+/// Default per-thread ring size [bytes] of the asynchronous back-end
+#define ASYNC_RING_SIZE_DEFAULT (64* 1024)
+
+/// Period [msecs] at which the asynchronous back-end drains the rings
+#define ASYNC_DRAIN_PERIOD_MSECS 5
+
+/// Minimum period [secs] between two reports of dropped messages
+#define ASYNC_DROP_REPORT_PERIOD_SECS 1
+
+/// Period [msecs] at which the asynchronous back-end outputs the suppressed counts of the silent call sites
+#define ASYNC_RL_FLUSH_PERIOD_MSECS 100
+
+/// Record header as stored in the per-thread rings. The formatted text follows it, except for the call-site traces,
+/// whose raw arguments follow it instead (encoded as in the binary records, see 'utils_logs_binary_rec_t'): these
+/// are formatted by the back-end thread.
+typedef struct utils_logs_record_s
+{
+    uint32_t size; ///< Total record size [bytes], header included
+    int32_t lineNo;
+    utils_logs_level_t utils_logs_level;
+    const char *fileName; ///< Always a literal ('__FILENAME__'); NULL for the call-site traces
+    const utils_logs_site_t *utils_logs_site; ///< Call site of the raw-argument records, NULL otherwise
+} utils_logs_record_t;
+
+/// Single-producer/single-consumer byte ring, one per producer thread.
+/// The producer only writes 'tail' and the consumer only writes 'head', so
+/// neither side needs a lock. The ring is shared by its thread and the module
+/// instance: whichever of them releases it last frees it.
+typedef struct utils_logs_ring_s
+{
+    alignas(64) std::atomic<uint64_t> head; ///< Consumer position
+    alignas(64) std::atomic<uint64_t> tail; ///< Producer position
+    std::atomic<uint64_t> dropped; ///< Written by the producer only
+    std::atomic<int> refs;
+    size_t size; ///< Power of two
+    char *buf;
+} utils_logs_ring_t;
+
+/// Asynchronous back-end state
+typedef struct utils_logs_async_s
+{
+    uint64_t id; ///< Unique along the process lifetime (keys the thread cache)
+    utils_logs_ctx_t *utils_logs_ctx; ///< Owner instance
+    size_t ring_size;
+    std::mutex mutex; ///< Protects 'rings' and 'dropped_retired'
+    std::vector<utils_logs_ring_t*> rings;
+    uint64_t dropped_retired; ///< Drops of the rings already freed
+    uint64_t dropped_reported;
+    std::chrono::steady_clock::time_point last_report;
+    std::condition_variable cond;
+    bool flag_exit;
+    std::thread thread;
+} utils_logs_async_t;
+
+/// Default binary log file size [bytes]
+#define BINARY_FILE_SIZE_DEFAULT ((size_t)1 << 30)
+
+/// Maximum number of call sites traced to binary instances
+#define BINARY_SITES_MAX 65536
+
+/// Binary log file magic and format version
+#define BINARY_MAGIC "UTLOGBIN"
+#define BINARY_VERSION 1
+
+/// Record identifier flag of the call-site description records
+#define BINARY_SITE_FLAG 0x80000000u
+
+/// Record size flag of the records reserved but not committed yet (a writer that crashed or was stopped before
+/// 'binary_commit()' leaves it set): the decoder skips these records as holes instead of ending the scan there
+#define BINARY_PENDING_FLAG 0x80000000u
+
+/// Record identifier of the traces not issued from a call site ('utils_logs_trace()'), stored already formatted
+#define BINARY_TEXT_ID 0
+
+/// Binary log file header
+typedef struct utils_logs_binary_hdr_s
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t hdr_size; ///< Offset of the first record
+    uint64_t used_size; ///< File size actually used; zero until closed (e.g. crashed process)
+    uint8_t reserved[40];
+} utils_logs_binary_hdr_t;
+
+/// Binary log record header. The records are 8-byte aligned; 'size' is written last, so that a zero size not
+/// followed by any written record marks the end of the complete records. On reservation 'size' is set flagged with
+/// 'BINARY_PENDING_FLAG', so that a record never committed can still be skipped.
+/// Trace records hold the raw arguments: 8 bytes per integer, double, pointer or '*' width/precision, 'long double'
+/// as is, and strings as a 4-byte length (~0 for NULL) followed by the characters.
+/// Call-site description records (identifier flagged with 'BINARY_SITE_FLAG') hold the level and the line (4 bytes
+/// each) followed by the file, function and format NULL-terminated strings.
+typedef struct utils_logs_binary_rec_s
+{
+    uint32_t size; ///< Total record size [bytes], header and padding included
+    uint32_t id; ///< Call-site identifier
+    uint64_t tstamp_nsecs; ///< Real-time clock
+} utils_logs_binary_rec_t;
+
+/// Type of argument a conversion specification takes
+typedef enum arg_type_enum
+{
+    ARG_NONE = 0, ///< '%%'
+    ARG_INT,
+    ARG_LONG,
+    ARG_LLONG,
+    ARG_SIZE,
+    ARG_INTMAX,
+    ARG_PTRDIFF,
+    ARG_DOUBLE,
+    ARG_LDOUBLE,
+    ARG_STR,
+    ARG_PTR
+} arg_type_t;
+
+/// Parsed printf conversion specification
+typedef struct arg_spec_s
+{
+    const char *start; ///< The '%' character
+    const char *end; ///< Past the conversion character
+    arg_type_t arg_type;
+    bool flag_width_star;
+    bool flag_prec_star;
+    int prec; ///< -1 if not given (or given with '*')
+} arg_spec_t;
+
+/// Argument signature of a call site, parsed from its format once
+typedef struct arg_sig_s
+{
+    int num;
+    arg_spec_t specs[];
+} arg_sig_t;
+
+/// Binary back-end state
+typedef struct utils_logs_binary_s
+{
+    int fd;
+    char *map;
+    size_t map_size;
+    alignas(64) std::atomic<uint64_t> tail; ///< Next record offset (may go past 'map_size')
+    alignas(64) std::atomic<uint64_t> dropped;
+    std::mutex sites_mutex; ///< Serializes the call-site descriptions
+    std::atomic<uint8_t> sites_stored[BINARY_SITES_MAX]; ///< Call-site description already in the file
+} utils_logs_binary_t;
+
 /// Module instance context structure
 typedef struct utils_logs_ctx_s
 {
     void *opaque_logger_ctx_ptr;
     utils_logs_ext_trace_fxn_t utils_logs_ext_trace_fxn;
+    utils_logs_async_t *async; ///< NULL unless opened with 'utils_logs_open_async()'
+    utils_logs_binary_t *binary; ///< NULL unless opened with 'utils_logs_open_binary()'
+    uint32_t rl_burst; ///< Traces allowed per call site and interval (zero: no rate limiting)
+    uint32_t rl_interval_msecs;
+    uint64_t suppressed; ///< Accessed atomically
 } utils_logs_ctx_t;
 
+/// Per-thread cache of the rings the thread produces to (one per instance)
+class utils_logs_thread_rings
+{
+public:
+    ~utils_logs_thread_rings();
+    utils_logs_ring_t* get(utils_logs_async_t *async);
+private:
+    uint64_t last_id = 0;
+    utils_logs_ring_t *last_ring = NULL;
+    std::vector<std::pair<uint64_t, utils_logs_ring_t*>> rings;
+};
+
+/// Allocate a value-initialized object with the alignment of its type. Before C++17 'operator new' does not honor
+/// over-aligned types (the 'alignas(64)' members that keep the positions written by different threads on their own
+/// cache lines), so the memory is obtained with 'posix_memalign()'.
+/// @return Pointer to the object, or NULL if fails.
+template<typename T> static T* aligned_new()
+{
+    void *p = NULL;
+
+    if(posix_memalign(&p, alignof(T) > sizeof(void*) ? alignof(T) : sizeof(void*), sizeof(T)) != 0)
+        return NULL;
+    return new(p) T();
+}
+
+/// Destroy and free an object allocated with 'aligned_new()'.
+template<typename T> static void aligned_delete(T *p)
+{
+    if(p == NULL)
+        return;
+    p->~T();
+    free(p);
+}
+
+static std::atomic<uint64_t> async_id_next(1);
+static std::mutex sites_register_mutex;
+static uint32_t sites_num = 0;
+static std::mutex sites_rl_mutex; ///< Protects 'sites_rl'
+static utils_logs_site_t *sites_rl = NULL; ///< Call sites that had traces suppressed
+static thread_local utils_logs_thread_rings thread_rings;
+
+static const char* level_color(utils_logs_level_t utils_logs_level);
+static void trace_va(utils_logs_ctx_t *utils_logs_ctx, utils_logs_level_t utils_logs_level, const char *fileName,
+        int lineNo, const char *funcName, const char *format, va_list args);
+static bool site_rate_limit(utils_logs_ctx_t *utils_logs_ctx, utils_logs_site_t *utils_logs_site);
+static void site_report_suppressed(utils_logs_ctx_t *utils_logs_ctx, utils_logs_site_t *utils_logs_site,
+        uint64_t suppressed);
+static bool site_window_open(utils_logs_ctx_t *utils_logs_ctx, utils_logs_site_t *utils_logs_site,
+        uint64_t now_msecs);
+static void sites_flush_suppressed(utils_logs_ctx_t *utils_logs_ctx);
+static uint64_t now_coarse_msecs();
+static const char* format_next_spec(const char *p, arg_spec_t *spec);
+static uint32_t site_register(utils_logs_site_t *utils_logs_site);
+static char* binary_reserve(utils_logs_binary_t *binary, uint32_t size);
+static void binary_commit(char *rec, uint32_t size);
+static void binary_store_site(utils_logs_binary_t *binary, utils_logs_site_t *utils_logs_site, uint32_t id);
+static void binary_trace(utils_logs_binary_t *binary, utils_logs_site_t *utils_logs_site, va_list args);
+static char* args_encode(const arg_sig_t *arg_sig, char *p, const char *end, va_list args);
+static void decode_message(const char *format, const char *p, const char *end, std::string &msg);
+static void binary_trace_text(utils_logs_binary_t *binary, utils_logs_level_t utils_logs_level,
+        const char *fileName, int lineNo, const char *format, va_list args);
+static void ring_release(utils_logs_ring_t *ring);
+static void ring_push(utils_logs_ring_t *ring, utils_logs_level_t utils_logs_level, const char *fileName,
+        int lineNo, const char *format, va_list args);
+static void ring_push_site(utils_logs_ring_t *ring, utils_logs_site_t *utils_logs_site, va_list args);
+static bool ring_drain(utils_logs_ring_t *ring);
+static void async_drain(utils_logs_async_t *async);
+static void async_thr(utils_logs_async_t *async);
+
 
 utils_logs_ctx_t* utils_logs_open(void *const opaque_logger_ctx_ptr,
         utils_logs_ext_trace_fxn_t utils_logs_ext_trace_fxn)
@@ -69,6 +302,106 @@ utils_logs_ctx_t* utils_logs_open(void *const opaque_logger_ctx_ptr,
 }
 
 
+utils_logs_ctx_t* utils_logs_open_async(size_t ring_size)
+{
+    utils_logs_ctx_t *utils_logs_ctx = NULL;
+    utils_logs_async_t *async = NULL;
+    size_t size = 1024;
+
+    // Round the ring size up to a power of two (the positions are masked)
+    if(ring_size == 0)
+        ring_size = ASYNC_RING_SIZE_DEFAULT;
+    while(size < ring_size)
+        size <<= 1;
+
+    utils_logs_ctx = utils_logs_open(NULL, NULL);
+    if(utils_logs_ctx == NULL)
+        return NULL;
+
+    try
+    {
+        async = new utils_logs_async_t();
+        async->id = async_id_next.fetch_add(1);
+        async->utils_logs_ctx = utils_logs_ctx;
+        async->ring_size = size;
+        async->dropped_retired = 0;
+        async->dropped_reported = 0;
+        async->flag_exit = false;
+        async->thread = std::thread(async_thr, async);
+    }
+    catch(...)
+    {
+        delete async;
+        utils_logs_close(&utils_logs_ctx);
+        return NULL;
+    }
+
+    utils_logs_ctx->async = async;
+    return utils_logs_ctx;
+}
+
+
+utils_logs_ctx_t* utils_logs_open_binary(const char *path, size_t file_size)
+{
+    utils_logs_ctx_t *utils_logs_ctx = NULL;
+    utils_logs_binary_t *binary = NULL;
+    utils_logs_binary_hdr_t *hdr;
+
+    if(path == NULL)
+        return NULL;
+    if(file_size == 0)
+        file_size = BINARY_FILE_SIZE_DEFAULT;
+    if(file_size < sizeof(utils_logs_binary_hdr_t) + UTILS_LOGS_TRACE_MAX_SIZE)
+        return NULL;
+
+    utils_logs_ctx = utils_logs_open(NULL, NULL);
+    if(utils_logs_ctx == NULL)
+        return NULL;
+
+    binary = aligned_new<utils_logs_binary_t>();
+    if(binary == NULL)
+        goto end;
+    binary->map = (char*)MAP_FAILED;
+    binary->map_size = file_size;
+    binary->tail = sizeof(utils_logs_binary_hdr_t);
+    binary->dropped = 0;
+    for(size_t i = 0; i < BINARY_SITES_MAX; i++)
+        binary->sites_stored[i] = 0;
+
+    // The file is sparse: only the pages actually written take up room
+    binary->fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(binary->fd < 0)
+        goto end;
+    if(ftruncate(binary->fd, (off_t)file_size) != 0)
+        goto end;
+    binary->map = (char*)mmap(NULL, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, binary->fd, 0);
+    if(binary->map == MAP_FAILED)
+        goto end;
+
+    hdr = (utils_logs_binary_hdr_t*)binary->map;
+    memcpy(hdr->magic, BINARY_MAGIC, sizeof(hdr->magic));
+    hdr->version = BINARY_VERSION;
+    hdr->hdr_size = sizeof(utils_logs_binary_hdr_t);
+
+    utils_logs_ctx->binary = binary;
+    return utils_logs_ctx;
+end:
+    if(binary != NULL)
+    {
+        if(binary->map != MAP_FAILED)
+            munmap(binary->map, binary->map_size);
+        if(binary->fd >= 0)
+        {
+            close(binary->fd);
+            unlink(path);
+        }
+        aligned_delete(binary);
+    }
+    utils_logs_close(&utils_logs_ctx);
+    return NULL;
+}
+
+
 void utils_logs_close(utils_logs_ctx_t **ref_utils_logs_ctx)
 {
     utils_logs_ctx_t *utils_logs_ctx;
@@ -76,6 +409,59 @@ void utils_logs_close(utils_logs_ctx_t **ref_utils_logs_ctx)
     if(ref_utils_logs_ctx == NULL || (utils_logs_ctx = *ref_utils_logs_ctx) == NULL)
         return;
 
+    // Output the rate limiting counts still pending
+    if(utils_logs_ctx->rl_burst != 0)
+    {
+        std::lock_guard<std::mutex> lock(sites_rl_mutex);
+
+        for(utils_logs_site_t *site = sites_rl; site != NULL; site = site->rl_next)
+        {
+            uint64_t pending;
+
+            if(__atomic_load_n(&site->rl_ctx, __ATOMIC_RELAXED) != utils_logs_ctx)
+                continue;
+            __atomic_store_n(&site->rl_ctx, (utils_logs_ctx_t*)NULL, __ATOMIC_RELAXED);
+            if((pending = __atomic_exchange_n(&site->rl_pending, 0, __ATOMIC_RELAXED)) != 0)
+                site_report_suppressed(utils_logs_ctx, site, pending);
+        }
+    }
+
+    if(utils_logs_ctx->async != NULL)
+    {
+        utils_logs_async_t *async = utils_logs_ctx->async;
+
+        // Stop the back-end thread; it drains all the rings before leaving
+        {
+            std::lock_guard<std::mutex> lock(async->mutex);
+            async->flag_exit = true;
+        }
+        async->cond.notify_one();
+        async->thread.join();
+
+        // Rings still referenced by live threads are freed when they exit
+        for(utils_logs_ring_t *ring : async->rings)
+            ring_release(ring);
+        delete async;
+    }
+
+    if(utils_logs_ctx->binary != NULL)
+    {
+        utils_logs_binary_t *binary = utils_logs_ctx->binary;
+        uint64_t used_size = binary->tail.load();
+
+        // Record the used size and give the unused (sparse) room back
+        if(used_size > binary->map_size)
+            used_size = binary->map_size;
+        ((utils_logs_binary_hdr_t*)binary->map)->used_size = used_size;
+        munmap(binary->map, binary->map_size);
+        if(ftruncate(binary->fd, (off_t)used_size) != 0)
+        {
+            // Harmless: the decoder relies on the header used size
+        }
+        close(binary->fd);
+        aligned_delete(binary);
+    }
+
     free(utils_logs_ctx);
     *ref_utils_logs_ctx = NULL;
 }
@@ -84,8 +470,6 @@ void utils_logs_close(utils_logs_ctx_t **ref_utils_logs_ctx)
 void utils_logs_trace(utils_logs_ctx_t *utils_logs_ctx, utils_logs_level_t utils_logs_level, const char *fileName,
         int lineNo, const char *funcName, const char *format, ...)
 {
-    void *opaque_logger_ctx_ptr;
-    utils_logs_ext_trace_fxn_t utils_logs_ext_trace_fxn;
     va_list args;
 
     // Check arguments.
@@ -95,21 +479,285 @@ void utils_logs_trace(utils_logs_ctx_t *utils_logs_ctx, utils_logs_level_t utils
         return;
 
     va_start(args, format);
+    if(utils_logs_ctx->binary != NULL)
+        binary_trace_text(utils_logs_ctx->binary, utils_logs_level, fileName, lineNo, format, args);
+    else
+        trace_va(utils_logs_ctx, utils_logs_level, fileName, lineNo, funcName, format, args);
+    va_end(args);
+    return;
+}
 
-    opaque_logger_ctx_ptr = utils_logs_ctx->opaque_logger_ctx_ptr;
-    utils_logs_ext_trace_fxn = utils_logs_ctx->utils_logs_ext_trace_fxn;
 
-    if(opaque_logger_ctx_ptr == NULL && utils_logs_ext_trace_fxn == NULL)
+void utils_logs_trace_site(utils_logs_ctx_t *utils_logs_ctx, utils_logs_site_t *utils_logs_site, ...)
+{
+    va_list args;
+
+    // Check arguments
+    if(utils_logs_ctx == NULL || utils_logs_site == NULL || utils_logs_site->format == NULL ||
+            utils_logs_site->utils_logs_level >= UTILS_LOGS_LEVEL_ENUM_MAX)
+        return;
+
+    if(utils_logs_ctx->rl_burst != 0 && site_rate_limit(utils_logs_ctx, utils_logs_site))
+        return;
+
+    va_start(args, utils_logs_site);
+    if(utils_logs_ctx->binary != NULL)
+    {
+        binary_trace(utils_logs_ctx->binary, utils_logs_site, args);
+    }
+    else if(utils_logs_ctx->async != NULL)
     {
-        std::string colcode;
+        utils_logs_ring_t *ring = thread_rings.get(utils_logs_ctx->async);
 
-        if(utils_logs_level == UTILS_LOGS_ERR)
-            colcode = CRED;
-        else if(utils_logs_level == UTILS_LOGS_WAR)
-            colcode = CYEL;
-        else
-            colcode = CNRM;
-        printf("%s%s-%d: ", colcode.c_str(), fileName, lineNo);
+        if(ring != NULL)
+            ring_push_site(ring, utils_logs_site, args);
+    }
+    else
+    {
+        const char *fileName = strrchr(utils_logs_site->filePath, '/');
+
+        trace_va(utils_logs_ctx, utils_logs_site->utils_logs_level,
+                fileName != NULL ? fileName + 1 : utils_logs_site->filePath, utils_logs_site->lineNo,
+                utils_logs_site->funcName, utils_logs_site->format, args);
+    }
+    va_end(args);
+    return;
+}
+
+
+void utils_logs_close_uptr(utils_logs_ctx_t *p)
+{
+    utils_logs_close(&p);
+}
+
+
+void* utils_logs_show_opaque_logger(utils_logs_ctx_t *utils_logs_ctx)
+{
+    return utils_logs_ctx->opaque_logger_ctx_ptr;
+}
+
+
+uint64_t utils_logs_dropped(utils_logs_ctx_t *utils_logs_ctx)
+{
+    utils_logs_async_t *async;
+    uint64_t dropped;
+
+    if(utils_logs_ctx == NULL)
+        return 0;
+    if(utils_logs_ctx->binary != NULL)
+        return utils_logs_ctx->binary->dropped.load(std::memory_order_relaxed);
+    if((async = utils_logs_ctx->async) == NULL)
+        return 0;
+
+    std::lock_guard<std::mutex> lock(async->mutex);
+    dropped = async->dropped_retired;
+    for(utils_logs_ring_t *ring : async->rings)
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+    return dropped;
+}
+
+
+void utils_logs_set_rate_limit(utils_logs_ctx_t *utils_logs_ctx, uint32_t burst, uint32_t interval_msecs)
+{
+    if(utils_logs_ctx == NULL)
+        return;
+
+    utils_logs_ctx->rl_burst = interval_msecs != 0 ? burst : 0;
+    utils_logs_ctx->rl_interval_msecs = interval_msecs;
+}
+
+
+uint64_t utils_logs_suppressed(utils_logs_ctx_t *utils_logs_ctx)
+{
+    if(utils_logs_ctx == NULL)
+        return 0;
+
+    return __atomic_load_n(&utils_logs_ctx->suppressed, __ATOMIC_RELAXED);
+}
+
+
+utils_logs_thread_rings::~utils_logs_thread_rings()
+{
+    for(auto &entry : rings)
+        ring_release(entry.second);
+}
+
+
+utils_logs_ring_t* utils_logs_thread_rings::get(utils_logs_async_t *async)
+{
+    utils_logs_ring_t *ring;
+
+    // Fast path: the thread logs to a single instance most of the time
+    if(async->id == last_id)
+        return last_ring;
+
+    ring = NULL;
+    for(auto &entry : rings)
+    {
+        if(entry.first == async->id)
+        {
+            ring = entry.second;
+            break;
+        }
+    }
+
+    if(ring == NULL)
+    {
+        // First trace of this thread to this instance: register a new ring
+        ring = aligned_new<utils_logs_ring_t>();
+        if(ring == NULL)
+            return NULL;
+        ring->buf = (char*)malloc(async->ring_size);
+        if(ring->buf == NULL)
+        {
+            aligned_delete(ring);
+            return NULL;
+        }
+        ring->size = async->ring_size;
+        ring->head = 0;
+        ring->tail = 0;
+        ring->dropped = 0;
+        ring->refs = 2; // This thread and the instance
+        try
+        {
+            rings.emplace_back(async->id, ring);
+            std::lock_guard<std::mutex> lock(async->mutex);
+            async->rings.push_back(ring);
+        }
+        catch(...)
+        {
+            if(!rings.empty() && rings.back().second == ring)
+                rings.pop_back();
+            free(ring->buf);
+            aligned_delete(ring);
+            return NULL;
+        }
+    }
+
+    last_id = async->id;
+    last_ring = ring;
+    return ring;
+}
+
+
+/// Account a trace in its call-site rate limiting interval.
+/// @return 'true' if the trace has to be suppressed.
+static bool site_rate_limit(utils_logs_ctx_t *utils_logs_ctx, utils_logs_site_t *utils_logs_site)
+{
+    // The first trace after the interval opens a new one (and reports the previous one)
+    site_window_open(utils_logs_ctx, utils_logs_site, now_coarse_msecs());
+
+    if(__atomic_fetch_add(&utils_logs_site->rl_count, 1, __ATOMIC_RELAXED) < utils_logs_ctx->rl_burst)
+        return false;
+
+    __atomic_fetch_add(&utils_logs_site->rl_pending, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&utils_logs_ctx->suppressed, 1, __ATOMIC_RELAXED);
+
+    // Remember the site, so that its pending count is output on close
+    if(__atomic_load_n(&utils_logs_site->rl_ctx, __ATOMIC_RELAXED) != utils_logs_ctx)
+    {
+        std::lock_guard<std::mutex> lock(sites_rl_mutex);
+        bool flag_listed = false;
+
+        for(utils_logs_site_t *site = sites_rl; site != NULL && !flag_listed; site = site->rl_next)
+            flag_listed = site == utils_logs_site;
+        if(!flag_listed)
+        {
+            utils_logs_site->rl_next = sites_rl;
+            sites_rl = utils_logs_site;
+        }
+        __atomic_store_n(&utils_logs_site->rl_ctx, utils_logs_ctx, __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+
+/// The coarse clock (a few milliseconds resolution) is enough for the rate limiting and far cheaper.
+static uint64_t now_coarse_msecs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+
+/// Open a new rate limiting interval for a call site if the current one is over, and report the traces it
+/// suppressed.
+/// @return 'true' if a new interval was opened.
+static bool site_window_open(utils_logs_ctx_t *utils_logs_ctx, utils_logs_site_t *utils_logs_site,
+        uint64_t now_msecs)
+{
+    uint64_t window_msecs = __atomic_load_n(&utils_logs_site->rl_window_msecs, __ATOMIC_RELAXED);
+    uint64_t pending;
+
+    if(now_msecs - window_msecs < utils_logs_ctx->rl_interval_msecs ||
+            !__atomic_compare_exchange_n(&utils_logs_site->rl_window_msecs, &window_msecs, now_msecs, false,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return false;
+
+    __atomic_store_n(&utils_logs_site->rl_count, 0, __ATOMIC_RELAXED);
+    if((pending = __atomic_exchange_n(&utils_logs_site->rl_pending, 0, __ATOMIC_RELAXED)) != 0)
+        site_report_suppressed(utils_logs_ctx, utils_logs_site, pending);
+    return true;
+}
+
+
+/// Report the suppressed counts of the call sites whose interval is over, even if they do not trace again (e.g.
+/// a burst followed by silence). Called periodically by the asynchronous back-end.
+static void sites_flush_suppressed(utils_logs_ctx_t *utils_logs_ctx)
+{
+    uint64_t now_msecs = now_coarse_msecs();
+    std::lock_guard<std::mutex> lock(sites_rl_mutex);
+
+    for(utils_logs_site_t *site = sites_rl; site != NULL; site = site->rl_next)
+    {
+        if(__atomic_load_n(&site->rl_ctx, __ATOMIC_RELAXED) == utils_logs_ctx &&
+                __atomic_load_n(&site->rl_pending, __ATOMIC_RELAXED) != 0)
+            site_window_open(utils_logs_ctx, site, now_msecs);
+    }
+}
+
+
+/// Output the number of traces of a call site suppressed along an interval, on behalf of the site.
+static void site_report_suppressed(utils_logs_ctx_t *utils_logs_ctx, utils_logs_site_t *utils_logs_site,
+        uint64_t suppressed)
+{
+    const char *fileName = strrchr(utils_logs_site->filePath, '/');
+    std::string digits = std::to_string(suppressed), grouped;
+
+    // Thousands separators: "12,345"
+    for(size_t i = 0; i < digits.size(); i++)
+    {
+        if(i != 0 && (digits.size() - i) % 3 == 0)
+            grouped.push_back(',');
+        grouped.push_back(digits[i]);
+    }
+
+    utils_logs_trace(utils_logs_ctx, utils_logs_site->utils_logs_level,
+            fileName != NULL ? fileName + 1 : utils_logs_site->filePath, utils_logs_site->lineNo,
+            utils_logs_site->funcName != NULL ? utils_logs_site->funcName : "", "suppressed %s similar traces\n",
+            grouped.c_str());
+}
+
+
+/// Trace to the text back-ends (standard output, asynchronous or external logger).
+static void trace_va(utils_logs_ctx_t *utils_logs_ctx, utils_logs_level_t utils_logs_level, const char *fileName,
+        int lineNo, const char *funcName, const char *format, va_list args)
+{
+    void *opaque_logger_ctx_ptr = utils_logs_ctx->opaque_logger_ctx_ptr;
+    utils_logs_ext_trace_fxn_t utils_logs_ext_trace_fxn = utils_logs_ctx->utils_logs_ext_trace_fxn;
+
+    if(utils_logs_ctx->async != NULL)
+    {
+        utils_logs_ring_t *ring = thread_rings.get(utils_logs_ctx->async);
+
+        if(ring != NULL)
+            ring_push(ring, utils_logs_level, fileName, lineNo, format, args);
+    }
+    else if(opaque_logger_ctx_ptr == NULL && utils_logs_ext_trace_fxn == NULL)
+    {
+        printf("%s%s-%d: ", level_color(utils_logs_level), fileName, lineNo);
         vprintf(format, args);
         printf("%s", CNRM);
         fflush(stdout);
@@ -118,19 +766,935 @@ void utils_logs_trace(utils_logs_ctx_t *utils_logs_ctx, utils_logs_level_t utils
     {
         utils_logs_ext_trace_fxn(opaque_logger_ctx_ptr, utils_logs_level, fileName, lineNo, funcName, format, args);
     }
+}
+
+
+static const char* level_color(utils_logs_level_t utils_logs_level)
+{
+    if(utils_logs_level == UTILS_LOGS_ERR)
+        return CRED;
+    if(utils_logs_level == UTILS_LOGS_WAR)
+        return CYEL;
+    return CNRM;
+}
+
+
+static void ring_release(utils_logs_ring_t *ring)
+{
+    if(ring->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        free(ring->buf);
+        aligned_delete(ring);
+    }
+}
 
+
+/// Copy 'size' bytes into the ring at position 'pos', wrapping around the end.
+static inline void ring_copy_in(utils_logs_ring_t *ring, uint64_t pos, const void *src, size_t size)
+{
+    size_t offset = (size_t)(pos & (ring->size - 1));
+    size_t first = ring->size - offset < size ? ring->size - offset : size;
+
+    memcpy(ring->buf + offset, src, first);
+    memcpy(ring->buf, (const char*)src + first, size - first);
+}
+
+
+/// Copy 'size' bytes out of the ring from position 'pos', wrapping around the end.
+static inline void ring_copy_out(utils_logs_ring_t *ring, uint64_t pos, void *dst, size_t size)
+{
+    size_t offset = (size_t)(pos & (ring->size - 1));
+    size_t first = ring->size - offset < size ? ring->size - offset : size;
+
+    memcpy(dst, ring->buf + offset, first);
+    memcpy((char*)dst + first, ring->buf, size - first);
+}
+
+
+/// Append a record to the thread ring. If it does not fit, the trace is dropped and accounted: the producer never
+/// waits for the back-end.
+static inline void ring_write(utils_logs_ring_t *ring, const char *rec, uint32_t size)
+{
+    uint64_t tail, head;
+
+    tail = ring->tail.load(std::memory_order_relaxed);
+    head = ring->head.load(std::memory_order_acquire);
+    if(ring->size - (size_t)(tail - head) < size)
+    {
+        ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+
+    ring_copy_in(ring, tail, rec, size);
+    ring->tail.store(tail + size, std::memory_order_release);
+}
+
+
+/// Producer side of the traces not issued from a call site: format the trace and append it to the thread ring.
+static void ring_push(utils_logs_ring_t *ring, utils_logs_level_t utils_logs_level, const char *fileName,
+        int lineNo, const char *format, va_list args)
+{
+    static thread_local char buf[sizeof(utils_logs_record_t) + UTILS_LOGS_TRACE_MAX_SIZE];
+    utils_logs_record_t record;
+    int len;
+
+    len = vsnprintf(buf + sizeof(record), UTILS_LOGS_TRACE_MAX_SIZE, format, args);
+    if(len < 0)
+        return;
+    if(len >= UTILS_LOGS_TRACE_MAX_SIZE)
+        len = UTILS_LOGS_TRACE_MAX_SIZE - 1; // Truncated
+
+    record.size = (uint32_t)(sizeof(record) + len);
+    record.lineNo = lineNo;
+    record.utils_logs_level = utils_logs_level;
+    record.fileName = fileName;
+    record.utils_logs_site = NULL;
+    memcpy(buf, &record, sizeof(record));
+    ring_write(ring, buf, record.size);
+}
+
+
+/// Producer side of the call-site traces (hot path): only the raw arguments are appended to the thread ring; the
+/// back-end formats them.
+static void ring_push_site(utils_logs_ring_t *ring, utils_logs_site_t *utils_logs_site, va_list args)
+{
+    static thread_local char buf[sizeof(utils_logs_record_t) + UTILS_LOGS_TRACE_MAX_SIZE];
+    utils_logs_record_t record;
+    char *p;
+
+    if(__atomic_load_n(&utils_logs_site->id, __ATOMIC_ACQUIRE) == 0 && site_register(utils_logs_site) == 0)
+    {
+        ring->dropped.store(ring->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    p = args_encode((const arg_sig_t*)utils_logs_site->args, buf + sizeof(record), buf + sizeof(buf), args);
+
+    record.size = (uint32_t)(p - buf);
+    record.lineNo = utils_logs_site->lineNo;
+    record.utils_logs_level = utils_logs_site->utils_logs_level;
+    record.fileName = NULL;
+    record.utils_logs_site = utils_logs_site;
+    memcpy(buf, &record, sizeof(record));
+    ring_write(ring, buf, record.size);
+}
+
+
+/// Consumer side: write out all the traces queued in the ring.
+/// @return 'true' if any trace was written.
+static bool ring_drain(utils_logs_ring_t *ring)
+{
+    static thread_local char text[UTILS_LOGS_TRACE_MAX_SIZE];
+    static thread_local std::string msg;
+    uint64_t head, tail;
+
+    head = ring->head.load(std::memory_order_relaxed);
+    tail = ring->tail.load(std::memory_order_acquire);
+    if(head == tail)
+        return false;
+
+    while(head != tail)
+    {
+        utils_logs_record_t record;
+        size_t len;
+
+        ring_copy_out(ring, head, &record, sizeof(record));
+        len = record.size - sizeof(record);
+        ring_copy_out(ring, head + sizeof(record), text, len);
+        if(record.utils_logs_site != NULL)
+        {
+            const char *filePath = record.utils_logs_site->filePath, *fileName = strrchr(filePath, '/');
+
+            msg.clear();
+            decode_message(record.utils_logs_site->format, text, text + len, msg);
+            printf("%s%s-%d: %s%s", level_color(record.utils_logs_level),
+                    fileName != NULL ? fileName + 1 : filePath, record.lineNo, msg.c_str(), CNRM);
+        }
+        else
+        {
+            printf("%s%s-%d: %.*s%s", level_color(record.utils_logs_level), record.fileName, record.lineNo,
+                    (int)len, text, CNRM);
+        }
+        head += record.size;
+    }
+    ring->head.store(head, std::memory_order_release);
+    return true;
+}
+
+
+/// Drain all the rings, free the ones orphaned by exited threads, and report new drops.
+static void async_drain(utils_logs_async_t *async)
+{
+    std::vector<utils_logs_ring_t*> rings;
+    uint64_t dropped;
+    bool flag_written = false;
+
+    {
+        std::lock_guard<std::mutex> lock(async->mutex);
+        rings = async->rings;
+    }
+
+    for(utils_logs_ring_t *ring : rings)
+        flag_written |= ring_drain(ring);
+
+    // A ring only referenced by the instance belongs to an exited thread: once drained it can go
+    std::lock_guard<std::mutex> lock(async->mutex);
+    for(size_t i = 0; i < async->rings.size();)
+    {
+        utils_logs_ring_t *ring = async->rings[i];
+
+        if(ring->refs.load(std::memory_order_acquire) == 1 &&
+                ring->head.load(std::memory_order_relaxed) == ring->tail.load(std::memory_order_acquire))
+        {
+            async->dropped_retired += ring->dropped.load(std::memory_order_relaxed);
+            async->rings[i] = async->rings.back();
+            async->rings.pop_back();
+            ring_release(ring);
+            continue;
+        }
+        i++;
+    }
+
+    dropped = async->dropped_retired;
+    for(utils_logs_ring_t *ring : async->rings)
+        dropped += ring->dropped.load(std::memory_order_relaxed);
+    if(dropped != async->dropped_reported)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+        if(async->flag_exit || now - async->last_report >= std::chrono::seconds(ASYNC_DROP_REPORT_PERIOD_SECS))
+        {
+            printf("%s%s-%d: %llu trace messages dropped (log rings full)\n%s", CYEL, __FILENAME__, __LINE__,
+                    (unsigned long long)(dropped - async->dropped_reported), CNRM);
+            async->dropped_reported = dropped;
+            async->last_report = now;
+            flag_written = true;
+        }
+    }
+
+    // Flush once per batch rather than once per trace
+    if(flag_written)
+        fflush(stdout);
+}
+
+
+/// Back-end thread: periodically drain the rings until the instance is closed.
+static void async_thr(utils_logs_async_t *async)
+{
+    std::unique_lock<std::mutex> lock(async->mutex);
+    std::chrono::steady_clock::time_point last_flush = std::chrono::steady_clock::now();
+
+    while(!async->flag_exit)
+    {
+        async->cond.wait_for(lock, std::chrono::milliseconds(ASYNC_DRAIN_PERIOD_MSECS));
+        lock.unlock();
+        if(std::chrono::steady_clock::now() - last_flush >= std::chrono::milliseconds(ASYNC_RL_FLUSH_PERIOD_MSECS))
+        {
+            sites_flush_suppressed(async->utils_logs_ctx);
+            last_flush = std::chrono::steady_clock::now();
+        }
+        async_drain(async);
+        lock.lock();
+    }
+    lock.unlock();
+
+    // Final drain: nothing is lost on close
+    async_drain(async);
+}
+
+
+/// Parse the next printf conversion specification of a format.
+/// @return Pointer past the specification, or NULL if there are no more.
+static const char* format_next_spec(const char *p, arg_spec_t *spec)
+{
+    int l_count = 0;
+    char length = 0; // Length modifier other than 'l'
+
+    while(*p != 0 && *p != '%')
+        p++;
+    if(*p == 0)
+        return NULL;
+
+    spec->start = p++;
+    spec->flag_width_star = false;
+    spec->flag_prec_star = false;
+    spec->prec = -1;
+
+    while(*p != 0 && strchr("-+ #0'", *p) != NULL)
+        p++;
+    if(*p == '*')
+    {
+        spec->flag_width_star = true;
+        p++;
+    }
+    while(*p >= '0' && *p <= '9')
+        p++;
+    if(*p == '.')
+    {
+        p++;
+        if(*p == '*')
+        {
+            spec->flag_prec_star = true;
+            p++;
+        }
+        else
+        {
+            spec->prec = 0;
+            while(*p >= '0' && *p <= '9')
+                spec->prec = spec->prec * 10 + (*p++ - '0');
+        }
+    }
+    while(*p != 0 && strchr("hlzjtLq", *p) != NULL)
+    {
+        if(*p == 'l')
+            l_count++;
+        else
+            length = *p;
+        p++;
+    }
+
+    switch(*p)
+    {
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+        if(l_count >= 2 || length == 'q' || length == 'L')
+            spec->arg_type = ARG_LLONG;
+        else if(l_count == 1)
+            spec->arg_type = ARG_LONG;
+        else if(length == 'z')
+            spec->arg_type = ARG_SIZE;
+        else if(length == 'j')
+            spec->arg_type = ARG_INTMAX;
+        else if(length == 't')
+            spec->arg_type = ARG_PTRDIFF;
+        else
+            spec->arg_type = ARG_INT; // 'h', 'hh' and 'c' are promoted
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        spec->arg_type = length == 'L' ? ARG_LDOUBLE : ARG_DOUBLE;
+        break;
+    case 's':
+        spec->arg_type = ARG_STR;
+        break;
+    case 'p': case 'n':
+        spec->arg_type = ARG_PTR;
+        break;
+    case 0:
+        spec->arg_type = ARG_NONE; // Truncated specification: printed as is
+        spec->end = p;
+        return p;
+    default:
+        spec->arg_type = ARG_NONE; // '%%' (or unknown: no argument assumed)
+        break;
+    }
+    spec->end = ++p;
+    return p;
+}
+
+
+/// Assign the call site its process-wide identifier and parse its argument signature (first trace only).
+/// @return Call-site identifier, or zero if too many sites.
+static uint32_t site_register(utils_logs_site_t *utils_logs_site)
+{
+    std::lock_guard<std::mutex> lock(sites_register_mutex);
+    arg_sig_t *arg_sig;
+    arg_spec_t spec;
+    const char *p;
+    int num = 0;
+
+    if(utils_logs_site->id != 0)
+        return utils_logs_site->id; // Registered meanwhile by another thread
+    if(sites_num + 1 >= BINARY_SITES_MAX)
+        return 0;
+
+    for(p = utils_logs_site->format; (p = format_next_spec(p, &spec)) != NULL;)
+        num++;
+    arg_sig = (arg_sig_t*)malloc(sizeof(arg_sig_t) + num * sizeof(arg_spec_t));
+    if(arg_sig == NULL)
+        return 0;
+    arg_sig->num = 0;
+    for(p = utils_logs_site->format; (p = format_next_spec(p, &arg_sig->specs[arg_sig->num])) != NULL;)
+        arg_sig->num++;
+
+    // The signature is never released: sites live as long as the process
+    utils_logs_site->args = arg_sig;
+    __atomic_store_n(&utils_logs_site->id, ++sites_num, __ATOMIC_RELEASE);
+    return utils_logs_site->id;
+}
+
+
+/// Reserve room for a record in the binary file.
+/// @return Record address, or NULL if the file is full (the trace is dropped).
+static inline char* binary_reserve(utils_logs_binary_t *binary, uint32_t size)
+{
+    uint64_t offset = binary->tail.fetch_add(size, std::memory_order_relaxed);
+
+    if(offset + size > binary->map_size)
+    {
+        binary->dropped.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+    __atomic_store_n(&((utils_logs_binary_rec_t*)(binary->map + offset))->size, size | BINARY_PENDING_FLAG,
+            __ATOMIC_RELAXED);
+    return binary->map + offset;
+}
+
+
+/// Publish a record written in the binary file: its size is written last (clearing 'BINARY_PENDING_FLAG').
+static inline void binary_commit(char *rec, uint32_t size)
+{
+    __atomic_store_n(&((utils_logs_binary_rec_t*)rec)->size, size, __ATOMIC_RELEASE);
+}
+
+
+/// Store the call-site description in the binary file (first trace of the site to this instance only).
+static void binary_store_site(utils_logs_binary_t *binary, utils_logs_site_t *utils_logs_site, uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(binary->sites_mutex);
+    utils_logs_binary_rec_t hdr;
+    const char *fileName, *funcName;
+    size_t file_len, func_len, format_len;
+    uint32_t size;
+    int32_t fields[2];
+    char *rec, *p;
+
+    if(binary->sites_stored[id].load(std::memory_order_relaxed))
+        return;
+
+    fileName = strrchr(utils_logs_site->filePath, '/');
+    fileName = fileName != NULL ? fileName + 1 : utils_logs_site->filePath;
+    funcName = utils_logs_site->funcName != NULL ? utils_logs_site->funcName : "";
+    file_len = strlen(fileName) + 1;
+    func_len = strlen(funcName) + 1;
+    format_len = strlen(utils_logs_site->format) + 1;
+
+    size = (uint32_t)((sizeof(hdr) + sizeof(fields) + file_len + func_len + format_len + 7) & ~(size_t)7);
+    if((rec = binary_reserve(binary, size)) == NULL)
+        return; // File full: the traces of this site are dropped as well
+
+    hdr.id = id | BINARY_SITE_FLAG;
+    hdr.tstamp_nsecs = 0;
+    fields[0] = (int32_t)utils_logs_site->utils_logs_level;
+    fields[1] = (int32_t)utils_logs_site->lineNo;
+    p = rec + sizeof(hdr.size);
+    memcpy(p, &hdr.id, sizeof(hdr) - sizeof(hdr.size));
+    p = rec + sizeof(hdr);
+    memcpy(p, fields, sizeof(fields));
+    p += sizeof(fields);
+    memcpy(p, fileName, file_len);
+    p += file_len;
+    memcpy(p, funcName, func_len);
+    p += func_len;
+    memcpy(p, utils_logs_site->format, format_len);
+    binary_commit(rec, size);
+
+    binary->sites_stored[id].store(1, std::memory_order_release);
+}
+
+
+static inline uint64_t binary_tstamp_nsecs()
+{
+    // TSC based when available (calibrated on first use otherwise)
+    return utils_gettime_tsc_nsecs();
+}
+
+
+/// Append a string argument ('len' bytes at most) to a record being encoded.
+static inline char* binary_encode_str(char *p, const char *end, const char *str, size_t len)
+{
+    uint32_t len32;
+
+    if(str == NULL)
+    {
+        len32 = UINT32_MAX;
+        memcpy(p, &len32, sizeof(len32));
+        return p + sizeof(len32);
+    }
+    if(len > (size_t)(end - p) - sizeof(len32))
+        len = (size_t)(end - p) - sizeof(len32); // Truncated
+    len32 = (uint32_t)len;
+    memcpy(p, &len32, sizeof(len32));
+    memcpy(p + sizeof(len32), str, len);
+    return p + sizeof(len32) + len;
+}
+
+
+/// Encode the raw arguments of a call-site trace (see 'utils_logs_binary_rec_t'), as many as fit before 'end'.
+/// @return Pointer past the encoded arguments.
+static char* args_encode(const arg_sig_t *arg_sig, char *p, const char *end, va_list args)
+{
+    // Largest encoding of a single argument, string length excluded
+    static const size_t arg_max_size = 3 * sizeof(uint64_t) + sizeof(long double);
+
+    for(int i = 0; i < arg_sig->num; i++)
+    {
+        const arg_spec_t *spec = &arg_sig->specs[i];
+        int prec = spec->prec;
+        int64_t value;
+
+        if(spec->arg_type == ARG_NONE)
+            continue;
+        if((size_t)(end - p) < arg_max_size)
+            break; // No room left: the decoder prints the missing arguments as '?'
+        if(spec->flag_width_star)
+        {
+            value = va_arg(args, int);
+            memcpy(p, &value, sizeof(value));
+            p += sizeof(value);
+        }
+        if(spec->flag_prec_star)
+        {
+            value = prec = va_arg(args, int);
+            memcpy(p, &value, sizeof(value));
+            p += sizeof(value);
+        }
+
+        switch(spec->arg_type)
+        {
+        case ARG_INT:
+            value = va_arg(args, int);
+            break;
+        case ARG_LONG:
+            value = va_arg(args, long);
+            break;
+        case ARG_LLONG:
+            value = va_arg(args, long long);
+            break;
+        case ARG_SIZE:
+            value = (int64_t)va_arg(args, size_t);
+            break;
+        case ARG_INTMAX:
+            value = va_arg(args, intmax_t);
+            break;
+        case ARG_PTRDIFF:
+            value = va_arg(args, ptrdiff_t);
+            break;
+        case ARG_PTR:
+            value = (int64_t)(uintptr_t)va_arg(args, void*);
+            break;
+        case ARG_DOUBLE:
+        {
+            double d = va_arg(args, double);
+            memcpy(p, &d, sizeof(d));
+            p += sizeof(d);
+            continue;
+        }
+        case ARG_LDOUBLE:
+        {
+            long double ld = va_arg(args, long double);
+            memcpy(p, &ld, sizeof(ld));
+            p += sizeof(ld);
+            continue;
+        }
+        case ARG_STR:
+        {
+            // With a precision, the string is not required to be NULL-terminated
+            const char *str = va_arg(args, const char*);
+            p = binary_encode_str(p, end, str,
+                    str == NULL ? 0 : (prec >= 0 ? strnlen(str, (size_t)prec) : strlen(str)));
+            continue;
+        }
+        default:
+            continue;
+        }
+        memcpy(p, &value, sizeof(value));
+        p += sizeof(value);
+    }
+
+    return p;
+}
+
+
+/// Hot path of the binary back-end: encode the raw arguments and append the record. No formatting takes place.
+static void binary_trace(utils_logs_binary_t *binary, utils_logs_site_t *utils_logs_site, va_list args)
+{
+    static thread_local char buf[sizeof(utils_logs_binary_rec_t) + UTILS_LOGS_TRACE_MAX_SIZE];
+    const char *end = buf + sizeof(buf);
+    const arg_sig_t *arg_sig;
+    utils_logs_binary_rec_t hdr;
+    uint32_t id, size;
+    char *p, *rec;
+
+    id = __atomic_load_n(&utils_logs_site->id, __ATOMIC_ACQUIRE);
+    if(id == 0 && (id = site_register(utils_logs_site)) == 0)
+    {
+        binary->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if(!binary->sites_stored[id].load(std::memory_order_acquire))
+        binary_store_site(binary, utils_logs_site, id);
+    arg_sig = (const arg_sig_t*)utils_logs_site->args;
+
+    hdr.id = id;
+    hdr.tstamp_nsecs = binary_tstamp_nsecs();
+    memcpy(buf + sizeof(hdr.size), &hdr.id, sizeof(hdr) - sizeof(hdr.size));
+    p = args_encode(arg_sig, buf + sizeof(hdr), end, args);
+
+    size = (uint32_t)((p - buf + 7) & ~(ptrdiff_t)7);
+    if((rec = binary_reserve(binary, size)) == NULL)
+        return;
+    memcpy(rec + sizeof(hdr.size), buf + sizeof(hdr.size), (size_t)(p - buf) - sizeof(hdr.size));
+    binary_commit(rec, size);
+}
+
+
+/// Binary back-end path of the traces not issued from a call site: they are formatted and stored as text.
+static void binary_trace_text(utils_logs_binary_t *binary, utils_logs_level_t utils_logs_level,
+        const char *fileName, int lineNo, const char *format, va_list args)
+{
+    static thread_local char text[UTILS_LOGS_TRACE_MAX_SIZE];
+    utils_logs_binary_rec_t hdr;
+    size_t file_len, text_len;
+    uint32_t size;
+    int32_t fields[2];
+    char *rec, *p;
+    int len;
+
+    if((len = vsnprintf(text, sizeof(text), format, args)) < 0)
+        return;
+    text_len = (size_t)len < sizeof(text) ? (size_t)len : sizeof(text) - 1;
+    file_len = strlen(fileName) + 1;
+
+    size = (uint32_t)((sizeof(hdr) + sizeof(fields) + file_len + text_len + 1 + 7) & ~(size_t)7);
+    if((rec = binary_reserve(binary, size)) == NULL)
+        return;
+
+    hdr.id = BINARY_TEXT_ID;
+    hdr.tstamp_nsecs = binary_tstamp_nsecs();
+    fields[0] = (int32_t)utils_logs_level;
+    fields[1] = (int32_t)lineNo;
+    memcpy(rec + sizeof(hdr.size), &hdr.id, sizeof(hdr) - sizeof(hdr.size));
+    p = rec + sizeof(hdr);
+    memcpy(p, fields, sizeof(fields));
+    p += sizeof(fields);
+    memcpy(p, fileName, file_len);
+    p += file_len;
+    memcpy(p, text, text_len);
+    p[text_len] = 0;
+    binary_commit(rec, size);
+}
+
+
+/// Call-site description, as read back from a binary file
+typedef struct decode_site_s
+{
+    bool flag_valid;
+    utils_logs_level_t utils_logs_level;
+    int lineNo;
+    const char *fileName;
+    const char *format;
+} decode_site_t;
+
+
+/// Append a formatted value to a string.
+static void decode_append(std::string &str, const char *format, ...)
+{
+    char buf[256];
+    va_list args, args_copy;
+    int len;
+
+    va_start(args, format);
+    va_copy(args_copy, args);
+    len = vsnprintf(buf, sizeof(buf), format, args);
+    if(len >= 0 && (size_t)len < sizeof(buf))
+    {
+        str.append(buf, (size_t)len);
+    }
+    else if(len >= 0)
+    {
+        std::vector<char> big((size_t)len + 1);
+        vsnprintf(big.data(), big.size(), format, args_copy);
+        str.append(big.data(), (size_t)len);
+    }
+    va_end(args_copy);
     va_end(args);
-    return;
 }
 
 
-void utils_logs_close_uptr(utils_logs_ctx_t *p)
+/// Read a fixed-size argument of a trace record.
+/// @return 'false' if the record is exhausted.
+static inline bool decode_read(const char **p, const char *end, void *value, size_t size)
 {
-    utils_logs_close(&p);
+    if((size_t)(end - *p) < size)
+        return false;
+    memcpy(value, *p, size);
+    *p += size;
+    return true;
 }
 
 
-void* utils_logs_show_opaque_logger(utils_logs_ctx_t *utils_logs_ctx)
+/// Render the message of a trace record from its call-site format and its raw arguments.
+static void decode_message(const char *format, const char *p, const char *end, std::string &msg)
 {
-    return utils_logs_ctx->opaque_logger_ctx_ptr;
+    arg_spec_t spec;
+    const char *last = format;
+
+    while(format_next_spec(last, &spec) != NULL)
+    {
+        std::string spec_str;
+        int64_t value;
+        bool flag_ok = true;
+
+        msg.append(last, (size_t)(spec.start - last));
+        last = spec.end;
+
+        if(spec.arg_type == ARG_NONE)
+        {
+            if(spec.end - spec.start == 2 && spec.start[1] == '%')
+                msg.push_back('%');
+            else
+                msg.append(spec.start, (size_t)(spec.end - spec.start));
+            continue;
+        }
+
+        // Substitute the '*' width/precision by their recorded values
+        for(const char *c = spec.start; c < spec.end && flag_ok; c++)
+        {
+            if(*c != '*')
+            {
+                spec_str.push_back(*c);
+                continue;
+            }
+            flag_ok = decode_read(&p, end, &value, sizeof(value));
+            if(flag_ok)
+                spec_str += std::to_string(value);
+        }
+
+        switch(spec.arg_type)
+        {
+        case ARG_INT:
+            if((flag_ok = flag_ok && decode_read(&p, end, &value, sizeof(value))))
+                decode_append(msg, spec_str.c_str(), (int)value);
+            break;
+        case ARG_LONG:
+            if((flag_ok = flag_ok && decode_read(&p, end, &value, sizeof(value))))
+                decode_append(msg, spec_str.c_str(), (long)value);
+            break;
+        case ARG_LLONG:
+            if((flag_ok = flag_ok && decode_read(&p, end, &value, sizeof(value))))
+                decode_append(msg, spec_str.c_str(), (long long)value);
+            break;
+        case ARG_SIZE:
+            if((flag_ok = flag_ok && decode_read(&p, end, &value, sizeof(value))))
+                decode_append(msg, spec_str.c_str(), (size_t)value);
+            break;
+        case ARG_INTMAX:
+            if((flag_ok = flag_ok && decode_read(&p, end, &value, sizeof(value))))
+                decode_append(msg, spec_str.c_str(), (intmax_t)value);
+            break;
+        case ARG_PTRDIFF:
+            if((flag_ok = flag_ok && decode_read(&p, end, &value, sizeof(value))))
+                decode_append(msg, spec_str.c_str(), (ptrdiff_t)value);
+            break;
+        case ARG_PTR:
+            if((flag_ok = flag_ok && decode_read(&p, end, &value, sizeof(value))) && spec.end[-1] == 'p')
+                decode_append(msg, spec_str.c_str(), (void*)(uintptr_t)value);
+            break;
+        case ARG_DOUBLE:
+        {
+            double d;
+            if((flag_ok = flag_ok && decode_read(&p, end, &d, sizeof(d))))
+                decode_append(msg, spec_str.c_str(), d);
+            break;
+        }
+        case ARG_LDOUBLE:
+        {
+            long double ld;
+            if((flag_ok = flag_ok && decode_read(&p, end, &ld, sizeof(ld))))
+                decode_append(msg, spec_str.c_str(), ld);
+            break;
+        }
+        case ARG_STR:
+        {
+            uint32_t len;
+            if(!(flag_ok = flag_ok && decode_read(&p, end, &len, sizeof(len))))
+                break;
+            if(len == UINT32_MAX)
+            {
+                decode_append(msg, spec_str.c_str(), "(null)");
+                break;
+            }
+            if(!(flag_ok = (size_t)(end - p) >= len))
+                break;
+            decode_append(msg, spec_str.c_str(), std::string(p, len).c_str());
+            p += len;
+            break;
+        }
+        default:
+            break;
+        }
+        if(!flag_ok)
+            msg.push_back('?'); // Argument not recorded (record truncated)
+    }
+    msg.append(last);
+}
+
+
+/// @return Length of the hole at the given offset if the record there was reserved but never committed, zero
+/// otherwise. A record flagged pending is a hole if its reserved length is consistent. A zero size is a hole if the
+/// writer died between the reservation and the pending size store: its room is then left zeroed, and the hole lasts
+/// up to the next written record (if there is none, the zero size is the end of the records instead).
+static size_t decode_hole(const char *map, size_t offset, size_t limit)
+{
+    uint32_t size;
+
+    memcpy(&size, map + offset, sizeof(size));
+    if(size == 0)
+    {
+        for(size_t next = offset + 8; next + sizeof(utils_logs_binary_rec_t) <= limit; next += 8)
+        {
+            memcpy(&size, map + next, sizeof(size));
+            if(size != 0)
+                return next - offset;
+        }
+        return 0;
+    }
+    if(!(size & BINARY_PENDING_FLAG))
+        return 0;
+    size &= ~BINARY_PENDING_FLAG;
+    return (size >= sizeof(utils_logs_binary_rec_t) && (size & 7) == 0 && size <= limit - offset) ? size : 0;
+}
+
+
+long utils_logs_binary_decode(const char *path, FILE *out)
+{
+    static const char *level_tags[UTILS_LOGS_LEVEL_ENUM_MAX] = {"DBG", "WAR", "ERR"};
+    std::vector<decode_site_t> sites;
+    const utils_logs_binary_hdr_t *hdr;
+    struct stat st;
+    char *map = (char*)MAP_FAILED;
+    size_t limit, hole;
+    long traces = -1;
+    int fd;
+
+    if(path == NULL || out == NULL)
+        return -1;
+
+    if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return -1;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(utils_logs_binary_hdr_t))
+        goto end;
+    map = (char*)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED)
+        goto end;
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    hdr = (const utils_logs_binary_hdr_t*)map;
+    if(memcmp(hdr->magic, BINARY_MAGIC, sizeof(hdr->magic)) != 0 || hdr->version != BINARY_VERSION ||
+            hdr->hdr_size < sizeof(utils_logs_binary_hdr_t))
+        goto end;
+
+    // A zero used size means the process did not close the file: decode up to the last complete record
+    limit = (size_t)st.st_size;
+    if(hdr->used_size != 0 && hdr->used_size < limit)
+        limit = (size_t)hdr->used_size;
+
+    // First pass: call-site descriptions (each one precedes the traces of its site)
+    for(size_t offset = hdr->hdr_size; offset + sizeof(utils_logs_binary_rec_t) <= limit;)
+    {
+        utils_logs_binary_rec_t rec;
+        const char *p, *end;
+        int32_t fields[2];
+        uint32_t id;
+
+        if((hole = decode_hole(map, offset, limit)) != 0)
+        {
+            offset += hole;
+            continue;
+        }
+        memcpy(&rec, map + offset, sizeof(rec));
+        if(rec.size < sizeof(rec) || rec.size > limit - offset)
+            break;
+        p = map + offset + sizeof(rec);
+        end = map + offset + rec.size;
+        offset += rec.size;
+        if(!(rec.id & BINARY_SITE_FLAG))
+            continue;
+
+        id = rec.id & ~BINARY_SITE_FLAG;
+        if(id >= BINARY_SITES_MAX || !decode_read(&p, end, fields, sizeof(fields)) ||
+                fields[0] < 0 || fields[0] >= UTILS_LOGS_LEVEL_ENUM_MAX ||
+                memchr(p, 0, (size_t)(end - p)) == NULL)
+            continue;
+        if(sites.size() <= id)
+            sites.resize(id + 1, decode_site_t());
+
+        sites[id].utils_logs_level = (utils_logs_level_t)fields[0];
+        sites[id].lineNo = fields[1];
+        sites[id].fileName = p;
+        p += strlen(p) + 1; // Function name follows (not rendered)
+        if(p >= end || memchr(p, 0, (size_t)(end - p)) == NULL)
+            continue;
+        p += strlen(p) + 1;
+        if(p >= end || memchr(p, 0, (size_t)(end - p)) == NULL)
+            continue;
+        sites[id].format = p;
+        sites[id].flag_valid = true;
+    }
+
+    // Second pass: traces
+    traces = 0;
+    for(size_t offset = hdr->hdr_size; offset + sizeof(utils_logs_binary_rec_t) <= limit;)
+    {
+        utils_logs_binary_rec_t rec;
+        utils_logs_level_t utils_logs_level;
+        const char *p, *end, *fileName;
+        std::string msg;
+        char date[32];
+        struct tm tm;
+        time_t secs;
+        int lineNo;
+
+        if((hole = decode_hole(map, offset, limit)) != 0)
+        {
+            fprintf(out, "<hole: %zu bytes at offset %zu, record reserved but never committed>\n", hole, offset);
+            offset += hole;
+            continue;
+        }
+        memcpy(&rec, map + offset, sizeof(rec));
+        if(rec.size < sizeof(rec) || rec.size > limit - offset)
+            break;
+        p = map + offset + sizeof(rec);
+        end = map + offset + rec.size;
+        offset += rec.size;
+        if(rec.id & BINARY_SITE_FLAG)
+            continue;
+
+        if(rec.id == BINARY_TEXT_ID)
+        {
+            int32_t fields[2];
+
+            if(!decode_read(&p, end, fields, sizeof(fields)) || fields[0] < 0 ||
+                    fields[0] >= UTILS_LOGS_LEVEL_ENUM_MAX || memchr(p, 0, (size_t)(end - p)) == NULL)
+                continue;
+            utils_logs_level = (utils_logs_level_t)fields[0];
+            lineNo = fields[1];
+            fileName = p;
+            p += strlen(p) + 1;
+            if(p >= end || memchr(p, 0, (size_t)(end - p)) == NULL)
+                continue;
+            msg = p;
+        }
+        else
+        {
+            if(rec.id >= sites.size() || !sites[rec.id].flag_valid)
+                continue; // Description lost (e.g. file full)
+            utils_logs_level = sites[rec.id].utils_logs_level;
+            lineNo = sites[rec.id].lineNo;
+            fileName = sites[rec.id].fileName;
+            decode_message(sites[rec.id].format, p, end, msg);
+        }
+
+        secs = (time_t)(rec.tstamp_nsecs / 1000000000ull);
+        localtime_r(&secs, &tm);
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+        fprintf(out, "%s.%06u %s %s-%d: %s%s", date, (unsigned)(rec.tstamp_nsecs % 1000000000ull / 1000),
+                level_tags[utils_logs_level], fileName, lineNo, msg.c_str(),
+                (msg.empty() || msg.back() != '\n') ? "\n" : "");
+        traces++;
+    }
+
+end:
+    if(map != MAP_FAILED)
+        munmap(map, (size_t)st.st_size);
+    close(fd);
+    return traces;
 }
@@ -43,12 +43,22 @@ extern "C" {
 #endif
 
 #include <stdarg.h> //va_list
+#include <stddef.h> //size_t
+#include <stdint.h> //uint64_t
+#include <stdio.h> //FILE
 #include <string.h> //strrchr
 
 // **** Definitions ****
 
 #define UTILS_LOGS_TRACE_MAX_SIZE 4096
 
+/// Compile-time tracing threshold: call sites of a lower level (0: debug, 1: warning; errors are always kept) are
+/// compiled out entirely, arguments included. It may be defined on the compiler command line (e.g.
+/// '-DUTILS_LOGS_LEVEL_MIN=1' to drop the LOGD() call sites).
+#ifndef UTILS_LOGS_LEVEL_MIN
+#define UTILS_LOGS_LEVEL_MIN 0
+#endif
+
 // Forward declarations
 typedef struct utils_logs_ctx_s utils_logs_ctx_t;
 
@@ -63,6 +73,25 @@ typedef enum utils_logs_level_enum {
 /// Source code file-name without path
 #define __FILENAME__ strrchr("/" __FILE__, '/') + 1
 
+/// Static description of a tracing call site: each LOG[D/W/E...]() occurrence defines one (see '_LOG()'), so that
+/// the file, line, function and format strings are not passed on each call.
+/// The members following 'format' are private to this module (binary identifier and rate limiting state); they must
+/// be initialized to zero.
+typedef struct utils_logs_site_s {
+    utils_logs_level_t utils_logs_level;
+    const char *filePath; ///< '__FILE__' (the path is stripped when tracing)
+    int lineNo;
+    const char *funcName;
+    const char *format;
+    uint32_t id;
+    const void *args;
+    uint64_t rl_window_msecs;
+    uint32_t rl_count;
+    uint64_t rl_pending;
+    utils_logs_ctx_t *rl_ctx;
+    struct utils_logs_site_s *rl_next;
+} utils_logs_site_t;
+
 /// Externally defined logging callback type
 typedef void (*utils_logs_ext_trace_fxn_t)(void *opaque_logger_ctx_ptr,
         utils_logs_level_t utils_logs_level, const char *fileName,
@@ -81,7 +110,33 @@ typedef void (*utils_logs_ext_trace_fxn_t)(void *opaque_logger_ctx_ptr,
 utils_logs_ctx_t* utils_logs_open(void *const opaque_logger_ctx_ptr,
         utils_logs_ext_trace_fxn_t utils_logs_ext_trace_fxn);
 
-/// Release an instance of this module, obtained by a previously call to 'utils_logs_open()'.
+/// Creates an instance of this module that traces to STDOUT asynchronously.
+/// Each calling thread queues its traces into its own lock-free ring, and a background thread formats, colours and
+/// writes them out in batches. The LOG[D/W/E...]() call sites queue their raw arguments only (as binary log records
+/// do, see 'utils_logs_open_binary()'), so the caller does no formatting at all; direct 'utils_logs_trace()' calls
+/// are still formatted by the caller. When a thread ring is full its new traces are dropped (and counted) rather
+/// than blocking the caller; the drops are reported periodically on STDOUT (see also 'utils_logs_dropped()').
+/// @param ring_size Size [bytes] of each per-thread ring (rounded up to a power of two); zero selects the default
+/// (64 KiB).
+/// @return Pointer to the new module instance context structure (handler) created.
+utils_logs_ctx_t* utils_logs_open_async(size_t ring_size);
+
+/// Creates an instance of this module that traces to a binary log file.
+/// No formatting takes place when tracing: each trace is stored as a record holding the call-site identifier, a
+/// time-stamp and the raw arguments (strings are copied), appended lock-free to the memory-mapped file. The
+/// call-site descriptions (level, file, line, function and format) are stored once in the same file. The file is
+/// rendered offline with 'utils_logs_binary_decode()' (see the 'utils-logs-decode' application).
+/// When the file is full the new traces are dropped and counted (see 'utils_logs_dropped()'). The records
+/// already stored survive a crash of the process.
+/// @param path Binary log file path (truncated if it exists).
+/// @param file_size Maximum size [bytes] of the file; zero selects the default (1 GiB). The file is sparse and is
+/// truncated to the actually used size on close.
+/// @return Pointer to the new module instance context structure (handler) created.
+utils_logs_ctx_t* utils_logs_open_binary(const char *path, size_t file_size);
+
+/// Release an instance of this module, obtained by a previously call to 'utils_logs_open()',
+/// 'utils_logs_open_async()' or 'utils_logs_open_binary()'. For the asynchronous instances, the traces still queued
+/// are written out before returning.
 /// @param Reference to the pointer to the module instance context structure (handler) to be released.
 void utils_logs_close(utils_logs_ctx_t **ref_utils_logs_ctx);
 
@@ -96,6 +151,12 @@ void utils_logs_close(utils_logs_ctx_t **ref_utils_logs_ctx);
 void utils_logs_trace(utils_logs_ctx_t *utils_logs_ctx, utils_logs_level_t utils_logs_level, const char *fileName,
         int lineNo, const char *funcName, const char *format, ...);
 
+/// Tracing function used by the LOG[D/W/E...]() MACROS.
+/// @param utils_logs_ctx
+/// @param utils_logs_site Static call-site description
+/// @param ...
+void utils_logs_trace_site(utils_logs_ctx_t *utils_logs_ctx, utils_logs_site_t *utils_logs_site, ...);
+
 /// Generic logger deleter for the smart pointers.
 /// @param p Pointer to the generic logger context structure to be deleted
 void utils_logs_close_uptr(utils_logs_ctx_t *p);
@@ -104,12 +165,58 @@ void utils_logs_close_uptr(utils_logs_ctx_t *p);
 /// @param utils_logs_ctx
 void* utils_logs_show_opaque_logger(utils_logs_ctx_t *utils_logs_ctx);
 
+/// Get the number of traces dropped so far because a thread ring was full.
+/// @param utils_logs_ctx
+/// @return Number of dropped traces (always zero for instances not opened with 'utils_logs_open_async()').
+uint64_t utils_logs_dropped(utils_logs_ctx_t *utils_logs_ctx);
+
+/// Rate-limit the traces of each call site: after 'burst' traces of a site within an interval, its further traces
+/// are not output but counted, and a single "suppressed N similar traces" line (with the site file, line and level)
+/// is output when the site traces again after the interval. Instances opened with 'utils_logs_open_async()' also
+/// output it from their back-end thread once the interval is over, if the site does not trace again; other
+/// instances output the pending counts of the silent sites on 'utils_logs_close()'.
+/// The rate limiting applies to the LOG[D/W/E...]() MACROS only (not to direct 'utils_logs_trace()' calls). This
+/// function is expected to be called right after opening the instance, before any tracing.
+/// @param utils_logs_ctx
+/// @param burst Number of traces allowed per call site and interval; zero disables rate limiting (default).
+/// @param interval_msecs Interval duration [msecs] (e.g. 1000).
+void utils_logs_set_rate_limit(utils_logs_ctx_t *utils_logs_ctx, uint32_t burst, uint32_t interval_msecs);
+
+/// Get the number of traces suppressed so far by the rate limiting (see 'utils_logs_set_rate_limit()').
+/// @param utils_logs_ctx
+/// @return Number of suppressed traces.
+uint64_t utils_logs_suppressed(utils_logs_ctx_t *utils_logs_ctx);
+
+/// Render a binary log file (see 'utils_logs_open_binary()') as text, one line per trace:
+/// '<date> <time.usecs> <level> <file>-<line>: <message>'.
+/// Files of crashed processes are rendered up to the last complete record. A record reserved but never committed
+/// (e.g. writer thread killed while storing it, even before its size was stored) is skipped and reported as a
+/// '<hole: ...>' line.
+/// @param path Binary log file path.
+/// @param out Output stream.
+/// @return Number of traces rendered, or -1 if the file could not be read or is not a binary log.
+long utils_logs_binary_decode(const char *path, FILE *out);
+
 // **** MACROS ****
 
-/// This is an internal MACRO, used by the logger MACROS LOG[D/W/E...]() for tracing.
+/// This is an internal MACRO, used by the logger MACROS LOG[D/W/E...]() for tracing. It defines the static call-site
+/// description, so only the context and the arguments are passed on each call.
 #define _LOG(LEVEL, FORMAT, ...) \
-        utils_logs_trace(__utils_logs_ctx, LEVEL, __FILENAME__, __LINE__, \
-                __FUNCTION__, FORMAT, ##__VA_ARGS__)
+        do { \
+            static utils_logs_site_t __utils_logs_site = {LEVEL, __FILE__, __LINE__, __FUNCTION__, FORMAT, 0, NULL, \
+                    0, 0, 0, NULL, NULL}; \
+            utils_logs_trace_site(__utils_logs_ctx, &__utils_logs_site, ##__VA_ARGS__); \
+        } while(0)
+
+/// This is an internal MACRO, used for the call sites below 'UTILS_LOGS_LEVEL_MIN': nothing is compiled in but the
+/// format and arguments are still type-checked.
+#define _LOG_DISCARD(FORMAT, ...) \
+        do { \
+            if(0) { \
+                (void)__utils_logs_ctx; \
+                printf(FORMAT, ##__VA_ARGS__); \
+            } \
+        } while(0)
 
 /// Logger initializer: this MACRO must be called in any function before using the LOG[D/W/E...]() MACROs. As can be
 /// seen, It just declare and initializes a "transparent" local pointer to the logger context structure
@@ -123,10 +230,18 @@ void* utils_logs_show_opaque_logger(utils_logs_ctx_t *utils_logs_ctx);
 #define LOG_CTX_GET() __utils_logs_ctx
 
 /// Logger Debug MACRO
+#if UTILS_LOGS_LEVEL_MIN > 0
+#define LOGD(FORMAT, ...) _LOG_DISCARD(FORMAT, ##__VA_ARGS__)
+#else
 #define LOGD(FORMAT, ...) _LOG(UTILS_LOGS_DBG, FORMAT, ##__VA_ARGS__)
+#endif
 
 /// Logger Warning MACRO
+#if UTILS_LOGS_LEVEL_MIN > 1
+#define LOGW(FORMAT, ...) _LOG_DISCARD(FORMAT, ##__VA_ARGS__)
+#else
 #define LOGW(FORMAT, ...) _LOG(UTILS_LOGS_WAR, FORMAT, ##__VA_ARGS__)
+#endif
 
 /// Logger Error MACRO
 #define LOGE(FORMAT, ...) _LOG(UTILS_LOGS_ERR, FORMAT, ##__VA_ARGS__)
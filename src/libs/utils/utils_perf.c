@@ -0,0 +1,617 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file utils_perf.c
+ * @author Rafael Antoniello
+ */
+
+#include "utils_perf.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "utils_logs.h"
+
+/* **** Definitions **** */
+
+/**
+ * Maximum number of threads we attach to.
+ * This maximum should never be achieved; it is just a security extreme bound.
+ */
+#define SAMPLER_FDS_MAX 4096
+
+/**
+ * Number of data pages of each sampling ring-buffer (must be a power of 2).
+ * The ring-buffer mapping takes one extra page for the control header.
+ */
+#define SAMPLER_DATA_PAGES 64
+
+/**
+ * Maximum call-chain depth we are able to handle.
+ */
+#define SAMPLER_MAX_STACK 127
+
+/**
+ * Sampling ring-buffer context structure (one per profiled thread).
+ */
+typedef struct sampler_ring_s {
+    int fd;
+    pid_t pid;
+    struct perf_event_mmap_page *mmap_page;
+    size_t mmap_size;
+    uint8_t *data;
+    size_t data_size;
+} sampler_ring_t;
+
+/**
+ * Sampler context structure.
+ */
+typedef struct utils_perf_sampler_ctx_s {
+    utils_logs_ctx_t *utils_logs_ctx;
+    sampler_ring_t *rings;
+    size_t rings_num;
+    struct pollfd *pollfds;
+    uint64_t lost_cnt;
+    /**
+     * Scratch buffer used to linearize records wrapping around the end of
+     * a ring-buffer.
+     */
+    uint8_t *scratch;
+} utils_perf_sampler_ctx_t;
+
+/**
+ * Counters attributes lookup table (indexed by 'utils_perf_counter_t').
+ * Field 'fallback_config' is tried when the primary event is not supported
+ * (zero if there is no alternative).
+ */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    uint64_t fallback_config;
+} counters_attr_lut[UTILS_PERF_COUNTER_ENUM_MAX]= {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, 0},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, 0},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL|
+            (PERF_COUNT_HW_CACHE_OP_READ<< 8)|
+            (PERF_COUNT_HW_CACHE_RESULT_MISS<< 16),
+            PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, 0},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, 0},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS, 0}
+};
+
+const char* utils_perf_counter_lut[UTILS_PERF_COUNTER_ENUM_MAX+ 1]= {
+    "cycles",
+    "instructions",
+    "LLC-misses",
+    "branch-misses",
+    "context-switches",
+    "cpu-migrations",
+    NULL
+};
+
+/**
+ * Counters context structure.
+ */
+typedef struct utils_perf_counters_ctx_s {
+    utils_logs_ctx_t *utils_logs_ctx;
+    /**
+     * Counter file descriptors, 'UTILS_PERF_COUNTER_ENUM_MAX' per monitored
+     * thread (set to -1 if the counter is not available).
+     */
+    int *fds;
+    size_t threads_num;
+} utils_perf_counters_ctx_t;
+
+/* **** Prototypes **** */
+
+static int sampler_ring_open(sampler_ring_t *ring, pid_t pid, pid_t tid,
+        uint32_t freq_hz, utils_logs_ctx_t *const utils_logs_ctx);
+static void sampler_ring_close(sampler_ring_t *ring);
+static int sampler_ring_drain(utils_perf_sampler_ctx_t *ctx,
+        sampler_ring_t *ring, utils_perf_sample_fxn_t sample_fxn,
+        void *opaque);
+static int counter_open(utils_perf_counter_t counter, pid_t tid,
+        int flag_inherit);
+
+/* **** Implementations **** */
+
+utils_perf_sampler_ctx_t* utils_perf_sampler_open(const pid_t *pids,
+        size_t pids_num, uint32_t freq_hz,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    size_t i;
+    int end_code= -1;
+    pid_t *tids= NULL;
+    utils_perf_sampler_ctx_t *ctx= NULL;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    /* Check arguments */
+    CHECK_DO(pids!= NULL && pids_num> 0, return NULL);
+    CHECK_DO(freq_hz> 0, return NULL);
+    // Parameter 'utils_logs_ctx' is allowed to be NULL.
+
+    /* Allocate context structure */
+    ctx= (utils_perf_sampler_ctx_t*)calloc(1, sizeof(
+            utils_perf_sampler_ctx_t));
+    CHECK_DO(ctx!= NULL, goto end);
+
+    /* **** Initialize context structure **** */
+
+    ctx->utils_logs_ctx= utils_logs_ctx;
+
+    ctx->rings= (sampler_ring_t*)calloc(SAMPLER_FDS_MAX,
+            sizeof(sampler_ring_t));
+    CHECK_DO(ctx->rings!= NULL, goto end);
+
+    ctx->scratch= (uint8_t*)malloc(SAMPLER_DATA_PAGES* getpagesize());
+    CHECK_DO(ctx->scratch!= NULL, goto end);
+
+    tids= (pid_t*)calloc(SAMPLER_FDS_MAX, sizeof(pid_t));
+    CHECK_DO(tids!= NULL, goto end);
+
+    /* Open one sampling event per thread of each process */
+    for(i= 0; i< pids_num; i++) {
+        int t, tids_num= utils_perf_get_tids(pids[i], tids, SAMPLER_FDS_MAX);
+        if(tids_num< 0) {
+            LOGW("Could not list threads of process %d\n", (int)pids[i]);
+            continue;
+        }
+        for(t= 0; t< tids_num && t< SAMPLER_FDS_MAX &&
+                ctx->rings_num< SAMPLER_FDS_MAX; t++) {
+            sampler_ring_t *ring= &ctx->rings[ctx->rings_num];
+            if(sampler_ring_open(ring, pids[i], tids[t], freq_hz,
+                    LOG_CTX_GET())!= 0)
+                continue;
+            ctx->rings_num++;
+        }
+    }
+    if(ctx->rings_num== 0) {
+        LOGE("Could not attach to any thread (check privileges and "
+                "'/proc/sys/kernel/perf_event_paranoid')\n");
+        goto end;
+    }
+
+    ctx->pollfds= (struct pollfd*)calloc(ctx->rings_num,
+            sizeof(struct pollfd));
+    CHECK_DO(ctx->pollfds!= NULL, goto end);
+    for(i= 0; i< ctx->rings_num; i++) {
+        ctx->pollfds[i].fd= ctx->rings[i].fd;
+        ctx->pollfds[i].events= POLLIN;
+    }
+
+    /* Enable all the events at once */
+    for(i= 0; i< ctx->rings_num; i++)
+        CHECK(ioctl(ctx->rings[i].fd, PERF_EVENT_IOC_ENABLE, 0)== 0);
+
+    end_code= 0;
+end:
+    if(tids!= NULL)
+        free(tids);
+    if(end_code!= 0)
+        utils_perf_sampler_close(&ctx);
+    return ctx;
+}
+
+void utils_perf_sampler_close(
+        utils_perf_sampler_ctx_t **ref_utils_perf_sampler_ctx)
+{
+    size_t i;
+    utils_perf_sampler_ctx_t *ctx;
+
+    if(ref_utils_perf_sampler_ctx== NULL ||
+            (ctx= *ref_utils_perf_sampler_ctx)== NULL)
+        return;
+
+    if(ctx->rings!= NULL) {
+        for(i= 0; i< ctx->rings_num; i++)
+            sampler_ring_close(&ctx->rings[i]);
+        free(ctx->rings);
+        ctx->rings= NULL;
+    }
+    if(ctx->pollfds!= NULL) {
+        free(ctx->pollfds);
+        ctx->pollfds= NULL;
+    }
+    if(ctx->scratch!= NULL) {
+        free(ctx->scratch);
+        ctx->scratch= NULL;
+    }
+
+    free(ctx);
+    *ref_utils_perf_sampler_ctx= NULL;
+}
+
+int utils_perf_sampler_poll(utils_perf_sampler_ctx_t *utils_perf_sampler_ctx,
+        int tout_msecs, utils_perf_sample_fxn_t sample_fxn, void *opaque)
+{
+    size_t i;
+    int samples_cnt= 0;
+    LOG_CTX_INIT(NULL);
+
+    /* Check arguments */
+    CHECK_DO(utils_perf_sampler_ctx!= NULL, return -1);
+    CHECK_DO(sample_fxn!= NULL, return -1);
+    // Parameter 'opaque' is allowed to be NULL.
+
+    LOG_CTX_SET(utils_perf_sampler_ctx->utils_logs_ctx);
+
+    /* Wait for any ring-buffer to reach its wake-up watermark */
+    if(poll(utils_perf_sampler_ctx->pollfds, utils_perf_sampler_ctx->rings_num,
+            tout_msecs)< 0 && errno!= EINTR) {
+        LOGE("Failure while executing 'poll()' (errno: %d)\n", errno);
+        return -1;
+    }
+
+    /* Drain everything available (not only the signaled ring-buffers) */
+    for(i= 0; i< utils_perf_sampler_ctx->rings_num; i++)
+        samples_cnt+= sampler_ring_drain(utils_perf_sampler_ctx,
+                &utils_perf_sampler_ctx->rings[i], sample_fxn, opaque);
+
+    return samples_cnt;
+}
+
+uint64_t utils_perf_sampler_lost(
+        utils_perf_sampler_ctx_t *utils_perf_sampler_ctx)
+{
+    return utils_perf_sampler_ctx!= NULL? utils_perf_sampler_ctx->lost_cnt: 0;
+}
+
+int utils_perf_get_tids(pid_t pid, pid_t *tids, size_t tids_max)
+{
+    DIR *dir;
+    struct dirent *entry;
+    char path[64];
+    int tids_num= 0;
+
+    if(tids== NULL)
+        return -1;
+
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+    if((dir= opendir(path))== NULL)
+        return -1;
+    while((entry= readdir(dir))!= NULL) {
+        char *endptr= NULL;
+        long tid= strtol(entry->d_name, &endptr, 10);
+        if(endptr== entry->d_name || *endptr!= '\0' || tid<= 0)
+            continue; // '.' and '..'
+        if((size_t)tids_num< tids_max)
+            tids[tids_num]= (pid_t)tid;
+        tids_num++;
+    }
+    closedir(dir);
+    return tids_num;
+}
+
+static int sampler_ring_open(sampler_ring_t *ring, pid_t pid, pid_t tid,
+        uint32_t freq_hz, utils_logs_ctx_t *const utils_logs_ctx)
+{
+    struct perf_event_attr attr;
+    long page_size= getpagesize();
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size= sizeof(attr);
+    attr.type= PERF_TYPE_SOFTWARE;
+    attr.config= PERF_COUNT_SW_CPU_CLOCK;
+    attr.freq= 1;
+    attr.sample_freq= freq_hz;
+    attr.sample_type= PERF_SAMPLE_TID| PERF_SAMPLE_CALLCHAIN;
+    attr.sample_max_stack= SAMPLER_MAX_STACK;
+    attr.disabled= 1;
+    attr.exclude_hv= 1;
+    attr.exclude_callchain_kernel= 0;
+    attr.watermark= 1;
+    attr.wakeup_watermark= (SAMPLER_DATA_PAGES* page_size)/ 4;
+
+    ring->fd= (int)syscall(__NR_perf_event_open, &attr, tid, -1, -1,
+            PERF_FLAG_FD_CLOEXEC);
+    if(ring->fd< 0 && (errno== EACCES || errno== EPERM)) {
+        /* Not allowed to profile the kernel; retry user-space only */
+        attr.exclude_kernel= 1;
+        attr.exclude_callchain_kernel= 1;
+        ring->fd= (int)syscall(__NR_perf_event_open, &attr, tid, -1, -1,
+                PERF_FLAG_FD_CLOEXEC);
+    }
+    if(ring->fd< 0) {
+        LOGW("Could not open perf event on thread %d (errno: %d)\n", (int)tid,
+                errno);
+        return -1;
+    }
+
+    ring->pid= pid;
+    ring->data_size= SAMPLER_DATA_PAGES* page_size;
+    ring->mmap_size= ring->data_size+ page_size;
+    ring->mmap_page= (struct perf_event_mmap_page*)mmap(NULL, ring->mmap_size,
+            PROT_READ| PROT_WRITE, MAP_SHARED, ring->fd, 0);
+    if(ring->mmap_page== MAP_FAILED) {
+        LOGE("Could not map perf ring-buffer (errno: %d)\n", errno);
+        ring->mmap_page= NULL;
+        close(ring->fd);
+        ring->fd= -1;
+        return -1;
+    }
+    ring->data= (uint8_t*)ring->mmap_page+ page_size;
+    return 0;
+}
+
+static void sampler_ring_close(sampler_ring_t *ring)
+{
+    if(ring->fd>= 0)
+        ioctl(ring->fd, PERF_EVENT_IOC_DISABLE, 0);
+    if(ring->mmap_page!= NULL) {
+        munmap(ring->mmap_page, ring->mmap_size);
+        ring->mmap_page= NULL;
+    }
+    if(ring->fd>= 0) {
+        close(ring->fd);
+        ring->fd= -1;
+    }
+}
+
+static int sampler_ring_drain(utils_perf_sampler_ctx_t *ctx,
+        sampler_ring_t *ring, utils_perf_sample_fxn_t sample_fxn,
+        void *opaque)
+{
+    uint64_t head, tail;
+    int samples_cnt= 0;
+    const size_t mask= ring->data_size- 1;
+    uint64_t ips[SAMPLER_MAX_STACK+ 1];
+
+    head= __atomic_load_n(&ring->mmap_page->data_head, __ATOMIC_ACQUIRE);
+    tail= ring->mmap_page->data_tail;
+
+    while(tail< head) {
+        struct perf_event_header *hdr;
+        size_t offset= tail& mask;
+
+        hdr= (struct perf_event_header*)&ring->data[offset];
+        if(hdr->size== 0)
+            break; // Should never happen; avoid looping forever
+
+        /* Linearize the record if it wraps around the end of the buffer */
+        if(offset+ hdr->size> ring->data_size) {
+            size_t first= ring->data_size- offset;
+            memcpy(ctx->scratch, &ring->data[offset], first);
+            memcpy(ctx->scratch+ first, ring->data, hdr->size- first);
+            hdr= (struct perf_event_header*)ctx->scratch;
+        }
+
+        if(hdr->type== PERF_RECORD_SAMPLE) {
+            /* Layout: {u32 pid, tid; u64 nr; u64 ips[nr];} */
+            const uint8_t *p= (const uint8_t*)(hdr+ 1);
+            uint32_t pid= *(const uint32_t*)p;
+            uint32_t tid= *(const uint32_t*)(p+ 4);
+            uint64_t i, nr= *(const uint64_t*)(p+ 8);
+            const uint64_t *chain= (const uint64_t*)(p+ 16);
+            uint32_t ips_num= 0;
+
+            for(i= 0; i< nr && ips_num< SAMPLER_MAX_STACK; i++) {
+                if(chain[i]>= (uint64_t)PERF_CONTEXT_MAX)
+                    continue; // Context marker (PERF_CONTEXT_USER, ...)
+                ips[ips_num++]= chain[i];
+            }
+            if(ips_num> 0) {
+                sample_fxn(opaque, (pid_t)pid, (pid_t)tid, ips, ips_num);
+                samples_cnt++;
+            }
+        } else if(hdr->type== PERF_RECORD_LOST) {
+            /* Layout: {u64 id; u64 lost;} */
+            ctx->lost_cnt+= *(const uint64_t*)((const uint8_t*)(hdr+ 1)+ 8);
+        }
+
+        tail+= hdr->size;
+    }
+
+    __atomic_store_n(&ring->mmap_page->data_tail, tail, __ATOMIC_RELEASE);
+    return samples_cnt;
+}
+
+utils_perf_counters_ctx_t* utils_perf_counters_open(const pid_t *pids,
+        size_t pids_num, int flag_inherit,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    size_t i, fds_cnt= 0;
+    int c, end_code= -1;
+    pid_t *tids= NULL;
+    utils_perf_counters_ctx_t *ctx= NULL;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    /* Check arguments */
+    CHECK_DO(pids!= NULL && pids_num> 0, return NULL);
+    // Parameter 'utils_logs_ctx' is allowed to be NULL.
+
+    /* Allocate context structure */
+    ctx= (utils_perf_counters_ctx_t*)calloc(1, sizeof(
+            utils_perf_counters_ctx_t));
+    CHECK_DO(ctx!= NULL, goto end);
+
+    /* **** Initialize context structure **** */
+
+    ctx->utils_logs_ctx= utils_logs_ctx;
+
+    ctx->fds= (int*)malloc(SAMPLER_FDS_MAX* UTILS_PERF_COUNTER_ENUM_MAX*
+            sizeof(int));
+    CHECK_DO(ctx->fds!= NULL, goto end);
+
+    tids= (pid_t*)calloc(SAMPLER_FDS_MAX, sizeof(pid_t));
+    CHECK_DO(tids!= NULL, goto end);
+
+    /* Open the whole set of counters on each thread to monitor */
+    for(i= 0; i< pids_num; i++) {
+        int t, tids_num;
+
+        if(flag_inherit!= 0) {
+            tids[0]= pids[i];
+            tids_num= 1;
+        } else if((tids_num= utils_perf_get_tids(pids[i], tids,
+                SAMPLER_FDS_MAX))< 0) {
+            LOGW("Could not list threads of process %d\n", (int)pids[i]);
+            continue;
+        }
+        for(t= 0; t< tids_num && t< SAMPLER_FDS_MAX &&
+                ctx->threads_num< SAMPLER_FDS_MAX; t++) {
+            int *fds= &ctx->fds[ctx->threads_num* UTILS_PERF_COUNTER_ENUM_MAX];
+            for(c= 0; c< UTILS_PERF_COUNTER_ENUM_MAX; c++) {
+                fds[c]= counter_open((utils_perf_counter_t)c, tids[t],
+                        flag_inherit);
+                if(fds[c]>= 0)
+                    fds_cnt++;
+            }
+            ctx->threads_num++;
+        }
+    }
+    if(fds_cnt== 0) {
+        LOGE("Could not open any counter (check privileges and "
+                "'/proc/sys/kernel/perf_event_paranoid')\n");
+        goto end;
+    }
+
+    /* Enable all the counters at once */
+    for(i= 0; i< ctx->threads_num* UTILS_PERF_COUNTER_ENUM_MAX; i++) {
+        if(ctx->fds[i]>= 0)
+            CHECK(ioctl(ctx->fds[i], PERF_EVENT_IOC_ENABLE, 0)== 0);
+    }
+
+    end_code= 0;
+end:
+    if(tids!= NULL)
+        free(tids);
+    if(end_code!= 0)
+        utils_perf_counters_close(&ctx);
+    return ctx;
+}
+
+void utils_perf_counters_close(
+        utils_perf_counters_ctx_t **ref_utils_perf_counters_ctx)
+{
+    size_t i;
+    utils_perf_counters_ctx_t *ctx;
+
+    if(ref_utils_perf_counters_ctx== NULL ||
+            (ctx= *ref_utils_perf_counters_ctx)== NULL)
+        return;
+
+    if(ctx->fds!= NULL) {
+        for(i= 0; i< ctx->threads_num* UTILS_PERF_COUNTER_ENUM_MAX; i++) {
+            if(ctx->fds[i]>= 0)
+                close(ctx->fds[i]);
+        }
+        free(ctx->fds);
+        ctx->fds= NULL;
+    }
+
+    free(ctx);
+    *ref_utils_perf_counters_ctx= NULL;
+}
+
+int utils_perf_counters_read(utils_perf_counters_ctx_t *utils_perf_counters_ctx,
+        int64_t values[UTILS_PERF_COUNTER_ENUM_MAX])
+{
+    size_t i;
+    int c;
+    LOG_CTX_INIT(NULL);
+
+    /* Check arguments */
+    CHECK_DO(utils_perf_counters_ctx!= NULL, return -1);
+    CHECK_DO(values!= NULL, return -1);
+
+    LOG_CTX_SET(utils_perf_counters_ctx->utils_logs_ctx);
+
+    for(c= 0; c< UTILS_PERF_COUNTER_ENUM_MAX; c++)
+        values[c]= -1;
+
+    for(i= 0; i< utils_perf_counters_ctx->threads_num; i++) {
+        const int *fds= &utils_perf_counters_ctx->fds[i*
+                UTILS_PERF_COUNTER_ENUM_MAX];
+        for(c= 0; c< UTILS_PERF_COUNTER_ENUM_MAX; c++) {
+            /* Layout: {u64 value; u64 time_enabled; u64 time_running;} */
+            uint64_t data[3];
+            double value;
+
+            if(fds[c]< 0)
+                continue;
+            if(read(fds[c], data, sizeof(data))!= (ssize_t)sizeof(data)) {
+                LOGW("Could not read counter '%s' (errno: %d)\n",
+                        utils_perf_counter_lut[c], errno);
+                continue;
+            }
+            if(values[c]< 0)
+                values[c]= 0;
+            if(data[2]== 0)
+                continue; // Counter never scheduled (e.g. thread slept)
+
+            /* Scale to compensate multiplexing of the hardware counters */
+            value= (double)data[0];
+            if(data[2]< data[1])
+                value*= (double)data[1]/ (double)data[2];
+            values[c]+= (int64_t)value;
+        }
+    }
+    return 0;
+}
+
+static int counter_open(utils_perf_counter_t counter, pid_t tid,
+        int flag_inherit)
+{
+    struct perf_event_attr attr;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size= sizeof(attr);
+    attr.type= counters_attr_lut[counter].type;
+    attr.config= counters_attr_lut[counter].config;
+    attr.read_format= PERF_FORMAT_TOTAL_TIME_ENABLED|
+            PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled= 1;
+    attr.inherit= flag_inherit!= 0;
+    attr.exclude_hv= 1;
+
+    fd= (int)syscall(__NR_perf_event_open, &attr, tid, -1, -1,
+            PERF_FLAG_FD_CLOEXEC);
+    if(fd< 0 && (errno== ENOENT || errno== EOPNOTSUPP) &&
+            counters_attr_lut[counter].fallback_config!= 0) {
+        attr.type= PERF_TYPE_HARDWARE;
+        attr.config= counters_attr_lut[counter].fallback_config;
+        fd= (int)syscall(__NR_perf_event_open, &attr, tid, -1, -1,
+                PERF_FLAG_FD_CLOEXEC);
+    }
+    if(fd< 0 && (errno== EACCES || errno== EPERM)) {
+        /* Not allowed to count kernel events; retry user-space only */
+        attr.exclude_kernel= 1;
+        fd= (int)syscall(__NR_perf_event_open, &attr, tid, -1, -1,
+                PERF_FLAG_FD_CLOEXEC);
+    }
+    return fd;
+}
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file utils_perf.h
+ * @brief Thin wrapper of the Linux 'perf_event_open()' interface.
+ * This module implements:
+ * - A CPU-clock sampling profiler attached to a given set of (already
+ * running) processes. Each sample carries the call-chain of the sampled
+ * thread, unwound by the kernel using frame pointers; thus, the profiled
+ * binaries should be compiled with '-fno-omit-frame-pointer' to get complete
+ * stacks.
+ * - A set of hardware and software event counters (cycles, instructions,
+ * cache misses, context switches, ...) aggregated over a set of processes.
+ */
+
+#ifndef UTILS_PERF_H_
+#define UTILS_PERF_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <inttypes.h>
+#include <stddef.h>
+
+/* **** Definitions **** */
+
+/* Forward declarations */
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+typedef struct utils_perf_sampler_ctx_s utils_perf_sampler_ctx_t;
+typedef struct utils_perf_counters_ctx_s utils_perf_counters_ctx_t;
+
+/**
+ * Supported event counters enumerator.
+ */
+typedef enum utils_perf_counter_enum {
+    UTILS_PERF_CYCLES= 0,
+    UTILS_PERF_INSTRUCTIONS,
+    /** Last-level cache read misses */
+    UTILS_PERF_LLC_MISSES,
+    UTILS_PERF_BRANCH_MISSES,
+    UTILS_PERF_CONTEXT_SWITCHES,
+    UTILS_PERF_CPU_MIGRATIONS,
+    UTILS_PERF_COUNTER_ENUM_MAX
+} utils_perf_counter_t;
+
+/**
+ * Sample callback type.
+ * @param opaque Opaque pointer passed by the caller to the polling function
+ * 'utils_perf_sampler_poll()'.
+ * @param pid Process ID of the sampled thread.
+ * @param tid Thread ID of the sampled thread.
+ * @param ips Call-chain instruction pointers, leaf frame first. Kernel and
+ * user-space addresses may be mixed (kernel frames come first); the
+ * perf context markers are already stripped.
+ * @param ips_num Number of instruction pointers in array 'ips'.
+ */
+typedef void (*utils_perf_sample_fxn_t)(void *opaque, pid_t pid, pid_t tid,
+        const uint64_t *ips, uint32_t ips_num);
+
+/* **** Prototypes **** */
+
+/**
+ * Opens a CPU-clock sampling session on every thread of the given processes.
+ * Sampling is enabled on return.
+ * @param pids Array of process IDs to be profiled.
+ * @param pids_num Number of elements in array 'pids'.
+ * @param freq_hz Sampling frequency in Hertz (samples per second and thread).
+ * @param utils_logs_ctx Externally defined logger. This is an optional field
+ * (can be set to NULL).
+ * @return Pointer to the sampler instance context structure ("handler") on
+ * success, NULL if fails (e.g. not enough privileges, see
+ * '/proc/sys/kernel/perf_event_paranoid').
+ */
+utils_perf_sampler_ctx_t* utils_perf_sampler_open(const pid_t *pids,
+        size_t pids_num, uint32_t freq_hz,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/**
+ * Disables sampling and releases the sampler instance.
+ * @param ref_utils_perf_sampler_ctx Reference to the pointer to the sampler
+ * instance context structure obtained in a previous call to
+ * 'utils_perf_sampler_open()'. Pointer is set to NULL on return.
+ */
+void utils_perf_sampler_close(
+        utils_perf_sampler_ctx_t **ref_utils_perf_sampler_ctx);
+
+/**
+ * Waits up to the given time-out for samples to be available and drains all
+ * the sampling ring-buffers, calling 'sample_fxn' once per sample.
+ * This function should be called periodically (e.g. from a dedicated thread)
+ * to avoid ring-buffer overruns.
+ * @param utils_perf_sampler_ctx Pointer to the sampler instance context
+ * structure.
+ * @param tout_msecs Maximum time to block waiting for samples, in
+ * milliseconds. Set to zero to return immediately.
+ * @param sample_fxn Sample callback.
+ * @param opaque Opaque pointer passed as is to 'sample_fxn'.
+ * @return Number of samples processed, or -1 on error.
+ */
+int utils_perf_sampler_poll(utils_perf_sampler_ctx_t *utils_perf_sampler_ctx,
+        int tout_msecs, utils_perf_sample_fxn_t sample_fxn, void *opaque);
+
+/**
+ * Get the number of samples lost by the kernel due to ring-buffer overruns.
+ * @param utils_perf_sampler_ctx Pointer to the sampler instance context
+ * structure.
+ * @return Number of lost samples.
+ */
+uint64_t utils_perf_sampler_lost(
+        utils_perf_sampler_ctx_t *utils_perf_sampler_ctx);
+
+/**
+ * Lists the thread IDs of the given process (reads '/proc/<pid>/task').
+ * @param pid Process ID.
+ * @param tids Array where to return the thread IDs.
+ * @param tids_max Maximum number of elements of array 'tids'.
+ * @return Number of threads found (may be greater than 'tids_max', in which
+ * case only the first 'tids_max' are returned), or -1 on error.
+ */
+int utils_perf_get_tids(pid_t pid, pid_t *tids, size_t tids_max);
+
+/**
+ * Opens and starts all the supported event counters on the given processes.
+ * Counters that are not supported by the platform (e.g. hardware counters
+ * in most virtual machines) are silently skipped and reported as
+ * not-available when read.
+ * @param pids Array of process IDs to be monitored.
+ * @param pids_num Number of elements in array 'pids'.
+ * @param flag_inherit If set to zero, all the threads currently existing in
+ * each process are monitored. If non-zero, only the main thread of each
+ * process is attached but the counters are inherited by any thread created
+ * afterwards (e.g. use it with 'getpid()' to monitor the calling
+ * application, including the threads it launches later).
+ * @param utils_logs_ctx Externally defined logger. This is an optional field
+ * (can be set to NULL).
+ * @return Pointer to the counters instance context structure ("handler") on
+ * success, NULL if fails (no counter at all could be opened).
+ */
+utils_perf_counters_ctx_t* utils_perf_counters_open(const pid_t *pids,
+        size_t pids_num, int flag_inherit,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/**
+ * Releases the counters instance.
+ * @param ref_utils_perf_counters_ctx Reference to the pointer to the
+ * counters instance context structure obtained in a previous call to
+ * 'utils_perf_counters_open()'. Pointer is set to NULL on return.
+ */
+void utils_perf_counters_close(
+        utils_perf_counters_ctx_t **ref_utils_perf_counters_ctx);
+
+/**
+ * Reads the current value of all the counters, summed over every monitored
+ * thread. Values are scaled to compensate counter multiplexing.
+ * @param utils_perf_counters_ctx Pointer to the counters instance context
+ * structure.
+ * @param values Array where to return the counter values, indexed by
+ * 'utils_perf_counter_t'. Counters not available are set to -1.
+ * @return 0 on success, -1 on error.
+ */
+int utils_perf_counters_read(utils_perf_counters_ctx_t *utils_perf_counters_ctx,
+        int64_t values[UTILS_PERF_COUNTER_ENUM_MAX]);
+
+/**
+ * Counters code to readable format lookup table.
+ */
+extern const char* utils_perf_counter_lut[];
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
+
+#endif /* UTILS_PERF_H_ */
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file utils_pool.h
+/// @brief Fixed-size object pool (C++ header-only).
+///
+/// Objects of a single type are carved out of slabs allocated a few dozen at a time and recycled through a free list,
+/// so that the objects created and destroyed at every request (e.g. request contexts) cost neither a 'malloc()' nor
+/// a 'free()' once the pool is warm. A pool is not thread-safe: it belongs to a single thread (typically an event
+/// loop), like the objects it hands out.
+
+#ifndef UTILS_UTILS_POOL_H_
+#define UTILS_UTILS_POOL_H_
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+template<typename T>
+class utils_pool
+{
+public:
+    /// @param slab_objs Number of objects allocated at once when the pool runs out of them.
+    explicit utils_pool(size_t slab_objs = 64): slab_objs(slab_objs > 0 ? slab_objs : 1)
+    {
+    }
+
+    /// Release the slabs. The objects still in use are not destroyed (they must all have been put back).
+    ~utils_pool()
+    {
+        for(size_t i = 0; i < slabs.size(); i++)
+            delete[] slabs[i];
+    }
+
+    utils_pool(const utils_pool&) = delete;
+    utils_pool& operator=(const utils_pool&) = delete;
+
+    /// Construct an object in the pool.
+    /// @return Pointer to the object (never NULL; 'std::bad_alloc' is thrown if a slab can not be allocated).
+    template<typename... Args>
+    T* get(Args&&... args)
+    {
+        if(free_list == nullptr)
+            grow();
+        slot_t *slot = free_list;
+        free_list = slot->next;
+        T *obj = new(slot->storage) T(std::forward<Args>(args)...);
+        used++;
+        return obj;
+    }
+
+    /// Destroy an object obtained with 'get()' and give its memory back to the pool.
+    void put(T *obj)
+    {
+        if(obj == nullptr)
+            return;
+        obj->~T();
+        slot_t *slot = reinterpret_cast<slot_t*>(obj);
+        slot->next = free_list;
+        free_list = slot;
+        used--;
+    }
+
+    /// @return Number of objects in use.
+    size_t in_use() const
+    {
+        return used;
+    }
+
+private:
+    typedef union slot_u
+    {
+        union slot_u *next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    } slot_t;
+
+    void grow()
+    {
+        slot_t *slab = new slot_t[slab_objs];
+        slabs.push_back(slab);
+        for(size_t i = slab_objs; i-- > 0;)
+        {
+            slab[i].next = free_list;
+            free_list = &slab[i];
+        }
+    }
+
+    size_t slab_objs;
+    size_t used = 0;
+    slot_t *free_list = nullptr;
+    std::vector<slot_t*> slabs;
+};
+
+#endif /* UTILS_UTILS_POOL_H_ */
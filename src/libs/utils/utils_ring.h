@@ -0,0 +1,207 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/// @file utils_ring.h
+/// @brief Bounded lock-free ring queues (C++ header-only).
+///
+/// Two flavours of fixed capacity queue for handing items over between threads without locks nor allocations:
+/// 'utils_ring_spsc' (one producer thread, one consumer thread) and 'utils_ring_mpsc' (any number of producer
+/// threads, one consumer thread). Items are copied in and out, so they are meant to be small trivially copyable
+/// records (or pointers). Pushing to a full ring fails instead of blocking: the producer decides whether to drop,
+/// count or retry.
+
+#ifndef UTILS_UTILS_RING_H_
+#define UTILS_UTILS_RING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+/// Producer and consumer indices are kept in separate cache lines, so that each side only writes its own line
+#define UTILS_RING_CACHE_LINE_SIZE 64
+
+/// Single-producer/single-consumer ring.
+/// The producer only writes 'tail' and the consumer only writes 'head'. Each side also keeps the value of the other
+/// index it last read, so that the line of the other side is only read when the ring looks full (or empty).
+template<typename T>
+class utils_ring_spsc
+{
+    static_assert(std::is_trivially_copyable<T>::value, "ring items must be trivially copyable");
+public:
+    /// @param capacity Maximum number of items, rounded up to a power of two.
+    explicit utils_ring_spsc(size_t capacity)
+    {
+        size_t size = 2;
+        while(size < capacity)
+            size <<= 1;
+        mask = size - 1;
+        items = new T[size];
+    }
+
+    ~utils_ring_spsc()
+    {
+        delete[] items;
+    }
+
+    utils_ring_spsc(const utils_ring_spsc&) = delete;
+    utils_ring_spsc& operator=(const utils_ring_spsc&) = delete;
+
+    /// Enqueue an item (producer thread only).
+    /// @return false if the ring is full.
+    bool push(const T &item)
+    {
+        size_t tail_pos = tail.load(std::memory_order_relaxed);
+        if(tail_pos - head_cache > mask)
+        {
+            head_cache = head.load(std::memory_order_acquire);
+            if(tail_pos - head_cache > mask)
+                return false;
+        }
+        items[tail_pos & mask] = item;
+        tail.store(tail_pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Dequeue an item (consumer thread only).
+    /// @return false if the ring is empty.
+    bool pop(T &item)
+    {
+        size_t head_pos = head.load(std::memory_order_relaxed);
+        if(head_pos == tail_cache)
+        {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if(head_pos == tail_cache)
+                return false;
+        }
+        item = items[head_pos & mask];
+        head.store(head_pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    alignas(UTILS_RING_CACHE_LINE_SIZE) std::atomic<size_t> head{0}; ///< Consumer position
+    size_t tail_cache = 0; ///< Consumer copy of 'tail'
+    alignas(UTILS_RING_CACHE_LINE_SIZE) std::atomic<size_t> tail{0}; ///< Producer position
+    size_t head_cache = 0; ///< Producer copy of 'head'
+    alignas(UTILS_RING_CACHE_LINE_SIZE) size_t mask;
+    T *items;
+};
+
+/// Multiple-producer/single-consumer ring.
+/// Producers claim a cell by advancing 'tail' with a compare-and-swap; each cell carries a sequence number telling
+/// whether it is free for the claiming lap or holds an item for the consumer, so a producer that was preempted after
+/// claiming a cell only delays the consumer from that cell on, never corrupts it.
+template<typename T>
+class utils_ring_mpsc
+{
+    static_assert(std::is_trivially_copyable<T>::value, "ring items must be trivially copyable");
+public:
+    /// @param capacity Maximum number of items, rounded up to a power of two.
+    explicit utils_ring_mpsc(size_t capacity)
+    {
+        size_t size = 2;
+        while(size < capacity)
+            size <<= 1;
+        mask = size - 1;
+        cells = new cell_t[size];
+        for(size_t i = 0; i < size; i++)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    ~utils_ring_mpsc()
+    {
+        delete[] cells;
+    }
+
+    utils_ring_mpsc(const utils_ring_mpsc&) = delete;
+    utils_ring_mpsc& operator=(const utils_ring_mpsc&) = delete;
+
+    /// Enqueue an item (any thread).
+    /// @return false if the ring is full.
+    bool push(const T &item)
+    {
+        cell_t *cell;
+        size_t pos = tail.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            cell = &cells[pos & mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            ptrdiff_t dif = (ptrdiff_t)seq - (ptrdiff_t)pos;
+            if(dif == 0)
+            {
+                if(tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(dif < 0)
+            {
+                return false; // the consumer did not free this cell yet
+            }
+            else
+            {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->item = item;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Dequeue an item (consumer thread only).
+    /// @return false if the ring is empty (or the next item is still being written).
+    bool pop(T &item)
+    {
+        cell_t *cell = &cells[head & mask];
+        if(cell->seq.load(std::memory_order_acquire) != head + 1)
+            return false;
+        item = cell->item;
+        // Free the cell for the producers of the next lap
+        cell->seq.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+private:
+    typedef struct cell_s
+    {
+        std::atomic<size_t> seq;
+        T item;
+    } cell_t;
+
+    alignas(UTILS_RING_CACHE_LINE_SIZE) std::atomic<size_t> tail{0}; ///< Next cell to claim
+    alignas(UTILS_RING_CACHE_LINE_SIZE) size_t head = 0; ///< Written by the consumer only
+    size_t mask;
+    cell_t *cells;
+};
+
+#endif /* UTILS_UTILS_RING_H_ */
@@ -27,8 +27,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <inttypes.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define UTILS_TIME_HAVE_TSC
+#endif
 
 #include "utils_logs.h"
 
@@ -42,6 +48,10 @@
     RET_MSEC  = (uint64_t)TS.tv_sec * 1000;\
     RET_MSEC += (uint64_t)TS.tv_nsec / 1000000;
 
+#define TIMESPEC2USEC(RET_USEC, TS) \
+    RET_USEC  = (uint64_t)TS.tv_sec * 1000000;\
+    RET_USEC += (uint64_t)TS.tv_nsec / 1000;
+
 #define UTILS_GETTIME_GENERIC(CLOCKID, TRANSFORM_MACRO, LOGCTX) \
     LOG_CTX_INIT(LOGCTX);\
     struct timespec ts = {.tv_sec = 0, .tv_nsec = 0};\
@@ -50,6 +60,45 @@
     TRANSFORM_MACRO(retval, ts)\
     return retval;
 
+/** Number of clock pairs read per calibration sample (the tightest wins) */
+#define TSC_SAMPLE_TRIES 8
+
+/** Duration of each of the two calibration rounds */
+#define TSC_CALIBRATION_NSECS 10000000
+
+/** Maximum rate mismatch [ppm] between calibration rounds */
+#define TSC_CALIBRATION_PPM_MAX 100
+
+/** Period of the CLOCK_REALTIME offset refresh and stability check */
+#define TSC_RESYNC_NSECS 1000000000
+
+/** Maximum drift of the TSC clock from CLOCK_MONOTONIC */
+#define TSC_DRIFT_NSECS_MAX 1000000
+
+/** Fixed-point shift of the ticks to nanoseconds multiplier */
+#define TSC_SHIFT 32
+
+/**
+ * TSC clock state. The calibration fields are written once (under
+ * 'tsc_mutex', before 'flag_calibrated' is set); 'flag_tsc',
+ * 'realtime_offset_nsecs', 'resync_ticks' and 'fallback_nsecs' are accessed
+ * atomically.
+ */
+static struct {
+    int flag_calibrated;
+    int flag_tsc;
+    uint64_t hz;
+    uint64_t ticks0;
+    uint64_t monot0_nsecs;
+    uint64_t mult;
+    int64_t realtime_offset_nsecs;
+    uint64_t resync_ticks;
+    /* TSC clock time when falling back to 'clock_gettime()' */
+    uint64_t fallback_nsecs;
+} tsc_clock;
+
+static pthread_mutex_t tsc_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 /* **** Implementations **** */
 
 utils_clock_gettime_fxn utils_clock_gettime = clock_gettime;
@@ -69,3 +118,278 @@ uint64_t utils_gettime_msecs(utils_logs_ctx_t *utils_logs_ctx)
 {
     UTILS_GETTIME_GENERIC(CLOCK_REALTIME, TIMESPEC2MSEC, utils_logs_ctx)
 }
+
+uint64_t utils_gettime_monot_usecs(utils_logs_ctx_t *utils_logs_ctx)
+{
+    UTILS_GETTIME_GENERIC(CLOCK_MONOTONIC, TIMESPEC2USEC, utils_logs_ctx)
+}
+
+uint64_t utils_gettime_thread_cputime_usecs(utils_logs_ctx_t *utils_logs_ctx)
+{
+    UTILS_GETTIME_GENERIC(CLOCK_THREAD_CPUTIME_ID, TIMESPEC2USEC,
+            utils_logs_ctx)
+}
+
+uint64_t utils_gettime_process_cputime_usecs(utils_logs_ctx_t *utils_logs_ctx)
+{
+    UTILS_GETTIME_GENERIC(CLOCK_PROCESS_CPUTIME_ID, TIMESPEC2USEC,
+            utils_logs_ctx)
+}
+
+static inline uint64_t timespec2nsecs(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000 + (uint64_t)ts->tv_nsec;
+}
+
+static inline uint64_t clock_nsecs(clockid_t clockid)
+{
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = 0};
+
+    utils_clock_gettime(clockid, &ts);
+    return timespec2nsecs(&ts);
+}
+
+static inline uint64_t tsc_read()
+{
+#ifdef UTILS_TIME_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Check that the TSC may be trusted: the CPU states it is invariant and the
+ * kernel did not discard it as clock source.
+ */
+static int tsc_is_reliable(utils_logs_ctx_t *utils_logs_ctx)
+{
+#ifdef UTILS_TIME_HAVE_TSC
+    unsigned int eax, ebx, ecx, edx;
+    char clocksource[32] = {0};
+    FILE *file;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    if(__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0 ||
+            (edx & (1 << 8)) == 0) {
+        LOGW("TSC is not invariant; using clock_gettime()\n");
+        return 0;
+    }
+
+    /* Not readable (e.g. containers): the calibration check has to do */
+    file = fopen("/sys/devices/system/clocksource/clocksource0/"
+            "current_clocksource", "r");
+    if(file != NULL) {
+        int flag_read = fgets(clocksource, sizeof(clocksource), file) !=
+                NULL;
+        fclose(file);
+        if(flag_read && strncmp(clocksource, "tsc", 3) != 0) {
+            LOGW("Kernel clock source is '%.*s', not the TSC; using "
+                    "clock_gettime()\n", (int)strcspn(clocksource, "\n"),
+                    clocksource);
+            return 0;
+        }
+    }
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Read a TSC value and the given clock time at (about) the same instant: the
+ * read pair enclosed by the two closest TSC reads is kept.
+ */
+static void tsc_sample(clockid_t clockid, uint64_t *ref_ticks,
+        uint64_t *ref_nsecs)
+{
+    uint64_t width_min = UINT64_MAX;
+    int i;
+
+    *ref_ticks = 0;
+    *ref_nsecs = 0;
+    for(i = 0; i < TSC_SAMPLE_TRIES; i++) {
+        uint64_t t0 = tsc_read();
+        uint64_t nsecs = clock_nsecs(clockid);
+        uint64_t t1 = tsc_read();
+
+        if(t1 - t0 < width_min) {
+            width_min = t1 - t0;
+            *ref_ticks = t0 + (t1 - t0) / 2;
+            *ref_nsecs = nsecs;
+        }
+    }
+}
+
+/**
+ * Map a TSC value to the CLOCK_MONOTONIC time base. The value may precede
+ * 'ticks0' (read on a core whose TSC lags, or before a resync), hence the
+ * signed difference.
+ */
+static inline uint64_t tsc_ticks2monot_nsecs(uint64_t ticks)
+{
+    int64_t delta = (int64_t)(ticks - tsc_clock.ticks0);
+
+    if(delta < 0)
+        return tsc_clock.monot0_nsecs - (uint64_t)(((unsigned __int128)
+                (uint64_t)-delta * tsc_clock.mult) >> TSC_SHIFT);
+    return tsc_clock.monot0_nsecs + (uint64_t)(((unsigned __int128)
+            (uint64_t)delta * tsc_clock.mult) >> TSC_SHIFT);
+}
+
+/**
+ * CLOCK_MONOTONIC time once the TSC clock is not in use. After a fall back
+ * the TSC clock may be ahead of CLOCK_MONOTONIC: its last time is held until
+ * CLOCK_MONOTONIC catches up, so that the clock does not go backwards.
+ */
+static inline uint64_t tsc_fallback_monot_nsecs()
+{
+    uint64_t nsecs = clock_nsecs(CLOCK_MONOTONIC);
+    uint64_t fallback_nsecs = __atomic_load_n(&tsc_clock.fallback_nsecs,
+            __ATOMIC_RELAXED);
+
+    return nsecs > fallback_nsecs ? nsecs : fallback_nsecs;
+}
+
+/**
+ * Refresh the CLOCK_REALTIME offset and check the TSC clock has not drifted
+ * from CLOCK_MONOTONIC (otherwise fall back to 'clock_gettime()').
+ */
+static void tsc_resync(uint64_t ticks)
+{
+    uint64_t expected = __atomic_load_n(&tsc_clock.resync_ticks,
+            __ATOMIC_RELAXED);
+    uint64_t monot_ticks = 0, monot_nsecs = 0, realtime_ticks = 0,
+            realtime_nsecs = 0;
+    int64_t drift;
+
+    /* A single thread does the refresh */
+    if(ticks < expected || !__atomic_compare_exchange_n(
+            &tsc_clock.resync_ticks, &expected, ticks + (uint64_t)(
+            (double)tsc_clock.hz * TSC_RESYNC_NSECS / 1000000000), 0,
+            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        return;
+
+    tsc_sample(CLOCK_MONOTONIC, &monot_ticks, &monot_nsecs);
+    tsc_sample(CLOCK_REALTIME, &realtime_ticks, &realtime_nsecs);
+
+    drift = (int64_t)(tsc_ticks2monot_nsecs(monot_ticks) - monot_nsecs);
+    if(drift > TSC_DRIFT_NSECS_MAX || drift < -TSC_DRIFT_NSECS_MAX) {
+        __atomic_store_n(&tsc_clock.fallback_nsecs,
+                tsc_ticks2monot_nsecs(tsc_read()), __ATOMIC_RELAXED);
+        __atomic_store_n(&tsc_clock.flag_tsc, 0, __ATOMIC_RELEASE);
+        return;
+    }
+    __atomic_store_n(&tsc_clock.realtime_offset_nsecs,
+            (int64_t)(realtime_nsecs - tsc_ticks2monot_nsecs(realtime_ticks)),
+            __ATOMIC_RELAXED);
+}
+
+int utils_tsc_calibrate(utils_logs_ctx_t *utils_logs_ctx)
+{
+    uint64_t ticks[3], nsecs[3], hz[2];
+    struct timespec ts = {.tv_sec = 0, .tv_nsec = TSC_CALIBRATION_NSECS};
+    int i;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    if(__atomic_load_n(&tsc_clock.flag_calibrated, __ATOMIC_ACQUIRE))
+        return __atomic_load_n(&tsc_clock.flag_tsc, __ATOMIC_ACQUIRE);
+
+    pthread_mutex_lock(&tsc_mutex);
+    if(tsc_clock.flag_calibrated)
+        goto end;
+
+    tsc_clock.flag_tsc = 0;
+    tsc_clock.realtime_offset_nsecs = (int64_t)(clock_nsecs(CLOCK_REALTIME) -
+            clock_nsecs(CLOCK_MONOTONIC));
+    if(!tsc_is_reliable(LOG_CTX_GET()))
+        goto end;
+
+    /* Two rounds: their rates have to agree */
+    tsc_sample(CLOCK_MONOTONIC, &ticks[0], &nsecs[0]);
+    for(i = 1; i < 3; i++) {
+        nanosleep(&ts, NULL);
+        tsc_sample(CLOCK_MONOTONIC, &ticks[i], &nsecs[i]);
+        CHECK_DO(nsecs[i] > nsecs[i - 1] && ticks[i] > ticks[i - 1],
+                goto end);
+        hz[i - 1] = (uint64_t)((double)(ticks[i] - ticks[i - 1]) * 1e9 /
+                (double)(nsecs[i] - nsecs[i - 1]));
+    }
+    if((hz[0] > hz[1] ? hz[0] - hz[1] : hz[1] - hz[0]) >
+            hz[0] / 1000000 * TSC_CALIBRATION_PPM_MAX) {
+        LOGW("TSC rate unstable along calibration (%" PRIu64 " vs. %" PRIu64
+                " Hz); using clock_gettime()\n", hz[0], hz[1]);
+        goto end;
+    }
+
+    /* Whole span for the final rate */
+    tsc_clock.hz = (uint64_t)((double)(ticks[2] - ticks[0]) * 1e9 /
+            (double)(nsecs[2] - nsecs[0]));
+    tsc_clock.mult = (uint64_t)(((unsigned __int128)1000000000 <<
+            TSC_SHIFT) / tsc_clock.hz);
+    tsc_clock.ticks0 = ticks[2];
+    tsc_clock.monot0_nsecs = nsecs[2];
+    tsc_clock.resync_ticks = ticks[2];
+    tsc_clock.flag_tsc = 1;
+    tsc_resync(ticks[2]);
+    LOGD("TSC clock calibrated at %" PRIu64 " Hz\n", tsc_clock.hz);
+
+end:
+    __atomic_store_n(&tsc_clock.flag_calibrated, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&tsc_mutex);
+    return __atomic_load_n(&tsc_clock.flag_tsc, __ATOMIC_RELAXED);
+}
+
+/*
+ * The ticks unit is fixed by the calibration outcome: TSC cycles if it
+ * succeeded (also after a fall back of the TSC clock, the rate is still
+ * valid for intervals), nanoseconds otherwise.
+ */
+
+uint64_t utils_tsc_hz(void)
+{
+    utils_tsc_calibrate(NULL);
+    return tsc_clock.hz;
+}
+
+uint64_t utils_tsc_ticks(void)
+{
+    utils_tsc_calibrate(NULL);
+    if(tsc_clock.hz == 0)
+        return clock_nsecs(CLOCK_MONOTONIC);
+    return tsc_read();
+}
+
+uint64_t utils_tsc_ticks2nsecs(uint64_t ticks)
+{
+    utils_tsc_calibrate(NULL);
+    if(tsc_clock.hz == 0)
+        return ticks;
+    return (uint64_t)(((unsigned __int128)ticks * tsc_clock.mult) >>
+            TSC_SHIFT);
+}
+
+uint64_t utils_gettime_tsc_monot_nsecs(void)
+{
+    uint64_t ticks;
+
+    if(!utils_tsc_calibrate(NULL))
+        return tsc_fallback_monot_nsecs();
+
+    ticks = tsc_read();
+    if(ticks >= __atomic_load_n(&tsc_clock.resync_ticks, __ATOMIC_RELAXED)) {
+        tsc_resync(ticks);
+        if(!__atomic_load_n(&tsc_clock.flag_tsc, __ATOMIC_ACQUIRE))
+            return tsc_fallback_monot_nsecs();
+    }
+    return tsc_ticks2monot_nsecs(ticks);
+}
+
+uint64_t utils_gettime_tsc_nsecs(void)
+{
+    if(!utils_tsc_calibrate(NULL))
+        return clock_nsecs(CLOCK_REALTIME);
+
+    return utils_gettime_tsc_monot_nsecs() + (uint64_t)__atomic_load_n(
+            &tsc_clock.realtime_offset_nsecs, __ATOMIC_RELAXED);
+}
@@ -61,6 +61,95 @@ uint64_t utils_gettime_monot_msecs(utils_logs_ctx_t *utils_logs_ctx);
 
 uint64_t utils_gettime_msecs(utils_logs_ctx_t *utils_logs_ctx);
 
+/**
+ * This function internally calls 'clock_gettime' with clock-id
+ * CLOCK_MONOTONIC but returning a 64-bit unsigned integer representing
+ * the time in microseconds.
+ * @param utils_logs_ctx Pointer to the log module context structure.
+ * @return A 64-bit unsigned integer representing the time in microseconds.
+ */
+uint64_t utils_gettime_monot_usecs(utils_logs_ctx_t *utils_logs_ctx);
+
+/**
+ * This function internally calls 'clock_gettime' with clock-id
+ * CLOCK_THREAD_CPUTIME_ID, returning the CPU time consumed by the calling
+ * thread in microseconds.
+ * @param utils_logs_ctx Pointer to the log module context structure.
+ * @return A 64-bit unsigned integer representing the CPU time in
+ * microseconds.
+ */
+uint64_t utils_gettime_thread_cputime_usecs(utils_logs_ctx_t *utils_logs_ctx);
+
+/**
+ * This function internally calls 'clock_gettime' with clock-id
+ * CLOCK_PROCESS_CPUTIME_ID, returning the CPU time consumed by all the
+ * threads of the calling process in microseconds.
+ * @param utils_logs_ctx Pointer to the log module context structure.
+ * @return A 64-bit unsigned integer representing the CPU time in
+ * microseconds.
+ */
+uint64_t utils_gettime_process_cputime_usecs(utils_logs_ctx_t *utils_logs_ctx);
+
+/**
+ * Calibrate the TSC clock ('utils_gettime_tsc_*()' functions) against
+ * CLOCK_MONOTONIC. The TSC is used only if it is invariant (constant rate
+ * and not stopped in deep C-states), if the kernel itself uses it as its
+ * clock source and if two consecutive calibrations agree; otherwise the TSC
+ * clock falls back to 'clock_gettime()'.
+ * Calibration takes about 20 milliseconds and is performed once: it is done
+ * implicitly on the first use of the TSC clock, but it is better called at
+ * start-up so that no measurement pays for it.
+ * @param utils_logs_ctx Pointer to the log module context structure.
+ * @return 1 if the TSC is in use, 0 if the TSC clock falls back to
+ * 'clock_gettime()'.
+ */
+int utils_tsc_calibrate(utils_logs_ctx_t *utils_logs_ctx);
+
+/**
+ * @return Calibrated TSC frequency [Hz], or 0 if the calibration did not
+ * succeed (see 'utils_tsc_ticks()').
+ */
+uint64_t utils_tsc_hz(void);
+
+/**
+ * Read the raw TSC (a few nanoseconds, no system call). Intervals are
+ * converted to nanoseconds with 'utils_tsc_ticks2nsecs()'. If the calibration
+ * did not succeed, CLOCK_MONOTONIC nanoseconds are returned instead (so that
+ * the conversion is the identity). The unit never changes once calibrated:
+ * the TSC keeps being returned if the TSC clock later falls back to
+ * 'clock_gettime()'.
+ * @return Current TSC value.
+ */
+uint64_t utils_tsc_ticks(void);
+
+/**
+ * Convert a TSC interval (difference of two 'utils_tsc_ticks()' values) to
+ * nanoseconds.
+ */
+uint64_t utils_tsc_ticks2nsecs(uint64_t ticks);
+
+/**
+ * TSC clock in the CLOCK_MONOTONIC time base, with nanosecond resolution.
+ * The TSC-to-CLOCK_MONOTONIC mapping is fixed at calibration; about once per
+ * second it is checked against CLOCK_MONOTONIC, and if they drifted apart
+ * more than a millisecond the TSC is deemed unstable and the clock falls back
+ * to 'clock_gettime()' for good. The returned values do not go backwards
+ * across the fall back: the last TSC clock time is held until
+ * CLOCK_MONOTONIC catches up with it.
+ * @return A 64-bit unsigned integer representing the time in nanoseconds.
+ */
+uint64_t utils_gettime_tsc_monot_nsecs(void);
+
+/**
+ * TSC clock in the CLOCK_REALTIME time base, with nanosecond resolution
+ * (e.g. to line up client time-stamps with nginx '$msec'). The offset to
+ * CLOCK_REALTIME is refreshed about once per second, so that NTP adjustments
+ * are followed.
+ * @return A 64-bit unsigned integer representing the time in nanoseconds
+ * since the Epoch.
+ */
+uint64_t utils_gettime_tsc_nsecs(void);
+
 extern utils_clock_gettime_fxn utils_clock_gettime;
 
 #ifdef __cplusplus
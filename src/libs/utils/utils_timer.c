@@ -0,0 +1,559 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file utils_timer.c
+ * @author Rafael Antoniello
+ */
+
+#include "utils_timer.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "utils_logs.h"
+#include "utils_time.h"
+
+/* **** Definitions **** */
+
+/**
+ * The wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots each. Level 'n'
+ * slots span WHEEL_SLOTS^n ticks: timers are linked in the level of their
+ * distance to the current tick, and are moved down ("cascaded") when the
+ * lower levels wrap around. Timers further than the whole wheel range are
+ * parked in the last level and re-linked on every wrap.
+ */
+#define WHEEL_BITS 8
+#define WHEEL_SLOTS (1<< WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS- 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_RANGE ((uint64_t)1<< (WHEEL_BITS* WHEEL_LEVELS))
+
+/** Slot of the timers that are not pending */
+#define SLOT_NONE UINT32_MAX
+
+/** Slot of the due timers, while their callbacks are being called */
+#define SLOT_EXPIRING (UINT32_MAX- 1)
+
+#define TICK_USECS_DEFAULT 1000
+
+/**
+ * Timer wheel context structure.
+ */
+typedef struct utils_timer_wheel_s {
+    utils_logs_ctx_t *utils_logs_ctx;
+    uint64_t tick_usecs;
+    /**
+     * First tick not processed yet
+     */
+    uint64_t cur_tick;
+    /**
+     * Tick the 'timerfd' is armed at (UINT64_MAX if disarmed)
+     */
+    uint64_t armed_tick;
+    size_t pending;
+    int epoll_fd;
+    int timer_fd;
+    int event_fd;
+    /**
+     * Non-empty slots, so that the next due tick is found without walking
+     * the empty slots
+     */
+    uint64_t bitmap[WHEEL_LEVELS][WHEEL_SLOTS/ 64];
+    /**
+     * Slot lists heads (circular doubly linked lists)
+     */
+    utils_timer_t slots[WHEEL_LEVELS* WHEEL_SLOTS];
+} utils_timer_wheel_t;
+
+/* **** Prototypes **** */
+
+static void wheel_link(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer);
+static void wheel_unlink(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer);
+static uint64_t wheel_next_tick(const utils_timer_wheel_t *utils_timer_wheel);
+static int wheel_arm(utils_timer_wheel_t *utils_timer_wheel, uint64_t tick);
+
+/* **** Implementations **** */
+
+void utils_timer_init(utils_timer_t *utils_timer, utils_timer_cb_t cb,
+        void *userdata)
+{
+    if(utils_timer== NULL)
+        return;
+
+    utils_timer->cb= cb;
+    utils_timer->userdata= userdata;
+    utils_timer->expires_tick= 0;
+    utils_timer->prev= utils_timer->next= NULL;
+    utils_timer->slot= SLOT_NONE;
+}
+
+int utils_timer_pending(const utils_timer_t *utils_timer)
+{
+    return utils_timer!= NULL && utils_timer->next!= NULL;
+}
+
+utils_timer_wheel_t* utils_timer_wheel_open(uint32_t tick_usecs,
+        utils_logs_ctx_t *const utils_logs_ctx)
+{
+    struct epoll_event ev= {0};
+    utils_timer_wheel_t *utils_timer_wheel= NULL;
+    int i;
+    LOG_CTX_INIT(utils_logs_ctx);
+
+    /* Check arguments */
+    // Parameter 'utils_logs_ctx' is allowed to be NULL.
+
+    utils_timer_wheel= (utils_timer_wheel_t*)calloc(1, sizeof(
+            utils_timer_wheel_t));
+    CHECK_DO(utils_timer_wheel!= NULL, return NULL);
+
+    utils_timer_wheel->utils_logs_ctx= LOG_CTX_GET();
+    utils_timer_wheel->tick_usecs= tick_usecs> 0? tick_usecs:
+            TICK_USECS_DEFAULT;
+    utils_timer_wheel->armed_tick= UINT64_MAX;
+    utils_timer_wheel->epoll_fd= -1;
+    utils_timer_wheel->timer_fd= -1;
+    utils_timer_wheel->event_fd= -1;
+    for(i= 0; i< WHEEL_LEVELS* WHEEL_SLOTS; i++) {
+        utils_timer_wheel->slots[i].prev= &utils_timer_wheel->slots[i];
+        utils_timer_wheel->slots[i].next= &utils_timer_wheel->slots[i];
+    }
+    utils_timer_wheel->cur_tick= utils_gettime_monot_usecs(LOG_CTX_GET())/
+            utils_timer_wheel->tick_usecs;
+
+    utils_timer_wheel->epoll_fd= epoll_create1(EPOLL_CLOEXEC);
+    CHECK_DO(utils_timer_wheel->epoll_fd>= 0, goto end);
+    utils_timer_wheel->timer_fd= timerfd_create(CLOCK_MONOTONIC,
+            TFD_NONBLOCK| TFD_CLOEXEC);
+    CHECK_DO(utils_timer_wheel->timer_fd>= 0, goto end);
+    utils_timer_wheel->event_fd= eventfd(0, EFD_NONBLOCK| EFD_CLOEXEC);
+    CHECK_DO(utils_timer_wheel->event_fd>= 0, goto end);
+
+    ev.events= EPOLLIN;
+    ev.data.fd= utils_timer_wheel->timer_fd;
+    CHECK_DO(epoll_ctl(utils_timer_wheel->epoll_fd, EPOLL_CTL_ADD,
+            utils_timer_wheel->timer_fd, &ev)== 0, goto end);
+    ev.data.fd= utils_timer_wheel->event_fd;
+    CHECK_DO(epoll_ctl(utils_timer_wheel->epoll_fd, EPOLL_CTL_ADD,
+            utils_timer_wheel->event_fd, &ev)== 0, goto end);
+
+    return utils_timer_wheel;
+end:
+    utils_timer_wheel_close(&utils_timer_wheel);
+    return NULL;
+}
+
+void utils_timer_wheel_close(utils_timer_wheel_t **ref_utils_timer_wheel)
+{
+    utils_timer_wheel_t *utils_timer_wheel;
+    int i;
+
+    if(ref_utils_timer_wheel== NULL ||
+            (utils_timer_wheel= *ref_utils_timer_wheel)== NULL)
+        return;
+
+    /* Leave the pending timers as if they were cancelled */
+    for(i= 0; i< WHEEL_LEVELS* WHEEL_SLOTS; i++) {
+        utils_timer_t *head= &utils_timer_wheel->slots[i];
+        while(head->next!= head)
+            wheel_unlink(utils_timer_wheel, head->next);
+    }
+
+    if(utils_timer_wheel->event_fd>= 0)
+        close(utils_timer_wheel->event_fd);
+    if(utils_timer_wheel->timer_fd>= 0)
+        close(utils_timer_wheel->timer_fd);
+    if(utils_timer_wheel->epoll_fd>= 0)
+        close(utils_timer_wheel->epoll_fd);
+
+    free(utils_timer_wheel);
+    *ref_utils_timer_wheel= NULL;
+}
+
+int utils_timer_wheel_add(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer, uint64_t deadline_usecs)
+{
+    uint64_t tick;
+    LOG_CTX_INIT(NULL);
+
+    /* Check arguments */
+    CHECK_DO(utils_timer_wheel!= NULL, return -1);
+    CHECK_DO(utils_timer!= NULL, return -1);
+
+    LOG_CTX_SET(utils_timer_wheel->utils_logs_ctx);
+
+    if(utils_timer->next!= NULL)
+        wheel_unlink(utils_timer_wheel, utils_timer);
+
+    /* Rounded up: a timer never expires before its deadline */
+    tick= deadline_usecs/ utils_timer_wheel->tick_usecs;
+    if(tick* utils_timer_wheel->tick_usecs< deadline_usecs)
+        tick++;
+    utils_timer->expires_tick= tick;
+    wheel_link(utils_timer_wheel, utils_timer);
+    utils_timer_wheel->pending++;
+
+    /* Arming at the very deadline is enough, even if the timer has to be
+     * cascaded before (the wheel catches up when processing)
+     */
+    if(tick< utils_timer_wheel->cur_tick)
+        tick= utils_timer_wheel->cur_tick;
+    if(tick< utils_timer_wheel->armed_tick)
+        CHECK_DO(wheel_arm(utils_timer_wheel, tick)== 0, return -1);
+    return 0;
+}
+
+int utils_timer_wheel_add_rel(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer, uint64_t usecs)
+{
+    LOG_CTX_INIT(NULL);
+
+    /* Check arguments */
+    CHECK_DO(utils_timer_wheel!= NULL, return -1);
+
+    LOG_CTX_SET(utils_timer_wheel->utils_logs_ctx);
+
+    return utils_timer_wheel_add(utils_timer_wheel, utils_timer,
+            utils_gettime_monot_usecs(LOG_CTX_GET())+ usecs);
+}
+
+int utils_timer_wheel_cancel(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer)
+{
+    if(utils_timer_wheel== NULL || utils_timer== NULL ||
+            utils_timer->next== NULL)
+        return 0;
+
+    /* The 'timerfd' is left armed: an early wake-up just finds nothing due */
+    wheel_unlink(utils_timer_wheel, utils_timer);
+    return 1;
+}
+
+size_t utils_timer_wheel_pending(utils_timer_wheel_t *utils_timer_wheel)
+{
+    return utils_timer_wheel!= NULL? utils_timer_wheel->pending: 0;
+}
+
+int utils_timer_wheel_get_fd(utils_timer_wheel_t *utils_timer_wheel)
+{
+    return utils_timer_wheel!= NULL? utils_timer_wheel->epoll_fd: -1;
+}
+
+int utils_timer_wheel_expire(utils_timer_wheel_t *utils_timer_wheel)
+{
+    uint64_t expirations, now_tick;
+    int expired= 0;
+    LOG_CTX_INIT(NULL);
+
+    /* Check arguments */
+    CHECK_DO(utils_timer_wheel!= NULL, return -1);
+
+    LOG_CTX_SET(utils_timer_wheel->utils_logs_ctx);
+
+    if(read(utils_timer_wheel->timer_fd, &expirations,
+            sizeof(expirations))< 0) {
+        // Not expired yet (EAGAIN): timers may be due anyway
+    }
+
+    now_tick= utils_gettime_monot_usecs(LOG_CTX_GET())/
+            utils_timer_wheel->tick_usecs;
+    while(utils_timer_wheel->cur_tick<= now_tick) {
+        utils_timer_t due, *utils_timer;
+        uint64_t tick= wheel_next_tick(utils_timer_wheel);
+        int level;
+
+        /* Skip the ticks with nothing to cascade nor to expire */
+        if(tick> now_tick) {
+            utils_timer_wheel->cur_tick= now_tick+ 1;
+            break;
+        }
+        utils_timer_wheel->cur_tick= tick;
+
+        /* Cascade the upper levels which lower level wraps around */
+        for(level= 1; level< WHEEL_LEVELS &&
+                ((tick>> (WHEEL_BITS* (level- 1)))& WHEEL_MASK)== 0;
+                level++) {
+            utils_timer_t cascade;
+            uint32_t slot= level* WHEEL_SLOTS+ ((tick>> (WHEEL_BITS*
+                    level))& WHEEL_MASK);
+            utils_timer_t *head= &utils_timer_wheel->slots[slot];
+
+            if(head->next== head)
+                continue;
+            cascade.next= head->next;
+            cascade.prev= head->prev;
+            cascade.next->prev= cascade.prev->next= &cascade;
+            head->next= head->prev= head;
+            utils_timer_wheel->bitmap[level][(slot& WHEEL_MASK)>> 6]&=
+                    ~((uint64_t)1<< (slot& 63));
+            while(cascade.next!= &cascade) {
+                utils_timer= cascade.next;
+                cascade.next= utils_timer->next;
+                utils_timer->next->prev= &cascade;
+                wheel_link(utils_timer_wheel, utils_timer);
+            }
+        }
+
+        /* Detach the due slot: callbacks may add timers to it again */
+        {
+            uint32_t slot= (uint32_t)(tick& WHEEL_MASK);
+            utils_timer_t *head= &utils_timer_wheel->slots[slot];
+
+            utils_timer_wheel->cur_tick= tick+ 1;
+            if(head->next== head)
+                continue;
+            due.next= head->next;
+            due.prev= head->prev;
+            due.next->prev= due.prev->next= &due;
+            head->next= head->prev= head;
+            utils_timer_wheel->bitmap[0][slot>> 6]&=
+                    ~((uint64_t)1<< (slot& 63));
+            for(utils_timer= due.next; utils_timer!= &due;
+                    utils_timer= utils_timer->next)
+                utils_timer->slot= SLOT_EXPIRING;
+        }
+        while(due.next!= &due) {
+            utils_timer= due.next;
+            wheel_unlink(utils_timer_wheel, utils_timer);
+            expired++;
+            if(utils_timer->cb!= NULL)
+                utils_timer->cb(utils_timer_wheel, utils_timer,
+                        utils_timer->userdata);
+        }
+    }
+
+    CHECK_DO(wheel_arm(utils_timer_wheel, wheel_next_tick(
+            utils_timer_wheel))== 0, return -1);
+    return expired;
+}
+
+int utils_timer_wheel_run(utils_timer_wheel_t *utils_timer_wheel,
+        int tout_msecs)
+{
+    struct epoll_event events[2];
+    LOG_CTX_INIT(NULL);
+
+    /* Check arguments */
+    CHECK_DO(utils_timer_wheel!= NULL, return -1);
+
+    LOG_CTX_SET(utils_timer_wheel->utils_logs_ctx);
+
+    if(epoll_wait(utils_timer_wheel->epoll_fd, events, 2, tout_msecs)< 0)
+        CHECK_DO(errno== EINTR, return -1);
+    return utils_timer_wheel_expire(utils_timer_wheel);
+}
+
+void utils_timer_wheel_wakeup(utils_timer_wheel_t *utils_timer_wheel)
+{
+    uint64_t one= 1;
+
+    if(utils_timer_wheel== NULL)
+        return;
+
+    if(write(utils_timer_wheel->event_fd, &one, sizeof(one))< 0) {
+        // Counter saturated: already woken up
+    }
+}
+
+int utils_timer_wheel_woken(utils_timer_wheel_t *utils_timer_wheel)
+{
+    uint64_t count;
+
+    if(utils_timer_wheel== NULL)
+        return 0;
+
+    return read(utils_timer_wheel->event_fd, &count, sizeof(count))==
+            sizeof(count);
+}
+
+int utils_timer_wait_fd(int fd, uint64_t deadline_usecs)
+{
+    struct pollfd pfd= {0};
+    int ret_code;
+    LOG_CTX_INIT(NULL);
+
+    /* Check arguments */
+    CHECK_DO(fd>= 0, return -1);
+
+    pfd.fd= fd;
+    pfd.events= POLLIN;
+    do {
+        struct timespec ts= {0};
+        uint64_t now_usecs= utils_gettime_monot_usecs(LOG_CTX_GET());
+
+        if(now_usecs< deadline_usecs) {
+            ts.tv_sec= (deadline_usecs- now_usecs)/ 1000000;
+            ts.tv_nsec= ((deadline_usecs- now_usecs)% 1000000)* 1000;
+        }
+        ret_code= ppoll(&pfd, 1, &ts, NULL);
+    } while(ret_code< 0 && errno== EINTR);
+    CHECK_DO(ret_code>= 0, return -1);
+
+    return ret_code> 0? 1: 0;
+}
+
+void utils_timer_wheel_close_uptr(utils_timer_wheel_t *p)
+{
+    utils_timer_wheel_close(&p);
+}
+
+/**
+ * Link a timer in the slot of its distance to the current tick.
+ */
+static void wheel_link(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer)
+{
+    uint64_t expires_tick= utils_timer->expires_tick, delta;
+    uint32_t slot;
+    utils_timer_t *head;
+    int level;
+
+    /* Already due: expire on the next processed tick */
+    if(expires_tick< utils_timer_wheel->cur_tick)
+        expires_tick= utils_timer_wheel->cur_tick;
+    delta= expires_tick- utils_timer_wheel->cur_tick;
+    if(delta>= WHEEL_RANGE) {
+        delta= WHEEL_RANGE- 1;
+        expires_tick= utils_timer_wheel->cur_tick+ delta;
+    }
+    for(level= 0; level< WHEEL_LEVELS- 1; level++) {
+        if(delta< ((uint64_t)1<< (WHEEL_BITS* (level+ 1))))
+            break;
+    }
+
+    slot= level* WHEEL_SLOTS+ (uint32_t)((expires_tick>> (WHEEL_BITS*
+            level))& WHEEL_MASK);
+    head= &utils_timer_wheel->slots[slot];
+    utils_timer->next= head;
+    utils_timer->prev= head->prev;
+    head->prev->next= utils_timer;
+    head->prev= utils_timer;
+    utils_timer->slot= slot;
+    utils_timer_wheel->bitmap[level][(slot& WHEEL_MASK)>> 6]|=
+            (uint64_t)1<< (slot& 63);
+}
+
+static void wheel_unlink(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer)
+{
+    uint32_t slot= utils_timer->slot;
+
+    utils_timer->prev->next= utils_timer->next;
+    utils_timer->next->prev= utils_timer->prev;
+    if(slot< WHEEL_LEVELS* WHEEL_SLOTS &&
+            utils_timer_wheel->slots[slot].next== &utils_timer_wheel->slots[
+            slot])
+        utils_timer_wheel->bitmap[slot/ WHEEL_SLOTS][(slot& WHEEL_MASK)>>
+                6]&= ~((uint64_t)1<< (slot& 63));
+    utils_timer->prev= utils_timer->next= NULL;
+    utils_timer->slot= SLOT_NONE;
+    utils_timer_wheel->pending--;
+}
+
+/**
+ * Find the first non-empty slot of a level, circularly from 'start'.
+ * @return Slot index, -1 if the level is empty.
+ */
+static int bitmap_find(const uint64_t *bitmap, uint32_t start)
+{
+    uint32_t w= start>> 6;
+    uint64_t word= bitmap[w]& (~(uint64_t)0<< (start& 63));
+    int i;
+
+    /* The start word is visited twice: its upper and then its lower bits */
+    for(i= 0; i<= WHEEL_SLOTS/ 64; i++) {
+        if(word!= 0)
+            return (int)((w<< 6)+ __builtin_ctzll(word));
+        w= (w+ 1)% (WHEEL_SLOTS/ 64);
+        word= bitmap[w];
+    }
+    return -1;
+}
+
+/**
+ * Get the next tick with anything to do: timers to expire (level 0) or a
+ * slot to cascade (upper levels, when their lower level wraps around).
+ * @return The tick, UINT64_MAX if there are no pending timers.
+ */
+static uint64_t wheel_next_tick(const utils_timer_wheel_t *utils_timer_wheel)
+{
+    uint64_t cur_tick= utils_timer_wheel->cur_tick, next_tick= UINT64_MAX;
+    int level;
+
+    if(utils_timer_wheel->pending== 0)
+        return UINT64_MAX;
+
+    for(level= 0; level< WHEEL_LEVELS; level++) {
+        int shift= WHEEL_BITS* level, slot;
+        uint64_t tick;
+        uint32_t index= (uint32_t)(cur_tick>> shift)& WHEEL_MASK, first,
+                offset;
+
+        /* The current slot of an upper level is cascaded on this very tick
+         * only if the tick is a wrap-around; otherwise it waits a full turn
+         */
+        offset= (level== 0 || (cur_tick& (((uint64_t)1<< shift)- 1))== 0)?
+                0: 1;
+        first= (index+ offset)& WHEEL_MASK;
+        slot= bitmap_find(utils_timer_wheel->bitmap[level], first);
+        if(slot< 0)
+            continue;
+        tick= (((uint32_t)slot- first)& WHEEL_MASK)+ offset;
+        tick= level== 0? cur_tick+ tick: ((cur_tick>> shift)+ tick)<< shift;
+        if(tick< next_tick)
+            next_tick= tick;
+    }
+    return next_tick;
+}
+
+/**
+ * Arm the 'timerfd' at the given tick (UINT64_MAX disarms it).
+ */
+static int wheel_arm(utils_timer_wheel_t *utils_timer_wheel, uint64_t tick)
+{
+    struct itimerspec its= {{0}}; // Zeroed: disarm
+    LOG_CTX_INIT(utils_timer_wheel->utils_logs_ctx);
+
+    if(tick== utils_timer_wheel->armed_tick)
+        return 0;
+
+    if(tick!= UINT64_MAX) {
+        uint64_t usecs= tick* utils_timer_wheel->tick_usecs;
+        its.it_value.tv_sec= usecs/ 1000000;
+        its.it_value.tv_nsec= (usecs% 1000000)* 1000;
+    }
+    CHECK_DO(timerfd_settime(utils_timer_wheel->timer_fd, TFD_TIMER_ABSTIME,
+            &its, NULL)== 0, return -1);
+    utils_timer_wheel->armed_tick= tick;
+    return 0;
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright 2021 Rafael Antoniello
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * @file utils_timer.h
+ * @brief Timer service for event loops.
+ * This module implements a hierarchical timer wheel: any number of timers
+ * (e.g. a million pending deadlines) are scheduled and cancelled in constant
+ * time, and a single file descriptor becomes readable when some of them are
+ * due, so that timers are waited on in the same 'epoll_wait()' as sockets.
+ * The wheel is backed by a 'timerfd' (armed at the next due tick only) and by
+ * an 'eventfd' used to wake up the waiting thread from any other thread.
+ * A wheel instance is used by a single thread (its event loop), except for
+ * 'utils_timer_wheel_wakeup()'.
+ * @author Rafael Antoniello
+ */
+
+#ifndef UTILS_TIMER_H_
+#define UTILS_TIMER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <sys/types.h>
+#include <inttypes.h>
+
+typedef struct utils_timer_wheel_s utils_timer_wheel_t;
+typedef struct utils_timer_s utils_timer_t;
+typedef struct utils_logs_ctx_s utils_logs_ctx_t;
+
+/**
+ * Timer expiration callback. It is called from 'utils_timer_wheel_run()' or
+ * 'utils_timer_wheel_expire()' once the timer is no longer pending, so it
+ * may re-schedule it (e.g. periodic timers), cancel other timers or release
+ * the timer memory.
+ */
+typedef void (*utils_timer_cb_t)(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer, void *userdata);
+
+/**
+ * Timer. The memory is owned by the user (typically embedded in the structure
+ * the timer belongs to), so scheduling never allocates. It must be
+ * initialized with 'utils_timer_init()'; the members below the callback are
+ * private to the wheel.
+ */
+typedef struct utils_timer_s {
+    utils_timer_cb_t cb;
+    void *userdata;
+    /* Private */
+    uint64_t expires_tick;
+    struct utils_timer_s *prev, *next;
+    uint32_t slot;
+} utils_timer_t;
+
+/**
+ * Initialize a timer (not pending).
+ * @param utils_timer Pointer to the timer.
+ * @param cb Expiration callback.
+ * @param userdata Opaque pointer handed to the callback.
+ */
+void utils_timer_init(utils_timer_t *utils_timer, utils_timer_cb_t cb,
+        void *userdata);
+
+/**
+ * @return Non-zero if the timer is scheduled in a wheel, 0 otherwise.
+ */
+int utils_timer_pending(const utils_timer_t *utils_timer);
+
+/**
+ * Open a timer wheel.
+ * @param tick_usecs Wheel resolution in microseconds (0 for the default of
+ * 1 millisecond). Timers never expire early; they expire at most one tick
+ * late (plus the loop latency).
+ * @param utils_logs_ctx Externally defined logger. This is an optional field
+ * (can be set to NULL).
+ * @return Pointer to the timer wheel instance on success, NULL if fails.
+ */
+utils_timer_wheel_t* utils_timer_wheel_open(uint32_t tick_usecs,
+        utils_logs_ctx_t *const utils_logs_ctx);
+
+/**
+ * Release a timer wheel. Pending timers are unlinked (not expired).
+ * @param ref_utils_timer_wheel Reference to the pointer to the timer wheel
+ * instance, that was obtained in a previous call to
+ * 'utils_timer_wheel_open()'. Pointer is set to NULL on return.
+ */
+void utils_timer_wheel_close(utils_timer_wheel_t **ref_utils_timer_wheel);
+
+/**
+ * Schedule a timer at an absolute deadline. A pending timer is re-scheduled;
+ * a deadline already passed expires on the next run.
+ * @param utils_timer_wheel Pointer to the timer wheel instance.
+ * @param utils_timer Pointer to an initialized timer.
+ * @param deadline_usecs Absolute deadline in microseconds, in the
+ * CLOCK_MONOTONIC time base (see 'utils_gettime_monot_usecs()').
+ * @return 0 on success, -1 on error.
+ */
+int utils_timer_wheel_add(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer, uint64_t deadline_usecs);
+
+/**
+ * Schedule a timer to expire in the given amount of microseconds from now
+ * (see 'utils_timer_wheel_add()').
+ */
+int utils_timer_wheel_add_rel(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer, uint64_t usecs);
+
+/**
+ * Cancel a timer.
+ * @return 1 if the timer was pending, 0 otherwise.
+ */
+int utils_timer_wheel_cancel(utils_timer_wheel_t *utils_timer_wheel,
+        utils_timer_t *utils_timer);
+
+/**
+ * @return Number of pending timers.
+ */
+size_t utils_timer_wheel_pending(utils_timer_wheel_t *utils_timer_wheel);
+
+/**
+ * Get the wheel file descriptor (an epoll instance on the 'timerfd' and the
+ * 'eventfd'). It becomes readable when timers are due or when the wheel is
+ * woken up; it is to be added (EPOLLIN) to the user event loop, which then
+ * calls 'utils_timer_wheel_expire()'.
+ * @return The file descriptor, -1 if the wheel is NULL.
+ */
+int utils_timer_wheel_get_fd(utils_timer_wheel_t *utils_timer_wheel);
+
+/**
+ * Expire the due timers (calling their callbacks) without blocking.
+ * @return Number of expired timers, -1 on error.
+ */
+int utils_timer_wheel_expire(utils_timer_wheel_t *utils_timer_wheel);
+
+/**
+ * Wait up to the given time-out for timers to be due, or for a wake-up, and
+ * expire them. This is the event loop of a thread that waits on timers only.
+ * @param tout_msecs Time-out in milliseconds (-1 blocks, 0 returns at once).
+ * @return Number of expired timers, -1 on error. The wake-up pending flag
+ * can be checked with 'utils_timer_wheel_woken()'.
+ */
+int utils_timer_wheel_run(utils_timer_wheel_t *utils_timer_wheel,
+        int tout_msecs);
+
+/**
+ * Wake up the thread waiting on the wheel (from any thread; async-signal
+ * safe). The wake-up is sticky until it is consumed by
+ * 'utils_timer_wheel_woken()'.
+ */
+void utils_timer_wheel_wakeup(utils_timer_wheel_t *utils_timer_wheel);
+
+/**
+ * Consume the wake-ups signalled with 'utils_timer_wheel_wakeup()'.
+ * @return Non-zero if the wheel was woken up since the last call.
+ */
+int utils_timer_wheel_woken(utils_timer_wheel_t *utils_timer_wheel);
+
+/**
+ * Block until a file descriptor is readable or until an absolute deadline,
+ * whichever comes first. Any thread may wait on the same descriptor (e.g. an
+ * 'eventfd' used as an exit signal).
+ * @param fd File descriptor to wait on.
+ * @param deadline_usecs Absolute deadline in microseconds, in the
+ * CLOCK_MONOTONIC time base.
+ * @return 0 when the deadline is reached, 1 if the descriptor is readable,
+ * -1 on error.
+ */
+int utils_timer_wait_fd(int fd, uint64_t deadline_usecs);
+
+/**
+ * Deleter function for the timer wheel. This function is used essentially in
+ * C++ applications using this module for releasing smart pointers.
+ * @param p Pointer to the timer wheel instance to be released
+ */
+void utils_timer_wheel_close_uptr(utils_timer_wheel_t *p);
+
+#ifdef __cplusplus
+} //extern "C"
+#endif
+
+#endif /* UTILS_TIMER_H_ */